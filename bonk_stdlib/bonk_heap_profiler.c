@@ -0,0 +1,242 @@
+
+#include "bonk_heap_profiler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Sampling heap profiler. Programs compiled with --heap-profile call
+// $$bonk_profile_site before each allocation with a site record that names
+// the hive and the source location. One allocation is sampled every
+// BONK_HEAP_PROFILE_INTERVAL bytes, and the samples are kept in a ring
+// buffer, so the newest ones survive. A sample remembers when its hive was
+// freed, measured in bytes allocated since the start of the program.
+//
+// At exit, the profile is written to $BONK_HEAP_PROFILE, or to
+// bonk-heap.profile by default. The bonk-heap-viewer tool prints it.
+
+#define BONK_HEAP_PROFILE_MAGIC "BONKHEAP"
+#define BONK_HEAP_PROFILE_VERSION 1
+#define BONK_DEFAULT_SAMPLE_INTERVAL 4096
+#define BONK_SAMPLE_CAPACITY 65536
+#define BONK_STILL_ALIVE UINT64_MAX
+
+// Live samples are found by the address of their hive in an open addressing
+// table, which holds sample indices plus one
+#define BONK_LIVE_TABLE_BITS 17
+#define BONK_LIVE_TABLE_SIZE (1 << BONK_LIVE_TABLE_BITS)
+
+// Emitted by the compiler, see QBEBackend::compile_profile_site_data
+struct bonk_profile_site {
+    uint32_t line;
+    uint32_t column;
+    const char* hive_name;
+    const char* file;
+    // Index of the site in the profile, assigned when it is written
+    uint32_t profile_index;
+    uint32_t reserved;
+};
+
+struct bonk_heap_sample {
+    uint64_t object;
+    const struct bonk_profile_site* site;
+    uint32_t size;
+    uint64_t allocated_at;
+    uint64_t freed_at;
+};
+
+int bonk_heap_profiling;
+
+static const struct bonk_profile_site* bonk_current_site;
+static struct bonk_heap_sample bonk_heap_samples[BONK_SAMPLE_CAPACITY];
+static uint64_t bonk_heap_sample_count;
+static uint32_t bonk_live_samples[BONK_LIVE_TABLE_SIZE];
+static uint64_t bonk_live_sample_count;
+
+static uint64_t bonk_allocated_bytes;
+static uint64_t bonk_allocation_count;
+static uint64_t bonk_sample_interval;
+static int64_t bonk_bytes_until_sample;
+
+static size_t bonk_get_live_table_home(uint64_t object) {
+    return (size_t)(((object >> 3) * 0x9E3779B97F4A7C15ull) >> (64 - BONK_LIVE_TABLE_BITS));
+}
+
+static size_t bonk_find_live_sample(uint64_t object) {
+    size_t position = bonk_get_live_table_home(object);
+    while(bonk_live_samples[position] != 0 &&
+          bonk_heap_samples[bonk_live_samples[position] - 1].object != object) {
+        position = (position + 1) & (BONK_LIVE_TABLE_SIZE - 1);
+    }
+    return position;
+}
+
+static void bonk_remove_live_sample(size_t position) {
+    // Entries that were displaced past the removed one are shifted back
+    size_t next = position;
+    while(1) {
+        next = (next + 1) & (BONK_LIVE_TABLE_SIZE - 1);
+        if(bonk_live_samples[next] == 0) {
+            break;
+        }
+
+        uint64_t object = bonk_heap_samples[bonk_live_samples[next] - 1].object;
+        size_t distance = (next - bonk_get_live_table_home(object)) & (BONK_LIVE_TABLE_SIZE - 1);
+        size_t gap = (next - position) & (BONK_LIVE_TABLE_SIZE - 1);
+
+        if(distance >= gap) {
+            bonk_live_samples[position] = bonk_live_samples[next];
+            position = next;
+        }
+    }
+
+    bonk_live_samples[position] = 0;
+    bonk_live_sample_count--;
+}
+
+static void bonk_write_u32(FILE* file, uint32_t value) {
+    fwrite(&value, sizeof(value), 1, file);
+}
+
+static void bonk_write_u64(FILE* file, uint64_t value) {
+    fwrite(&value, sizeof(value), 1, file);
+}
+
+static void bonk_write_string(FILE* file, const char* string) {
+    uint32_t length = (uint32_t)strlen(string);
+    bonk_write_u32(file, length);
+    fwrite(string, 1, length, file);
+}
+
+static void bonk_write_heap_profile(void) {
+    const char* path = getenv("BONK_HEAP_PROFILE");
+    if(path == NULL) {
+        path = "bonk-heap.profile";
+    }
+
+    FILE* file = fopen(path, "wb");
+    if(file == NULL) {
+        fprintf(stderr, "bonk: failed to write heap profile to %s\n", path);
+        return;
+    }
+
+    uint64_t first_sample = 0;
+    if(bonk_heap_sample_count > BONK_SAMPLE_CAPACITY) {
+        first_sample = bonk_heap_sample_count - BONK_SAMPLE_CAPACITY;
+    }
+
+    // Number the sites referenced by the samples. Index 0 stands for
+    // allocations without a site.
+    uint32_t site_count = 0;
+    for(uint64_t i = first_sample; i < bonk_heap_sample_count; i++) {
+        struct bonk_profile_site* site =
+            (struct bonk_profile_site*)bonk_heap_samples[i % BONK_SAMPLE_CAPACITY].site;
+        if(site != NULL && site->profile_index == 0) {
+            site->profile_index = ++site_count;
+        }
+    }
+
+    fwrite(BONK_HEAP_PROFILE_MAGIC, 1, 8, file);
+    bonk_write_u32(file, BONK_HEAP_PROFILE_VERSION);
+    bonk_write_u32(file, site_count);
+    bonk_write_u64(file, bonk_heap_sample_count - first_sample);
+    bonk_write_u64(file, bonk_sample_interval);
+    bonk_write_u64(file, bonk_allocation_count);
+    bonk_write_u64(file, bonk_allocated_bytes);
+
+    uint32_t written_sites = 0;
+    for(uint64_t i = first_sample; i < bonk_heap_sample_count; i++) {
+        const struct bonk_profile_site* site = bonk_heap_samples[i % BONK_SAMPLE_CAPACITY].site;
+        if(site == NULL || site->profile_index != written_sites + 1) {
+            continue;
+        }
+        written_sites++;
+        bonk_write_u32(file, site->line);
+        bonk_write_u32(file, site->column);
+        bonk_write_string(file, site->hive_name);
+        bonk_write_string(file, site->file);
+    }
+
+    for(uint64_t i = first_sample; i < bonk_heap_sample_count; i++) {
+        struct bonk_heap_sample* sample = &bonk_heap_samples[i % BONK_SAMPLE_CAPACITY];
+        bonk_write_u32(file, sample->site ? sample->site->profile_index : 0);
+        bonk_write_u32(file, sample->size);
+        bonk_write_u64(file, sample->allocated_at);
+        bonk_write_u64(file, sample->freed_at);
+    }
+
+    fclose(file);
+}
+
+static void bonk_start_heap_profiler(void) {
+    bonk_heap_profiling = 1;
+    bonk_sample_interval = BONK_DEFAULT_SAMPLE_INTERVAL;
+
+    const char* interval = getenv("BONK_HEAP_PROFILE_INTERVAL");
+    if(interval != NULL && strtoull(interval, NULL, 10) > 0) {
+        bonk_sample_interval = strtoull(interval, NULL, 10);
+    }
+
+    bonk_bytes_until_sample = (int64_t)bonk_sample_interval;
+    atexit(bonk_write_heap_profile);
+}
+
+void $$bonk_profile_site(const struct bonk_profile_site* site) {
+    if(!bonk_heap_profiling) {
+        bonk_start_heap_profiler();
+    }
+    bonk_current_site = site;
+}
+
+void bonk_heap_profiler_record_allocation(uint64_t object, uint32_t size) {
+    // The site only applies to the allocation that follows it
+    const struct bonk_profile_site* site = bonk_current_site;
+    bonk_current_site = NULL;
+
+    // The reference counter is a part of the allocation
+    uint64_t allocation_size = size + sizeof(uint64_t);
+
+    bonk_allocation_count++;
+    bonk_allocated_bytes += allocation_size;
+    bonk_bytes_until_sample -= (int64_t)allocation_size;
+
+    if(bonk_bytes_until_sample > 0) {
+        return;
+    }
+
+    bonk_bytes_until_sample += (int64_t)bonk_sample_interval;
+    if(bonk_bytes_until_sample <= 0) {
+        bonk_bytes_until_sample = (int64_t)bonk_sample_interval;
+    }
+
+    size_t index = bonk_heap_sample_count % BONK_SAMPLE_CAPACITY;
+    struct bonk_heap_sample* sample = &bonk_heap_samples[index];
+
+    // The oldest sample is overwritten once the ring is full
+    if(bonk_heap_sample_count >= BONK_SAMPLE_CAPACITY && sample->freed_at == BONK_STILL_ALIVE) {
+        bonk_remove_live_sample(bonk_find_live_sample(sample->object));
+    }
+
+    sample->object = object;
+    sample->site = site;
+    sample->size = size;
+    sample->allocated_at = bonk_allocated_bytes;
+    sample->freed_at = BONK_STILL_ALIVE;
+    bonk_heap_sample_count++;
+
+    bonk_live_samples[bonk_find_live_sample(object)] = index + 1;
+    bonk_live_sample_count++;
+}
+
+void bonk_heap_profiler_record_free(uint64_t object) {
+    if(bonk_live_sample_count == 0) {
+        return;
+    }
+
+    size_t position = bonk_find_live_sample(object);
+    if(bonk_live_samples[position] == 0) {
+        return;
+    }
+
+    bonk_heap_samples[bonk_live_samples[position] - 1].freed_at = bonk_allocated_bytes;
+    bonk_remove_live_sample(position);
+}
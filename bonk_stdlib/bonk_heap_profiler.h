@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdint.h>
+
+// Set once a program compiled with --heap-profile reports its first
+// allocation site. The allocator only calls the profiler when it is set.
+extern int bonk_heap_profiling;
+
+void bonk_heap_profiler_record_allocation(uint64_t object, uint32_t size);
+void bonk_heap_profiler_record_free(uint64_t object);
@@ -0,0 +1,128 @@
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Reference counter traffic counters. Programs compiled with
+// --instrument-refcounts count every counter update of every increment and
+// decrement site, and decrements also count the hives they release. A site
+// registers itself with $$bonk_register_refcount_site the first time it is
+// reached.
+//
+// At exit, the sites are merged by source location and printed to
+// $BONK_REFCOUNT_PROFILE, or to stderr by default, the busiest first.
+
+enum bonk_refcount_site_kind {
+    BONK_REFCOUNT_INCREMENT = 0,
+    BONK_REFCOUNT_DECREMENT = 1
+};
+
+// Emitted by the compiler, see QBEBackend::compile_refcount_site_data
+struct bonk_refcount_site {
+    uint64_t updates;
+    uint64_t releases;
+    struct bonk_refcount_site* next;
+    const char* file;
+    const char* procedure;
+    uint32_t line;
+    uint32_t column;
+    uint32_t kind;
+    uint32_t reserved;
+};
+
+static struct bonk_refcount_site* bonk_refcount_sites;
+static size_t bonk_refcount_site_count;
+
+static int bonk_compare_site_locations(const void* a, const void* b) {
+    const struct bonk_refcount_site* first = *(const struct bonk_refcount_site**)a;
+    const struct bonk_refcount_site* second = *(const struct bonk_refcount_site**)b;
+
+    int result = strcmp(first->file, second->file);
+    if(result != 0) return result;
+    if(first->line != second->line) return first->line < second->line ? -1 : 1;
+    if(first->column != second->column) return first->column < second->column ? -1 : 1;
+    if(first->kind != second->kind) return first->kind < second->kind ? -1 : 1;
+    // Generated procedures, like destructors, have no location
+    if(first->line == 0) return strcmp(first->procedure, second->procedure);
+    return 0;
+}
+
+static int bonk_compare_site_updates(const void* a, const void* b) {
+    const struct bonk_refcount_site* first = *(const struct bonk_refcount_site**)a;
+    const struct bonk_refcount_site* second = *(const struct bonk_refcount_site**)b;
+
+    if(first->updates != second->updates) return first->updates > second->updates ? -1 : 1;
+    return bonk_compare_site_locations(a, b);
+}
+
+static void bonk_write_refcount_counters(void) {
+    FILE* file = stderr;
+    const char* path = getenv("BONK_REFCOUNT_PROFILE");
+    if(path != NULL) {
+        file = fopen(path, "w");
+        if(file == NULL) {
+            fprintf(stderr, "bonk: failed to write reference counter profile to %s\n", path);
+            return;
+        }
+    }
+
+    struct bonk_refcount_site** sites = calloc(bonk_refcount_site_count, sizeof(*sites));
+    size_t count = 0;
+    for(struct bonk_refcount_site* site = bonk_refcount_sites; site; site = site->next) {
+        sites[count++] = site;
+    }
+
+    // Inlined code shares the location of its call site, so several sites
+    // may have the same location. Their counters are added to the first one.
+    qsort(sites, count, sizeof(*sites), bonk_compare_site_locations);
+
+    size_t merged_count = 0;
+    uint64_t total_updates = 0;
+    for(size_t i = 0; i < count; i++) {
+        total_updates += sites[i]->updates;
+        struct bonk_refcount_site* last = merged_count > 0 ? sites[merged_count - 1] : NULL;
+        if(last != NULL && bonk_compare_site_locations(&last, &sites[i]) == 0) {
+            last->updates += sites[i]->updates;
+            last->releases += sites[i]->releases;
+        } else {
+            sites[merged_count++] = sites[i];
+        }
+    }
+
+    qsort(sites, merged_count, sizeof(*sites), bonk_compare_site_updates);
+
+    fprintf(file, "bonk: %llu reference counter updates at %zu sites\n",
+            (unsigned long long)total_updates, merged_count);
+    fprintf(file, "%16s %12s  site\n", "updates", "releases");
+
+    for(size_t i = 0; i < merged_count; i++) {
+        struct bonk_refcount_site* site = sites[i];
+        if(site->kind == BONK_REFCOUNT_DECREMENT) {
+            fprintf(file, "%16llu %12llu  dec ", (unsigned long long)site->updates,
+                    (unsigned long long)site->releases);
+        } else {
+            fprintf(file, "%16llu %12s  inc ", (unsigned long long)site->updates, "-");
+        }
+        if(site->line == 0) {
+            fprintf(file, "%s\n", site->procedure);
+        } else {
+            fprintf(file, "%s:%u:%u\n", site->file, site->line, site->column);
+        }
+    }
+
+    free(sites);
+    if(file != stderr) {
+        fclose(file);
+    }
+}
+
+void $$bonk_register_refcount_site(struct bonk_refcount_site* site) {
+    if(bonk_refcount_sites == NULL) {
+        atexit(bonk_write_refcount_counters);
+    }
+
+    site->next = bonk_refcount_sites;
+    bonk_refcount_sites = site;
+    bonk_refcount_site_count++;
+}
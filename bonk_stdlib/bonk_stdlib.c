@@ -1,14 +1,136 @@
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include "bonk_heap_profiler.h"
+
+// Hives of up to this many bytes are constructed with $$bonk_create_small_object.
+// Must match HiveConstructorDestructorLateGenerator::max_small_object_size.
+#define BONK_MAX_SMALL_OBJECT_SIZE 248
+
+// Small objects are served from per-size-class free lists. Size classes are
+// 8 bytes apart and include the reference counter. The free blocks are linked
+// through their first word. New blocks are carved from slab pages, which are
+// never returned to the system. The runtime is single-threaded.
+#define BONK_SIZE_CLASS_COUNT ((BONK_MAX_SMALL_OBJECT_SIZE + sizeof(uint64_t)) / 8)
+#define BONK_SLAB_PAGE_SIZE (64 * 1024)
+
+struct bonk_size_class {
+    void* free_list;
+    char* slab_position;
+    char* slab_end;
+};
+
+static struct bonk_size_class bonk_size_classes[BONK_SIZE_CLASS_COUNT];
+
+static int bonk_debug_alloc = -1;
+
+static int bonk_is_alloc_debug_enabled() {
+    // The environment is only scanned once
+    if(bonk_debug_alloc < 0) {
+        bonk_debug_alloc = getenv("BONK_DEBUG_ALLOC") != NULL;
+    }
+    return bonk_debug_alloc;
+}
+
+static void bonk_out_of_memory() {
+    fprintf(stderr, "bonk: failed to allocate memory for new object");
+    exit(1);
+}
+
+static void bonk_report_allocation(uint32_t size, uint64_t* ref_counter) {
+    printf("Allocated object of size %d at %p\n", size, (void*)(ref_counter + 1));
+    fflush(stdout);
+}
+
+static void bonk_report_free(uint64_t object) {
+    printf("Freed object at %p\n", (void*)object);
+    fflush(stdout);
+}
+
+static unsigned bonk_get_size_class(uint32_t size) {
+    return (size + sizeof(uint64_t) - 1) / 8;
+}
+
+static void* bonk_refill_size_class(struct bonk_size_class* size_class, size_t block_size) {
+    if((size_t)(size_class->slab_end - size_class->slab_position) < block_size) {
+        char* page = malloc(BONK_SLAB_PAGE_SIZE);
+        if(page == NULL) {
+            bonk_out_of_memory();
+        }
+        size_class->slab_position = page;
+        size_class->slab_end = page + BONK_SLAB_PAGE_SIZE;
+    }
+
+    void* block = size_class->slab_position;
+    size_class->slab_position += block_size;
+    return block;
+}
+
+// Hives that are waiting for their destructor in the iterative teardown mode
+typedef int32_t (*bonk_destructor)(uint64_t object);
+
+struct bonk_pending_destruction {
+    uint64_t object;
+    bonk_destructor destructor;
+};
+
+static struct bonk_pending_destruction* bonk_pending_destructions;
+static size_t bonk_pending_destruction_count;
+static size_t bonk_pending_destruction_capacity;
+static int bonk_is_tearing_down;
+
+uint64_t $$bonk_create_small_object(uint32_t size) {
+    unsigned index = bonk_get_size_class(size);
+    struct bonk_size_class* size_class = &bonk_size_classes[index];
+    size_t block_size = (index + 1) * 8;
+
+    void* block = size_class->free_list;
+    if(block != NULL) {
+        size_class->free_list = *(void**)block;
+    } else {
+        block = bonk_refill_size_class(size_class, block_size);
+    }
+
+    memset(block, 0, block_size);
+
+    uint64_t* ref_counter = (uint64_t*) block;
+    *ref_counter = 1;
+
+    if(bonk_heap_profiling) {
+        bonk_heap_profiler_record_allocation((uint64_t) (ref_counter + 1), size);
+    }
+
+    if(bonk_is_alloc_debug_enabled()) {
+        bonk_report_allocation(size, ref_counter);
+    }
+
+    return (uint64_t) (ref_counter + 1);
+}
+
+void $$bonk_small_object_free(uint64_t object, uint32_t size) {
+    void* block = (uint64_t*) object - 1;
+    struct bonk_size_class* size_class = &bonk_size_classes[bonk_get_size_class(size)];
+
+    if(bonk_heap_profiling) {
+        bonk_heap_profiler_record_free(object);
+    }
+
+    if(bonk_is_alloc_debug_enabled()) {
+        bonk_report_free(object);
+    }
+
+    *(void**)block = size_class->free_list;
+    size_class->free_list = block;
+}
 
 uint64_t $$bonk_create_object(uint32_t size) {
     // Allocate memory for the object and for the reference counter
 
     void* ptr = calloc(sizeof(uint64_t) + size, 1);
     if(ptr == NULL) {
-        fprintf(stderr, "bonk: failed to allocate memory for new object");
-        exit(1);
+        bonk_out_of_memory();
     }
 
     // Set the reference counter to 1
@@ -16,15 +138,18 @@ uint64_t $$bonk_create_object(uint32_t size) {
     uint64_t* ref_counter = (uint64_t*) ptr;
     *ref_counter = 1;
 
-    // Return the pointer to the object
+    if(bonk_heap_profiling) {
+        bonk_heap_profiler_record_allocation((uint64_t) (ref_counter + 1), size);
+    }
 
-    // If environment variable BONK_DEBUG is set, print the address of the allocated object
+    // If environment variable BONK_DEBUG_ALLOC is set, print the address of the allocated object
 
-    if(getenv("BONK_DEBUG_ALLOC") != NULL) {
-        printf("Allocated object of size %d at %p\n", size, ptr + sizeof(uint64_t));
-        fflush(stdout);
+    if(bonk_is_alloc_debug_enabled()) {
+        bonk_report_allocation(size, ref_counter);
     }
 
+    // Return the pointer to the object
+
     return (uint64_t) (ref_counter + 1);
 }
 
@@ -33,11 +158,56 @@ void $$bonk_object_free(uint64_t object) {
 
     uint64_t* ref_counter = (uint64_t*) object - 1;
 
-    if(getenv("BONK_DEBUG_ALLOC") != NULL) {
-        printf("Freed object at %p\n", (void*)object);
-        fflush(stdout);
+    if(bonk_heap_profiling) {
+        bonk_heap_profiler_record_free(object);
+    }
+
+    if(bonk_is_alloc_debug_enabled()) {
+        bonk_report_free(object);
     }
 
     // Free the object
     free(ref_counter);
-}
\ No newline at end of file
+}
+
+static void bonk_queue_destruction(uint64_t object, bonk_destructor destructor) {
+    if(bonk_pending_destruction_count == bonk_pending_destruction_capacity) {
+        size_t capacity = bonk_pending_destruction_capacity * 2;
+        if(capacity == 0) {
+            capacity = 64;
+        }
+
+        void* pending = realloc(bonk_pending_destructions,
+                                capacity * sizeof(struct bonk_pending_destruction));
+        if(pending == NULL) {
+            bonk_out_of_memory();
+        }
+        bonk_pending_destructions = pending;
+        bonk_pending_destruction_capacity = capacity;
+    }
+
+    bonk_pending_destructions[bonk_pending_destruction_count].object = object;
+    bonk_pending_destructions[bonk_pending_destruction_count].destructor = destructor;
+    bonk_pending_destruction_count++;
+}
+
+static void bonk_run_pending_destructions(void) {
+    // Destructors release the fields of their hive, which may queue more
+    // hives. Only the outermost call destroys them, one by one.
+    if(bonk_is_tearing_down) {
+        return;
+    }
+
+    bonk_is_tearing_down = 1;
+    while(bonk_pending_destruction_count > 0) {
+        struct bonk_pending_destruction next =
+            bonk_pending_destructions[--bonk_pending_destruction_count];
+        next.destructor(next.object);
+    }
+    bonk_is_tearing_down = 0;
+}
+
+void $$bonk_destroy_object(uint64_t object, bonk_destructor destructor) {
+    bonk_queue_destruction(object, destructor);
+    bonk_run_pending_destructions();
+}
@@ -0,0 +1,28 @@
+# Writes a header with a hash of the compiler sources. Compiled modules are
+# cached between bonk builds, so a changed compiler must not reuse them.
+#
+# Usage: cmake -DSOURCE_DIR=<repository> -DOUTPUT=<header> -P build_id.cmake
+
+file(GLOB_RECURSE compiler_sources RELATIVE ${SOURCE_DIR}
+        ${SOURCE_DIR}/src/bonk/*.cpp ${SOURCE_DIR}/src/bonk/*.hpp
+        ${SOURCE_DIR}/src/utils/*.cpp ${SOURCE_DIR}/src/utils/*.hpp
+        ${SOURCE_DIR}/bonk_stdlib/*.c ${SOURCE_DIR}/bonk_stdlib/*.h)
+list(SORT compiler_sources)
+
+set(digest "")
+foreach(source ${compiler_sources})
+    file(SHA256 ${SOURCE_DIR}/${source} source_hash)
+    string(APPEND digest "${source} ${source_hash}\n")
+endforeach()
+string(SHA256 build_id "${digest}")
+
+set(contents "#pragma once\n\n#define BONK_BUILD_ID \"${build_id}\"\n")
+
+# Only touch the header when the sources change, otherwise every build
+# would recompile its users
+if(EXISTS ${OUTPUT})
+    file(READ ${OUTPUT} old_contents)
+endif()
+if(NOT "${old_contents}" STREQUAL "${contents}")
+    file(WRITE ${OUTPUT} "${contents}")
+endif()
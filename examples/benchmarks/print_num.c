@@ -0,0 +1,6 @@
+
+#include <stdio.h>
+
+void print_num(int num) {
+    printf("%d\n", num);
+}
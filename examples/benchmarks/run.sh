@@ -0,0 +1,19 @@
+# Builds the loop-heavy benchmarks through the QBE path and prints their average run time.
+# BONK overrides the compiler, RUNS sets the number of runs per benchmark.
+
+cd "$(dirname "$0")" || exit 1
+
+BONK="${BONK:-$(git rev-parse --show-toplevel)/cmake-build-debug/bonk}"
+RUNS="${RUNS:-10}"
+
+for benchmark in loops primes predicates; do
+    "$BONK" build "$benchmark.bs" -l print_num.c -o "build/$benchmark" || exit 1
+
+    start=$(date +%s%N)
+    for _ in $(seq "$RUNS"); do
+        "./build/$benchmark" > /dev/null
+    done
+    end=$(date +%s%N)
+
+    echo "$benchmark: $(( (end - start) / RUNS / 1000000 )) ms"
+done
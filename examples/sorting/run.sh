@@ -1 +1 @@
-../build_script.sh sorting_main.bs print_num.c && ./build/out
\ No newline at end of file
+"$(git rev-parse --show-toplevel)/cmake-build-debug/bonk" build sorting_main.bs -g -l print_num.c -o build/out && ./build/out
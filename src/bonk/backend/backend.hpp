@@ -4,9 +4,11 @@ namespace bonk {
 
 struct Backend;
 struct Compiler;
+class ProcedureOutputCache;
 
 }
 
+#include <string>
 #include "bonk/frontend/ast/ast.hpp"
 #include "bonk/middleend/ir/hir.hpp"
 #include "utils/streams.hpp"
@@ -15,11 +17,22 @@ namespace bonk {
 
 struct Backend {
     Compiler& linked_compiler;
+
+    // If set, the output for procedures that did not change since
+    // the last compilation of the module is taken from this cache
+    ProcedureOutputCache* procedure_cache = nullptr;
+
     Backend(Compiler& linked_compiler): linked_compiler(linked_compiler) {};
 
     virtual ~Backend() = default;
 
     virtual void compile_program(HIRProgram& program, const bonk::OutputStream& output) = 0;
+
+    // Options that change the generated code. Modules compiled with
+    // different options are compiled again rather than reused.
+    virtual std::string get_output_options() const {
+        return "";
+    }
 };
 
 } // namespace bonk
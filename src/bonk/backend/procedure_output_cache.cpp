@@ -0,0 +1,119 @@
+
+#include "procedure_output_cache.hpp"
+#include <cstring>
+#include <fstream>
+#include "utils/streams.hpp"
+
+bonk::ProcedureOutputCache::ProcedureOutputCache(std::filesystem::path path)
+    : path(std::move(path)) {
+    read();
+}
+
+static std::optional<std::string> read_string(const std::string& contents, size_t& offset) {
+    uint64_t size = 0;
+    if (contents.size() - offset < sizeof(size)) {
+        return std::nullopt;
+    }
+
+    memcpy(&size, contents.data() + offset, sizeof(size));
+    offset += sizeof(size);
+
+    if (contents.size() - offset < size) {
+        return std::nullopt;
+    }
+
+    std::string result = contents.substr(offset, size);
+    offset += size;
+    return result;
+}
+
+void bonk::ProcedureOutputCache::read() {
+    std::ifstream file{path, std::ios::binary};
+    if (!file.is_open()) {
+        return;
+    }
+
+    std::string contents{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+    // A damaged or outdated cache is simply ignored
+    uint32_t file_version = 0;
+    uint32_t entry_count = 0;
+    size_t offset = sizeof(magic) + sizeof(file_version) + sizeof(entry_count);
+
+    if (contents.size() < offset || memcmp(contents.data(), magic, sizeof(magic)) != 0) {
+        return;
+    }
+
+    memcpy(&file_version, contents.data() + sizeof(magic), sizeof(file_version));
+    memcpy(&entry_count, contents.data() + sizeof(magic) + sizeof(file_version),
+           sizeof(entry_count));
+
+    if (file_version != version) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < entry_count; i++) {
+        std::optional<std::string> key = read_string(contents, offset);
+        std::optional<std::string> output;
+        if (key) {
+            output = read_string(contents, offset);
+        }
+
+        if (!output) {
+            entries.clear();
+            return;
+        }
+
+        entries[std::move(*key)].output = std::move(*output);
+    }
+}
+
+std::optional<std::string_view> bonk::ProcedureOutputCache::find(const std::string& key) {
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        miss_count++;
+        return std::nullopt;
+    }
+
+    hit_count++;
+    it->second.used = true;
+    return it->second.output;
+}
+
+void bonk::ProcedureOutputCache::store(std::string key, std::string output) {
+    entries[std::move(key)] = {std::move(output), true};
+}
+
+bool bonk::ProcedureOutputCache::write() {
+    uint32_t entry_count = 0;
+    for (auto& [key, entry] : entries) {
+        if (entry.used) {
+            entry_count++;
+        }
+    }
+
+    FileOutputStream output{path.string()};
+    if (!output.get_stream()) {
+        return false;
+    }
+
+    auto& stream = output.get_stream();
+    stream.write(magic, sizeof(magic));
+    stream.write((const char*)&version, sizeof(version));
+    stream.write((const char*)&entry_count, sizeof(entry_count));
+
+    for (auto& [key, entry] : entries) {
+        if (!entry.used) {
+            continue;
+        }
+
+        uint64_t key_size = key.size();
+        uint64_t size = entry.output.size();
+        stream.write((const char*)&key_size, sizeof(key_size));
+        stream.write(key.data(), key_size);
+        stream.write((const char*)&size, sizeof(size));
+        stream.write(entry.output.data(), size);
+    }
+
+    return (bool)stream;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace bonk {
+
+// Per-module cache of backend output for individual procedures, keyed by
+// the serialized procedure and backend options (see HIRProcedureHasher).
+// Keys are compared in full, so a hash collision can not return the output
+// of another procedure. When a module is recompiled,
+// procedures that did not change are copied from the cache instead of being
+// compiled again. Entries that were not used by the last compilation are
+// dropped when the cache is written back.
+class ProcedureOutputCache {
+  public:
+    static constexpr char magic[8] = {'B', 'O', 'N', 'K', 'P', 'R', 'O', 'C'};
+    static constexpr uint32_t version = 2;
+
+    explicit ProcedureOutputCache(std::filesystem::path path);
+
+    std::optional<std::string_view> find(const std::string& key);
+    void store(std::string key, std::string output);
+
+    bool write();
+
+    int get_hit_count() const {
+        return hit_count;
+    }
+
+    int get_miss_count() const {
+        return miss_count;
+    }
+
+  private:
+    struct Entry {
+        std::string output;
+        bool used = false;
+    };
+
+    void read();
+
+    std::filesystem::path path;
+    std::unordered_map<std::string, Entry> entries;
+    int hit_count = 0;
+    int miss_count = 0;
+};
+
+} // namespace bonk
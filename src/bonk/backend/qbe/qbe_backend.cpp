@@ -1,7 +1,11 @@
 
 #include "qbe_backend.hpp"
+#include <sstream>
+#include "bonk/backend/procedure_output_cache.hpp"
 #include "bonk/compiler/compiler.hpp"
+#include "bonk/frontend/annotators/basic_symbol_annotator.hpp"
 #include "bonk/frontend/frontend.hpp"
+#include "bonk/middleend/ir/algorithms/hir_procedure_hasher.hpp"
 #include "bonk/middleend/ir/hir.hpp"
 
 void bonk::qbe_backend::QBEBackend::compile_program(bonk::HIRProgram& program,
@@ -10,8 +14,56 @@ void bonk::qbe_backend::QBEBackend::compile_program(bonk::HIRProgram& program,
     output_stream = &output;
 
     for (auto& procedure : program.procedures) {
-        compile_procedure(*procedure);
+        if (procedure_cache) {
+            compile_cached_procedure(*procedure);
+        } else {
+            compile_procedure(*procedure);
+        }
+    }
+}
+
+std::string bonk::qbe_backend::QBEBackend::get_output_options() const {
+    std::string options;
+    if (generate_debug_symbols) {
+        options += " -g";
+    }
+    if (iterative_teardown) {
+        options += " --iterative-teardown";
+    }
+    if (heap_profiling) {
+        options += " --heap-profile";
+    }
+    if (instrument_refcounts) {
+        options += " --instrument-refcounts";
     }
+    return options;
+}
+
+void bonk::qbe_backend::QBEBackend::compile_cached_procedure(bonk::HIRProcedure& procedure) {
+    if (procedure.is_external)
+        return;
+
+    HIRProcedureHasher hasher;
+    hasher.hash_locations = generate_debug_symbols || heap_profiling || instrument_refcounts;
+
+    std::string procedure_key = get_output_options() + '\n' + hasher.get_key(procedure);
+
+    if (auto cached_output = procedure_cache->find(procedure_key)) {
+        output_stream->get_stream() << *cached_output;
+        return;
+    }
+
+    std::stringstream procedure_stringstream;
+    bonk::StdOutputStream procedure_stream{procedure_stringstream};
+
+    auto module_stream = output_stream;
+    output_stream = &procedure_stream;
+    compile_procedure(procedure);
+    output_stream = module_stream;
+
+    std::string procedure_output = procedure_stringstream.str();
+    output_stream->get_stream() << procedure_output;
+    procedure_cache->store(std::move(procedure_key), std::move(procedure_output));
 }
 
 void bonk::qbe_backend::QBEBackend::compile_procedure(bonk::HIRProcedure& procedure) {
@@ -42,6 +94,23 @@ void bonk::qbe_backend::QBEBackend::compile_procedure(bonk::HIRProcedure& proced
 
     output_stream->get_stream() << ") {\n";
 
+    current_procedure_name = procedure_name;
+    current_line = 0;
+    current_column = 0;
+    profile_sites.clear();
+    refcount_sites.clear();
+
+    // Registers used by the lowered reference counter operations
+    next_register = procedure.used_registers;
+
+    // Successors refer to the last label of the block in their phi functions
+    block_exit_labels.assign(procedure.base_blocks.size(), 0);
+    for (auto& block : procedure.base_blocks) {
+        for (auto instruction : block->instructions) {
+            block_exit_labels[block->index] += get_lowered_label_count(*instruction);
+        }
+    }
+
     compile_block(procedure.base_blocks[procedure.start_block_index]);
 
     for (auto& block : procedure.base_blocks) {
@@ -53,9 +122,16 @@ void bonk::qbe_backend::QBEBackend::compile_procedure(bonk::HIRProcedure& proced
     }
 
     output_stream->get_stream() << "}\n";
+
+    if (!profile_sites.empty() || !refcount_sites.empty()) {
+        compile_site_file_data(procedure);
+    }
+    compile_profile_site_data();
+    compile_refcount_site_data();
 }
 void bonk::qbe_backend::QBEBackend::compile_block(std::unique_ptr<HIRBaseBlock>& block) {
     current_block = block.get();
+    current_label = 0;
     output_stream->get_stream() << "@L" << block->index << "\n";
     for (auto& instruction : block->instructions) {
         compile_instruction(*instruction);
@@ -108,6 +184,11 @@ void bonk::qbe_backend::QBEBackend::compile_instruction(HIRSymbolLoadInstruction
 void bonk::qbe_backend::QBEBackend::compile_instruction(HIROperationInstruction& instruction) {
     auto target = instruction.target;
 
+    if (instruction.operation_type == HIROperationType::multiply_high) {
+        compile_multiply_high(instruction);
+        return;
+    }
+
     padding();
 
     output_stream->get_stream() << "%r" << target << " =" << get_hir_type(instruction.result_type)
@@ -138,8 +219,20 @@ void bonk::qbe_backend::QBEBackend::compile_instruction(HIROperationInstruction&
         print_comparison(instruction.operation_type, instruction.operand_type);
         break;
     case HIROperationType::and_op:
+        output_stream->get_stream() << "and ";
+        break;
     case HIROperationType::or_op:
+        output_stream->get_stream() << "or ";
+        break;
     case HIROperationType::xor_op:
+        output_stream->get_stream() << "xor ";
+        break;
+    case HIROperationType::shift_left:
+        output_stream->get_stream() << "shl ";
+        break;
+    case HIROperationType::shift_right:
+        output_stream->get_stream() << "sar ";
+        break;
     case HIROperationType::not_op:
     default:
         assert(!"Cannot compile this just yet");
@@ -155,6 +248,29 @@ void bonk::qbe_backend::QBEBackend::compile_instruction(HIROperationInstruction&
     output_stream->get_stream() << "\n";
 }
 
+void bonk::qbe_backend::QBEBackend::compile_multiply_high(HIROperationInstruction& instruction) {
+    // QBE has no high multiplication, so the word operands are multiplied as
+    // longs. The instruction combiner does not emit it for longs.
+    assert(get_hir_type(instruction.operand_type) == 'w');
+
+    IRRegister left = next_register++;
+    IRRegister right = next_register++;
+    IRRegister product = next_register++;
+    IRRegister high = next_register++;
+
+    auto& stream = output_stream->get_stream();
+    padding();
+    stream << "%r" << left << " =l extsw %r" << instruction.left << "\n";
+    padding();
+    stream << "%r" << right << " =l extsw %r" << instruction.right.value() << "\n";
+    padding();
+    stream << "%r" << product << " =l mul %r" << left << ", %r" << right << "\n";
+    padding();
+    stream << "%r" << high << " =l sar %r" << product << ", 32\n";
+    padding();
+    stream << "%r" << instruction.target << " =w copy %r" << high << "\n";
+}
+
 void bonk::qbe_backend::QBEBackend::print_comparison(HIROperationType type,
                                                      HIRDataType operand_type) {
 
@@ -211,6 +327,10 @@ void bonk::qbe_backend::QBEBackend::compile_instruction(HIRJumpNZInstruction& in
 }
 
 void bonk::qbe_backend::QBEBackend::compile_instruction(HIRCallInstruction& instruction) {
+    if (heap_profiling) {
+        compile_profile_site(instruction);
+    }
+
     padding();
 
     if (instruction.return_value.has_value()) {
@@ -236,6 +356,163 @@ void bonk::qbe_backend::QBEBackend::compile_instruction(HIRCallInstruction& inst
     output_stream->get_stream() << ")\n";
 }
 
+void bonk::qbe_backend::QBEBackend::compile_profile_site(HIRCallInstruction& instruction) {
+    auto& front_end = current_program->id_table.front_end;
+    TreeNode* callee = current_program->id_table.get_node(instruction.procedure_label_id);
+    TreeNodeHiveDefinition* hive_definition = front_end.get_constructed_hive(callee);
+
+    // Inlined constructors call the allocator of the runtime directly
+    if (!hive_definition && instruction.inlined_procedure_id != -1) {
+        std::string_view callee_name = current_program->symbol_table.symbol_names[callee];
+        if (callee_name == "$$bonk_create_small_object" || callee_name == "$$bonk_create_object") {
+            hive_definition = front_end.get_constructed_hive(
+                current_program->id_table.get_node(instruction.inlined_procedure_id));
+        }
+    }
+
+    if (!hive_definition) {
+        return;
+    }
+
+    padding();
+    output_stream->get_stream() << "call $\"_$$bonk_profile_site\"(l $\"_" << current_procedure_name
+                                << "$$site" << profile_sites.size() << "\")\n";
+
+    profile_sites.push_back({hive_definition, current_line, current_column});
+}
+
+void bonk::qbe_backend::QBEBackend::compile_site_file_data(HIRProcedure& procedure) {
+    auto file_instruction = find_procedure_file_instruction(procedure);
+
+    output_stream->get_stream() << "data $\"_" << current_procedure_name << "$$file\" = { b ";
+    print_string(file_instruction ? std::string_view(file_instruction->file) : "");
+    output_stream->get_stream() << ", b 0 }\n";
+}
+
+void bonk::qbe_backend::QBEBackend::compile_profile_site_data() {
+    // Sites are laid out like struct bonk_profile_site of the runtime. The
+    // last word is used by the runtime to number the sites in the profile.
+    auto& stream = output_stream->get_stream();
+
+    for (int i = 0; i < profile_sites.size(); i++) {
+        auto& site = profile_sites[i];
+
+        stream << "data $\"_" << current_procedure_name << "$$site" << i << "$$hive\" = { b ";
+        print_string(site.hive_definition->hive_name->identifier_text);
+        stream << ", b 0 }\n";
+
+        stream << "data $\"_" << current_procedure_name << "$$site" << i << "\" = align 8 { w "
+               << site.line << ", w " << site.column << ", l $\"_" << current_procedure_name
+               << "$$site" << i << "$$hive\", l $\"_" << current_procedure_name
+               << "$$file\", w 0, w 0 }\n";
+    }
+}
+
+void bonk::qbe_backend::QBEBackend::compile_refcount_counter(bool is_decrement) {
+    // The sequence continues from the counted label, so it is numbered last,
+    // like the exit label of the block is counted
+    int register_label = ++current_label;
+    int counted_label = ++current_label;
+    IRRegister updates = next_register++;
+    IRRegister updated = next_register++;
+
+    // The site is registered with the runtime the first time it is reached
+    auto& stream = output_stream->get_stream();
+    std::string site_name = "$\"_" + std::string(current_procedure_name) + "$$refcount" +
+                            std::to_string(refcount_sites.size()) + "\"";
+
+    padding();
+    stream << "%r" << updates << " =l loadl " << site_name << "\n";
+    padding();
+    stream << "%r" << updated << " =l add %r" << updates << ", 1\n";
+    padding();
+    stream << "storel %r" << updated << ", " << site_name << "\n";
+    padding();
+    stream << "jnz %r" << updates << ", ";
+    print_label(current_block->index, counted_label);
+    stream << ", ";
+    print_label(current_block->index, register_label);
+    stream << "\n";
+
+    print_label(current_block->index, register_label);
+    stream << "\n";
+    padding();
+    stream << "call $\"_$$bonk_register_refcount_site\"(l " << site_name << ")\n";
+
+    print_label(current_block->index, counted_label);
+    stream << "\n";
+
+    refcount_sites.push_back({current_line, current_column, is_decrement});
+}
+
+void bonk::qbe_backend::QBEBackend::compile_refcount_release_counter() {
+    // The release counter is the second field of the site
+    IRRegister address = next_register++;
+    IRRegister releases = next_register++;
+    IRRegister updated = next_register++;
+
+    auto& stream = output_stream->get_stream();
+    padding();
+    stream << "%r" << address << " =l add $\"_" << current_procedure_name << "$$refcount"
+           << refcount_sites.size() - 1 << "\", 8\n";
+    padding();
+    stream << "%r" << releases << " =l loadl %r" << address << "\n";
+    padding();
+    stream << "%r" << updated << " =l add %r" << releases << ", 1\n";
+    padding();
+    stream << "storel %r" << updated << ", %r" << address << "\n";
+}
+
+void bonk::qbe_backend::QBEBackend::compile_refcount_site_data() {
+    if (refcount_sites.empty()) {
+        return;
+    }
+
+    // Sites are laid out like struct bonk_refcount_site of the runtime: the
+    // update and release counters, the link to the next registered site, the
+    // file and the procedure, the location and the kind of the operation
+    auto& stream = output_stream->get_stream();
+
+    stream << "data $\"_" << current_procedure_name << "$$name\" = { b ";
+    print_string(current_procedure_name);
+    stream << ", b 0 }\n";
+
+    for (int i = 0; i < refcount_sites.size(); i++) {
+        auto& site = refcount_sites[i];
+
+        stream << "data $\"_" << current_procedure_name << "$$refcount" << i
+               << "\" = align 8 { l 0, l 0, l 0, l $\"_" << current_procedure_name
+               << "$$file\", l $\"_" << current_procedure_name << "$$name\", w " << site.line
+               << ", w " << site.column << ", w " << (site.is_decrement ? 1 : 0) << ", w 0 }\n";
+    }
+}
+
+void bonk::qbe_backend::QBEBackend::print_string(std::string_view string) {
+    output_stream->get_stream() << "\"";
+
+    for (char c : string) {
+        switch (c) {
+        case '\n':
+            output_stream->get_stream() << "\\n";
+            break;
+        case '\r':
+            output_stream->get_stream() << "\\r";
+            break;
+        case '\\':
+            output_stream->get_stream() << "\\\\";
+            break;
+        case '\"':
+            output_stream->get_stream() << "\\\"";
+            break;
+        default:
+            output_stream->get_stream() << c;
+            break;
+        }
+    }
+
+    output_stream->get_stream() << "\"";
+}
+
 void bonk::qbe_backend::QBEBackend::compile_instruction(HIRReturnInstruction& instruction) {
     padding();
     output_stream->get_stream() << "ret";
@@ -268,6 +545,189 @@ void bonk::qbe_backend::QBEBackend::compile_instruction(HIRMemoryStoreInstructio
                                 << instruction.value << ", %r" << instruction.address << "\n";
 }
 
+void bonk::qbe_backend::QBEBackend::compile_instruction(HIRIncRefCounterInstruction& instruction) {
+    // The sequence ends with the last of its labels
+    int skip_label = current_label + get_lowered_label_count(instruction);
+
+    // Null references are not counted
+    if (!instruction.never_null) {
+        compile_null_test(instruction.address, skip_label);
+    }
+
+    if (instrument_refcounts) {
+        compile_refcount_counter(false);
+    }
+
+    IRRegister counter_address = 0;
+    IRRegister counter = compile_reference_count_update(instruction.address, 1, counter_address);
+
+    padding();
+    output_stream->get_stream() << "storel %r" << counter << ", %r" << counter_address << "\n";
+
+    if (!instruction.never_null) {
+        print_label(current_block->index, ++current_label);
+        output_stream->get_stream() << "\n";
+    }
+}
+
+void bonk::qbe_backend::QBEBackend::compile_instruction(HIRDecRefCounterInstruction& instruction) {
+    int skip_label = current_label + get_lowered_label_count(instruction);
+
+    if (!instruction.never_null) {
+        compile_null_test(instruction.address, skip_label);
+    }
+
+    if (instrument_refcounts) {
+        compile_refcount_counter(true);
+    }
+
+    int keep_label = ++current_label;
+    int destroy_label = ++current_label;
+
+    IRRegister counter_address = 0;
+    IRRegister counter = compile_reference_count_update(instruction.address, -1, counter_address);
+
+    padding();
+    output_stream->get_stream() << "jnz %r" << counter << ", ";
+    print_label(current_block->index, keep_label);
+    output_stream->get_stream() << ", ";
+    print_label(current_block->index, destroy_label);
+    output_stream->get_stream() << "\n";
+
+    // The counter is only stored while the hive is alive, otherwise the
+    // destructor would release it once again
+    print_label(current_block->index, keep_label);
+    output_stream->get_stream() << "\n";
+    padding();
+    output_stream->get_stream() << "storel %r" << counter << ", %r" << counter_address << "\n";
+    padding();
+    output_stream->get_stream() << "jmp ";
+    print_label(current_block->index, skip_label);
+    output_stream->get_stream() << "\n";
+
+    print_label(current_block->index, destroy_label);
+    output_stream->get_stream() << "\n";
+    if (instrument_refcounts) {
+        compile_refcount_release_counter();
+    }
+    padding();
+    auto destructor_name = get_destructor_name(instruction.hive_definition);
+    if (iterative_teardown) {
+        output_stream->get_stream() << "call $\"_$$bonk_destroy_object\"(l %r"
+                                    << instruction.address << ", l $\"_" << destructor_name
+                                    << "\")\n";
+    } else {
+        output_stream->get_stream() << "call $\"_" << destructor_name << "\"(l %r"
+                                    << instruction.address << ")\n";
+    }
+
+    print_label(current_block->index, ++current_label);
+    output_stream->get_stream() << "\n";
+}
+
+void bonk::qbe_backend::QBEBackend::compile_null_test(IRRegister hive, int skip_label) {
+    int update_label = ++current_label;
+
+    padding();
+    output_stream->get_stream() << "jnz %r" << hive << ", ";
+    print_label(current_block->index, update_label);
+    output_stream->get_stream() << ", ";
+    print_label(current_block->index, skip_label);
+    output_stream->get_stream() << "\n";
+
+    print_label(current_block->index, update_label);
+    output_stream->get_stream() << "\n";
+}
+
+bonk::IRRegister bonk::qbe_backend::QBEBackend::compile_reference_count_update(
+    IRRegister hive, int delta, IRRegister& counter_address) {
+    // The reference counter is stored right before the hive fields
+    counter_address = next_register++;
+    IRRegister counter = next_register++;
+    IRRegister updated_counter = next_register++;
+
+    padding();
+    output_stream->get_stream() << "%r" << counter_address << " =l sub %r" << hive << ", 8\n";
+    padding();
+    output_stream->get_stream() << "%r" << counter << " =l loadl %r" << counter_address << "\n";
+    padding();
+    output_stream->get_stream() << "%r" << updated_counter << " =l add %r" << counter << ", "
+                                << delta << "\n";
+
+    return updated_counter;
+}
+
+std::string_view
+bonk::qbe_backend::QBEBackend::get_destructor_name(TreeNodeHiveDefinition* hive_definition) {
+    std::string destructor_name =
+        std::string(hive_definition->hive_name->identifier_text) + "$$destructor";
+
+    auto scope = current_program->symbol_table.get_scope_for_node(hive_definition)->parent_scope;
+    auto destructor_definition = ScopedNameResolver(scope).get_name_definition(destructor_name);
+
+    return current_program->symbol_table.symbol_names[destructor_definition];
+}
+
+int bonk::qbe_backend::QBEBackend::get_lowered_label_count(HIRInstruction& instruction) {
+    // Instrumented operations have two more labels around the registration
+    int counter_labels = instrument_refcounts ? 2 : 0;
+
+    switch (instruction.type) {
+    case HIRInstructionType::inc_ref_counter:
+        return (static_cast<HIRIncRefCounterInstruction&>(instruction).never_null ? 0 : 2) +
+               counter_labels;
+    case HIRInstructionType::dec_ref_counter:
+        return (static_cast<HIRDecRefCounterInstruction&>(instruction).never_null ? 3 : 4) +
+               counter_labels;
+    default:
+        return 0;
+    }
+}
+
+void bonk::qbe_backend::QBEBackend::print_label(int block_index, int label) {
+    output_stream->get_stream() << "@L" << block_index;
+    if (label != 0) {
+        output_stream->get_stream() << "_" << label;
+    }
+}
+
+void bonk::qbe_backend::QBEBackend::compile_instruction(HIRSelectInstruction& instruction) {
+    // QBE has no conditional move, so the value is picked with a mask:
+    // z_value ^ ((nz_value ^ z_value) & -(condition != 0))
+    char type = get_hir_type(instruction.type);
+    IRRegister is_set = next_register++;
+    IRRegister mask = next_register++;
+    IRRegister difference = next_register++;
+    IRRegister masked_difference = next_register++;
+
+    auto& stream = output_stream->get_stream();
+    padding();
+    stream << "%r" << is_set << " =w cnew %r" << instruction.condition << ", 0\n";
+    if (type == 'l') {
+        IRRegister extended = next_register++;
+        padding();
+        stream << "%r" << extended << " =l extuw %r" << is_set << "\n";
+        is_set = extended;
+    }
+    padding();
+    stream << "%r" << mask << " =" << type << " sub 0, %r" << is_set << "\n";
+    padding();
+    stream << "%r" << difference << " =" << type << " xor %r" << instruction.nz_value << ", %r"
+           << instruction.z_value << "\n";
+    padding();
+    stream << "%r" << masked_difference << " =" << type << " and %r" << difference << ", %r"
+           << mask << "\n";
+    padding();
+    stream << "%r" << instruction.target << " =" << type << " xor %r" << instruction.z_value
+           << ", %r" << masked_difference << "\n";
+}
+
+void bonk::qbe_backend::QBEBackend::compile_instruction(HIRStackAllocInstruction& instruction) {
+    padding();
+    output_stream->get_stream() << "%r" << instruction.target << " =l alloc8 "
+                                << instruction.size << "\n";
+}
+
 void bonk::qbe_backend::QBEBackend::compile_instruction(bonk::HIRInstruction& instruction) {
 
     auto hir_instruction = static_cast<HIRInstruction&>(instruction);
@@ -293,10 +753,18 @@ void bonk::qbe_backend::QBEBackend::compile_instruction(bonk::HIRInstruction& in
         return compile_instruction(static_cast<HIRMemoryLoadInstruction&>(instruction));
     case HIRInstructionType::memory_store:
         return compile_instruction(static_cast<HIRMemoryStoreInstruction&>(instruction));
+    case HIRInstructionType::stack_alloc:
+        return compile_instruction(static_cast<HIRStackAllocInstruction&>(instruction));
+    case HIRInstructionType::inc_ref_counter:
+        return compile_instruction(static_cast<HIRIncRefCounterInstruction&>(instruction));
+    case HIRInstructionType::dec_ref_counter:
+        return compile_instruction(static_cast<HIRDecRefCounterInstruction&>(instruction));
     case HIRInstructionType::location:
         return compile_instruction(static_cast<HIRLocationInstruction&>(instruction));
     case HIRInstructionType::phi_function:
         return compile_instruction(static_cast<HIRPhiFunctionInstruction&>(instruction));
+    case HIRInstructionType::select:
+        return compile_instruction(static_cast<HIRSelectInstruction&>(instruction));
     case HIRInstructionType::file:
         // Ignore, because QBE doesn't support file instructions within functions
         return;
@@ -309,33 +777,21 @@ void bonk::qbe_backend::QBEBackend::compile_instruction(bonk::HIRInstruction& in
 }
 
 void bonk::qbe_backend::QBEBackend::compile_instruction(bonk::HIRFileInstruction& instruction) {
-    padding();
-    output_stream->get_stream() << "file \"";
-
-    for (char c : instruction.file) {
-        switch (c) {
-        case '\n':
-            output_stream->get_stream() << "\\n";
-            break;
-        case '\r':
-            output_stream->get_stream() << "\\r";
-            break;
-        case '\\':
-            output_stream->get_stream() << "\\\\";
-            break;
-        case '\"':
-            output_stream->get_stream() << "\\\"";
-            break;
-        default:
-            output_stream->get_stream() << c;
-            break;
-        }
-    }
+    // File names are only needed for debug info. Leaving them out otherwise
+    // keeps the output independent of the module location.
+    if (!generate_debug_symbols)
+        return;
 
-    output_stream->get_stream() << "\"\n";
+    padding();
+    output_stream->get_stream() << "file ";
+    print_string(instruction.file);
+    output_stream->get_stream() << "\n";
 }
 
 void bonk::qbe_backend::QBEBackend::compile_instruction(bonk::HIRLocationInstruction& instruction) {
+    current_line = instruction.line;
+    current_column = instruction.column;
+
     if (!generate_debug_symbols)
         return;
 
@@ -353,8 +809,9 @@ void bonk::qbe_backend::QBEBackend::compile_instruction(
     for (int i = 0; i < instruction.sources.size(); i++) {
         if (i != 0)
             output_stream->get_stream() << ", ";
-        output_stream->get_stream()
-            << "@L" << current_block->predecessors[i]->index << " %r" << instruction.sources[i];
+        int predecessor = current_block->predecessors[i]->index;
+        print_label(predecessor, block_exit_labels[predecessor]);
+        output_stream->get_stream() << " %r" << instruction.sources[i];
     }
 
     output_stream->get_stream() << "\n";
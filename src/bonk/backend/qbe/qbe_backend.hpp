@@ -9,10 +9,37 @@ class QBEBackend : public Backend {
 
     HIRProgram* current_program = nullptr;
     HIRBaseBlock* current_block = nullptr;
+    // Reference counter operations are lowered into several QBE blocks,
+    // which are labeled after the HIR block they belong to
+    int current_label = 0;
+    std::vector<int> block_exit_labels;
+    IRRegister next_register = 0;
     std::vector<HIRProcedureParameter> call_parameters;
+
+    // Allocations of the current procedure that are attributed to a hive
+    // and a source location for the heap profiler
+    struct ProfileSite {
+        TreeNodeHiveDefinition* hive_definition = nullptr;
+        unsigned int line = 0;
+        unsigned int column = 0;
+    };
+    std::string_view current_procedure_name;
+    unsigned int current_line = 0;
+    unsigned int current_column = 0;
+    std::vector<ProfileSite> profile_sites;
+
+    // Reference counter operations of the current procedure that count
+    // their updates for --instrument-refcounts
+    struct RefCountSite {
+        unsigned int line = 0;
+        unsigned int column = 0;
+        bool is_decrement = false;
+    };
+    std::vector<RefCountSite> refcount_sites;
     const bonk::OutputStream* output_stream = nullptr;
 
     void compile_procedure(HIRProcedure& procedure);
+    void compile_cached_procedure(HIRProcedure& procedure);
     void compile_instruction(HIRInstruction& instruction);
     bool compile_procedure_header(bonk::HIRInstruction& instruction);
     void compile_procedure_footer();
@@ -27,21 +54,51 @@ class QBEBackend : public Backend {
     void compile_instruction(HIRParameterInstruction& instruction);
     void compile_instruction(HIRMemoryLoadInstruction& instruction);
     void compile_instruction(HIRMemoryStoreInstruction& instruction);
+    void compile_instruction(HIRStackAllocInstruction& instruction);
+    void compile_instruction(HIRIncRefCounterInstruction& instruction);
+    void compile_instruction(HIRDecRefCounterInstruction& instruction);
     void compile_instruction(HIRFileInstruction& instruction);
     void compile_instruction(HIRLocationInstruction& instruction);
     void compile_instruction(HIRPhiFunctionInstruction& instruction);
+    void compile_instruction(HIRSelectInstruction& instruction);
+
+    void compile_null_test(IRRegister hive, int skip_label);
+    void compile_profile_site(HIRCallInstruction& instruction);
+    void compile_profile_site_data();
+    void compile_refcount_counter(bool is_decrement);
+    void compile_refcount_release_counter();
+    void compile_refcount_site_data();
+    void compile_site_file_data(HIRProcedure& procedure);
+    void print_string(std::string_view string);
+    IRRegister compile_reference_count_update(IRRegister hive, int delta,
+                                              IRRegister& counter_address);
+    std::string_view get_destructor_name(TreeNodeHiveDefinition* hive_definition);
+    int get_lowered_label_count(HIRInstruction& instruction);
+    void print_label(int block_index, int label);
 
     char get_hir_type(bonk::HIRDataType type, bool base_type = true);
     void print_comparison(HIROperationType type, HIRDataType operand_type);
+    void compile_multiply_high(HIROperationInstruction& instruction);
 
     void padding();
 
   public:
     void compile_program(HIRProgram& program, const bonk::OutputStream& output) override;
+    std::string get_output_options() const override;
 
     QBEBackend(Compiler& linked_compiler): Backend(linked_compiler) {};
 
     bool generate_debug_symbols = false;
+    // Hives whose counter reaches zero are handed to the runtime, which
+    // destroys them from a worklist. Destroying a long chain of hives then
+    // takes constant stack depth instead of one frame per hive.
+    bool iterative_teardown = false;
+    // Allocations report their hive and call site to the sampling heap
+    // profiler of the runtime
+    bool heap_profiling = false;
+    // Every reference counter operation counts its updates and releases in
+    // a static site record, which the runtime prints at exit
+    bool instrument_refcounts = false;
     HIRFileInstruction* find_procedure_file_instruction(HIRProcedure& procedure);
     void compile_block(std::unique_ptr<HIRBaseBlock>& block);
 };
@@ -0,0 +1,266 @@
+
+#include "build_report.hpp"
+#include <iomanip>
+#include "utils/json_serializer.hpp"
+
+const char* bonk::BONK_MODULE_VERDICT_NAMES[] = {
+    "up_to_date", "archived", "restored_from_cache", "rebuilt", "failed",
+};
+
+const char* bonk::BONK_REBUILD_REASON_NAMES[] = {
+    "none",
+    "output_missing",
+    "metadata_outdated",
+    "options_changed",
+    "dependency_missing",
+    "dependency_failed",
+    "dependency_changed",
+};
+
+const char* bonk::BONK_BUILD_PHASE_NAMES[] = {
+    "parsing", "frontend", "hir_generation", "middle_end", "backend",
+};
+
+void bonk::ModuleReport::set_reason(bonk::RebuildReason new_reason,
+                                    const std::filesystem::path& new_trigger) {
+    // Only the first reason is interesting, the rest follow from it
+    if (reason != RebuildReason::none) {
+        return;
+    }
+    reason = new_reason;
+    trigger = new_trigger;
+}
+
+bonk::ModuleReport* bonk::BuildReport::begin_module(const std::filesystem::path& path) {
+    auto key = path.lexically_normal().string();
+    if (module_map.find(key) != module_map.end()) {
+        return nullptr;
+    }
+
+    auto& report = modules.emplace_back(std::make_unique<ModuleReport>());
+    report->path = path.lexically_normal();
+    module_map[key] = report.get();
+    return report.get();
+}
+
+bonk::ModuleReport* bonk::BuildReport::find_module(const std::filesystem::path& path) {
+    auto it = module_map.find(path.lexically_normal().string());
+    if (it == module_map.end()) {
+        return nullptr;
+    }
+    return it->second;
+}
+
+namespace {
+
+struct BuildTotals {
+    int verdicts[(int)bonk::ModuleVerdict::failed + 1]{};
+    double phase_times[(int)bonk::BuildPhase::count]{};
+    int cache_lookups = 0;
+    int cache_hits = 0;
+    int procedures_reused = 0;
+    int procedures_compiled = 0;
+    int modules = 0;
+
+    explicit BuildTotals(const std::vector<std::unique_ptr<bonk::ModuleReport>>& reports) {
+        for (auto& report : reports) {
+            modules++;
+            verdicts[(int)report->verdict]++;
+            for (int i = 0; i < (int)bonk::BuildPhase::count; i++) {
+                phase_times[i] += report->phase_times[i];
+            }
+            cache_lookups += report->cache_lookups;
+            cache_hits += report->cache_hits;
+            procedures_reused += report->procedures_reused;
+            procedures_compiled += report->procedures_compiled;
+        }
+    }
+
+    // Modules that did not have to be rebuilt
+    int get_module_hits() const {
+        return verdicts[(int)bonk::ModuleVerdict::up_to_date] +
+               verdicts[(int)bonk::ModuleVerdict::archived] +
+               verdicts[(int)bonk::ModuleVerdict::restored_from_cache];
+    }
+};
+
+double get_rate(int hits, int total) {
+    return total == 0 ? 0 : (double)hits / total;
+}
+
+} // namespace
+
+void bonk::BuildReport::print_explanation(const bonk::OutputStream& output) const {
+    auto& stream = output.get_stream();
+    auto current_path = std::filesystem::current_path();
+
+    stream << std::fixed << std::setprecision(2);
+
+    for (auto& report : modules) {
+        stream << report->path.lexically_proximate(current_path).string() << ": ";
+
+        switch (report->verdict) {
+        case ModuleVerdict::up_to_date:
+            stream << "up to date";
+            break;
+        case ModuleVerdict::archived:
+            stream << "taken from a metadata archive";
+            break;
+        case ModuleVerdict::restored_from_cache:
+            stream << "restored from the compilation cache";
+            break;
+        case ModuleVerdict::rebuilt:
+            stream << "rebuilt";
+            break;
+        case ModuleVerdict::failed:
+            stream << "failed to build";
+            break;
+        }
+
+        switch (report->reason) {
+        case RebuildReason::none:
+            break;
+        case RebuildReason::output_missing:
+            stream << " (output file is missing)";
+            break;
+        case RebuildReason::metadata_outdated:
+            stream << " (metafile is missing or older than the source)";
+            break;
+        case RebuildReason::options_changed:
+            stream << " (output was compiled with different options)";
+            break;
+        case RebuildReason::dependency_missing:
+            stream << " (dependency " << report->trigger.string() << " doesn't exist)";
+            break;
+        case RebuildReason::dependency_failed:
+            stream << " (dependency "
+                   << report->trigger.lexically_proximate(current_path).string()
+                   << " failed to build)";
+            break;
+        case RebuildReason::dependency_changed:
+            stream << " (interface of "
+                   << report->trigger.lexically_proximate(current_path).string()
+                   << " has changed)";
+            break;
+        }
+
+        stream << "\n";
+
+        bool has_phase_times = false;
+        for (int i = 0; i < (int)BuildPhase::count; i++) {
+            if (report->phase_times[i] == 0) {
+                continue;
+            }
+            stream << (has_phase_times ? ", " : "    ") << BONK_BUILD_PHASE_NAMES[i] << " "
+                   << report->phase_times[i] << " ms";
+            has_phase_times = true;
+        }
+        if (has_phase_times) {
+            stream << "\n";
+        }
+
+        if (report->procedures_reused + report->procedures_compiled > 0) {
+            stream << "    procedures: " << report->procedures_reused << " reused, "
+                   << report->procedures_compiled << " compiled\n";
+        }
+    }
+
+    BuildTotals totals(modules);
+
+    stream << "modules: " << totals.modules << ", "
+           << totals.modules - totals.verdicts[(int)ModuleVerdict::rebuilt] -
+                  totals.verdicts[(int)ModuleVerdict::failed]
+           << " not rebuilt (" << get_rate(totals.get_module_hits(), totals.modules) * 100
+           << "%)\n";
+
+    if (totals.cache_lookups > 0) {
+        stream << "compilation cache: " << totals.cache_hits << " of " << totals.cache_lookups
+               << " lookups hit (" << get_rate(totals.cache_hits, totals.cache_lookups) * 100
+               << "%)\n";
+    }
+
+    int procedures = totals.procedures_reused + totals.procedures_compiled;
+    if (procedures > 0) {
+        stream << "procedures: " << totals.procedures_reused << " of " << procedures
+               << " reused (" << get_rate(totals.procedures_reused, procedures) * 100 << "%)\n";
+    }
+
+    stream << std::defaultfloat;
+}
+
+void bonk::BuildReport::write_json(const bonk::OutputStream& output) const {
+    BuildTotals totals(modules);
+
+    {
+        JSONSerializer serializer{output};
+
+        serializer.field("modules").block_start_array();
+        for (auto& report : modules) {
+            serializer.array_add_block();
+            serializer.field("path").block_string_field() << report->path.string();
+            serializer.field("verdict").block_string_field()
+                << BONK_MODULE_VERDICT_NAMES[(int)report->verdict];
+            serializer.field("reason").block_string_field()
+                << BONK_REBUILD_REASON_NAMES[(int)report->reason];
+            if (report->trigger.empty()) {
+                serializer.field("trigger").block_add_null();
+            } else {
+                serializer.field("trigger").block_string_field() << report->trigger.string();
+            }
+
+            serializer.field("phase_times_ms").block_start_block();
+            for (int i = 0; i < (int)BuildPhase::count; i++) {
+                serializer.field(BONK_BUILD_PHASE_NAMES[i])
+                    .block_number_field(report->phase_times[i]);
+            }
+            serializer.close_block();
+
+            serializer.field("cache_lookups").block_number_field(report->cache_lookups);
+            serializer.field("cache_hits").block_number_field(report->cache_hits);
+            serializer.field("procedures_reused").block_number_field(report->procedures_reused);
+            serializer.field("procedures_compiled")
+                .block_number_field(report->procedures_compiled);
+            serializer.close_block();
+        }
+        serializer.close_array();
+
+        int procedures = totals.procedures_reused + totals.procedures_compiled;
+
+        serializer.field("totals").block_start_block();
+        serializer.field("modules").block_number_field(totals.modules);
+        for (int i = 0; i <= (int)ModuleVerdict::failed; i++) {
+            serializer.field(BONK_MODULE_VERDICT_NAMES[i]).block_number_field(totals.verdicts[i]);
+        }
+        serializer.field("module_hit_rate")
+            .block_number_field(get_rate(totals.get_module_hits(), totals.modules));
+        serializer.field("cache_lookups").block_number_field(totals.cache_lookups);
+        serializer.field("cache_hits").block_number_field(totals.cache_hits);
+        serializer.field("cache_hit_rate")
+            .block_number_field(get_rate(totals.cache_hits, totals.cache_lookups));
+        serializer.field("procedures_reused").block_number_field(totals.procedures_reused);
+        serializer.field("procedures_compiled").block_number_field(totals.procedures_compiled);
+        serializer.field("procedure_hit_rate")
+            .block_number_field(get_rate(totals.procedures_reused, procedures));
+
+        serializer.field("phase_times_ms").block_start_block();
+        for (int i = 0; i < (int)BuildPhase::count; i++) {
+            serializer.field(BONK_BUILD_PHASE_NAMES[i]).block_number_field(totals.phase_times[i]);
+        }
+        serializer.close_block();
+        serializer.close_block();
+    }
+
+    output.get_stream() << "\n";
+}
+
+bonk::BuildPhaseTimer::BuildPhaseTimer(bonk::ModuleReport* report, bonk::BuildPhase phase)
+    : report(report), phase(phase), start(std::chrono::steady_clock::now()) {
+}
+
+bonk::BuildPhaseTimer::~BuildPhaseTimer() {
+    if (!report) {
+        return;
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    report->phase_times[(int)phase] += elapsed.count();
+}
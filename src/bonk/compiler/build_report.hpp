@@ -0,0 +1,78 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "utils/streams.hpp"
+
+namespace bonk {
+
+enum class ModuleVerdict { up_to_date, archived, restored_from_cache, rebuilt, failed };
+
+enum class RebuildReason {
+    none,
+    output_missing,
+    metadata_outdated,
+    options_changed,
+    dependency_missing,
+    dependency_failed,
+    dependency_changed
+};
+
+enum class BuildPhase { parsing, frontend, hir_generation, middle_end, backend, count };
+
+extern const char* BONK_MODULE_VERDICT_NAMES[];
+extern const char* BONK_REBUILD_REASON_NAMES[];
+extern const char* BONK_BUILD_PHASE_NAMES[];
+
+struct ModuleReport {
+    std::filesystem::path path;
+    ModuleVerdict verdict = ModuleVerdict::up_to_date;
+    RebuildReason reason = RebuildReason::none;
+
+    // The dependency that caused the rebuild, if any
+    std::filesystem::path trigger;
+
+    double phase_times[(int)BuildPhase::count]{};
+
+    int cache_lookups = 0;
+    int cache_hits = 0;
+    int procedures_reused = 0;
+    int procedures_compiled = 0;
+
+    void set_reason(RebuildReason new_reason, const std::filesystem::path& new_trigger = {});
+};
+
+// Collects the decisions made by the help resolver, so it's possible to
+// tell why a module was rebuilt and where the build time went.
+class BuildReport {
+  public:
+    // Returns nullptr if the module has already been reported. Modules are
+    // visited once per dependent, but only the first visit can rebuild them.
+    ModuleReport* begin_module(const std::filesystem::path& path);
+    ModuleReport* find_module(const std::filesystem::path& path);
+
+    void print_explanation(const OutputStream& output) const;
+    void write_json(const OutputStream& output) const;
+
+  private:
+    std::vector<std::unique_ptr<ModuleReport>> modules;
+    std::unordered_map<std::string, ModuleReport*> module_map;
+};
+
+// Adds the time spent in its scope to the given phase of the module report
+class BuildPhaseTimer {
+  public:
+    BuildPhaseTimer(ModuleReport* report, BuildPhase phase);
+    ~BuildPhaseTimer();
+
+  private:
+    ModuleReport* report;
+    BuildPhase phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+} // namespace bonk
@@ -0,0 +1,237 @@
+
+#include "compilation_cache.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/file.h>
+#include <unistd.h>
+#include "utils/hash.hpp"
+
+static std::optional<std::string> read_file(const std::filesystem::path& path) {
+    std::ifstream file{path, std::ios::binary};
+    if (!file.is_open()) {
+        return std::nullopt;
+    }
+    std::string contents{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    if (file.bad()) {
+        return std::nullopt;
+    }
+    return contents;
+}
+
+// Other processes may read the file at any moment, so it is written
+// under a unique temporary name and then atomically renamed into place
+static bool write_file_atomically(const std::filesystem::path& path, std::string_view contents) {
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+
+    auto temporary_path = path;
+    temporary_path += "." + std::to_string(getpid()) + ".tmp";
+
+    {
+        std::ofstream file{temporary_path, std::ios::binary | std::ios::trunc};
+        if (!file.is_open()) {
+            return false;
+        }
+        file.write(contents.data(), contents.size());
+        if (!file) {
+            file.close();
+            std::filesystem::remove(temporary_path, error);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temporary_path, path, error);
+    if (error) {
+        std::filesystem::remove(temporary_path, error);
+        return false;
+    }
+    return true;
+}
+
+bonk::CompilationCache::CompilationCache(std::filesystem::path directory,
+                                         std::string configuration, uint64_t size_limit)
+    : directory(std::move(directory)), configuration(std::move(configuration)),
+      size_limit(size_limit) {
+}
+
+bonk::CompilationCache::~CompilationCache() {
+    if (has_stored_entries) {
+        trim();
+    }
+}
+
+std::unique_ptr<bonk::CompilationCache>
+bonk::CompilationCache::from_environment(std::string configuration) {
+    const char* directory = getenv("BONK_CACHE_DIR");
+    if (!directory || !*directory) {
+        return nullptr;
+    }
+
+    uint64_t size_limit = default_size_limit;
+    if (const char* size = getenv("BONK_CACHE_SIZE")) {
+        char* end = nullptr;
+        unsigned long long megabytes = strtoull(size, &end, 10);
+        if (end != size && *end == '\0') {
+            size_limit = megabytes * 1024 * 1024;
+        }
+    }
+
+    return std::make_unique<CompilationCache>(std::filesystem::absolute(directory),
+                                              std::move(configuration), size_limit);
+}
+
+const bonk::CompilationCache::ModuleKey*
+bonk::CompilationCache::get_module_key(const std::filesystem::path& source_path) const {
+    auto it = module_keys.find(source_path.lexically_normal().string());
+    if (it == module_keys.end()) {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+const bonk::CompilationCache::ModuleKey&
+bonk::CompilationCache::set_module_key(const std::filesystem::path& source_path, ModuleKey key) {
+    return module_keys[source_path.lexically_normal().string()] = std::move(key);
+}
+
+std::filesystem::path bonk::CompilationCache::get_entry_path(const ModuleKey& key) const {
+    return directory / key.hash;
+}
+
+// Entries are shared by every checkout on the machine, so a colliding
+// path hash would hand out the output of another location
+static std::string get_path_hash(const std::filesystem::path& source_path) {
+    auto digest = bonk::SHA256Hasher().update(source_path.lexically_normal().string()).digest();
+    return bonk::SHA256Hasher::to_hex(digest);
+}
+
+std::filesystem::path
+bonk::CompilationCache::get_output_entry_path(const ModuleKey& key,
+                                              const std::filesystem::path& source_path) const {
+    if (!path_dependent_outputs) {
+        return get_entry_path(key) / "module.out";
+    }
+    return get_entry_path(key) / (get_path_hash(source_path) + ".out");
+}
+
+std::filesystem::path
+bonk::CompilationCache::get_metadata_entry_path(const ModuleKey& key,
+                                                const std::filesystem::path& source_path) const {
+    return get_entry_path(key) / (get_path_hash(source_path) + ".meta");
+}
+
+void bonk::CompilationCache::touch(const std::filesystem::path& entry_path) {
+    // Entry modification time is used as the last access time for eviction
+    std::error_code error;
+    std::filesystem::last_write_time(entry_path, std::filesystem::file_time_type::clock::now(),
+                                     error);
+}
+
+bool bonk::CompilationCache::restore_output(const ModuleKey& key,
+                                            const std::filesystem::path& source_path,
+                                            const std::filesystem::path& output_path) {
+    auto contents = read_file(get_output_entry_path(key, source_path));
+    if (!contents || !write_file_atomically(output_path, *contents)) {
+        return false;
+    }
+    touch(get_entry_path(key));
+    return true;
+}
+
+void bonk::CompilationCache::store_output(const ModuleKey& key,
+                                          const std::filesystem::path& source_path,
+                                          const std::filesystem::path& output_path) {
+    auto contents = read_file(output_path);
+    if (!contents) {
+        return;
+    }
+    if (write_file_atomically(get_output_entry_path(key, source_path), *contents)) {
+        has_stored_entries = true;
+    }
+}
+
+std::optional<std::string>
+bonk::CompilationCache::find_metadata(const ModuleKey& key,
+                                      const std::filesystem::path& source_path) {
+    auto contents = read_file(get_metadata_entry_path(key, source_path));
+    if (contents) {
+        touch(get_entry_path(key));
+    }
+    return contents;
+}
+
+void bonk::CompilationCache::store_metadata(const ModuleKey& key,
+                                            const std::filesystem::path& source_path,
+                                            const std::filesystem::path& meta_path) {
+    auto contents = read_file(meta_path);
+    if (!contents) {
+        return;
+    }
+    if (write_file_atomically(get_metadata_entry_path(key, source_path), *contents)) {
+        has_stored_entries = true;
+    }
+}
+
+void bonk::CompilationCache::trim() {
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+
+    // Only one process trims the cache at a time. If somebody else
+    // is already doing it, there is no need to wait for them.
+    auto lock_path = directory / "trim.lock";
+    int lock_fd = open(lock_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (lock_fd < 0) {
+        return;
+    }
+    if (flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+        close(lock_fd);
+        return;
+    }
+
+    struct Entry {
+        std::filesystem::path path;
+        std::filesystem::file_time_type access_time;
+        uint64_t size;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t total_size = 0;
+
+    for (auto& entry : std::filesystem::directory_iterator(directory, error)) {
+        if (!entry.is_directory(error)) {
+            continue;
+        }
+
+        uint64_t size = 0;
+        for (auto& file : std::filesystem::directory_iterator(entry.path(), error)) {
+            auto file_size = file.file_size(error);
+            if (!error) {
+                size += file_size;
+            }
+        }
+
+        auto access_time = std::filesystem::last_write_time(entry.path(), error);
+        entries.push_back({entry.path(), access_time, size});
+        total_size += size;
+    }
+
+    if (total_size > size_limit) {
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+            return a.access_time < b.access_time;
+        });
+
+        // A concurrent reader of an evicted entry simply sees a cache miss
+        for (auto& entry : entries) {
+            if (total_size <= size_limit) {
+                break;
+            }
+            std::filesystem::remove_all(entry.path, error);
+            total_size -= entry.size;
+        }
+    }
+
+    flock(lock_fd, LOCK_UN);
+    close(lock_fd);
+}
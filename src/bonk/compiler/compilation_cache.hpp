@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace bonk {
+
+// Content-addressed cache of compiled modules, shared between all the
+// checkouts on the machine. Enabled by setting BONK_CACHE_DIR.
+//
+// Every module gets a key, which is a SHA-256 hash of the compiler build and
+// its configuration, the module source and the keys of its dependencies.
+// Backend outputs do not depend on the module location, so they are stored
+// right under the key:
+//
+//   <cache dir>/<key>/module.out
+//   <cache dir>/<key>/<source path hash>.meta
+//
+// Metafiles reference modules by their absolute paths, so they are only
+// reused for the same source location.
+//
+// Entries are written to temporary files and renamed into place, so
+// concurrent bonk processes never see partially written artifacts. Least
+// recently used entries are evicted when the cache grows past its size limit.
+class CompilationCache {
+  public:
+    struct ModuleKey {
+        // Hex SHA-256 digest, a collision would restore another module
+        std::string hash;
+        std::vector<std::filesystem::path> dependencies;
+    };
+
+    // Bump when the format of cached artifacts changes
+    static constexpr uint32_t version = 1;
+    static constexpr uint64_t default_size_limit = 512ull * 1024 * 1024;
+
+    CompilationCache(std::filesystem::path directory, std::string configuration,
+                     uint64_t size_limit = default_size_limit);
+    ~CompilationCache();
+
+    // Creates a cache in BONK_CACHE_DIR, limited to BONK_CACHE_SIZE megabytes.
+    // Returns nullptr if BONK_CACHE_DIR is not set.
+    static std::unique_ptr<CompilationCache> from_environment(std::string configuration);
+
+    // Backend outputs that contain source paths (e.g. debug info)
+    // should not be shared between different locations
+    bool path_dependent_outputs = false;
+
+    const std::string& get_configuration() const {
+        return configuration;
+    }
+
+    const ModuleKey* get_module_key(const std::filesystem::path& source_path) const;
+    const ModuleKey& set_module_key(const std::filesystem::path& source_path, ModuleKey key);
+
+    bool restore_output(const ModuleKey& key, const std::filesystem::path& source_path,
+                        const std::filesystem::path& output_path);
+    void store_output(const ModuleKey& key, const std::filesystem::path& source_path,
+                      const std::filesystem::path& output_path);
+
+    std::optional<std::string> find_metadata(const ModuleKey& key,
+                                             const std::filesystem::path& source_path);
+    void store_metadata(const ModuleKey& key, const std::filesystem::path& source_path,
+                        const std::filesystem::path& meta_path);
+
+    // Evicts least recently used entries until the cache fits into its size limit
+    void trim();
+
+  private:
+    std::filesystem::path get_entry_path(const ModuleKey& key) const;
+    std::filesystem::path get_output_entry_path(const ModuleKey& key,
+                                                const std::filesystem::path& source_path) const;
+    std::filesystem::path get_metadata_entry_path(const ModuleKey& key,
+                                                  const std::filesystem::path& source_path) const;
+
+    void touch(const std::filesystem::path& entry_path);
+
+    std::filesystem::path directory;
+    std::string configuration;
+    uint64_t size_limit;
+    bool has_stored_entries = false;
+
+    std::unordered_map<std::string, ModuleKey> module_keys;
+};
+
+} // namespace bonk
@@ -1,5 +1,8 @@
 
 #include "compiler.hpp"
+#include "build_report.hpp"
+#include "compilation_cache.hpp"
+#include "bonk/frontend/metadata/metadata_archive.hpp"
 
 namespace bonk {
 
@@ -9,6 +12,8 @@ Compiler::Compiler() : config() {
 Compiler::Compiler(const CompilerConfig& config) : config(config) {
 }
 
+Compiler::~Compiler() = default;
+
 void Compiler::report_project_file(std::string_view path) {
     output_files.insert(std::string(path));
 }
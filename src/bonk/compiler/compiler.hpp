@@ -5,10 +5,14 @@ namespace bonk {
 struct Compiler;
 struct CompilerConfig;
 struct Parser;
+class MetadataArchive;
+class CompilationCache;
+class BuildReport;
 
 } // namespace bonk
 
 #include <cstdio>
+#include <memory>
 #include <ostream>
 #include <sstream>
 #include <unordered_set>
@@ -32,9 +36,19 @@ struct Compiler {
     std::unordered_set<std::string> updated_files;
     std::unordered_set<std::string> output_files;
 
+    // Prebuilt library interfaces, consulted by the help resolver
+    // before looking for metafiles on the filesystem
+    std::vector<std::unique_ptr<MetadataArchive>> metadata_archives;
+
+    // Shared cache of compiled modules, if enabled with BONK_CACHE_DIR
+    std::unique_ptr<CompilationCache> compilation_cache;
+
+    // Records why modules were rebuilt, if requested with --explain
+    std::unique_ptr<BuildReport> build_report;
+
     Compiler();
     Compiler(const CompilerConfig& config);
-    ~Compiler() = default;
+    ~Compiler();
 
     CompilerMessageStreamProxy error();
     CompilerMessageStreamProxy warning() const;
@@ -0,0 +1,260 @@
+
+#include "build_driver.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unordered_map>
+#include "utils/hash.hpp"
+
+extern char** environ;
+
+// Stamps store the hash of the inputs an artifact was last built from
+static std::optional<std::string> read_build_stamp(const std::filesystem::path& stamp_path) {
+    std::ifstream stamp{stamp_path};
+    std::string hash;
+    if (!(stamp >> hash)) {
+        return std::nullopt;
+    }
+    return hash;
+}
+
+static void write_build_stamp(const std::filesystem::path& stamp_path, const std::string& hash) {
+    std::ofstream stamp{stamp_path, std::ios::trunc};
+    stamp << hash << "\n";
+}
+
+static bool hash_file(bonk::FNVHasher& hasher, const std::filesystem::path& path) {
+    std::ifstream file{path, std::ios::binary};
+    if (!file.is_open()) {
+        return false;
+    }
+
+    char buffer[4096];
+    while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
+        hasher.update(std::string_view(buffer, file.gcount()));
+    }
+    return true;
+}
+
+bonk::BuildDriver::BuildDriver(bonk::Compiler& compiler, bonk::BuildDriverConfig config)
+    : compiler(compiler), config(std::move(config)) {
+}
+
+bool bonk::BuildDriver::build() {
+    std::vector<std::string> output_files(compiler.output_files.begin(),
+                                          compiler.output_files.end());
+    std::sort(output_files.begin(), output_files.end());
+
+    std::vector<ModuleJob> jobs;
+    std::vector<std::filesystem::path> objects;
+
+    FNVHasher link_hasher;
+
+    for (auto& output_file : output_files) {
+        ModuleJob job;
+        job.output_path = output_file;
+        job.assembly_path = std::filesystem::path(output_file).replace_extension(".s");
+        job.object_path = std::filesystem::path(output_file).replace_extension(".o");
+        job.hash = get_module_hash(job.output_path);
+
+        if (job.hash.empty()) {
+            compiler.fatal_error() << "cannot read " << output_file;
+            return false;
+        }
+
+        objects.push_back(job.object_path);
+        link_hasher.update(job.hash);
+
+        auto stamp_path = job.object_path;
+        stamp_path += ".hash";
+
+        if (!std::filesystem::exists(job.object_path) || read_build_stamp(stamp_path) != job.hash) {
+            jobs.push_back(std::move(job));
+        }
+    }
+
+    if (!run_module_jobs(jobs)) {
+        return false;
+    }
+
+    link_hasher.update(config.cc);
+    link_hasher.update_value(config.debug);
+    link_hasher.update(config.output_path.string());
+
+    for (auto& input : config.link_inputs) {
+        link_hasher.update(input);
+        if (!hash_file(link_hasher, input)) {
+            compiler.fatal_error() << "cannot read " << input;
+            return false;
+        }
+    }
+
+    return link(objects, FNVHasher::to_hex(link_hasher.digest()));
+}
+
+std::string bonk::BuildDriver::get_module_hash(const std::filesystem::path& output_path) {
+    FNVHasher hasher;
+    if (!hash_file(hasher, output_path)) {
+        return "";
+    }
+    hasher.update(config.qbe);
+    hasher.update(config.cc);
+    hasher.update_value(config.debug);
+    return FNVHasher::to_hex(hasher.digest());
+}
+
+std::vector<std::string> bonk::BuildDriver::get_stage_command(const ModuleJob& job) {
+    if (job.stage == 0) {
+        return {config.qbe, "-o", job.assembly_path.string(), job.output_path.string()};
+    }
+
+    std::vector<std::string> command{config.cc, "-c"};
+    if (config.debug) {
+        command.emplace_back("-g");
+    }
+    command.insert(command.end(), {"-o", job.object_path.string(), job.assembly_path.string()});
+    return command;
+}
+
+bool bonk::BuildDriver::run_module_jobs(std::vector<ModuleJob>& jobs) {
+    constexpr int stage_count = 2;
+
+    std::unordered_map<pid_t, ModuleJob*> running;
+    size_t next_job = 0;
+    bool failed = false;
+
+    while (true) {
+        while (!failed && next_job < jobs.size() && running.size() < config.jobs) {
+            auto& job = jobs[next_job++];
+            auto pid = spawn(get_stage_command(job));
+            if (!pid) {
+                failed = true;
+                break;
+            }
+            running[*pid] = &job;
+        }
+
+        if (running.empty()) {
+            break;
+        }
+
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, 0);
+
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            compiler.fatal_error() << "waitpid failed: " << strerror(errno);
+
+            // Don't leave the tools running after the build has given up
+            for (auto& running_job : running) {
+                kill(running_job.first, SIGKILL);
+                wait_for(running_job.first);
+            }
+            return false;
+        }
+
+        auto it = running.find(pid);
+        if (it == running.end()) {
+            continue;
+        }
+
+        auto& job = *it->second;
+        running.erase(it);
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            // Let the jobs that are already running finish, but don't start new ones
+            compiler.error() << "failed to compile " << job.output_path.string();
+            failed = true;
+            continue;
+        }
+
+        job.stage++;
+
+        if (job.stage == stage_count) {
+            auto stamp_path = job.object_path;
+            stamp_path += ".hash";
+            write_build_stamp(stamp_path, job.hash);
+            continue;
+        }
+
+        if (failed) {
+            continue;
+        }
+
+        auto next_pid = spawn(get_stage_command(job));
+        if (!next_pid) {
+            failed = true;
+            continue;
+        }
+        running[*next_pid] = &job;
+    }
+
+    return !failed;
+}
+
+bool bonk::BuildDriver::link(const std::vector<std::filesystem::path>& objects,
+                             const std::string& link_hash) {
+    auto stamp_path = config.stamp_directory / (config.output_path.filename().string() + ".link");
+
+    if (std::filesystem::exists(config.output_path) && read_build_stamp(stamp_path) == link_hash) {
+        return true;
+    }
+
+    if (config.output_path.has_parent_path()) {
+        std::filesystem::create_directories(config.output_path.parent_path());
+    }
+
+    std::vector<std::string> command{config.cc};
+    if (config.debug) {
+        command.emplace_back("-g");
+    }
+    for (auto& object : objects) {
+        command.push_back(object.string());
+    }
+    command.insert(command.end(), config.link_inputs.begin(), config.link_inputs.end());
+    command.insert(command.end(), {"-o", config.output_path.string()});
+
+    auto pid = spawn(command);
+    if (!pid || !wait_for(*pid)) {
+        compiler.error() << "failed to link " << config.output_path.string();
+        return false;
+    }
+
+    std::filesystem::create_directories(config.stamp_directory);
+    write_build_stamp(stamp_path, link_hash);
+    return true;
+}
+
+std::optional<pid_t> bonk::BuildDriver::spawn(const std::vector<std::string>& arguments) {
+    std::vector<char*> argv;
+    for (auto& argument : arguments) {
+        argv.push_back(const_cast<char*>(argument.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = 0;
+    int error = posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ);
+
+    if (error != 0) {
+        compiler.fatal_error() << "cannot run " << arguments[0] << ": " << strerror(error);
+        return std::nullopt;
+    }
+
+    return pid;
+}
+
+bool bonk::BuildDriver::wait_for(pid_t pid) {
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
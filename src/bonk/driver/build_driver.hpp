@@ -0,0 +1,57 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+#include "bonk/compiler/compiler.hpp"
+
+namespace bonk {
+
+struct BuildDriverConfig {
+    // Linked along with the compiled modules (C sources, objects, libraries)
+    std::vector<std::string> link_inputs;
+    std::filesystem::path output_path;
+    std::filesystem::path stamp_directory;
+
+    std::string qbe = "qbe";
+    std::string cc = "cc";
+    size_t jobs = 1;
+    bool debug = false;
+};
+
+// Turns the backend outputs reported in Compiler::output_files into an
+// executable. Each module goes through qbe and the assembler, modules are
+// processed concurrently. Modules whose output did not change since the
+// last build are skipped, which is detected by content hashes rather than
+// timestamps. Tools are spawned directly, without a shell.
+class BuildDriver {
+  public:
+    BuildDriver(Compiler& compiler, BuildDriverConfig config);
+
+    bool build();
+
+  private:
+    struct ModuleJob {
+        std::filesystem::path output_path;
+        std::filesystem::path assembly_path;
+        std::filesystem::path object_path;
+        std::string hash;
+        int stage = 0;
+    };
+
+    std::string get_module_hash(const std::filesystem::path& output_path);
+    std::vector<std::string> get_stage_command(const ModuleJob& job);
+
+    bool run_module_jobs(std::vector<ModuleJob>& jobs);
+    bool link(const std::vector<std::filesystem::path>& objects, const std::string& link_hash);
+
+    std::optional<pid_t> spawn(const std::vector<std::string>& arguments);
+    bool wait_for(pid_t pid);
+
+    Compiler& compiler;
+    BuildDriverConfig config;
+};
+
+} // namespace bonk
@@ -1,5 +1,6 @@
 
 #include "bonk/frontend/annotators/type_inferring.hpp"
+#include <algorithm>
 #include "bonk/frontend/frontend.hpp"
 #include "bonk/compiler/compiler.hpp"
 #include "bonk/frontend/help_resolver/help_resolver.hpp"
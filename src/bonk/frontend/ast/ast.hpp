@@ -149,6 +149,10 @@ struct TreeNodeBlockDefinition : TreeNode {
     std::unique_ptr<TreeNodeCodeBlock> body{};
     std::unique_ptr<TreeNode> return_type{};
 
+    // Set for 'flat blok' definitions. Bodies of flat bloks are
+    // exported to metafiles, so they can be inlined into other modules
+    bool is_flat = false;
+
     TreeNodeBlockDefinition() {
         type = TreeNodeType::n_block_definition;
     }
@@ -161,6 +165,7 @@ struct TreeNodeBlockDefinition : TreeNode {
         callback(block_parameters, "block_parameters");
         callback(body, "body");
         callback(return_type, "return_type");
+        callback(is_flat, "is_flat");
     }
 };
 
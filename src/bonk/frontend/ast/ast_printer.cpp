@@ -12,6 +12,9 @@ void bonk::ASTPrinter::visit(TreeNodeIdentifier* node) {
 }
 
 void bonk::ASTPrinter::visit(TreeNodeBlockDefinition* node) {
+    if (node->is_flat) {
+        stream.get_stream() << "flat ";
+    }
     stream.get_stream() << "blok ";
     node->block_name->accept(this);
     if (node->block_parameters) {
@@ -34,6 +34,10 @@ void bonk::BinaryImportMainStageCallback::operator()(bonk::TreeNodeType& value,
     // Do nothing, as tree node type has already been read by the read_node function
     // (it's guaranteed to be the first field in the node)
 }
+
+void bonk::BinaryImportMainStageCallback::operator()(bool& value, std::string_view) {
+    value = context.stream.get_stream().get() != 0;
+}
 std::unique_ptr<bonk::TreeNode> bonk::BinaryImportMainStageCallback::read_node() {
     TreeNodeType type;
 
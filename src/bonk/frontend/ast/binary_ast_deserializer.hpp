@@ -40,6 +40,7 @@ class BinaryImportMainStageCallback {
     void operator()(std::string_view& value, std::string_view);
     void operator()(std::string& value, std::string_view);
     void operator()(TreeNodeType& value, std::string_view);
+    void operator()(bool& value, std::string_view);
 
     template <typename T> void operator()(std::unique_ptr<T>& value, std::string_view) {
         char is_present = 0;
@@ -27,6 +27,10 @@ void bonk::BinaryExportMainStageCallback::operator()(TreeNodeType& value, std::s
     context.stream.get_stream().write((char*)&value, sizeof(value));
 }
 
+void bonk::BinaryExportMainStageCallback::operator()(bool& value, std::string_view) {
+    context.stream.get_stream() << (char)value;
+}
+
 void bonk::BinaryExportContext::register_string(std::string_view value) {
     if(value.size() < sizeof(unsigned long) - 1) {
         return;
@@ -39,6 +39,7 @@ class BinaryExportMainStageCallback {
     void operator()(bonk::ParserPosition& value, std::string_view);
     void operator()(std::string_view value, std::string_view);
     void operator()(TreeNodeType& value, std::string_view);
+    void operator()(bool& value, std::string_view);
 
     template <typename T> void operator()(std::unique_ptr<T>& value, std::string_view) {
         if (value) {
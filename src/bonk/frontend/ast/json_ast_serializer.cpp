@@ -101,3 +101,6 @@ void bonk::JSONASTFieldCallback::operator()(TreeNodeType& value, std::string_vie
         break;
     }
 }
+void bonk::JSONASTFieldCallback::operator()(bool& value, std::string_view name) {
+    serializer.field(name).block_number_field(value);
+}
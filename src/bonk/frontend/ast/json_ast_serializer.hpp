@@ -26,6 +26,7 @@ class JSONASTFieldCallback {
     void operator()(bonk::ParserPosition& value, std::string_view name);
     void operator()(std::string_view value, std::string_view name);
     void operator()(TreeNodeType& value, std::string_view name);
+    void operator()(bool& value, std::string_view name);
 
     template <typename T> void operator()(std::unique_ptr<T>& value, std::string_view name) {
         if (value) {
@@ -1,5 +1,6 @@
 
 #include "hir_early_generator_visitor.hpp"
+#include <algorithm>
 #include "bonk/frontend/annotators/basic_symbol_annotator.hpp"
 #include "bonk/frontend/annotators/type_visitor.hpp"
 #include "bonk/middleend/ir/algorithms/hir_base_block_separator.hpp"
@@ -57,10 +58,14 @@ void bonk::HIREarlyGeneratorVisitor::visit(bonk::TreeNodeBlockDefinition* node)
         }
     }
 
-    // Create parameter values (if it's necessary)
+    // Create parameter values (if it's necessary). The caller holds a reference
+    // to every argument for the whole call, so a parameter only needs its own
+    // reference if it is reassigned: reassigning releases the previous value.
     if (node->block_parameters && node->body) {
+        auto reassigned = get_reassigned_variables(node);
+
         for (auto& parameter : node->block_parameters->parameters) {
-            if (parameter) {
+            if (parameter && reassigned.count(parameter.get())) {
                 int parameter_id = front_end.id_table.get_id(parameter.get());
                 auto parameter_type = (BlokType*)front_end.type_table.get_type(parameter.get());
 
@@ -89,6 +94,40 @@ void bonk::HIREarlyGeneratorVisitor::visit(bonk::TreeNodeBlockDefinition* node)
     }
 }
 
+std::unordered_set<bonk::TreeNode*>
+bonk::HIREarlyGeneratorVisitor::get_reassigned_variables(TreeNodeBlockDefinition* node) {
+
+    std::unordered_set<TreeNode*> reassigned;
+
+    struct AssignmentVisitor : public ASTVisitor {
+        FrontEnd& front_end;
+        std::unordered_set<TreeNode*>& reassigned;
+        AssignmentVisitor(FrontEnd& front_end, std::unordered_set<TreeNode*>& reassigned)
+            : front_end(front_end), reassigned(reassigned) {
+        }
+
+        void visit(TreeNodeBinaryOperation* node) override {
+            ASTVisitor::visit(node);
+            if (node->operator_type != OperatorType::o_assign ||
+                node->left->type != TreeNodeType::n_identifier) {
+                return;
+            }
+            auto& definition = front_end.symbol_table.symbol_definitions[node->left.get()];
+            if (definition.is_local()) {
+                reassigned.insert(definition.get_local().definition);
+            }
+        }
+    };
+
+    AssignmentVisitor assignment_visitor(front_end, reassigned);
+
+    if (node->body) {
+        node->body->accept(&assignment_visitor);
+    }
+
+    return reassigned;
+}
+
 void bonk::HIREarlyGeneratorVisitor::visit(bonk::TreeNodeVariableDefinition* node) {
     write_location(node);
 
@@ -709,9 +748,36 @@ std::unique_ptr<bonk::HIRProgram> bonk::HIREarlyGeneratorVisitor::generate(bonk:
     auto program = std::make_unique<HIRProgram>(front_end.id_table, front_end.symbol_table);
     current_program = program.get();
     ast->accept(this);
+    generate_imported_procedures();
     return program;
 }
 
+void bonk::HIREarlyGeneratorVisitor::generate_imported_procedures() {
+    // Helped modules may export bodies of their bloks in metafiles. They are
+    // compiled as well, so the middle end could inline them into this module.
+    std::vector<std::pair<std::string_view, TreeNodeProgram*>> modules;
+    for (auto& [path, module] : front_end.external_modules) {
+        modules.emplace_back(path, module->module_ast.root.get());
+    }
+
+    // Keep the register numbering independent of the hash map order
+    std::sort(modules.begin(), modules.end());
+
+    for (auto& [path, module] : modules) {
+        for (auto& definition : module->body) {
+            if (definition->type != TreeNodeType::n_block_definition)
+                continue;
+
+            auto block_definition = (TreeNodeBlockDefinition*)definition.get();
+            if (!block_definition->body)
+                continue;
+
+            block_definition->accept(this);
+            current_procedure->is_imported = true;
+        }
+    }
+}
+
 bonk::HIROperationType bonk::HIREarlyGeneratorVisitor::convert_operation_to_hir(OperatorType type) {
     switch (type) {
     case OperatorType::o_plus:
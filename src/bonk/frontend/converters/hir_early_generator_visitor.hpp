@@ -1,6 +1,7 @@
 #pragma once
 
 #include <unordered_map>
+#include <unordered_set>
 #include "bonk/frontend/ast/ast_visitor.hpp"
 #include "bonk/frontend/frontend.hpp"
 #include "bonk/middleend/ir/hir.hpp"
@@ -92,6 +93,7 @@ class HIREarlyGeneratorVisitor : ASTVisitor {
     }
 
     std::unique_ptr<HIRProgram> generate(TreeNode* ast);
+    void generate_imported_procedures();
 
     HIROperationType convert_operation_to_hir(OperatorType type);
     HIRDataType convert_type_to_hir(Type* type);
@@ -119,6 +121,7 @@ class HIREarlyGeneratorVisitor : ASTVisitor {
     void visit(TreeNodeNull* node) override;
 
     void compile_lazy_logic(TreeNodeBinaryOperation* node);
+    std::unordered_set<TreeNode*> get_reassigned_variables(TreeNodeBlockDefinition* node);
 
     std::unique_ptr<HIRValue> load_value(HIRValue* value);
 
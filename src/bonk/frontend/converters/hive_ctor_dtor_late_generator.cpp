@@ -42,29 +42,20 @@ void bonk::HiveConstructorDestructorLateGenerator::fill_constructor(
 
     constructor->body = std::make_unique<TreeNodeCodeBlock>();
 
-    // Generate 'bowl object = @$$bonk_create_object[size = ...]'
+    // Generate 'bowl object = @$$bonk_create_small_object[size = ...]'
+    // or 'bowl object = @$$bonk_create_object[size = ...]' for large hives
+
+    int hive_size = front_end.get_hive_field_offset(hive, -1);
+    bool is_small = hive_size <= max_small_object_size;
 
     // First, call the library function to construct the hive
     auto call = std::make_unique<TreeNodeCall>();
     auto callee_identifier = std::make_unique<TreeNodeIdentifier>();
-    callee_identifier->identifier_text =
-        current_ast->buffer.get_symbol("$$bonk_create_object");
+    callee_identifier->identifier_text = current_ast->buffer.get_symbol(
+        is_small ? "$$bonk_create_small_object" : "$$bonk_create_object");
     call->callee = std::move(callee_identifier);
     call->arguments = std::make_unique<TreeNodeParameterList>();
-
-    auto size_parameter_name = std::make_unique<TreeNodeIdentifier>();
-    size_parameter_name->identifier_text = current_ast->buffer.get_symbol("size");
-
-    int hive_size = front_end.get_hive_field_offset(hive, -1);
-
-    auto size_placeholder_name = std::make_unique<TreeNodeNumberConstant>();
-    size_placeholder_name->contents.set_integer(hive_size);
-
-    auto size_parameter = std::make_unique<TreeNodeParameterListItem>();
-    size_parameter->parameter_value = std::move(size_placeholder_name);
-    size_parameter->parameter_name = std::move(size_parameter_name);
-
-    call->arguments->parameters.push_back(std::move(size_parameter));
+    call->arguments->parameters.push_back(create_size_parameter(hive_size));
 
     // Cast the call to the hive type
     auto cast = std::make_unique<TreeNodeCast>();
@@ -198,13 +189,18 @@ void bonk::HiveConstructorDestructorLateGenerator::fill_destructor(
     assignment->operator_type = OperatorType::o_assign;
     destructor->body->body.push_back(std::move(assignment));
 
-    // Now call the $$bonk_destroy_object function
+    // Now return the memory to the runtime. Small hives tell it their size,
+    // so it knows which pool the memory belongs to.
+
+    // @$$bonk_small_object_free[object = addr, size = ...]
+    // or @$$bonk_object_free[object = addr] for large hives
+    int hive_size = front_end.get_hive_field_offset(hive, -1);
+    bool is_small = hive_size <= max_small_object_size;
 
-    // @$$bonk_object_free[object = addr]
     auto call = std::make_unique<TreeNodeCall>();
     auto callee_identifier = std::make_unique<TreeNodeIdentifier>();
-    callee_identifier->identifier_text =
-        current_ast->buffer.get_symbol("$$bonk_object_free");
+    callee_identifier->identifier_text = current_ast->buffer.get_symbol(
+        is_small ? "$$bonk_small_object_free" : "$$bonk_object_free");
     call->callee = std::move(callee_identifier);
     call->arguments = std::make_unique<TreeNodeParameterList>();
 
@@ -222,6 +218,10 @@ void bonk::HiveConstructorDestructorLateGenerator::fill_destructor(
 
     call->arguments->parameters.push_back(std::move(size_parameter));
 
+    if (is_small) {
+        call->arguments->parameters.push_back(create_size_parameter(hive_size));
+    }
+
     destructor->body->body.push_back(std::move(call));
 
     // Now, the destructor body should be annotated properly
@@ -234,3 +234,19 @@ void bonk::HiveConstructorDestructorLateGenerator::fill_destructor(
     TypeAnnotator annotator{front_end};
     destructor->accept(&annotator);
 }
+
+std::unique_ptr<bonk::TreeNodeParameterListItem>
+bonk::HiveConstructorDestructorLateGenerator::create_size_parameter(int size) {
+    // Generate 'size = ...'
+    auto size_parameter_name = std::make_unique<TreeNodeIdentifier>();
+    size_parameter_name->identifier_text = current_ast->buffer.get_symbol("size");
+
+    auto size_value = std::make_unique<TreeNodeNumberConstant>();
+    size_value->contents.set_integer(size);
+
+    auto size_parameter = std::make_unique<TreeNodeParameterListItem>();
+    size_parameter->parameter_value = std::move(size_value);
+    size_parameter->parameter_name = std::move(size_parameter_name);
+
+    return size_parameter;
+}
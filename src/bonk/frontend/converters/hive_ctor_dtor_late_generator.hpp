@@ -10,6 +10,10 @@ class HiveConstructorDestructorLateGenerator : public ASTVisitor {
     bonk::AST* current_ast = nullptr;
 
   public:
+    // Hives of up to this many bytes are allocated from the size-class pools
+    // of the runtime. Must match BONK_MAX_SMALL_OBJECT_SIZE in bonk_stdlib.c.
+    static constexpr int max_small_object_size = 248;
+
     explicit HiveConstructorDestructorLateGenerator(FrontEnd& front_end)
         : front_end(front_end) {
     }
@@ -22,6 +26,7 @@ class HiveConstructorDestructorLateGenerator : public ASTVisitor {
 
     void fill_constructor(TreeNodeBlockDefinition* ctor, TreeNodeHiveDefinition* hive);
     void fill_destructor(TreeNodeBlockDefinition* dtor, TreeNodeHiveDefinition* hive);
+    std::unique_ptr<TreeNodeParameterListItem> create_size_parameter(int size);
 };
 
 } // namespace bonk
\ No newline at end of file
@@ -19,6 +19,17 @@ bonk::AST bonk::StdLibHeaderGenerator::generate() {
         .return_type(TrivialTypeKind::t_nubr)
         .attach(program);
 
+    generate_stdlib_function("$$bonk_create_small_object")
+        .parameter("size", TrivialTypeKind::t_nubr)
+        .return_type(TrivialTypeKind::t_long)
+        .attach(program);
+
+    generate_stdlib_function("$$bonk_small_object_free")
+        .parameter("object", TrivialTypeKind::t_long)
+        .parameter("size", TrivialTypeKind::t_nubr)
+        .return_type(TrivialTypeKind::t_nubr)
+        .attach(program);
+
     return result;
 }
 
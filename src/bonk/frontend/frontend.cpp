@@ -102,6 +102,35 @@ int bonk::FrontEnd::get_hive_field_offset(bonk::TreeNodeHiveDefinition* hive_def
     return offset;
 }
 
+bonk::TreeNodeHiveDefinition* bonk::FrontEnd::get_constructed_hive(TreeNode* blok_definition) {
+    if (!blok_definition || blok_definition->type != TreeNodeType::n_block_definition) {
+        return nullptr;
+    }
+
+    // Constructors are generated by the compiler, users cannot name their bloks like this
+    static const std::string_view suffix = "$$constructor";
+    auto name = ((TreeNodeBlockDefinition*)blok_definition)->block_name->identifier_text;
+
+    if (name.size() < suffix.size() || name.substr(name.size() - suffix.size()) != suffix) {
+        return nullptr;
+    }
+
+    auto blok_type = type_table.get_type(blok_definition);
+    if (!blok_type || blok_type->kind != TypeKind::blok) {
+        return nullptr;
+    }
+
+    auto return_type = ((BlokType*)blok_type)->return_type.get();
+    if (return_type && return_type->kind == TypeKind::external) {
+        return_type = ((ExternalType*)return_type)->get_resolved();
+    }
+    if (!return_type || return_type->kind != TypeKind::hive) {
+        return nullptr;
+    }
+
+    return ((HiveType*)return_type)->hive_definition;
+}
+
 bool bonk::FrontEnd::has_module(const std::string& name) {
     return external_modules.find(name) != external_modules.end();
 }
@@ -178,6 +178,8 @@ class FrontEnd {
     std::unique_ptr<HIRProgram> generate_hir(TreeNode* ast);
 
     int get_hive_field_offset(TreeNodeHiveDefinition* hive_definition, int field_index);
+    // Returns the hive that is constructed by the given blok, if it is a constructor
+    TreeNodeHiveDefinition* get_constructed_hive(TreeNode* blok_definition);
 
     bool has_module(const std::string& name);
     bool annotate_ast(AST& ast, SymbolScope* scope);
@@ -1,11 +1,28 @@
 
 #include "help_resolver.hpp"
+#include <fstream>
+#include "bonk/backend/procedure_output_cache.hpp"
+#include "bonk/build_id.hpp"
+#include "bonk/frontend/metadata/metadata_archive.hpp"
 #include "bonk/middleend/middleend.hpp"
+#include "utils/hash.hpp"
 
 std::filesystem::path bonk::HelpResolver::get_output_path(const std::filesystem::path& path) {
     return path.parent_path() / ".bscache" / (path.stem().string() + ".out");
 }
 
+std::filesystem::path
+bonk::HelpResolver::get_procedure_cache_path(const std::filesystem::path& path) {
+    return path.parent_path() / ".bscache" / (path.stem().string() + ".procs");
+}
+
+// The backend options the output was compiled with, so that changing them
+// rebuilds the module instead of linking outputs compiled in different modes
+std::filesystem::path
+bonk::HelpResolver::get_output_options_path(const std::filesystem::path& path) {
+    return path.parent_path() / ".bscache" / (path.stem().string() + ".options");
+}
+
 bonk::HelpResolver::HelpResolver(bonk::Compiler& compiler) : compiler(compiler) {
 }
 
@@ -31,18 +48,44 @@ std::unique_ptr<bonk::SourceMetadata>
 bonk::HelpResolver::get_recent_metadata_for_source(const std::filesystem::path& path) {
     assert(path.is_absolute());
 
-    auto output_path = HelpResolver::get_output_path(path);
-    compiler.report_project_file(output_path.string());
-
     FrontEnd nested_front_end(compiler);
     nested_front_end.module_path = path;
 
+    ModuleReport* report = nullptr;
+    if (compiler.build_report) {
+        report = compiler.build_report->begin_module(path);
+    }
+
+    // Modules from metadata archives are prebuilt libraries. They are never
+    // rebuilt and their objects are linked separately, so they are not
+    // reported as project files.
+    if (auto archived_metadata = get_archived_metadata(nested_front_end, path)) {
+        if (report) {
+            report->verdict = ModuleVerdict::archived;
+        }
+        return archived_metadata;
+    }
+
+    auto output_path = HelpResolver::get_output_path(path);
+    compiler.report_project_file(output_path.string());
+
     bool all_dependencies_are_good = true;
 
     auto metadata = std::make_unique<SourceMetadata>(nested_front_end, path);
 
     bool should_update_metadata = !std::filesystem::exists(output_path);
 
+    if (should_update_metadata && report) {
+        report->set_reason(RebuildReason::output_missing);
+    }
+
+    if (!should_update_metadata && !output_options_match(path)) {
+        should_update_metadata = true;
+        if (report) {
+            report->set_reason(RebuildReason::options_changed);
+        }
+    }
+
     if (!should_update_metadata && metadata->metadata_is_newer_than_source()) {
         auto meta_ast = metadata->get_meta_ast();
 
@@ -54,11 +97,14 @@ bonk::HelpResolver::get_recent_metadata_for_source(const std::filesystem::path&
         for (auto& statement : meta_ast_program->help_statements) {
 
             auto help_string = statement->string->string_value;
-            auto dependency_path = canonical(path.parent_path() /= help_string);
+            auto dependency_path = weakly_canonical(path.parent_path() /= help_string);
 
-            if (!std::filesystem::exists(dependency_path)) {
+            if (!module_exists(dependency_path)) {
                 file_not_found(statement.get(), help_string);
                 all_dependencies_are_good = false;
+                if (report) {
+                    report->set_reason(RebuildReason::dependency_missing, help_string);
+                }
                 continue;
             }
 
@@ -66,21 +112,41 @@ bonk::HelpResolver::get_recent_metadata_for_source(const std::filesystem::path&
 
             if(!dependency_metadata) {
                 all_dependencies_are_good = false;
+                if (report) {
+                    report->set_reason(RebuildReason::dependency_failed, dependency_path);
+                }
                 continue;
             }
 
             if (!metadata->is_up_to_date_for(*dependency_metadata)) {
                 should_update_metadata = true;
+                if (report) {
+                    report->set_reason(RebuildReason::dependency_changed, dependency_path);
+                }
             }
         }
     } else {
         should_update_metadata = true;
+        if (report) {
+            report->set_reason(RebuildReason::metadata_outdated);
+        }
     }
 
     if (!should_update_metadata) {
         return metadata;
     }
 
+    if (restore_from_cache(*metadata, path)) {
+        if (report) {
+            report->verdict = ModuleVerdict::restored_from_cache;
+        }
+        return metadata;
+    }
+
+    if (report) {
+        report->verdict = ModuleVerdict::failed;
+    }
+
     // Need a nested resolver here, because otherwise
     // this->sources and this->filenames will be populated
     // with all the sources of the project tree. These fields
@@ -102,13 +168,184 @@ bonk::HelpResolver::get_recent_metadata_for_source(const std::filesystem::path&
         return nullptr;
     }
 
-    if(!metadata->rebuild_metadata_ast(ast->root.get())) {
-        return nullptr;
+    {
+        BuildPhaseTimer timer(report, BuildPhase::frontend);
+        if (!metadata->rebuild_metadata_ast(ast->root.get())) {
+            return nullptr;
+        }
+    }
+
+    if (report) {
+        report->verdict = ModuleVerdict::rebuilt;
+    }
+
+    if (auto cache = compiler.compilation_cache.get()) {
+        if (auto key = get_module_key(path)) {
+            cache->store_metadata(*key, path, SourceMetadata::get_meta_path(path));
+        }
     }
 
     return metadata;
 }
 
+const bonk::CompilationCache::ModuleKey*
+bonk::HelpResolver::get_module_key(const std::filesystem::path& path) {
+    auto cache = compiler.compilation_cache.get();
+
+    if (auto key = cache->get_module_key(path)) {
+        return key;
+    }
+
+    SHA256Hasher hasher;
+    hasher.update_value(CompilationCache::version);
+    hasher.update(BONK_BUILD_ID);
+    hasher.update(cache->get_configuration());
+
+    for (auto& archive : compiler.metadata_archives) {
+        if (auto contents = archive->find(path)) {
+            hasher.update(*contents);
+            return &cache->set_module_key(path, {SHA256Hasher::to_hex(hasher.digest()), {}});
+        }
+    }
+
+    bonk::Buffer buffer;
+    auto source = get_source(buffer, path);
+    if (!source) {
+        return nullptr;
+    }
+
+    hasher.update_value(source->size());
+    hasher.update(*source);
+
+    // Only the help statements are needed here. Errors are not reported,
+    // the module will be parsed again if it has to be compiled anyway.
+    Compiler quiet_compiler;
+    std::string filename = path.string();
+    auto lexemes = bonk::Lexer(quiet_compiler).parse_file(filename, *source);
+    if (lexemes.empty()) {
+        return nullptr;
+    }
+
+    auto ast = bonk::Parser(quiet_compiler).parse_file(&lexemes);
+    if (!ast) {
+        return nullptr;
+    }
+
+    CompilationCache::ModuleKey key{};
+
+    for (auto& help_statement : ast->help_statements) {
+        auto help_string = help_statement->string->string_value;
+        auto dependency_path = std::filesystem::absolute(path.parent_path() / help_string);
+
+        if (!module_exists(dependency_path)) {
+            return nullptr;
+        }
+
+        auto dependency_key = get_module_key(dependency_path);
+        if (!dependency_key) {
+            return nullptr;
+        }
+
+        hasher.update(help_string);
+        hasher.update(dependency_key->hash);
+        key.dependencies.push_back(dependency_path);
+    }
+
+    key.hash = SHA256Hasher::to_hex(hasher.digest());
+    return &cache->set_module_key(path, std::move(key));
+}
+
+bool bonk::HelpResolver::restore_from_cache(SourceMetadata& metadata,
+                                            const std::filesystem::path& path) {
+    auto cache = compiler.compilation_cache.get();
+    if (!cache) {
+        return false;
+    }
+
+    auto key = get_module_key(path);
+    if (!key) {
+        return false;
+    }
+
+    auto report = get_module_report(path);
+    if (report) {
+        report->cache_lookups++;
+    }
+
+    auto cached_metadata = cache->find_metadata(*key, path);
+    if (!cached_metadata) {
+        return false;
+    }
+
+    // Dependencies still have to be built and reported as project files
+    for (auto& dependency_path : key->dependencies) {
+        if (!get_recent_metadata_for_source(dependency_path)) {
+            return false;
+        }
+    }
+
+    if (!cache->restore_output(*key, path, get_output_path(path))) {
+        return false;
+    }
+    write_output_options(path);
+
+    if (!metadata.restore_metadata(*cached_metadata)) {
+        return false;
+    }
+
+    if (report) {
+        report->cache_hits++;
+    }
+    return true;
+}
+
+bonk::ModuleReport* bonk::HelpResolver::get_module_report(const std::filesystem::path& path) {
+    if (!compiler.build_report) {
+        return nullptr;
+    }
+    return compiler.build_report->find_module(path);
+}
+
+bool bonk::HelpResolver::module_exists(const std::filesystem::path& path) {
+    // Libraries may be shipped as an archive without their sources
+    for (auto& archive : compiler.metadata_archives) {
+        if (archive->find(path)) {
+            return true;
+        }
+    }
+
+    return std::filesystem::exists(path);
+}
+
+bool bonk::HelpResolver::output_options_match(const std::filesystem::path& path) {
+    std::ifstream options_file{get_output_options_path(path)};
+    std::string options;
+    if (!std::getline(options_file, options)) {
+        return false;
+    }
+    return options == compiler.backend->get_output_options();
+}
+
+void bonk::HelpResolver::write_output_options(const std::filesystem::path& path) {
+    std::ofstream options_file{get_output_options_path(path), std::ios::trunc};
+    options_file << compiler.backend->get_output_options() << "\n";
+}
+
+std::unique_ptr<bonk::SourceMetadata>
+bonk::HelpResolver::get_archived_metadata(FrontEnd& front_end, const std::filesystem::path& path) {
+    for (auto& archive : compiler.metadata_archives) {
+        auto contents = archive->find(path);
+        if (!contents) {
+            continue;
+        }
+
+        return std::make_unique<SourceMetadata>(front_end, path, *contents,
+                                                archive->get_write_time());
+    }
+
+    return nullptr;
+}
+
 std::optional<bonk::AST> bonk::HelpResolver::get_ast(const std::filesystem::path& file_path) {
     bonk::Buffer buffer;
 
@@ -140,7 +377,14 @@ std::optional<bonk::AST> bonk::HelpResolver::get_transformed_ast(bonk::FrontEnd&
                                                   const std::filesystem::path& file_path) {
     front_end.module_path = file_path;
 
-    auto ast = get_ast(file_path);
+    auto report = get_module_report(file_path);
+
+    std::optional<AST> ast;
+    {
+        BuildPhaseTimer timer(report, BuildPhase::parsing);
+        ast = get_ast(file_path);
+    }
+
     if (!ast) {
         return std::nullopt;
     }
@@ -149,7 +393,7 @@ std::optional<bonk::AST> bonk::HelpResolver::get_transformed_ast(bonk::FrontEnd&
         auto path = file_path.parent_path() /= help_statement->string->string_value;
         auto absolute_path = std::filesystem::absolute(path);
 
-        if (!std::filesystem::exists(absolute_path)) {
+        if (!module_exists(absolute_path)) {
             file_not_found(help_statement.get(), help_statement->string->string_value);
             continue;
         }
@@ -164,8 +408,11 @@ std::optional<bonk::AST> bonk::HelpResolver::get_transformed_ast(bonk::FrontEnd&
         front_end.add_external_module(absolute_path, std::move(*metafile).to_ast());
     }
 
-    if (!front_end.transform_ast(ast.value())) {
-        return std::nullopt;
+    {
+        BuildPhaseTimer timer(report, BuildPhase::frontend);
+        if (!front_end.transform_ast(ast.value())) {
+            return std::nullopt;
+        }
     }
 
     auto absolute_file_path = std::filesystem::absolute(file_path);
@@ -183,17 +430,64 @@ bool bonk::HelpResolver::compile_file(const std::filesystem::path& file_path) {
 void bonk::HelpResolver::recompile_file(bonk::FrontEnd& front_end,
                                         const std::filesystem::path& path,
                                         bonk::TreeNodeProgram* ast) {
-    auto hir = front_end.generate_hir(ast);
+    std::filesystem::path output_path = get_output_path(path);
+
+    auto report = get_module_report(path);
+    auto cache = compiler.compilation_cache.get();
+    auto key = cache ? get_module_key(path) : nullptr;
+
+    if (key) {
+        bool restored = cache->restore_output(*key, path, output_path);
+        if (report) {
+            report->cache_lookups++;
+            report->cache_hits += restored;
+        }
+        if (restored) {
+            write_output_options(path);
+            return;
+        }
+    }
+
+    std::unique_ptr<HIRProgram> hir;
+    {
+        BuildPhaseTimer timer(report, BuildPhase::hir_generation);
+        hir = front_end.generate_hir(ast);
+    }
+
     if (!hir)
         return;
 
-    if(!bonk::MiddleEnd(compiler).do_passes(*hir))
-        return;
+    {
+        BuildPhaseTimer timer(report, BuildPhase::middle_end);
+        if (!bonk::MiddleEnd(compiler).do_passes(*hir))
+            return;
+    }
 
-    std::filesystem::path output_path = get_output_path(path);
     std::filesystem::create_directories(output_path.parent_path());
-    bonk::FileOutputStream output_file(output_path.string());
-    compiler.backend->compile_program(*hir, output_file);
+
+    {
+        BuildPhaseTimer timer(report, BuildPhase::backend);
+
+        ProcedureOutputCache procedure_cache{get_procedure_cache_path(path)};
+        compiler.backend->procedure_cache = &procedure_cache;
+
+        bonk::FileOutputStream output_file(output_path.string());
+        compiler.backend->compile_program(*hir, output_file);
+
+        compiler.backend->procedure_cache = nullptr;
+        procedure_cache.write();
+
+        if (report) {
+            report->procedures_reused += procedure_cache.get_hit_count();
+            report->procedures_compiled += procedure_cache.get_miss_count();
+        }
+    }
+
+    write_output_options(path);
+
+    if (key) {
+        cache->store_output(*key, path, output_path);
+    }
 }
 
 void bonk::HelpResolver::file_not_found(bonk::TreeNode* node, const std::filesystem::path& path) {
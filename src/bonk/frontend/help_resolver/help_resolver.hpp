@@ -3,6 +3,8 @@
 #include <filesystem>
 #include <iostream>
 #include <string>
+#include "bonk/compiler/build_report.hpp"
+#include "bonk/compiler/compilation_cache.hpp"
 #include "bonk/compiler/compiler.hpp"
 #include "bonk/frontend/frontend.hpp"
 #include "bonk/frontend/metadata/metadata.hpp"
@@ -19,10 +21,25 @@ class HelpResolver {
     get_recent_metadata_for_source(const std::filesystem::path& path);
 
     static std::filesystem::path get_output_path(const std::filesystem::path& path);
+    static std::filesystem::path get_procedure_cache_path(const std::filesystem::path& path);
+    static std::filesystem::path get_output_options_path(const std::filesystem::path& path);
 
   private:
     Compiler& compiler;
 
+    bool module_exists(const std::filesystem::path& path);
+
+    bool output_options_match(const std::filesystem::path& path);
+    void write_output_options(const std::filesystem::path& path);
+
+    const CompilationCache::ModuleKey* get_module_key(const std::filesystem::path& path);
+    bool restore_from_cache(SourceMetadata& metadata, const std::filesystem::path& path);
+
+    ModuleReport* get_module_report(const std::filesystem::path& path);
+
+    std::unique_ptr<SourceMetadata> get_archived_metadata(FrontEnd& front_end,
+                                                          const std::filesystem::path& path);
+
     std::optional<std::string_view> get_source(bonk::Buffer& buffer,
                                                const std::filesystem::path& path);
     std::optional<bonk::AST> get_ast(const std::filesystem::path& file_path);
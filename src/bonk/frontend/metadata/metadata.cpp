@@ -10,18 +10,138 @@ std::filesystem::path bonk::SourceMetadata::get_meta_path(const std::filesystem:
 
 // These structures are moved to .cpp file because they are not used outside of this file
 
+// Collects the nodes that bodies exported to the meta AST may refer to. Modules
+// that help this one only see its own definitions and the stdlib, so bodies
+// mentioning anything else (e.g. symbols of its dependencies) are not exported.
+class VisibleDefinitionCollector : public bonk::ASTFieldWalker<VisibleDefinitionCollector> {
+    std::unordered_set<bonk::TreeNode*>& definitions;
+
+  public:
+    VisibleDefinitionCollector(std::unordered_set<bonk::TreeNode*>& definitions)
+        : definitions(definitions), ASTFieldWalker(*this) {
+    }
+
+    template <typename T> void operator()(std::unique_ptr<T>& field, std::string_view) {
+        if (field)
+            collect(field.get());
+    }
+
+    template <typename T> void operator()(std::list<T>& field, std::string_view) {
+        for (auto& node : field) {
+            if (node)
+                collect(node.get());
+        }
+    }
+
+    template <typename T> void operator()(T& field, std::string_view) {
+    }
+
+    void collect_program(bonk::TreeNodeProgram* program) {
+        for (auto& definition : program->body) {
+            // Global variables are not compiled into the HIR of other modules
+            if (definition->type == bonk::TreeNodeType::n_variable_definition)
+                continue;
+            collect(definition.get());
+        }
+    }
+
+  private:
+    void collect(bonk::TreeNode* node) {
+        definitions.insert(node);
+        node->accept(this);
+    }
+};
+
+// Decides whether the blok body is small and self-contained enough to be
+// exported to the meta AST
+class ExportedBodyChecker : public bonk::ASTFieldWalker<ExportedBodyChecker> {
+    bonk::FrontEnd& front_end;
+    const std::unordered_set<bonk::TreeNode*>& visible_definitions;
+    int node_count = 0;
+    bool exportable = true;
+
+  public:
+    ExportedBodyChecker(bonk::FrontEnd& front_end,
+                        const std::unordered_set<bonk::TreeNode*>& visible_definitions)
+        : front_end(front_end), visible_definitions(visible_definitions), ASTFieldWalker(*this) {
+    }
+
+    template <typename T> void operator()(std::unique_ptr<T>& field, std::string_view) {
+        if (field)
+            check(field.get());
+    }
+
+    template <typename T> void operator()(std::list<T>& field, std::string_view) {
+        for (auto& node : field) {
+            if (node)
+                check(node.get());
+        }
+    }
+
+    template <typename T> void operator()(T& field, std::string_view) {
+    }
+
+    bool can_export(bonk::TreeNodeBlockDefinition* node, int max_node_count) {
+        node_count = 0;
+        exportable = true;
+        check(node->body.get());
+        return exportable && (node->is_flat || node_count <= max_node_count);
+    }
+
+  private:
+    void check(bonk::TreeNode* node) {
+        node_count++;
+
+        if (node->type == bonk::TreeNodeType::n_identifier) {
+            auto definition = front_end.symbol_table.get_definition(node);
+            if (definition.is_external() ||
+                (definition.is_local() &&
+                 !visible_definitions.count(definition.get_local().definition))) {
+                exportable = false;
+            }
+        }
+
+        if (auto type = front_end.type_table.get_type(node)) {
+            if (type->kind == bonk::TypeKind::external || type->kind == bonk::TypeKind::many) {
+                exportable = false;
+            } else if (type->kind == bonk::TypeKind::hive &&
+                       !visible_definitions.count(((bonk::HiveType*)type)->hive_definition)) {
+                exportable = false;
+            }
+        }
+
+        if (exportable)
+            node->accept(this);
+    }
+};
+
 class MetadataASTBuilderVisitor : public bonk::ASTCloneVisitor {
     bonk::FrontEnd& front_end;
+    std::unordered_set<bonk::TreeNode*> visible_definitions;
+    int hive_depth = 0;
 
   public:
-    MetadataASTBuilderVisitor(bonk::FrontEnd& front_end) : front_end(front_end) {
+    // Bodies of bloks not marked as 'flat' are only exported if they
+    // have at most this many nodes
+    static constexpr int max_exported_body_size = 64;
+
+    MetadataASTBuilderVisitor(bonk::FrontEnd& front_end, bonk::TreeNodeProgram* ast)
+        : front_end(front_end) {
         // Source position should be copied to the meta AST,
         // because it is used to resolve external symbols implicit imports
         copy_source_positions = true;
+
+        VisibleDefinitionCollector collector{visible_definitions};
+        collector.collect_program(ast);
+
+        if (auto stdlib = front_end.get_external_module("$$stdlib")) {
+            collector.collect_program(stdlib->module_ast.root.get());
+        }
     }
 
     void visit(bonk::TreeNodeBlockDefinition* node) override;
     void visit(bonk::TreeNodeVariableDefinition* node) override;
+    void visit(bonk::TreeNodeHiveDefinition* node) override;
 };
 
 class ASTCloneWithExternalSymbolsVisitor : public bonk::ASTCloneVisitor {
@@ -129,6 +249,12 @@ void ASTCloneWithExternalSymbolsVisitor::visit(bonk::TreeNodeIdentifier* node) {
 }
 
 void MetadataASTBuilderVisitor::visit(bonk::TreeNodeBlockDefinition* node) {
+    // Small and 'flat' bloks keep their bodies, so other modules could inline them.
+    // Changing such a body changes the metafile, so dependent modules get rebuilt.
+    bool export_body = node->body && hive_depth == 0 &&
+                       ExportedBodyChecker(front_end, visible_definitions)
+                           .can_export(node, max_exported_body_size);
+
     // Remove the body from block definition to avoid cloning it in the meta AST
     auto definition = std::move(node->body);
     node->body = nullptr;
@@ -156,6 +282,16 @@ void MetadataASTBuilderVisitor::visit(bonk::TreeNodeBlockDefinition* node) {
         auto block_type = (bonk::BlokType*)type;
         copy->return_type = bonk::TypeToASTConvertVisitor().convert(block_type->return_type.get());
     }
+
+    if (export_body) {
+        copy->body = clone(node->body.get());
+    }
+}
+
+void MetadataASTBuilderVisitor::visit(bonk::TreeNodeHiveDefinition* node) {
+    hive_depth++;
+    ASTCloneVisitor::visit(node);
+    hive_depth--;
 }
 
 void MetadataASTBuilderVisitor::visit(bonk::TreeNodeVariableDefinition* node) {
@@ -182,6 +318,16 @@ bonk::SourceMetadata::SourceMetadata(bonk::FrontEnd& front_end,
     read_metadata();
 }
 
+bonk::SourceMetadata::SourceMetadata(bonk::FrontEnd& front_end,
+                                     const std::filesystem::path& source_path,
+                                     std::string_view archived_contents,
+                                     std::filesystem::file_time_type check_date)
+    : source_path(source_path), front_end(front_end) {
+    meta_path = get_meta_path(source_path);
+    this->check_date = check_date;
+    parse_metadata(archived_contents);
+}
+
 bool bonk::SourceMetadata::is_up_to_date_for(const bonk::SourceMetadata& other) {
     if (!meta_ast.root)
         return false;
@@ -193,7 +339,7 @@ bool bonk::SourceMetadata::rebuild_metadata_ast(bonk::TreeNodeProgram* ast) {
 
     // Create header AST and move all the identifier strings to its
     // buffer, so it becomes independent of the original AST
-    meta_ast.root = MetadataASTBuilderVisitor(front_end).clone(ast);
+    meta_ast.root = MetadataASTBuilderVisitor(front_end, ast).clone(ast);
     MetadataASTStringMoveVisitor(meta_ast).move_strings();
 
     // Perform symbol/type annotation on the meta AST,
@@ -223,6 +369,9 @@ bool bonk::SourceMetadata::rebuild_metadata_ast(bonk::TreeNodeProgram* ast) {
         return false;
     }
 
+    // Start over, so references read from the previous metafile are not duplicated
+    type_reference_metadata = {};
+
     TypeReferenceBuilderVisitor type_reference_builder(meta_front_end, type_reference_metadata);
     meta_ast.root->accept(&type_reference_builder);
 
@@ -230,6 +379,41 @@ bool bonk::SourceMetadata::rebuild_metadata_ast(bonk::TreeNodeProgram* ast) {
     return true;
 }
 
+bool bonk::SourceMetadata::restore_metadata(std::string_view contents) {
+    if (contents.size() < sizeof(changed_date)) {
+        return false;
+    }
+
+    std::string new_metadata_contents{contents};
+
+    // The cached metafile carries the change date of whoever built it. If the
+    // interface differs from the local one, dependent modules must notice it.
+    bool interface_changed =
+        meta_file_contents.size() < sizeof(changed_date) ||
+        meta_file_contents.substr(sizeof(changed_date)) != contents.substr(sizeof(changed_date));
+
+    if (interface_changed) {
+        auto now = std::filesystem::file_time_type::clock::now();
+        std::memcpy(new_metadata_contents.data(), &now, sizeof(now));
+    } else {
+        std::memcpy(new_metadata_contents.data(), meta_file_contents.data(),
+                    sizeof(changed_date));
+    }
+
+    std::filesystem::create_directories(meta_path.parent_path());
+
+    {
+        FileOutputStream file_output_stream{meta_path.string()};
+        file_output_stream.get_stream().write(new_metadata_contents.data(),
+                                              new_metadata_contents.size());
+    }
+
+    meta_ast = {};
+    meta_file_contents = {};
+    read_metadata();
+    return meta_ast.root != nullptr;
+}
+
 bool bonk::SourceMetadata::metadata_is_newer_than_source() {
     if (!meta_ast.root)
         return false;
@@ -264,10 +448,14 @@ void bonk::SourceMetadata::read_metadata() {
     meta_file_contents = {buffer, (size_t)file_size};
     meta_file.read(buffer, meta_file_contents.size());
 
+    parse_metadata(meta_file_contents);
+}
+
+void bonk::SourceMetadata::parse_metadata(std::string_view contents) {
+    meta_file_contents = contents;
     metadata_rebuilt = false;
 
-    bonk::BufferInputStream input{
-        std::string_view(meta_file_contents.data(), meta_file_contents.size())};
+    bonk::BufferInputStream input{contents};
 
     // Read the changed_date from the beginning of the meta file
     input.get_stream().read((char*)&changed_date, sizeof(changed_date));
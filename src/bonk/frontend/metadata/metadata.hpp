@@ -26,8 +26,17 @@ class SourceMetadata {
 
     SourceMetadata(FrontEnd& front_end, const std::filesystem::path& source_path);
 
+    // Reads metadata that was packed into a metadata archive. The contents
+    // must outlive the resulting meta AST.
+    SourceMetadata(FrontEnd& front_end, const std::filesystem::path& source_path,
+                   std::string_view archived_contents, std::filesystem::file_time_type check_date);
+
     bool is_up_to_date_for(const SourceMetadata& other);
     bool rebuild_metadata_ast(TreeNodeProgram* ast);
+
+    // Replaces the metafile with contents restored from the compilation cache
+    bool restore_metadata(std::string_view contents);
+
     bool metadata_is_newer_than_source();
 
     TreeNode* get_meta_ast();
@@ -37,6 +46,7 @@ class SourceMetadata {
 
   protected:
     void read_metadata();
+    void parse_metadata(std::string_view contents);
     void write_metadata_if_needed();
 
   private:
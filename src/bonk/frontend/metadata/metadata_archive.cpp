@@ -0,0 +1,240 @@
+
+#include "metadata_archive.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "utils/hash.hpp"
+#include "utils/streams.hpp"
+
+std::optional<std::string> bonk::get_metadata_archive_key(const std::filesystem::path& root,
+                                                          const std::filesystem::path& source_path) {
+    auto relative = source_path.lexically_normal().lexically_relative(root.lexically_normal());
+
+    if (relative.empty() || *relative.begin() == "..") {
+        return std::nullopt;
+    }
+
+    return relative.generic_string();
+}
+
+std::unique_ptr<bonk::MetadataArchive>
+bonk::MetadataArchive::open(const std::filesystem::path& archive_path, std::filesystem::path root) {
+    int fd = ::open(archive_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size < (off_t)sizeof(MetadataArchiveHeader)) {
+        close(fd);
+        return nullptr;
+    }
+
+    void* mapping = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+
+    auto archive = std::unique_ptr<MetadataArchive>(new MetadataArchive());
+    archive->data = (const char*)mapping;
+    archive->size = file_stat.st_size;
+    archive->root = std::move(root);
+    archive->write_time = std::filesystem::last_write_time(archive_path);
+
+    if (!archive->validate()) {
+        return nullptr;
+    }
+
+    return archive;
+}
+
+bonk::MetadataArchive::~MetadataArchive() {
+    if (data) {
+        munmap((void*)data, size);
+    }
+}
+
+// Offsets and lengths come from the file, so the checks are written in a form
+// that cannot overflow, whatever their values are
+static bool is_within(uint64_t offset, uint64_t length, uint64_t size) {
+    return offset <= size && length <= size - offset;
+}
+
+bool bonk::MetadataArchive::validate() const {
+    auto header = (const MetadataArchiveHeader*)data;
+
+    if (memcmp(header->magic, magic, sizeof(magic)) != 0 || header->version != version) {
+        return false;
+    }
+
+    // The tables are read in place, so they must be aligned like the writer aligns them
+    if (header->buckets_offset % alignment != 0 || header->entries_offset % alignment != 0) {
+        return false;
+    }
+
+    uint64_t buckets_size = (uint64_t)header->bucket_count * sizeof(uint32_t);
+    uint64_t entries_size = (uint64_t)header->entry_count * sizeof(MetadataArchiveEntry);
+
+    if (!is_within(header->buckets_offset, buckets_size, size) ||
+        !is_within(header->entries_offset, entries_size, size) || header->bucket_count == 0) {
+        return false;
+    }
+
+    // Bucket count is always a power of two, so the probe sequence can use a mask
+    if ((header->bucket_count & (header->bucket_count - 1)) != 0) {
+        return false;
+    }
+
+    auto entries = (const MetadataArchiveEntry*)(data + header->entries_offset);
+
+    for (uint32_t i = 0; i < header->entry_count; i++) {
+        auto& entry = entries[i];
+        if (!is_within(entry.path_offset, entry.path_length, size) ||
+            !is_within(entry.meta_offset, entry.meta_size, size)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::optional<std::string_view>
+bonk::MetadataArchive::find(const std::filesystem::path& source_path) const {
+    auto key = get_metadata_archive_key(root, source_path);
+    if (!key) {
+        return std::nullopt;
+    }
+    return find_relative(*key);
+}
+
+std::optional<std::string_view> bonk::MetadataArchive::find_relative(std::string_view key) const {
+    auto header = (const MetadataArchiveHeader*)data;
+    auto buckets = (const uint32_t*)(data + header->buckets_offset);
+    auto entries = (const MetadataArchiveEntry*)(data + header->entries_offset);
+
+    uint64_t hash = FNVHasher::hash(key);
+    uint32_t mask = header->bucket_count - 1;
+
+    for (uint32_t probe = 0; probe < header->bucket_count; probe++) {
+        uint32_t entry_index = buckets[(hash + probe) & mask];
+
+        if (entry_index == empty_bucket || entry_index >= header->entry_count) {
+            return std::nullopt;
+        }
+
+        auto& entry = entries[entry_index];
+        if (entry.path_hash != hash) {
+            continue;
+        }
+
+        std::string_view path{data + entry.path_offset, entry.path_length};
+        if (path != key) {
+            continue;
+        }
+
+        return std::string_view{data + entry.meta_offset, entry.meta_size};
+    }
+
+    return std::nullopt;
+}
+
+bool bonk::MetadataArchiveWriter::add(const std::filesystem::path& source_path,
+                                      std::string meta_contents) {
+    auto key = get_metadata_archive_key(root, source_path);
+    if (!key) {
+        return false;
+    }
+
+    for (auto& entry : entries) {
+        if (entry.key == *key) {
+            entry.meta_contents = std::move(meta_contents);
+            return true;
+        }
+    }
+
+    entries.push_back({std::move(*key), std::move(meta_contents)});
+    return true;
+}
+
+static uint64_t align_offset(uint64_t offset) {
+    return (offset + bonk::MetadataArchive::alignment - 1) / bonk::MetadataArchive::alignment *
+           bonk::MetadataArchive::alignment;
+}
+
+bool bonk::MetadataArchiveWriter::write(const std::filesystem::path& archive_path) {
+    // Keep the load factor at or below one half, so probe sequences stay short
+    uint32_t bucket_count = 1;
+    while (bucket_count < entries.size() * 2) {
+        bucket_count *= 2;
+    }
+
+    MetadataArchiveHeader header{};
+    memcpy(header.magic, MetadataArchive::magic, sizeof(header.magic));
+    header.version = MetadataArchive::version;
+    header.entry_count = entries.size();
+    header.bucket_count = bucket_count;
+    header.buckets_offset = align_offset(sizeof(MetadataArchiveHeader));
+    header.entries_offset = align_offset(header.buckets_offset + bucket_count * sizeof(uint32_t));
+
+    std::vector<uint32_t> buckets(bucket_count, MetadataArchive::empty_bucket);
+    std::vector<MetadataArchiveEntry> archive_entries(entries.size());
+
+    uint64_t offset =
+        align_offset(header.entries_offset + entries.size() * sizeof(MetadataArchiveEntry));
+
+    for (uint32_t i = 0; i < entries.size(); i++) {
+        auto& entry = archive_entries[i];
+        entry.path_hash = FNVHasher::hash(entries[i].key);
+        entry.path_offset = offset;
+        entry.path_length = entries[i].key.size();
+        offset = align_offset(offset + entry.path_length);
+        entry.meta_offset = offset;
+        entry.meta_size = entries[i].meta_contents.size();
+        offset = align_offset(offset + entry.meta_size);
+
+        uint32_t bucket = entry.path_hash & (bucket_count - 1);
+        while (buckets[bucket] != MetadataArchive::empty_bucket) {
+            bucket = (bucket + 1) & (bucket_count - 1);
+        }
+        buckets[bucket] = i;
+    }
+
+    // Assemble the whole archive in memory and write it in one go. Writing to
+    // a temporary file first keeps readers from mapping a half-written archive.
+    std::string contents(offset, '\0');
+    memcpy(contents.data(), &header, sizeof(header));
+    memcpy(contents.data() + header.buckets_offset, buckets.data(),
+           buckets.size() * sizeof(uint32_t));
+    memcpy(contents.data() + header.entries_offset, archive_entries.data(),
+           archive_entries.size() * sizeof(MetadataArchiveEntry));
+
+    for (uint32_t i = 0; i < entries.size(); i++) {
+        auto& entry = archive_entries[i];
+        memcpy(contents.data() + entry.path_offset, entries[i].key.data(), entry.path_length);
+        memcpy(contents.data() + entry.meta_offset, entries[i].meta_contents.data(),
+               entry.meta_size);
+    }
+
+    auto temporary_path = archive_path;
+    temporary_path += ".tmp";
+
+    {
+        FileOutputStream output{temporary_path.string()};
+        if (!output.get_stream()) {
+            return false;
+        }
+        output.get_stream().write(contents.data(), contents.size());
+        if (!output.get_stream()) {
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary_path, archive_path, error);
+    return !error;
+}
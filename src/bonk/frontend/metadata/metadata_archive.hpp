@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace bonk {
+
+// On-disk layout of a metadata archive (.bspack):
+//
+//   MetadataArchiveHeader
+//   uint32_t buckets[bucket_count]         open-addressed hash index, entry index or empty_bucket
+//   MetadataArchiveEntry entries[entry_count]
+//   path and metafile blobs, each aligned to MetadataArchive::alignment
+//
+// Paths are stored relative to the archive root, so an archive can be moved
+// along with the library it describes. Every offset is absolute from the start
+// of the file, so the archive can be used directly from an mmap-ed region.
+
+struct MetadataArchiveHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t bucket_count;
+    uint32_t reserved;
+    uint64_t buckets_offset;
+    uint64_t entries_offset;
+};
+
+struct MetadataArchiveEntry {
+    uint64_t path_hash;
+    uint64_t path_offset;
+    uint64_t path_length;
+    uint64_t meta_offset;
+    uint64_t meta_size;
+};
+
+class MetadataArchive {
+  public:
+    static constexpr char magic[8] = {'B', 'O', 'N', 'K', 'P', 'A', 'C', 'K'};
+    static constexpr uint32_t version = 1;
+    static constexpr uint32_t empty_bucket = UINT32_MAX;
+    static constexpr uint64_t alignment = 16;
+
+    // Maps the archive into memory. Returns nullptr if the file does not exist
+    // or is not a valid archive.
+    static std::unique_ptr<MetadataArchive> open(const std::filesystem::path& archive_path,
+                                                 std::filesystem::path root);
+
+    ~MetadataArchive();
+
+    MetadataArchive(const MetadataArchive&) = delete;
+    MetadataArchive& operator=(const MetadataArchive&) = delete;
+
+    // Returns the metafile contents for the given absolute source path, if
+    // the source belongs to the archive root and was packed into it. The view
+    // stays valid for the lifetime of the archive.
+    std::optional<std::string_view> find(const std::filesystem::path& source_path) const;
+
+    const std::filesystem::path& get_root() const {
+        return root;
+    }
+
+    std::filesystem::file_time_type get_write_time() const {
+        return write_time;
+    }
+
+  private:
+    MetadataArchive() = default;
+
+    bool validate() const;
+    std::optional<std::string_view> find_relative(std::string_view key) const;
+
+    const char* data = nullptr;
+    size_t size = 0;
+    std::filesystem::path root;
+    std::filesystem::file_time_type write_time;
+};
+
+class MetadataArchiveWriter {
+  public:
+    explicit MetadataArchiveWriter(std::filesystem::path root) : root(std::move(root)) {
+    }
+
+    // Returns false if the source path is outside the archive root
+    bool add(const std::filesystem::path& source_path, std::string meta_contents);
+
+    bool write(const std::filesystem::path& archive_path);
+
+    size_t get_entry_count() const {
+        return entries.size();
+    }
+
+  private:
+    struct PendingEntry {
+        std::string key;
+        std::string meta_contents;
+    };
+
+    std::filesystem::path root;
+    std::vector<PendingEntry> entries;
+};
+
+// Archive lookup key for a source path, or std::nullopt if the source
+// is not located under the root directory
+std::optional<std::string> get_metadata_archive_key(const std::filesystem::path& root,
+                                                    const std::filesystem::path& source_path);
+
+} // namespace bonk
@@ -77,10 +77,24 @@ std::unique_ptr<TreeNodeHelp> Parser::parse_help_statement() {
 }
 
 std::unique_ptr<TreeNode> Parser::parse_definition() {
-    // Definition : BlokDefinition | VariableDefinition | HiveDefinition
+    // Definition : BlokDefinition | FlatBlokDefinition | VariableDefinition | HiveDefinition
 
     if (next_lexeme()->is(OperatorType::o_blok)) {
         return parse_blok_definition();
+    } else if (next_lexeme()->is(LexemeType::l_identifier) &&
+               std::get<IdentifierLexeme>(next_lexeme()->data).identifier == "flat") {
+        // FlatBlokDefinition : flat BlokDefinition
+        // 'flat' is not reserved, it only has a meaning in front of a definition
+        eat_lexeme();
+        if (!next_lexeme()->is(OperatorType::o_blok)) {
+            error().at(next_lexeme()->start_position) << "Expected blok definition after 'flat'";
+            return nullptr;
+        }
+        auto blok = parse_blok_definition();
+        if (blok) {
+            blok->is_flat = true;
+        }
+        return blok;
     } else if (next_lexeme()->is(OperatorType::o_bowl)) {
         return parse_variable_definition();
     } else if (next_lexeme()->is(OperatorType::o_hive)) {
@@ -46,6 +46,15 @@ bool bonk::HIRAliveVariablesFinder::walk(bonk::HIRProcedure& procedure) {
             break;
     }
 
+    in.clear();
+    in.reserve(procedure.base_blocks.size());
+
+    for (auto& block : procedure.base_blocks) {
+        in.push_back(out[block->index]);
+        in.back() -= define[block->index];
+        in.back() |= use[block->index];
+    }
+
     return true;
 }
 
@@ -87,16 +96,6 @@ bonk::DynamicBitSet bonk::HIRAliveVariablesFinder::get_out(bonk::HIRBaseBlock& b
     return new_out;
 }
 
-bonk::DynamicBitSet bonk::HIRAliveVariablesFinder::get_in(bonk::HIRBaseBlock& block) {
-    auto& block_use = use[block.index];
-    auto& block_define = define[block.index];
-    auto& block_out = out[block.index];
-
-    auto new_in = bonk::DynamicBitSet(block.procedure.used_registers, false);
-
-    new_in |= block_out;
-    new_in -= block_define;
-    new_in |= block_use;
-
-    return new_in;
+const bonk::DynamicBitSet& bonk::HIRAliveVariablesFinder::get_in(bonk::HIRBaseBlock& block) {
+    return in[block.index];
 }
@@ -11,11 +11,13 @@ class HIRAliveVariablesFinder {
     std::vector<DynamicBitSet> use;
     std::vector<DynamicBitSet> define;
     std::vector<DynamicBitSet> out;
+    // Computed once the walk is complete
+    std::vector<DynamicBitSet> in;
 
     bool walk(bonk::HIRProcedure& procedure);
 
     DynamicBitSet get_out(bonk::HIRBaseBlock& block);
-    DynamicBitSet get_in(bonk::HIRBaseBlock& block);
+    const DynamicBitSet& get_in(bonk::HIRBaseBlock& block);
 
   private:
     void update_use_define(bonk::HIRBaseBlock& block);
@@ -0,0 +1,205 @@
+
+#include "hir_constant_folder.hpp"
+#include <cstring>
+
+long long bonk::HIRConstantFolder::normalize(long long value, bonk::HIRDataType type) {
+    switch (type) {
+    case HIRDataType::byte:
+        return (int8_t)value;
+    case HIRDataType::hword:
+        return (int16_t)value;
+    case HIRDataType::word:
+        return (int32_t)value;
+    case HIRDataType::float32:
+        return (uint32_t)value;
+    default:
+        return value;
+    }
+}
+
+long long bonk::HIRConstantFolder::from_float(float value) {
+    uint32_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+long long bonk::HIRConstantFolder::from_double(double value) {
+    long long bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+float bonk::HIRConstantFolder::to_float(long long value) {
+    auto bits = (uint32_t)value;
+    float result = 0;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+double bonk::HIRConstantFolder::to_double(long long value) {
+    double result = 0;
+    memcpy(&result, &value, sizeof(result));
+    return result;
+}
+
+std::optional<long long> bonk::HIRConstantFolder::fold(const HIROperationInstruction& instruction,
+                                                       long long left,
+                                                       std::optional<long long> right) {
+    auto operand_type = instruction.operand_type;
+    auto result_type = instruction.result_type;
+
+    if (instruction.operation_type == HIROperationType::assign) {
+        return normalize(left, result_type);
+    }
+
+    if (!right.has_value()) {
+        return std::nullopt;
+    }
+
+    switch (operand_type) {
+    case HIRDataType::byte:
+    case HIRDataType::hword:
+    case HIRDataType::word:
+    case HIRDataType::dword: {
+        auto result = fold_integer(instruction.operation_type, operand_type,
+                                   normalize(left, operand_type), normalize(*right, operand_type));
+        if (!result.has_value()) {
+            return std::nullopt;
+        }
+        return normalize(*result, result_type);
+    }
+    case HIRDataType::float32:
+    case HIRDataType::float64: {
+        bool is_comparison = false;
+        double left_value =
+            operand_type == HIRDataType::float32 ? to_float(left) : to_double(left);
+        double right_value =
+            operand_type == HIRDataType::float32 ? to_float(*right) : to_double(*right);
+
+        auto result =
+            fold_float(instruction.operation_type, left_value, right_value, is_comparison);
+        if (!result.has_value()) {
+            return std::nullopt;
+        }
+
+        if (is_comparison) {
+            return normalize(*result, result_type);
+        }
+
+        // Arithmetic is folded in double precision, so that float32 results
+        // have to be rounded to match what the target would compute
+        double value = to_double(*result);
+        if (result_type == HIRDataType::float32) {
+            return from_float((float)value);
+        }
+        if (result_type == HIRDataType::float64) {
+            return from_double(value);
+        }
+        return std::nullopt;
+    }
+    default:
+        return std::nullopt;
+    }
+}
+
+std::optional<long long> bonk::HIRConstantFolder::fold_integer(HIROperationType operation,
+                                                               HIRDataType type, long long left,
+                                                               long long right) {
+    int bits = type == HIRDataType::byte    ? 8
+               : type == HIRDataType::hword ? 16
+               : type == HIRDataType::word  ? 32
+                                            : 64;
+
+    // Wrap around like the target does instead of relying on signed overflow
+    auto unsigned_left = (unsigned long long)left;
+    auto unsigned_right = (unsigned long long)right;
+
+    switch (operation) {
+    case HIROperationType::plus:
+        return (long long)(unsigned_left + unsigned_right);
+    case HIROperationType::minus:
+        return (long long)(unsigned_left - unsigned_right);
+    case HIROperationType::multiply:
+        return (long long)(unsigned_left * unsigned_right);
+    case HIROperationType::multiply_high:
+        // Only emitted for words and longs
+        if (bits == 64) {
+            return (long long)(((__int128)left * right) >> 64);
+        }
+        if (bits == 32) {
+            return (left * right) >> 32;
+        }
+        return std::nullopt;
+    case HIROperationType::shift_left:
+        return (long long)(unsigned_left << (unsigned_right % bits));
+    case HIROperationType::shift_right:
+        return left >> (unsigned_right % bits);
+    case HIROperationType::divide: {
+        long long min_value = normalize((long long)(1ull << (bits - 1)), type);
+
+        // Division by zero and overflowing division trap at runtime
+        if (right == 0 || (left == min_value && right == -1)) {
+            return std::nullopt;
+        }
+        return left / right;
+    }
+    case HIROperationType::and_op:
+        return left & right;
+    case HIROperationType::or_op:
+        return left | right;
+    case HIROperationType::xor_op:
+        return left ^ right;
+    case HIROperationType::equal:
+        return left == right;
+    case HIROperationType::not_equal:
+        return left != right;
+    case HIROperationType::less:
+        return left < right;
+    case HIROperationType::less_equal:
+        return left <= right;
+    case HIROperationType::greater:
+        return left > right;
+    case HIROperationType::greater_equal:
+        return left >= right;
+    default:
+        return std::nullopt;
+    }
+}
+
+std::optional<long long> bonk::HIRConstantFolder::fold_float(HIROperationType operation,
+                                                             double left, double right,
+                                                             bool& is_comparison) {
+    is_comparison = true;
+
+    switch (operation) {
+    case HIROperationType::equal:
+        return left == right;
+    case HIROperationType::not_equal:
+        return left != right;
+    case HIROperationType::less:
+        return left < right;
+    case HIROperationType::less_equal:
+        return left <= right;
+    case HIROperationType::greater:
+        return left > right;
+    case HIROperationType::greater_equal:
+        return left >= right;
+    default:
+        break;
+    }
+
+    is_comparison = false;
+
+    switch (operation) {
+    case HIROperationType::plus:
+        return from_double(left + right);
+    case HIROperationType::minus:
+        return from_double(left - right);
+    case HIROperationType::multiply:
+        return from_double(left * right);
+    case HIROperationType::divide:
+        return from_double(left / right);
+    default:
+        return std::nullopt;
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <optional>
+#include "bonk/middleend/ir/hir.hpp"
+
+namespace bonk {
+
+// Evaluates HIR operations on constants. Constants are represented the same way
+// as in HIRConstantLoadInstruction: integers are sign-extended to 64 bits, floats
+// are stored as their bit patterns.
+class HIRConstantFolder {
+  public:
+    static std::optional<long long> fold(const HIROperationInstruction& instruction,
+                                         long long left, std::optional<long long> right);
+
+    // Truncates the value to the given type and brings it to the canonical form
+    static long long normalize(long long value, HIRDataType type);
+
+    static long long from_float(float value);
+    static long long from_double(double value);
+    static float to_float(long long value);
+    static double to_double(long long value);
+
+  private:
+    static std::optional<long long> fold_integer(HIROperationType operation, HIRDataType type,
+                                                 long long left, long long right);
+    static std::optional<long long> fold_float(HIROperationType operation, double left,
+                                               double right, bool& is_comparison);
+};
+
+} // namespace bonk
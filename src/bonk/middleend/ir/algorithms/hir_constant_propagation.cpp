@@ -0,0 +1,375 @@
+
+#include "hir_constant_propagation.hpp"
+#include "hir_constant_folder.hpp"
+
+bool bonk::HIRConstantPropagation::propagate_constants(HIRProgram& program) {
+    for (auto& procedure : program.procedures) {
+        if (!propagate_constants(*procedure)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool bonk::HIRConstantPropagation::propagate_constants(HIRProcedure& procedure) {
+    if (procedure.is_external) {
+        return true;
+    }
+
+    reset(procedure);
+    solve(procedure);
+    rewrite(procedure);
+
+    return true;
+}
+
+void bonk::HIRConstantPropagation::reset(HIRProcedure& procedure) {
+    values.assign(procedure.used_registers, {LatticeState::overdefined});
+    uses.assign(procedure.used_registers, {});
+    executable_edges.clear();
+    executable_blocks = DynamicBitSet(procedure.base_blocks.size());
+    flow_work_list.clear();
+    ssa_work_list.clear();
+
+    for (auto& block : procedure.base_blocks) {
+        executable_edges.emplace_back(block->predecessors.size(), false);
+
+        for (auto instruction : block->instructions) {
+            // Registers without a definition (e.g. parameters) stay overdefined
+            for (int i = 0; i < instruction->get_write_register_count(); i++) {
+                values[instruction->get_write_register(i)] = {LatticeState::undefined};
+            }
+            for (int i = 0; i < instruction->get_read_register_count(); i++) {
+                uses[instruction->get_read_register(i)].push_back({instruction, block.get()});
+            }
+        }
+    }
+}
+
+void bonk::HIRConstantPropagation::solve(HIRProcedure& procedure) {
+    auto start_block = procedure.base_blocks[procedure.start_block_index].get();
+    executable_blocks[start_block->index] = true;
+
+    for (auto instruction : start_block->instructions) {
+        visit_instruction(instruction, start_block);
+    }
+    visit_branch(start_block);
+
+    do {
+        propagate();
+    } while (resolve_undefined_branches(procedure));
+}
+
+void bonk::HIRConstantPropagation::propagate() {
+    while (!flow_work_list.empty() || !ssa_work_list.empty()) {
+        while (!flow_work_list.empty()) {
+            auto [from, to] = flow_work_list.back();
+            flow_work_list.pop_back();
+
+            if (executable_blocks[to->index]) {
+                // Only phi functions depend on the newly executable edge
+                for (auto instruction : to->instructions) {
+                    if (instruction->type != HIRInstructionType::phi_function) {
+                        break;
+                    }
+                    visit_instruction(instruction, to);
+                }
+                continue;
+            }
+
+            executable_blocks[to->index] = true;
+
+            for (auto instruction : to->instructions) {
+                visit_instruction(instruction, to);
+            }
+            visit_branch(to);
+        }
+
+        while (!ssa_work_list.empty()) {
+            IRRegister reg = ssa_work_list.back();
+            ssa_work_list.pop_back();
+
+            for (auto& use : uses[reg]) {
+                if (!executable_blocks[use.block->index]) {
+                    continue;
+                }
+                if (use.instruction->type == HIRInstructionType::jump_nz) {
+                    visit_branch(use.block);
+                } else {
+                    visit_instruction(use.instruction, use.block);
+                }
+            }
+        }
+    }
+}
+
+bool bonk::HIRConstantPropagation::resolve_undefined_branches(HIRProcedure& procedure) {
+    // A branch on a value that is never defined (e.g. read from an uninitialized
+    // variable) may go either way. Treat its condition as unknown, so that both
+    // successors are analyzed and kept.
+    bool changed = false;
+
+    for (auto& block : procedure.base_blocks) {
+        if (!executable_blocks[block->index] || block->instructions.empty() ||
+            block->instructions.back()->type != HIRInstructionType::jump_nz) {
+            continue;
+        }
+
+        auto jnz = (HIRJumpNZInstruction*)block->instructions.back();
+        if (values[jnz->condition].state == LatticeState::undefined) {
+            set_value(jnz->condition, {LatticeState::overdefined});
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+void bonk::HIRConstantPropagation::mark_edge(HIRBaseBlock* from, HIRBaseBlock* to) {
+    auto& edges = executable_edges[to->index];
+    bool changed = false;
+
+    // Both labels of a jnz may point to the same block
+    for (int i = 0; i < to->predecessors.size(); i++) {
+        if (to->predecessors[i] == from && !edges[i]) {
+            edges[i] = true;
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        flow_work_list.emplace_back(from, to);
+    }
+}
+
+void bonk::HIRConstantPropagation::visit_instruction(HIRInstruction* instruction,
+                                                     HIRBaseBlock* block) {
+    if (instruction->get_write_register_count() == 0) {
+        return;
+    }
+
+    auto reg = instruction->get_write_register(0);
+    if (values[reg].state == LatticeState::overdefined) {
+        return;
+    }
+
+    set_value(reg, evaluate(instruction, block));
+}
+
+void bonk::HIRConstantPropagation::visit_branch(HIRBaseBlock* block) {
+    auto& procedure = block->procedure;
+
+    if (block->instructions.empty() ||
+        block->instructions.back()->type != HIRInstructionType::jump_nz) {
+        for (auto successor : block->successors) {
+            mark_edge(block, successor);
+        }
+        return;
+    }
+
+    auto jnz = (HIRJumpNZInstruction*)block->instructions.back();
+    auto& condition = values[jnz->condition];
+
+    switch (condition.state) {
+    case LatticeState::undefined:
+        break;
+    case LatticeState::constant:
+        mark_edge(block, procedure.base_blocks[condition.constant != 0 ? jnz->nz_label
+                                                                        : jnz->z_label]
+                             .get());
+        break;
+    case LatticeState::overdefined:
+        mark_edge(block, procedure.base_blocks[jnz->nz_label].get());
+        mark_edge(block, procedure.base_blocks[jnz->z_label].get());
+        break;
+    }
+}
+
+void bonk::HIRConstantPropagation::set_value(IRRegister reg, LatticeValue value) {
+    auto& old_value = values[reg];
+
+    // Values only move down the lattice
+    if (old_value.state == LatticeState::overdefined || old_value == value) {
+        return;
+    }
+    if (old_value.state == LatticeState::constant && value.state == LatticeState::undefined) {
+        return;
+    }
+    if (old_value.state == LatticeState::constant && value.state == LatticeState::constant) {
+        value = {LatticeState::overdefined};
+    }
+
+    old_value = value;
+    ssa_work_list.push_back(reg);
+}
+
+bonk::HIRConstantPropagation::LatticeValue
+bonk::HIRConstantPropagation::evaluate(HIRInstruction* instruction, HIRBaseBlock* block) {
+    switch (instruction->type) {
+    case HIRInstructionType::constant_load: {
+        auto constant = (HIRConstantLoadInstruction*)instruction;
+        return {LatticeState::constant,
+                HIRConstantFolder::normalize(constant->constant, constant->type)};
+    }
+    case HIRInstructionType::operation:
+        return evaluate_operation((HIROperationInstruction*)instruction);
+    case HIRInstructionType::phi_function:
+        return evaluate_phi((HIRPhiFunctionInstruction*)instruction, block);
+    default:
+        return {LatticeState::overdefined};
+    }
+}
+
+bonk::HIRConstantPropagation::LatticeValue
+bonk::HIRConstantPropagation::evaluate_phi(HIRPhiFunctionInstruction* phi, HIRBaseBlock* block) {
+    auto& edges = executable_edges[block->index];
+    LatticeValue result = {LatticeState::undefined};
+
+    for (int i = 0; i < phi->sources.size(); i++) {
+        if (!edges[i]) {
+            continue;
+        }
+
+        auto& source = values[phi->sources[i]];
+
+        if (source.state == LatticeState::undefined) {
+            continue;
+        }
+        if (source.state == LatticeState::overdefined ||
+            (result.state == LatticeState::constant && result.constant != source.constant)) {
+            return {LatticeState::overdefined};
+        }
+        result = source;
+    }
+
+    return result;
+}
+
+bonk::HIRConstantPropagation::LatticeValue
+bonk::HIRConstantPropagation::evaluate_operation(HIROperationInstruction* operation) {
+    auto& left = values[operation->left];
+    const LatticeValue* right = nullptr;
+
+    if (operation->right.has_value()) {
+        right = &values[operation->right.value()];
+    }
+
+    if (left.state == LatticeState::overdefined ||
+        (right && right->state == LatticeState::overdefined)) {
+        return {LatticeState::overdefined};
+    }
+
+    if (left.state == LatticeState::undefined ||
+        (right && right->state == LatticeState::undefined)) {
+        return {LatticeState::undefined};
+    }
+
+    std::optional<long long> right_constant;
+    if (right) {
+        right_constant = right->constant;
+    }
+
+    auto result = HIRConstantFolder::fold(*operation, left.constant, right_constant);
+    if (!result.has_value()) {
+        return {LatticeState::overdefined};
+    }
+
+    return {LatticeState::constant, *result};
+}
+
+void bonk::HIRConstantPropagation::rewrite(HIRProcedure& procedure) {
+    for (auto& block : procedure.base_blocks) {
+        if (!executable_blocks[block->index]) {
+            continue;
+        }
+
+        // Phi functions have to stay at the beginning of the block,
+        // so the constant loads replacing them are inserted after them
+        auto phi_end = block->instructions.begin();
+        while (phi_end != block->instructions.end() &&
+               (*phi_end)->type == HIRInstructionType::phi_function) {
+            phi_end++;
+        }
+
+        for (auto it = block->instructions.begin(); it != block->instructions.end();) {
+            auto instruction = *it;
+
+            if (instruction->type == HIRInstructionType::constant_load ||
+                instruction->get_write_register_count() == 0) {
+                it++;
+                continue;
+            }
+
+            HIRDataType type = HIRDataType::unset;
+            auto reg = instruction->get_write_register(0, &type);
+            auto& value = values[reg];
+
+            if (value.state != LatticeState::constant) {
+                it++;
+                continue;
+            }
+
+            auto constant_load =
+                block->instruction<HIRConstantLoadInstruction>(reg, value.constant, type);
+
+            if (instruction->type == HIRInstructionType::phi_function) {
+                block->instructions.insert(phi_end, constant_load);
+                it = block->instructions.erase(it);
+            } else {
+                *it = constant_load;
+                it++;
+            }
+        }
+
+        if (block->instructions.empty() ||
+            block->instructions.back()->type != HIRInstructionType::jump_nz) {
+            continue;
+        }
+
+        auto jnz = (HIRJumpNZInstruction*)block->instructions.back();
+        auto& condition = values[jnz->condition];
+
+        if (condition.state != LatticeState::constant) {
+            continue;
+        }
+
+        int taken_label = condition.constant != 0 ? jnz->nz_label : jnz->z_label;
+        int skipped_label = condition.constant != 0 ? jnz->z_label : jnz->nz_label;
+
+        block->instructions.back() = block->instruction<HIRJumpInstruction>(taken_label);
+
+        if (skipped_label != taken_label) {
+            procedure.remove_control_flow_edge(block.get(),
+                                               procedure.base_blocks[skipped_label].get());
+        }
+    }
+
+    // Detach unreachable blocks first, so that the phi functions
+    // of the reachable blocks lose the corresponding sources
+    bool has_unreachable_blocks = false;
+
+    for (auto& block : procedure.base_blocks) {
+        if (executable_blocks[block->index] || block->index == procedure.start_block_index ||
+            block->index == procedure.end_block_index) {
+            continue;
+        }
+
+        while (!block->successors.empty()) {
+            procedure.remove_control_flow_edge(block.get(), block->successors.back());
+        }
+        has_unreachable_blocks = true;
+    }
+
+    if (!has_unreachable_blocks) {
+        return;
+    }
+
+    for (auto& block : procedure.base_blocks) {
+        if (!executable_blocks[block->index] && block->index != procedure.start_block_index &&
+            block->index != procedure.end_block_index) {
+            block->kill();
+        }
+    }
+
+    procedure.remove_killed_blocks();
+}
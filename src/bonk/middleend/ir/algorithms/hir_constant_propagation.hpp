@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include "bonk/middleend/ir/hir.hpp"
+#include "utils/dynamic_bitset.hpp"
+
+namespace bonk {
+
+// Sparse conditional constant propagation. Only follows the control flow edges
+// that can actually be taken, so constants flowing through phi functions and
+// branches on constant conditions are resolved together. Definitions of constant
+// registers are replaced with constant loads, never taken edges and blocks are
+// removed. Expects the procedure to be in SSA form.
+class HIRConstantPropagation {
+  public:
+    enum class LatticeState { undefined, constant, overdefined };
+
+    struct LatticeValue {
+        LatticeState state = LatticeState::undefined;
+        long long constant = 0;
+
+        bool operator==(const LatticeValue& other) const {
+            return state == other.state &&
+                   (state != LatticeState::constant || constant == other.constant);
+        }
+        bool operator!=(const LatticeValue& other) const {
+            return !(*this == other);
+        }
+    };
+
+    HIRConstantPropagation() = default;
+
+    bool propagate_constants(HIRProgram& program);
+    bool propagate_constants(HIRProcedure& procedure);
+
+  private:
+    struct RegisterUse {
+        HIRInstruction* instruction;
+        HIRBaseBlock* block;
+    };
+
+    void reset(HIRProcedure& procedure);
+    void solve(HIRProcedure& procedure);
+    void propagate();
+    bool resolve_undefined_branches(HIRProcedure& procedure);
+    void rewrite(HIRProcedure& procedure);
+
+    void mark_edge(HIRBaseBlock* from, HIRBaseBlock* to);
+    void visit_instruction(HIRInstruction* instruction, HIRBaseBlock* block);
+    void visit_branch(HIRBaseBlock* block);
+    void set_value(IRRegister reg, LatticeValue value);
+
+    LatticeValue evaluate(HIRInstruction* instruction, HIRBaseBlock* block);
+    LatticeValue evaluate_phi(HIRPhiFunctionInstruction* phi, HIRBaseBlock* block);
+    LatticeValue evaluate_operation(HIROperationInstruction* operation);
+
+    std::vector<LatticeValue> values;
+    std::vector<std::vector<RegisterUse>> uses;
+    std::vector<std::vector<bool>> executable_edges;
+    DynamicBitSet executable_blocks{0};
+
+    std::vector<std::pair<HIRBaseBlock*, HIRBaseBlock*>> flow_work_list;
+    std::vector<IRRegister> ssa_work_list;
+};
+
+} // namespace bonk
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <unordered_map>
 #include "bonk/middleend/ir/hir.hpp"
 namespace bonk {
 
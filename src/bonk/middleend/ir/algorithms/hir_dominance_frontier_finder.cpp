@@ -3,7 +3,6 @@
 
 void bonk::HIRDominanceFrontierFinder::calculate_dominators() {
     counted_dominators.resize(procedure.base_blocks.size());
-    std::fill(counted_dominators.begin(), counted_dominators.end(), -1);
 
     for (int i = 0; i < procedure.base_blocks.size(); i++) {
         auto& block = *procedure.base_blocks[i];
@@ -15,14 +14,18 @@ void bonk::HIRDominanceFrontierFinder::calculate_dominators() {
         for (auto predecessor : block.predecessors) {
             auto runner = predecessor->index;
             while (runner != direct_dominator && runner != -1) {
-                counted_dominators[runner] = i;
+                // A block can have several blocks in its frontier
+                auto& frontier = counted_dominators[runner];
+                if (frontier.empty() || frontier.back() != i) {
+                    frontier.push_back(i);
+                }
                 runner = dominance_tree_builder.get_parent(runner);
             }
         }
     }
 }
 
-std::vector<int>& bonk::HIRDominanceFrontierFinder::get_frontiers() {
+std::vector<std::vector<int>>& bonk::HIRDominanceFrontierFinder::get_frontiers() {
     if (counted_dominators.empty()) {
         calculate_dominators();
     }
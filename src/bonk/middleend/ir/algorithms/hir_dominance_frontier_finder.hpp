@@ -18,10 +18,10 @@ class HIRDominanceFrontierFinder {
           dominance_tree_builder(dominance_tree_builder) {
     }
 
-    std::vector<int>& get_frontiers();
+    std::vector<std::vector<int>>& get_frontiers();
 
   private:
-    std::vector<int> counted_dominators;
+    std::vector<std::vector<int>> counted_dominators;
     void calculate_dominators();
 };
 
@@ -0,0 +1,254 @@
+
+#include "hir_if_converter.hpp"
+#include <algorithm>
+
+// Both arms are executed after the conversion, so they are kept short
+static constexpr int max_arm_instructions = 6;
+
+// Every select costs several instructions in the backend
+static constexpr int max_selects = 2;
+
+bool bonk::HIRIfConverter::convert(HIRProgram& program) {
+    for (auto& procedure : program.procedures) {
+        if (!convert(*procedure)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool bonk::HIRIfConverter::convert(HIRProcedure& procedure) {
+    if (procedure.is_external) {
+        return true;
+    }
+
+    this->procedure = &procedure;
+    collect_definitions();
+
+    // Converting an inner diamond turns it into straight-line code, which may
+    // make the arm of an outer diamond convertible
+    bool converted = false;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto& block : procedure.base_blocks) {
+            if (block->index != -1 && convert_diamond(*block)) {
+                changed = true;
+                converted = true;
+            }
+        }
+    }
+
+    if (converted) {
+        procedure.remove_killed_blocks();
+    }
+
+    definitions.clear();
+    this->procedure = nullptr;
+    return true;
+}
+
+void bonk::HIRIfConverter::collect_definitions() {
+    definitions.assign(procedure->used_registers, nullptr);
+
+    for (auto& block : procedure->base_blocks) {
+        for (auto instruction : block->instructions) {
+            for (int i = 0; i < instruction->get_write_register_count(); i++) {
+                definitions[instruction->get_write_register(i, nullptr)] = instruction;
+            }
+        }
+    }
+}
+
+bool bonk::HIRIfConverter::convert_diamond(HIRBaseBlock& header) {
+    if (header.instructions.empty() ||
+        header.instructions.back()->type != HIRInstructionType::jump_nz) {
+        return false;
+    }
+
+    auto jump = (HIRJumpNZInstruction*)header.instructions.back();
+    if (jump->nz_label == jump->z_label || !is_word_register(jump->condition)) {
+        return false;
+    }
+
+    // An arm that is not convertible may still be the join itself, which
+    // makes a triangle
+    auto nz_block = procedure->base_blocks[jump->nz_label].get();
+    auto z_block = procedure->base_blocks[jump->z_label].get();
+    auto nz_arm = is_convertible_arm(*nz_block, header) ? nz_block : nullptr;
+    auto z_arm = is_convertible_arm(*z_block, header) ? z_block : nullptr;
+
+    if (!nz_arm && !z_arm) {
+        return false;
+    }
+
+    auto join = nz_arm ? nz_arm->successors[0] : nz_block;
+    if (join != (z_arm ? z_arm->successors[0] : z_block)) {
+        return false;
+    }
+
+    if (join == &header || join->predecessors.size() != 2) {
+        return false;
+    }
+
+    auto nz_predecessor = nz_arm ? nz_arm : &header;
+    auto z_predecessor = z_arm ? z_arm : &header;
+
+    int nz_index = std::find(join->predecessors.begin(), join->predecessors.end(),
+                             nz_predecessor) -
+                   join->predecessors.begin();
+    int z_index = std::find(join->predecessors.begin(), join->predecessors.end(), z_predecessor) -
+                  join->predecessors.begin();
+
+    int phi_count = 0;
+    for (auto instruction : join->instructions) {
+        if (instruction->type != HIRInstructionType::phi_function) {
+            break;
+        }
+        auto phi = (HIRPhiFunctionInstruction*)instruction;
+        if (phi->type == HIRDataType::float32 || phi->type == HIRDataType::float64) {
+            return false;
+        }
+        phi_count++;
+    }
+
+    if (phi_count > max_selects) {
+        return false;
+    }
+
+    // Straighten the diamond: arms first, then the selects, then the join
+    header.instructions.pop_back();
+
+    if (nz_arm) {
+        hoist_instructions(*nz_arm, header);
+    }
+    if (z_arm) {
+        hoist_instructions(*z_arm, header);
+    }
+
+    while (!join->instructions.empty() &&
+           join->instructions.front()->type == HIRInstructionType::phi_function) {
+        auto phi = (HIRPhiFunctionInstruction*)join->instructions.front();
+        auto select = header.instruction<HIRSelectInstruction>(
+            phi->target, jump->condition, phi->sources[nz_index], phi->sources[z_index],
+            phi->type);
+        header.instructions.push_back(select);
+        definitions[phi->target] = select;
+        join->instructions.pop_front();
+    }
+
+    header.instructions.push_back(header.instruction<HIRJumpInstruction>(join->index));
+
+    if (nz_arm) {
+        nz_arm->kill();
+    }
+    if (z_arm) {
+        z_arm->kill();
+    }
+
+    header.successors = {join};
+    join->predecessors = {&header};
+
+    if (join->index != procedure->end_block_index) {
+        merge_into_predecessor(*join);
+    }
+
+    return true;
+}
+
+bool bonk::HIRIfConverter::is_convertible_arm(HIRBaseBlock& arm, HIRBaseBlock& header) {
+    if (&arm == &header || arm.index == procedure->start_block_index ||
+        arm.index == procedure->end_block_index) {
+        return false;
+    }
+
+    if (arm.predecessors.size() != 1 || arm.predecessors[0] != &header ||
+        arm.successors.size() != 1 || arm.instructions.empty() ||
+        arm.instructions.back()->type != HIRInstructionType::jump) {
+        return false;
+    }
+
+    int cost = 0;
+    for (auto instruction : arm.instructions) {
+        if (instruction == arm.instructions.back()) {
+            break;
+        }
+        if (instruction->type == HIRInstructionType::label ||
+            instruction->type == HIRInstructionType::location) {
+            continue;
+        }
+        if (!is_speculatable(instruction)) {
+            return false;
+        }
+        cost++;
+    }
+
+    return cost <= max_arm_instructions;
+}
+
+bool bonk::HIRIfConverter::is_speculatable(HIRInstruction* instruction) {
+    switch (instruction->type) {
+    case HIRInstructionType::constant_load:
+    case HIRInstructionType::symbol_load:
+    case HIRInstructionType::select:
+        return true;
+    case HIRInstructionType::operation:
+        // Division traps on zero
+        return ((HIROperationInstruction*)instruction)->operation_type !=
+               HIROperationType::divide;
+    default:
+        return false;
+    }
+}
+
+bool bonk::HIRIfConverter::is_word_register(IRRegister register_id) {
+    // The backend tests the condition as a word
+    HIRDataType type = HIRDataType::unset;
+
+    if (auto definition = definitions[register_id]) {
+        for (int i = 0; i < definition->get_write_register_count(); i++) {
+            if (definition->get_write_register(i, &type) == register_id) {
+                break;
+            }
+        }
+    } else {
+        for (auto& parameter : procedure->parameters) {
+            if (parameter.register_id == register_id) {
+                type = parameter.type;
+            }
+        }
+    }
+
+    return type == HIRDataType::byte || type == HIRDataType::hword || type == HIRDataType::word;
+}
+
+void bonk::HIRIfConverter::hoist_instructions(HIRBaseBlock& from, HIRBaseBlock& to) {
+    from.instructions.pop_back();
+
+    for (auto instruction : from.instructions) {
+        if (instruction->type != HIRInstructionType::label) {
+            to.instructions.push_back(instruction);
+        }
+    }
+
+    from.instructions.clear();
+}
+
+void bonk::HIRIfConverter::merge_into_predecessor(HIRBaseBlock& block) {
+    auto predecessor = block.predecessors[0];
+
+    // The jump to the block is replaced by its instructions
+    predecessor->instructions.pop_back();
+    predecessor->instructions.splice(predecessor->instructions.end(), block.instructions);
+    predecessor->successors = std::move(block.successors);
+
+    for (auto successor : predecessor->successors) {
+        for (auto& successor_predecessor : successor->predecessors) {
+            if (successor_predecessor == &block) {
+                successor_predecessor = predecessor;
+            }
+        }
+    }
+
+    block.kill();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include "bonk/middleend/ir/hir.hpp"
+
+namespace bonk {
+
+// Replaces small diamonds and triangles of blocks with select instructions.
+// A jnz whose arms only compute values without side effects, and then meet in
+// a join block, becomes straight-line code: the arms are hoisted above the
+// jnz, and the phi functions of the join turn into selects over the jnz
+// condition. Short lazy 'and' and 'or' operations over comparisons compile
+// into such diamonds.
+//
+// Arms may not load from memory or divide, since they are executed
+// unconditionally afterwards. Diamonds are converted from the inside out, so
+// that nested lazy operations are flattened completely. Expects the procedures
+// to be in SSA form.
+class HIRIfConverter {
+  public:
+    HIRIfConverter() = default;
+
+    bool convert(HIRProgram& program);
+    bool convert(HIRProcedure& procedure);
+
+  private:
+    void collect_definitions();
+    bool convert_diamond(HIRBaseBlock& header);
+    bool is_convertible_arm(HIRBaseBlock& arm, HIRBaseBlock& header);
+    bool is_speculatable(HIRInstruction* instruction);
+    bool is_word_register(IRRegister register_id);
+    void hoist_instructions(HIRBaseBlock& from, HIRBaseBlock& to);
+    void merge_into_predecessor(HIRBaseBlock& block);
+
+    HIRProcedure* procedure = nullptr;
+    std::vector<HIRInstruction*> definitions;
+};
+
+} // namespace bonk
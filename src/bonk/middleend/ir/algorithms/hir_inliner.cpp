@@ -0,0 +1,387 @@
+
+#include "hir_inliner.hpp"
+#include <algorithm>
+
+bool bonk::HIRInliner::inline_calls(HIRProgram& program) {
+    for (auto& procedure : program.procedures) {
+        if (!inline_calls(*procedure)) {
+            return false;
+        }
+    }
+
+    auto& procedures = program.procedures;
+    procedures.erase(std::remove_if(procedures.begin(), procedures.end(),
+                                    [](auto& procedure) { return procedure->is_imported; }),
+                     procedures.end());
+    return true;
+}
+
+bool bonk::HIRInliner::inline_calls(HIRProcedure& procedure) {
+    if (procedure.is_external || procedure.is_imported) {
+        return true;
+    }
+
+    collect_imported_procedures(procedure.program);
+    if (imported_procedures.empty()) {
+        return true;
+    }
+
+    this->procedure = &procedure;
+    call_depths.clear();
+
+    int size = get_size(procedure);
+
+    // Blocks created by inlining are appended to the procedure,
+    // so calls in the inlined code are visited as well
+    for (int i = 0; i < procedure.base_blocks.size(); i++) {
+        auto& block = *procedure.base_blocks[i];
+
+        for (auto it = block.instructions.begin(); it != block.instructions.end(); ++it) {
+            if ((*it)->type != HIRInstructionType::call) {
+                continue;
+            }
+
+            auto call = (HIRCallInstruction*)*it;
+            auto callee_it = imported_procedures.find(call->procedure_label_id);
+            if (callee_it == imported_procedures.end()) {
+                continue;
+            }
+
+            auto& callee = *callee_it->second;
+            auto depth_it = call_depths.find(call);
+            int depth = depth_it == call_depths.end() ? 0 : depth_it->second;
+            int callee_size = get_size(callee);
+
+            if (depth >= max_depth || callee_size > max_callee_size ||
+                size + callee_size > max_procedure_size) {
+                continue;
+            }
+
+            // The rest of the block is moved to the continuation block
+            if (inline_call(block, it, callee, depth)) {
+                size += callee_size;
+                break;
+            }
+        }
+    }
+
+    this->procedure = nullptr;
+    return true;
+}
+
+void bonk::HIRInliner::collect_imported_procedures(HIRProgram& program) {
+    imported_procedures.clear();
+    for (auto& procedure : program.procedures) {
+        if (procedure->is_imported && !procedure->is_external) {
+            imported_procedures[procedure->procedure_id] = procedure.get();
+        }
+    }
+}
+
+bool bonk::HIRInliner::inline_call(HIRBaseBlock& block,
+                                   std::list<HIRInstruction*>::iterator call_iterator,
+                                   HIRProcedure& callee, int depth) {
+    auto call = (HIRCallInstruction*)*call_iterator;
+
+    // Arguments are passed with parameter instructions right before the call
+    std::vector<std::list<HIRInstruction*>::iterator> parameter_iterators;
+    for (auto it = call_iterator; parameter_iterators.size() < callee.parameters.size();) {
+        if (it == block.instructions.begin()) {
+            break;
+        }
+        --it;
+        if ((*it)->type == HIRInstructionType::location ||
+            (*it)->type == HIRInstructionType::file) {
+            continue;
+        }
+        if ((*it)->type != HIRInstructionType::parameter) {
+            break;
+        }
+        parameter_iterators.push_back(it);
+    }
+
+    if (parameter_iterators.size() != callee.parameters.size()) {
+        return false;
+    }
+
+    // In SSA form the parameters are never redefined,
+    // so the callee can use the arguments directly
+    register_map.clear();
+    for (int i = 0; i < callee.parameters.size(); i++) {
+        auto parameter = (HIRParameterInstruction*)*parameter_iterators.rbegin()[i];
+        register_map[callee.parameters[i].register_id] = parameter->parameter;
+    }
+
+    for (auto& it : parameter_iterators) {
+        block.instructions.erase(it);
+    }
+
+    // Split the block after the call
+    procedure->create_base_block();
+    auto continuation = procedure->base_blocks.back().get();
+
+    continuation->instructions.splice(continuation->instructions.end(), block.instructions,
+                                      std::next(call_iterator), block.instructions.end());
+    block.instructions.erase(call_iterator);
+
+    continuation->successors = std::move(block.successors);
+    block.successors.clear();
+
+    for (auto successor : continuation->successors) {
+        for (auto& predecessor : successor->predecessors) {
+            if (predecessor == &block) {
+                predecessor = continuation;
+            }
+        }
+    }
+
+    // Only copy the blocks that are reachable from the callee start block.
+    // The end block is always empty, returns jump to the continuation instead.
+    int callee_end = callee.end_block_index;
+    std::vector<bool> reachable(callee.base_blocks.size(), false);
+    std::vector<HIRBaseBlock*> stack{callee.base_blocks[callee.start_block_index].get()};
+    reachable[callee.start_block_index] = true;
+
+    while (!stack.empty()) {
+        auto callee_block = stack.back();
+        stack.pop_back();
+        for (auto successor : callee_block->successors) {
+            if (!reachable[successor->index]) {
+                reachable[successor->index] = true;
+                stack.push_back(successor);
+            }
+        }
+    }
+
+    std::vector<HIRBaseBlock*> copies(callee.base_blocks.size(), nullptr);
+    for (int i = 0; i < callee.base_blocks.size(); i++) {
+        if (reachable[i] && i != callee_end) {
+            procedure->create_base_block();
+            copies[i] = procedure->base_blocks.back().get();
+        }
+    }
+
+    std::vector<std::pair<HIRBaseBlock*, std::optional<IRRegister>>> returns;
+
+    for (int i = 0; i < callee.base_blocks.size(); i++) {
+        auto copy = copies[i];
+        if (!copy) {
+            continue;
+        }
+
+        auto& callee_block = *callee.base_blocks[i];
+
+        // Keep the predecessor order, since phi sources are bound to it
+        std::vector<int> kept_predecessors;
+        for (int j = 0; j < callee_block.predecessors.size(); j++) {
+            if (auto predecessor = copies[callee_block.predecessors[j]->index]) {
+                copy->predecessors.push_back(predecessor);
+                kept_predecessors.push_back(j);
+            }
+        }
+
+        for (auto successor : callee_block.successors) {
+            if (copies[successor->index]) {
+                copy->successors.push_back(copies[successor->index]);
+            }
+        }
+
+        for (auto instruction : callee_block.instructions) {
+            switch (instruction->type) {
+            case HIRInstructionType::file:
+            case HIRInstructionType::location:
+                // Inlined code is attributed to the call site
+                break;
+            case HIRInstructionType::return_op: {
+                auto return_instruction = (HIRReturnInstruction*)instruction;
+                std::optional<IRRegister> value;
+                if (return_instruction->return_value) {
+                    value = map_register(*return_instruction->return_value);
+                }
+                returns.emplace_back(copy, value);
+
+                copy->instructions.push_back(
+                    procedure->instruction<HIRJumpInstruction>(continuation->index));
+                copy->successors.push_back(continuation);
+                continuation->predecessors.push_back(copy);
+                break;
+            }
+            case HIRInstructionType::phi_function: {
+                auto phi = (HIRPhiFunctionInstruction*)instruction;
+                auto phi_copy = procedure->instruction<HIRPhiFunctionInstruction>();
+                phi_copy->type = phi->type;
+                phi_copy->target = map_register(phi->target);
+                for (int j : kept_predecessors) {
+                    phi_copy->sources.push_back(map_register(phi->sources[j]));
+                }
+                copy->instructions.push_back(phi_copy);
+                break;
+            }
+            default: {
+                auto instruction_copy = copy_instruction(instruction);
+                if (instruction_copy->type == HIRInstructionType::jump) {
+                    auto jump = (HIRJumpInstruction*)instruction_copy;
+                    jump->label_id = copies[jump->label_id]->index;
+                } else if (instruction_copy->type == HIRInstructionType::jump_nz) {
+                    auto jump = (HIRJumpNZInstruction*)instruction_copy;
+                    jump->nz_label = copies[jump->nz_label]->index;
+                    jump->z_label = copies[jump->z_label]->index;
+                } else if (instruction_copy->type == HIRInstructionType::call) {
+                    auto call_copy = (HIRCallInstruction*)instruction_copy;
+                    call_depths[call_copy] = depth + 1;
+                    if (call_copy->inlined_procedure_id == -1) {
+                        call_copy->inlined_procedure_id = callee.procedure_id;
+                    }
+                }
+                copy->instructions.push_back(instruction_copy);
+            }
+            }
+        }
+    }
+
+    auto entry = copies[callee.start_block_index];
+    block.instructions.push_back(procedure->instruction<HIRJumpInstruction>(entry->index));
+    procedure->add_control_flow_edge(&block, entry);
+
+    if (!call->return_value) {
+        return true;
+    }
+
+    IRRegister result = *call->return_value;
+    HIRDataType result_type = call->return_type;
+
+    if (returns.empty()) {
+        // The callee never returns, the continuation is unreachable
+        continuation->instructions.push_front(
+            procedure->instruction<HIRConstantLoadInstruction>(result, 0LL, result_type));
+        return true;
+    }
+
+    std::vector<IRRegister> values;
+    for (auto& [return_block, value] : returns) {
+        if (value) {
+            values.push_back(*value);
+            continue;
+        }
+
+        // Value-less 'bonk' in a blok that returns a value
+        IRRegister zero = procedure->get_unused_register();
+        auto jump = std::prev(return_block->instructions.end());
+        return_block->instructions.insert(
+            jump, procedure->instruction<HIRConstantLoadInstruction>(zero, 0LL, result_type));
+        values.push_back(zero);
+    }
+
+    if (values.size() == 1) {
+        auto assign = procedure->instruction<HIROperationInstruction>();
+        assign->set_assign(result, values[0], result_type);
+        continuation->instructions.push_front(assign);
+    } else {
+        auto phi = procedure->instruction<HIRPhiFunctionInstruction>();
+        phi->type = result_type;
+        phi->target = result;
+        phi->sources = std::move(values);
+        continuation->instructions.push_front(phi);
+    }
+
+    return true;
+}
+
+bonk::HIRInstruction* bonk::HIRInliner::copy_instruction(HIRInstruction* instruction) {
+    HIRInstruction* copy = nullptr;
+
+    switch (instruction->type) {
+    case HIRInstructionType::constant_load:
+        copy = procedure->instruction<HIRConstantLoadInstruction>(
+            *(const HIRConstantLoadInstruction*)instruction);
+        break;
+    case HIRInstructionType::symbol_load:
+        copy = procedure->instruction<HIRSymbolLoadInstruction>(
+            *(const HIRSymbolLoadInstruction*)instruction);
+        break;
+    case HIRInstructionType::operation:
+        copy = procedure->instruction<HIROperationInstruction>(
+            *(const HIROperationInstruction*)instruction);
+        break;
+    case HIRInstructionType::jump:
+        copy = procedure->instruction<HIRJumpInstruction>(*(const HIRJumpInstruction*)instruction);
+        break;
+    case HIRInstructionType::jump_nz:
+        copy = procedure->instruction<HIRJumpNZInstruction>(
+            *(const HIRJumpNZInstruction*)instruction);
+        break;
+    case HIRInstructionType::call:
+        copy = procedure->instruction<HIRCallInstruction>(*(const HIRCallInstruction*)instruction);
+        // The return of the callee turns into a jump to the continuation
+        ((HIRCallInstruction*)copy)->is_tail_call = false;
+        break;
+    case HIRInstructionType::parameter:
+        copy = procedure->instruction<HIRParameterInstruction>(
+            *(const HIRParameterInstruction*)instruction);
+        break;
+    case HIRInstructionType::memory_load:
+        copy = procedure->instruction<HIRMemoryLoadInstruction>(
+            *(const HIRMemoryLoadInstruction*)instruction);
+        break;
+    case HIRInstructionType::memory_store:
+        copy = procedure->instruction<HIRMemoryStoreInstruction>(
+            *(const HIRMemoryStoreInstruction*)instruction);
+        break;
+    case HIRInstructionType::stack_alloc:
+        copy = procedure->instruction<HIRStackAllocInstruction>(
+            *(const HIRStackAllocInstruction*)instruction);
+        break;
+    case HIRInstructionType::select:
+        copy = procedure->instruction<HIRSelectInstruction>(
+            *(const HIRSelectInstruction*)instruction);
+        break;
+    case HIRInstructionType::inc_ref_counter:
+        copy = procedure->instruction<HIRIncRefCounterInstruction>(
+            *(const HIRIncRefCounterInstruction*)instruction);
+        break;
+    case HIRInstructionType::dec_ref_counter:
+        copy = procedure->instruction<HIRDecRefCounterInstruction>(
+            *(const HIRDecRefCounterInstruction*)instruction);
+        break;
+    default:
+        assert(!"Unexpected instruction in inlined procedure");
+    }
+
+    for (int i = 0; i < copy->get_operand_count(); i++) {
+        auto& operand = copy->get_operand(i);
+        operand = map_register(operand);
+    }
+
+    return copy;
+}
+
+bonk::IRRegister bonk::HIRInliner::map_register(IRRegister callee_register) {
+    auto it = register_map.find(callee_register);
+    if (it != register_map.end()) {
+        return it->second;
+    }
+
+    IRRegister caller_register = procedure->get_unused_register();
+    register_map[callee_register] = caller_register;
+    return caller_register;
+}
+
+int bonk::HIRInliner::get_size(HIRProcedure& procedure) {
+    auto it = procedure_sizes.find(&procedure);
+    if (it != procedure_sizes.end() && &procedure != this->procedure) {
+        return it->second;
+    }
+
+    int size = 0;
+    for (auto& block : procedure.base_blocks) {
+        for (auto instruction : block->instructions) {
+            if (instruction->type != HIRInstructionType::location &&
+                instruction->type != HIRInstructionType::file) {
+                size++;
+            }
+        }
+    }
+
+    procedure_sizes[&procedure] = size;
+    return size;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <unordered_map>
+#include "bonk/middleend/ir/hir.hpp"
+
+namespace bonk {
+
+// Splices imported procedures (bloks of other modules, whose bodies were
+// exported to their metafiles) into the procedures that call them. Callees
+// larger than max_callee_size instructions are never inlined, calls that
+// come from inlined code are only inlined up to max_depth levels deep, and
+// a caller stops growing once it reaches max_procedure_size instructions.
+// Imported procedures are removed from the program afterwards, since their
+// code belongs to other modules. Expects the procedures to be in SSA form.
+class HIRInliner {
+  public:
+    HIRInliner() = default;
+
+    int max_callee_size = 192;
+    int max_depth = 3;
+    int max_procedure_size = 4096;
+
+    bool inline_calls(HIRProgram& program);
+    bool inline_calls(HIRProcedure& procedure);
+
+  private:
+    void collect_imported_procedures(HIRProgram& program);
+    bool inline_call(HIRBaseBlock& block, std::list<HIRInstruction*>::iterator call_iterator,
+                     HIRProcedure& callee, int depth);
+    HIRInstruction* copy_instruction(HIRInstruction* instruction);
+    IRRegister map_register(IRRegister callee_register);
+    int get_size(HIRProcedure& procedure);
+
+    HIRProcedure* procedure = nullptr;
+    std::unordered_map<int, HIRProcedure*> imported_procedures;
+    std::unordered_map<HIRProcedure*, int> procedure_sizes;
+    std::unordered_map<HIRCallInstruction*, int> call_depths;
+    std::unordered_map<IRRegister, IRRegister> register_map;
+};
+
+} // namespace bonk
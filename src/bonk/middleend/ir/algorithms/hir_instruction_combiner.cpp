@@ -0,0 +1,667 @@
+
+#include "hir_instruction_combiner.hpp"
+#include "hir_constant_folder.hpp"
+
+static constexpr int type_bit(bonk::HIRDataType type) {
+    return 1 << (int)type;
+}
+
+static constexpr int integer_types =
+    type_bit(bonk::HIRDataType::byte) | type_bit(bonk::HIRDataType::hword) |
+    type_bit(bonk::HIRDataType::word) | type_bit(bonk::HIRDataType::dword);
+
+// Smaller integers are computed in word registers by the backend, so shifts
+// by their width would not give the same results
+static constexpr int word_types =
+    type_bit(bonk::HIRDataType::word) | type_bit(bonk::HIRDataType::dword);
+
+// High multiplication is only lowered for words
+static constexpr int word_only = type_bit(bonk::HIRDataType::word);
+
+// clang-format off
+const bonk::HIRInstructionCombiner::PatternTableEntry bonk::HIRInstructionCombiner::patterns[] = {
+    {HIROperationType::plus, integer_types, &HIRInstructionCombiner::move_constant_right},
+    {HIROperationType::plus, integer_types, &HIRInstructionCombiner::fold_identity},
+    {HIROperationType::plus, integer_types, &HIRInstructionCombiner::reassociate_constants},
+
+    {HIROperationType::minus, integer_types, &HIRInstructionCombiner::fold_identity},
+    {HIROperationType::minus, integer_types, &HIRInstructionCombiner::fold_same_operands},
+    {HIROperationType::minus, integer_types, &HIRInstructionCombiner::negate_subtrahend},
+
+    {HIROperationType::multiply, integer_types, &HIRInstructionCombiner::move_constant_right},
+    {HIROperationType::multiply, integer_types, &HIRInstructionCombiner::fold_identity},
+    {HIROperationType::multiply, integer_types, &HIRInstructionCombiner::fold_absorbing_constant},
+    {HIROperationType::multiply, integer_types, &HIRInstructionCombiner::reassociate_constants},
+    {HIROperationType::multiply, word_types, &HIRInstructionCombiner::reduce_multiplication},
+
+    {HIROperationType::divide, integer_types, &HIRInstructionCombiner::fold_identity},
+    {HIROperationType::divide, word_types, &HIRInstructionCombiner::reduce_division_by_power},
+    {HIROperationType::divide, word_only, &HIRInstructionCombiner::reduce_division_by_constant},
+
+    {HIROperationType::and_op, integer_types, &HIRInstructionCombiner::move_constant_right},
+    {HIROperationType::and_op, integer_types, &HIRInstructionCombiner::fold_identity},
+    {HIROperationType::and_op, integer_types, &HIRInstructionCombiner::fold_absorbing_constant},
+    {HIROperationType::and_op, integer_types, &HIRInstructionCombiner::fold_same_operands},
+    {HIROperationType::and_op, integer_types, &HIRInstructionCombiner::reassociate_constants},
+
+    {HIROperationType::or_op, integer_types, &HIRInstructionCombiner::move_constant_right},
+    {HIROperationType::or_op, integer_types, &HIRInstructionCombiner::fold_identity},
+    {HIROperationType::or_op, integer_types, &HIRInstructionCombiner::fold_absorbing_constant},
+    {HIROperationType::or_op, integer_types, &HIRInstructionCombiner::fold_same_operands},
+    {HIROperationType::or_op, integer_types, &HIRInstructionCombiner::reassociate_constants},
+
+    {HIROperationType::xor_op, integer_types, &HIRInstructionCombiner::move_constant_right},
+    {HIROperationType::xor_op, integer_types, &HIRInstructionCombiner::fold_identity},
+    {HIROperationType::xor_op, integer_types, &HIRInstructionCombiner::fold_same_operands},
+    {HIROperationType::xor_op, integer_types, &HIRInstructionCombiner::reassociate_constants},
+
+    {HIROperationType::shift_left, integer_types, &HIRInstructionCombiner::fold_identity},
+    {HIROperationType::shift_right, integer_types, &HIRInstructionCombiner::fold_identity},
+
+    {HIROperationType::not_op, integer_types, &HIRInstructionCombiner::fold_double_negation},
+
+    {HIROperationType::equal, integer_types, &HIRInstructionCombiner::move_constant_right},
+    {HIROperationType::equal, integer_types, &HIRInstructionCombiner::fold_same_operands},
+    {HIROperationType::equal, integer_types, &HIRInstructionCombiner::fold_compare_of_compare},
+
+    {HIROperationType::not_equal, integer_types, &HIRInstructionCombiner::move_constant_right},
+    {HIROperationType::not_equal, integer_types, &HIRInstructionCombiner::fold_same_operands},
+    {HIROperationType::not_equal, integer_types, &HIRInstructionCombiner::fold_compare_of_compare},
+
+    {HIROperationType::less, integer_types, &HIRInstructionCombiner::move_constant_right},
+    {HIROperationType::less, integer_types, &HIRInstructionCombiner::fold_same_operands},
+    {HIROperationType::less_equal, integer_types, &HIRInstructionCombiner::move_constant_right},
+    {HIROperationType::less_equal, integer_types, &HIRInstructionCombiner::fold_same_operands},
+    {HIROperationType::greater, integer_types, &HIRInstructionCombiner::move_constant_right},
+    {HIROperationType::greater, integer_types, &HIRInstructionCombiner::fold_same_operands},
+    {HIROperationType::greater_equal, integer_types, &HIRInstructionCombiner::move_constant_right},
+    {HIROperationType::greater_equal, integer_types, &HIRInstructionCombiner::fold_same_operands},
+};
+// clang-format on
+
+static bool is_comparison(bonk::HIROperationType operation) {
+    switch (operation) {
+    case bonk::HIROperationType::equal:
+    case bonk::HIROperationType::not_equal:
+    case bonk::HIROperationType::less:
+    case bonk::HIROperationType::less_equal:
+    case bonk::HIROperationType::greater:
+    case bonk::HIROperationType::greater_equal:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// The comparison that gives the same result with the operands swapped
+static bonk::HIROperationType mirror_comparison(bonk::HIROperationType operation) {
+    switch (operation) {
+    case bonk::HIROperationType::less:
+        return bonk::HIROperationType::greater;
+    case bonk::HIROperationType::less_equal:
+        return bonk::HIROperationType::greater_equal;
+    case bonk::HIROperationType::greater:
+        return bonk::HIROperationType::less;
+    case bonk::HIROperationType::greater_equal:
+        return bonk::HIROperationType::less_equal;
+    default:
+        return operation;
+    }
+}
+
+// The comparison that gives the opposite result. Only valid for integers,
+// since every ordered comparison with a NaN is false.
+static bonk::HIROperationType invert_comparison(bonk::HIROperationType operation) {
+    switch (operation) {
+    case bonk::HIROperationType::equal:
+        return bonk::HIROperationType::not_equal;
+    case bonk::HIROperationType::not_equal:
+        return bonk::HIROperationType::equal;
+    case bonk::HIROperationType::less:
+        return bonk::HIROperationType::greater_equal;
+    case bonk::HIROperationType::less_equal:
+        return bonk::HIROperationType::greater;
+    case bonk::HIROperationType::greater:
+        return bonk::HIROperationType::less_equal;
+    case bonk::HIROperationType::greater_equal:
+        return bonk::HIROperationType::less;
+    default:
+        assert(false);
+        return operation;
+    }
+}
+
+static bool is_power_of_two(unsigned long long value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+static int get_log2(unsigned long long value) {
+    int result = 0;
+    while (value > 1) {
+        value >>= 1;
+        result++;
+    }
+    return result;
+}
+
+// Finds the multiplier and the shift for a signed division of 32-bit values
+// by a constant, following Hacker's Delight, section 10-4. The divisor must
+// not be -1, 0 or 1.
+static void get_signed_magic_number(int32_t divisor, int32_t& multiplier, int& shift) {
+    const uint32_t two31 = 0x80000000u;
+
+    uint32_t absolute_divisor = divisor < 0 ? 0u - (uint32_t)divisor : (uint32_t)divisor;
+    uint32_t t = two31 + ((uint32_t)divisor >> 31);
+    uint32_t absolute_nc = t - 1 - t % absolute_divisor;
+    int power = 31;
+    uint32_t q1 = two31 / absolute_nc;
+    uint32_t r1 = two31 - q1 * absolute_nc;
+    uint32_t q2 = two31 / absolute_divisor;
+    uint32_t r2 = two31 - q2 * absolute_divisor;
+    uint32_t delta = 0;
+
+    do {
+        power++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= absolute_nc) {
+            q1++;
+            r1 -= absolute_nc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= absolute_divisor) {
+            q2++;
+            r2 -= absolute_divisor;
+        }
+        delta = absolute_divisor - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    multiplier = (int32_t)(q2 + 1);
+    if (divisor < 0) {
+        multiplier = (int32_t)(0u - (uint32_t)multiplier);
+    }
+    shift = power - 32;
+}
+
+bool bonk::HIRInstructionCombiner::combine(HIRProgram& program) {
+    for (auto& procedure : program.procedures) {
+        if (!combine(*procedure)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool bonk::HIRInstructionCombiner::combine(HIRProcedure& procedure) {
+    if (procedure.is_external) {
+        return true;
+    }
+
+    this->procedure = &procedure;
+    reset();
+
+    while (!work_list.empty()) {
+        auto instruction = work_list.back();
+        work_list.pop_back();
+        queued_instructions.erase(instruction);
+
+        // The instruction may have been replaced with a constant load
+        if (positions.find(instruction) == positions.end()) {
+            continue;
+        }
+
+        auto operation = (HIROperationInstruction*)instruction;
+        if (combine_operation(*operation)) {
+            if (positions.find(instruction) != positions.end()) {
+                push(instruction);
+            }
+            push_users(operation->target);
+        }
+    }
+
+    definitions.clear();
+    users.clear();
+    positions.clear();
+    this->procedure = nullptr;
+    return true;
+}
+
+void bonk::HIRInstructionCombiner::reset() {
+    definitions.assign(procedure->used_registers, nullptr);
+    users.assign(procedure->used_registers, {});
+    positions.clear();
+    work_list.clear();
+    queued_instructions.clear();
+
+    for (auto& block : procedure->base_blocks) {
+        for (auto it = block->instructions.begin(); it != block->instructions.end(); ++it) {
+            add_instruction(*it, {block.get(), it});
+        }
+    }
+
+    // The work list is a stack, so the first instructions are pushed last
+    for (auto it = procedure->base_blocks.rbegin(); it != procedure->base_blocks.rend(); ++it) {
+        auto& instructions = (*it)->instructions;
+        for (auto instruction = instructions.rbegin(); instruction != instructions.rend();
+             ++instruction) {
+            push(*instruction);
+        }
+    }
+}
+
+void bonk::HIRInstructionCombiner::add_instruction(HIRInstruction* instruction,
+                                                   InstructionPosition position) {
+    positions[instruction] = position;
+
+    for (int i = 0; i < instruction->get_write_register_count(); i++) {
+        definitions[instruction->get_write_register(i, nullptr)] = instruction;
+    }
+    for (int i = 0; i < instruction->get_read_register_count(); i++) {
+        users[instruction->get_read_register(i)].push_back(instruction);
+    }
+}
+
+void bonk::HIRInstructionCombiner::push(HIRInstruction* instruction) {
+    if (instruction->type != HIRInstructionType::operation) {
+        return;
+    }
+    if (queued_instructions.insert(instruction).second) {
+        work_list.push_back(instruction);
+    }
+}
+
+void bonk::HIRInstructionCombiner::push_users(IRRegister register_id) {
+    for (auto user : users[register_id]) {
+        push(user);
+    }
+}
+
+bool bonk::HIRInstructionCombiner::combine_operation(HIROperationInstruction& instruction) {
+    // Operations on constants are folded whatever their type is
+    if (fold_constants(instruction)) {
+        return true;
+    }
+
+    for (auto& entry : patterns) {
+        if (entry.operation == instruction.operation_type &&
+            (entry.operand_types & type_bit(instruction.operand_type)) &&
+            (this->*entry.pattern)(instruction)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool bonk::HIRInstructionCombiner::fold_constants(HIROperationInstruction& instruction) {
+    auto left = get_constant(instruction.left);
+    if (!left.has_value()) {
+        return false;
+    }
+
+    std::optional<long long> right;
+    if (instruction.right.has_value()) {
+        right = get_constant(*instruction.right);
+        if (!right.has_value()) {
+            return false;
+        }
+    }
+
+    auto result = HIRConstantFolder::fold(instruction, *left, right);
+    if (!result.has_value()) {
+        return false;
+    }
+
+    replace_with_constant(instruction, *result);
+    return true;
+}
+
+bool bonk::HIRInstructionCombiner::move_constant_right(HIROperationInstruction& instruction) {
+    if (!instruction.right.has_value() || !get_constant(instruction.left).has_value() ||
+        get_constant(*instruction.right).has_value()) {
+        return false;
+    }
+
+    set_operation(instruction, mirror_comparison(instruction.operation_type), *instruction.right,
+                  instruction.left);
+    return true;
+}
+
+bool bonk::HIRInstructionCombiner::negate_subtrahend(HIROperationInstruction& instruction) {
+    // x - c becomes x + (-c), so that it can be re-associated with other additions
+    auto constant = get_constant(*instruction.right);
+    if (!constant.has_value()) {
+        return false;
+    }
+
+    long long negated = HIRConstantFolder::normalize(
+        (long long)(0ull - (unsigned long long)*constant), instruction.operand_type);
+
+    set_operation(instruction, HIROperationType::plus, instruction.left,
+                  insert_constant(instruction, negated, instruction.operand_type));
+    return true;
+}
+
+bool bonk::HIRInstructionCombiner::fold_identity(HIROperationInstruction& instruction) {
+    auto constant = get_constant(*instruction.right);
+    if (!constant.has_value() || instruction.operand_type != instruction.result_type) {
+        return false;
+    }
+
+    long long identity = 0;
+    switch (instruction.operation_type) {
+    case HIROperationType::multiply:
+    case HIROperationType::divide:
+        identity = 1;
+        break;
+    case HIROperationType::and_op:
+        identity = -1;
+        break;
+    default:
+        break;
+    }
+
+    if (*constant != identity) {
+        return false;
+    }
+
+    replace_with_register(instruction, instruction.left);
+    return true;
+}
+
+bool bonk::HIRInstructionCombiner::fold_absorbing_constant(HIROperationInstruction& instruction) {
+    // x * 0 and x & 0 are zero, x | -1 is -1
+    auto constant = get_constant(*instruction.right);
+    long long absorbing = instruction.operation_type == HIROperationType::or_op ? -1 : 0;
+
+    if (!constant.has_value() || *constant != absorbing) {
+        return false;
+    }
+
+    replace_with_constant(instruction, absorbing);
+    return true;
+}
+
+bool bonk::HIRInstructionCombiner::fold_same_operands(HIROperationInstruction& instruction) {
+    if (instruction.right != instruction.left) {
+        return false;
+    }
+
+    switch (instruction.operation_type) {
+    case HIROperationType::and_op:
+    case HIROperationType::or_op:
+        replace_with_register(instruction, instruction.left);
+        return true;
+    case HIROperationType::equal:
+    case HIROperationType::less_equal:
+    case HIROperationType::greater_equal:
+        replace_with_constant(instruction, 1);
+        return true;
+    default:
+        // x - x, x ^ x, x != x, x < x and x > x
+        replace_with_constant(instruction, 0);
+        return true;
+    }
+}
+
+bool bonk::HIRInstructionCombiner::reassociate_constants(HIROperationInstruction& instruction) {
+    // (x op c1) op c2 becomes x op (c1 op c2)
+    auto outer_constant = get_constant(*instruction.right);
+    auto inner = get_operation(instruction.left);
+
+    if (!outer_constant.has_value() || !inner ||
+        inner->operation_type != instruction.operation_type ||
+        inner->operand_type != instruction.operand_type ||
+        inner->result_type != instruction.result_type || !inner->right.has_value()) {
+        return false;
+    }
+
+    auto inner_constant = get_constant(*inner->right);
+    if (!inner_constant.has_value()) {
+        return false;
+    }
+
+    auto constant = HIRConstantFolder::fold(instruction, *inner_constant, *outer_constant);
+    if (!constant.has_value()) {
+        return false;
+    }
+
+    set_operation(instruction, instruction.operation_type, inner->left,
+                  insert_constant(instruction, *constant, instruction.operand_type));
+    return true;
+}
+
+bool bonk::HIRInstructionCombiner::fold_compare_of_compare(HIROperationInstruction& instruction) {
+    // Comparisons give zero or one, so comparing their result with either
+    // of them is the comparison itself or its inverse
+    auto constant = get_constant(*instruction.right);
+    auto inner = get_operation(instruction.left);
+
+    if (!constant.has_value() || (*constant != 0 && *constant != 1) || !inner ||
+        !is_comparison(inner->operation_type)) {
+        return false;
+    }
+
+    bool is_inverted = (instruction.operation_type == HIROperationType::equal) == (*constant == 0);
+    auto operation = inner->operation_type;
+
+    if (is_inverted) {
+        if (!(integer_types & type_bit(inner->operand_type))) {
+            return false;
+        }
+        operation = invert_comparison(operation);
+    }
+
+    instruction.operand_type = inner->operand_type;
+    set_operation(instruction, operation, inner->left, inner->right);
+    return true;
+}
+
+bool bonk::HIRInstructionCombiner::fold_double_negation(HIROperationInstruction& instruction) {
+    // Negating a comparison result twice gives it back, whether the negation
+    // is logical or bitwise
+    auto inner = get_operation(instruction.left);
+    if (!inner || inner->operation_type != HIROperationType::not_op) {
+        return false;
+    }
+
+    auto comparison = get_operation(inner->left);
+    if (!comparison || !is_comparison(comparison->operation_type) ||
+        comparison->result_type != instruction.result_type) {
+        return false;
+    }
+
+    replace_with_register(instruction, inner->left);
+    return true;
+}
+
+bool bonk::HIRInstructionCombiner::reduce_multiplication(HIROperationInstruction& instruction) {
+    auto constant = get_constant(*instruction.right);
+    if (!constant.has_value() || *constant <= 1 || !is_power_of_two(*constant)) {
+        return false;
+    }
+
+    set_operation(
+        instruction, HIROperationType::shift_left, instruction.left,
+        insert_constant(instruction, get_log2(*constant), instruction.operand_type));
+    return true;
+}
+
+// Divisions by powers of two become shifts
+bool bonk::HIRInstructionCombiner::reduce_division_by_power(HIROperationInstruction& instruction) {
+    auto constant = get_constant(*instruction.right);
+    if (!constant.has_value()) {
+        return false;
+    }
+
+    auto absolute = *constant < 0 ? 0ull - (unsigned long long)*constant
+                                  : (unsigned long long)*constant;
+    if (absolute <= 1 || !is_power_of_two(absolute)) {
+        return false;
+    }
+
+    // Division rounds towards zero, so negative dividends are biased by
+    // the divisor minus one before shifting
+    auto type = instruction.operand_type;
+    int bits = type == HIRDataType::dword ? 64 : 32;
+    int shift = get_log2(absolute);
+    IRRegister dividend = instruction.left;
+
+    IRRegister sign = insert_operation(instruction, HIROperationType::shift_right, dividend,
+                                       insert_constant(instruction, bits - 1, type), type);
+    IRRegister bias =
+        insert_operation(instruction, HIROperationType::and_op, sign,
+                         insert_constant(instruction, (long long)(absolute - 1), type), type);
+    IRRegister biased = insert_operation(instruction, HIROperationType::plus, dividend, bias, type);
+    IRRegister shift_register = insert_constant(instruction, shift, type);
+
+    if (*constant > 0) {
+        set_operation(instruction, HIROperationType::shift_right, biased, shift_register);
+    } else {
+        IRRegister quotient = insert_operation(instruction, HIROperationType::shift_right, biased,
+                                               shift_register, type);
+        set_operation(instruction, HIROperationType::minus, insert_constant(instruction, 0, type),
+                      quotient);
+    }
+    return true;
+}
+
+bool bonk::HIRInstructionCombiner::reduce_division_by_constant(
+    HIROperationInstruction& instruction) {
+    auto constant = get_constant(*instruction.right);
+    if (!constant.has_value() || *constant == -1 || *constant == 0 || *constant == 1) {
+        return false;
+    }
+
+    int32_t multiplier = 0;
+    int shift = 0;
+    get_signed_magic_number((int32_t)*constant, multiplier, shift);
+
+    auto type = instruction.operand_type;
+    IRRegister dividend = instruction.left;
+    IRRegister quotient =
+        insert_operation(instruction, HIROperationType::multiply_high, dividend,
+                         insert_constant(instruction, multiplier, type), type);
+
+    // The multiplier may have overflowed into the sign bit
+    if (*constant > 0 && multiplier < 0) {
+        quotient = insert_operation(instruction, HIROperationType::plus, quotient, dividend, type);
+    } else if (*constant < 0 && multiplier > 0) {
+        quotient = insert_operation(instruction, HIROperationType::minus, quotient, dividend, type);
+    }
+
+    if (shift > 0) {
+        quotient = insert_operation(instruction, HIROperationType::shift_right, quotient,
+                                    insert_constant(instruction, shift, type), type);
+    }
+
+    // Negative quotients are rounded towards zero by adding one
+    IRRegister sign = insert_operation(instruction, HIROperationType::shift_right, quotient,
+                                       insert_constant(instruction, 31, type), type);
+    set_operation(instruction, HIROperationType::minus, quotient, sign);
+    return true;
+}
+
+std::optional<long long> bonk::HIRInstructionCombiner::get_constant(IRRegister register_id) {
+    auto definition = definitions[register_id];
+    if (!definition || definition->type != HIRInstructionType::constant_load) {
+        return std::nullopt;
+    }
+    return ((HIRConstantLoadInstruction*)definition)->constant;
+}
+
+bonk::HIROperationInstruction* bonk::HIRInstructionCombiner::get_operation(IRRegister register_id) {
+    auto definition = definitions[register_id];
+    if (!definition || definition->type != HIRInstructionType::operation) {
+        return nullptr;
+    }
+    return (HIROperationInstruction*)definition;
+}
+
+bonk::IRRegister bonk::HIRInstructionCombiner::insert_constant(HIRInstruction& before,
+                                                              long long value, HIRDataType type) {
+    IRRegister target = procedure->get_unused_register();
+    definitions.resize(procedure->used_registers, nullptr);
+    users.resize(procedure->used_registers);
+
+    auto& position = positions[&before];
+    auto constant = procedure->instruction<HIRConstantLoadInstruction>(
+        target, HIRConstantFolder::normalize(value, type), type);
+    auto iterator = position.block->instructions.insert(position.iterator, constant);
+    add_instruction(constant, {position.block, iterator});
+
+    return target;
+}
+
+bonk::IRRegister bonk::HIRInstructionCombiner::insert_operation(HIRInstruction& before,
+                                                               HIROperationType operation,
+                                                               IRRegister left, IRRegister right,
+                                                               HIRDataType type) {
+    IRRegister target = procedure->get_unused_register();
+    definitions.resize(procedure->used_registers, nullptr);
+    users.resize(procedure->used_registers);
+
+    auto instruction = procedure->instruction<HIROperationInstruction>();
+    instruction->target = target;
+    instruction->left = left;
+    instruction->right = right;
+    instruction->operation_type = operation;
+    instruction->operand_type = type;
+    instruction->result_type = type;
+
+    auto& position = positions[&before];
+    auto iterator = position.block->instructions.insert(position.iterator, instruction);
+    add_instruction(instruction, {position.block, iterator});
+    push(instruction);
+
+    return target;
+}
+
+void bonk::HIRInstructionCombiner::set_operation(HIROperationInstruction& instruction,
+                                                 HIROperationType operation, IRRegister left,
+                                                 std::optional<IRRegister> right) {
+    // The users of the old operands keep a stale entry, which only costs an
+    // extra visit
+    instruction.operation_type = operation;
+    instruction.left = left;
+    instruction.right = right;
+
+    users[left].push_back(&instruction);
+    if (right.has_value()) {
+        users[*right].push_back(&instruction);
+    }
+}
+
+void bonk::HIRInstructionCombiner::replace_with_constant(HIROperationInstruction& instruction,
+                                                         long long value) {
+    auto constant = procedure->instruction<HIRConstantLoadInstruction>(
+        instruction.target, HIRConstantFolder::normalize(value, instruction.result_type),
+        instruction.result_type);
+
+    auto position = positions[&instruction];
+    *position.iterator = constant;
+    positions.erase(&instruction);
+    positions[constant] = position;
+    definitions[instruction.target] = constant;
+
+    push_users(instruction.target);
+}
+
+void bonk::HIRInstructionCombiner::replace_with_register(HIROperationInstruction& instruction,
+                                                         IRRegister register_id) {
+    for (auto user : users[instruction.target]) {
+        for (int i = 0; i < user->get_read_register_count(); i++) {
+            auto& read_register = user->get_read_register(i);
+            if (read_register == instruction.target) {
+                read_register = register_id;
+            }
+        }
+        users[register_id].push_back(user);
+        push(user);
+    }
+    users[instruction.target].clear();
+
+    // The copy is left without uses
+    set_operation(instruction, HIROperationType::assign, register_id, std::nullopt);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "bonk/middleend/ir/hir.hpp"
+
+namespace bonk {
+
+// Simplifies operations with algebraic identities. Each operation is matched
+// against a table of patterns, keyed by the operation type and the operand
+// types it applies to. Patterns fold constants and identities like x + 0 or
+// x - x, move constants to the right operand and re-associate chains of them,
+// fold comparisons of comparison results, and reduce multiplications and
+// divisions by constants to shifts and high multiplications.
+//
+// Instructions are kept on a work list. When an operation changes, its users
+// are revisited, so the procedure is never rescanned as a whole. Operations
+// made redundant are turned into copies and their uses are redirected, the
+// dead definitions are left for HIRUnusedDefDeleter. Expects the procedure to
+// be in SSA form.
+class HIRInstructionCombiner {
+  public:
+    HIRInstructionCombiner() = default;
+
+    bool combine(HIRProgram& program);
+    bool combine(HIRProcedure& procedure);
+
+  private:
+    using Pattern = bool (HIRInstructionCombiner::*)(HIROperationInstruction& instruction);
+
+    struct PatternTableEntry {
+        HIROperationType operation;
+        // Bit mask of the operand types the pattern applies to
+        int operand_types;
+        Pattern pattern;
+    };
+
+    struct InstructionPosition {
+        HIRBaseBlock* block;
+        std::list<HIRInstruction*>::iterator iterator;
+    };
+
+    static const PatternTableEntry patterns[];
+
+    void reset();
+    void add_instruction(HIRInstruction* instruction, InstructionPosition position);
+    void push(HIRInstruction* instruction);
+    void push_users(IRRegister register_id);
+    bool combine_operation(HIROperationInstruction& instruction);
+
+    bool fold_constants(HIROperationInstruction& instruction);
+    bool move_constant_right(HIROperationInstruction& instruction);
+    bool negate_subtrahend(HIROperationInstruction& instruction);
+    bool fold_identity(HIROperationInstruction& instruction);
+    bool fold_absorbing_constant(HIROperationInstruction& instruction);
+    bool fold_same_operands(HIROperationInstruction& instruction);
+    bool reassociate_constants(HIROperationInstruction& instruction);
+    bool fold_compare_of_compare(HIROperationInstruction& instruction);
+    bool fold_double_negation(HIROperationInstruction& instruction);
+    bool reduce_multiplication(HIROperationInstruction& instruction);
+    bool reduce_division_by_power(HIROperationInstruction& instruction);
+    bool reduce_division_by_constant(HIROperationInstruction& instruction);
+
+    std::optional<long long> get_constant(IRRegister register_id);
+    HIROperationInstruction* get_operation(IRRegister register_id);
+    IRRegister insert_constant(HIRInstruction& before, long long value, HIRDataType type);
+    IRRegister insert_operation(HIRInstruction& before, HIROperationType operation,
+                                IRRegister left, IRRegister right, HIRDataType type);
+    void set_operation(HIROperationInstruction& instruction, HIROperationType operation,
+                       IRRegister left, std::optional<IRRegister> right);
+    void replace_with_constant(HIROperationInstruction& instruction, long long value);
+    void replace_with_register(HIROperationInstruction& instruction, IRRegister register_id);
+
+    HIRProcedure* procedure = nullptr;
+    std::vector<HIRInstruction*> definitions;
+    std::vector<std::vector<HIRInstruction*>> users;
+    std::unordered_map<HIRInstruction*, InstructionPosition> positions;
+    std::vector<HIRInstruction*> work_list;
+    std::unordered_set<HIRInstruction*> queued_instructions;
+};
+
+} // namespace bonk
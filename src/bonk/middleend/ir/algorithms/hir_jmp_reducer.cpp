@@ -35,6 +35,18 @@ bool bonk::HIRJmpReducer::reduce(bonk::HIRProcedure& procedure) {
             continue;
         }
 
+        // Phi functions of a block with a single predecessor have a single
+        // source, and become copies once the block is merged into it
+        for (auto& instruction : block->instructions) {
+            if (instruction->type != HIRInstructionType::phi_function) {
+                break;
+            }
+            auto phi = (HIRPhiFunctionInstruction*)instruction;
+            assert(phi->sources.size() == 1);
+            instruction = &block->instruction<HIROperationInstruction>()->set_assign(
+                phi->target, phi->sources[0], phi->type);
+        }
+
         // Remove the jump from the predecessor
         predecessor->instructions.pop_back();
 
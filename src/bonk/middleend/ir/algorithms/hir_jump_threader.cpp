@@ -0,0 +1,308 @@
+
+#include "hir_jump_threader.hpp"
+#include <algorithm>
+
+// Threaded edges may form a loop of empty blocks if the program never leaves
+// it, so the number of rounds is limited
+static constexpr int max_threading_rounds = 8;
+
+// Branch facts are only looked up this far along single-predecessor chains
+static constexpr int max_chain_length = 8;
+
+bool bonk::HIRJumpThreader::thread_jumps(HIRProgram& program) {
+    for (auto& procedure : program.procedures) {
+        if (!thread_jumps(*procedure)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool bonk::HIRJumpThreader::thread_jumps(HIRProcedure& procedure) {
+    if (procedure.is_external) {
+        return true;
+    }
+
+    this->procedure = &procedure;
+    collect_definitions();
+
+    for (int round = 0; round < max_threading_rounds; round++) {
+        bool changed = false;
+
+        // Folding first leaves fewer uses of the tested phi functions, which
+        // makes more of them threadable
+        for (auto& block : procedure.base_blocks) {
+            changed |= fold_correlated_branch(*block);
+        }
+        for (auto& block : procedure.base_blocks) {
+            changed |= thread_branch(*block);
+        }
+
+        if (!changed) {
+            break;
+        }
+    }
+
+    definitions.clear();
+    use_counts.clear();
+    this->procedure = nullptr;
+    return true;
+}
+
+void bonk::HIRJumpThreader::collect_definitions() {
+    definitions.assign(procedure->used_registers, nullptr);
+    use_counts.assign(procedure->used_registers, 0);
+
+    for (auto& block : procedure->base_blocks) {
+        for (auto instruction : block->instructions) {
+            for (int i = 0; i < instruction->get_write_register_count(); i++) {
+                definitions[instruction->get_write_register(i, nullptr)] = instruction;
+            }
+            for (int i = 0; i < instruction->get_read_register_count(); i++) {
+                use_counts[instruction->get_read_register(i)]++;
+            }
+        }
+    }
+}
+
+bool bonk::HIRJumpThreader::fold_correlated_branch(HIRBaseBlock& block) {
+    if (block.instructions.empty() ||
+        block.instructions.back()->type != HIRInstructionType::jump_nz ||
+        block.predecessors.size() != 1) {
+        return false;
+    }
+
+    auto jump = (HIRJumpNZInstruction*)block.instructions.back();
+    if (jump->nz_label == jump->z_label) {
+        return false;
+    }
+
+    auto is_taken = get_value_on_edge(*block.predecessors[0], block, jump->condition);
+    if (!is_taken.has_value()) {
+        return false;
+    }
+
+    int target = get_target_label(jump, *is_taken);
+    int skipped = get_target_label(jump, !*is_taken);
+
+    use_counts[jump->condition]--;
+    block.instructions.back() = block.instruction<HIRJumpInstruction>(target);
+    procedure->remove_control_flow_edge(&block, procedure->base_blocks[skipped].get());
+    return true;
+}
+
+bool bonk::HIRJumpThreader::thread_branch(HIRBaseBlock& block) {
+    auto phi = get_branch_phi(block);
+    if (!phi) {
+        return false;
+    }
+
+    auto jump = (HIRJumpNZInstruction*)block.instructions.back();
+    bool changed = false;
+
+    // Retargeted edges are removed from the predecessors of the block
+    for (int i = 0; i < block.predecessors.size();) {
+        auto& predecessor = *block.predecessors[i];
+        IRRegister source = phi->sources[i];
+
+        if (auto is_taken = get_value_on_edge(predecessor, block, source)) {
+            auto& target = *procedure->base_blocks[get_target_label(jump, *is_taken)];
+            if (retarget_edge(predecessor, block, block, target)) {
+                changed = true;
+                continue;
+            }
+        } else if (is_forwarding_block(predecessor, source)) {
+            changed |= thread_forwarded_edges(predecessor, source, block);
+        }
+        i++;
+    }
+
+    return changed;
+}
+
+bool bonk::HIRJumpThreader::thread_forwarded_edges(HIRBaseBlock& forwarder,
+                                                   IRRegister forwarded_phi,
+                                                   HIRBaseBlock& branch) {
+    auto phi = (HIRPhiFunctionInstruction*)definitions[forwarded_phi];
+    auto jump = (HIRJumpNZInstruction*)branch.instructions.back();
+    bool changed = false;
+
+    for (int i = 0; i < forwarder.predecessors.size();) {
+        auto& predecessor = *forwarder.predecessors[i];
+
+        if (auto is_taken = get_value_on_edge(predecessor, forwarder, phi->sources[i])) {
+            auto& target = *procedure->base_blocks[get_target_label(jump, *is_taken)];
+            if (retarget_edge(predecessor, forwarder, branch, target)) {
+                changed = true;
+                continue;
+            }
+        }
+        i++;
+    }
+
+    return changed;
+}
+
+bool bonk::HIRJumpThreader::retarget_edge(HIRBaseBlock& from, HIRBaseBlock& via,
+                                          HIRBaseBlock& branch, HIRBaseBlock& to) {
+    if (&to == &via || &to == &branch || &to == &from || from.instructions.empty()) {
+        return false;
+    }
+
+    // A second edge between the same blocks would need two phi sources for
+    // one predecessor
+    if (std::find(to.predecessors.begin(), to.predecessors.end(), &from) !=
+        to.predecessors.end()) {
+        return false;
+    }
+
+    auto terminator = from.instructions.back();
+    if (terminator->type == HIRInstructionType::jump) {
+        ((HIRJumpInstruction*)terminator)->label_id = to.index;
+    } else if (terminator->type == HIRInstructionType::jump_nz) {
+        auto jump = (HIRJumpNZInstruction*)terminator;
+        if (jump->nz_label == jump->z_label) {
+            return false;
+        }
+        if (jump->nz_label == via.index) {
+            jump->nz_label = to.index;
+        } else {
+            jump->z_label = to.index;
+        }
+    } else {
+        return false;
+    }
+
+    // The edge carries the values that the branch passed on to 'to'. These
+    // are defined above 'via', since phi functions of the blocks being
+    // skipped are only used by the threaded branch.
+    int branch_index = std::find(to.predecessors.begin(), to.predecessors.end(), &branch) -
+                       to.predecessors.begin();
+    int from_index = std::find(via.predecessors.begin(), via.predecessors.end(), &from) -
+                     via.predecessors.begin();
+
+    for (auto instruction : via.instructions) {
+        if (instruction->type != HIRInstructionType::phi_function) {
+            break;
+        }
+        use_counts[((HIRPhiFunctionInstruction*)instruction)->sources[from_index]]--;
+    }
+    procedure->remove_control_flow_edge(&from, &via);
+    procedure->add_control_flow_edge(&from, &to);
+
+    for (auto instruction : to.instructions) {
+        if (instruction->type != HIRInstructionType::phi_function) {
+            break;
+        }
+        auto phi = (HIRPhiFunctionInstruction*)instruction;
+        IRRegister source = phi->sources[branch_index];
+        phi->sources.push_back(source);
+        use_counts[source]++;
+    }
+
+    return true;
+}
+
+std::optional<bool> bonk::HIRJumpThreader::get_value_on_edge(HIRBaseBlock& from,
+                                                             HIRBaseBlock& to,
+                                                             IRRegister register_id) {
+    auto definition = definitions[register_id];
+    if (definition && definition->type == HIRInstructionType::constant_load) {
+        return ((HIRConstantLoadInstruction*)definition)->constant != 0;
+    }
+
+    // Walk up while every path to the edge comes through a single block
+    HIRBaseBlock* block = &from;
+    HIRBaseBlock* successor = &to;
+
+    for (int i = 0; i < max_chain_length; i++) {
+        if (!block->instructions.empty() &&
+            block->instructions.back()->type == HIRInstructionType::jump_nz) {
+            auto jump = (HIRJumpNZInstruction*)block->instructions.back();
+            if (jump->condition == register_id && jump->nz_label != jump->z_label) {
+                return jump->nz_label == successor->index;
+            }
+        }
+
+        if (block->predecessors.size() != 1) {
+            break;
+        }
+        successor = block;
+        block = block->predecessors[0];
+    }
+
+    return std::nullopt;
+}
+
+bonk::HIRPhiFunctionInstruction* bonk::HIRJumpThreader::get_branch_phi(HIRBaseBlock& block) {
+    if (block.instructions.empty() ||
+        block.instructions.back()->type != HIRInstructionType::jump_nz) {
+        return nullptr;
+    }
+
+    auto jump = (HIRJumpNZInstruction*)block.instructions.back();
+    if (jump->nz_label == jump->z_label) {
+        return nullptr;
+    }
+
+    // The block may only join values for the jnz, so that the successors do
+    // not need new phi functions when they are entered from elsewhere
+    HIRPhiFunctionInstruction* branch_phi = nullptr;
+
+    for (auto instruction : block.instructions) {
+        switch (instruction->type) {
+        case HIRInstructionType::label:
+        case HIRInstructionType::location:
+        case HIRInstructionType::jump_nz:
+            break;
+        case HIRInstructionType::phi_function: {
+            auto phi = (HIRPhiFunctionInstruction*)instruction;
+            if (phi->target == jump->condition && use_counts[phi->target] == 1) {
+                branch_phi = phi;
+            } else if (use_counts[phi->target] != 0) {
+                return nullptr;
+            }
+            break;
+        }
+        default:
+            return nullptr;
+        }
+    }
+
+    return branch_phi;
+}
+
+bool bonk::HIRJumpThreader::is_forwarding_block(HIRBaseBlock& block, IRRegister forwarded_phi) {
+    if (block.instructions.empty() ||
+        block.instructions.back()->type != HIRInstructionType::jump) {
+        return false;
+    }
+
+    bool forwards_phi = false;
+
+    for (auto instruction : block.instructions) {
+        switch (instruction->type) {
+        case HIRInstructionType::label:
+        case HIRInstructionType::location:
+        case HIRInstructionType::jump:
+            break;
+        case HIRInstructionType::phi_function: {
+            auto phi = (HIRPhiFunctionInstruction*)instruction;
+            if (phi->target == forwarded_phi && use_counts[phi->target] == 1) {
+                forwards_phi = true;
+            } else if (use_counts[phi->target] != 0) {
+                return false;
+            }
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+
+    return forwards_phi;
+}
+
+int bonk::HIRJumpThreader::get_target_label(HIRJumpNZInstruction* jump, bool is_taken) {
+    return is_taken ? jump->nz_label : jump->z_label;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <optional>
+#include <vector>
+#include "bonk/middleend/ir/hir.hpp"
+
+namespace bonk {
+
+// Lazy 'and' and 'or' operations join their arms with a phi function, which
+// is often tested by a jnz right away. On many of the incoming edges the
+// value of the phi is already known: it is either a constant, or the register
+// that was tested by the jnz the edge comes from. Such edges are retargeted
+// to the successor the jnz would choose, so the join and the test are skipped.
+// When the edge comes from a block that only forwards another phi, the
+// predecessors of that block are threaded through both joins.
+//
+// A jnz is also folded when a dominating jnz on a chain of single-predecessor
+// blocks has already tested its condition. Expects the procedures to be in
+// SSA form. Blocks left without predecessors are not deleted.
+class HIRJumpThreader {
+  public:
+    HIRJumpThreader() = default;
+
+    bool thread_jumps(HIRProgram& program);
+    bool thread_jumps(HIRProcedure& procedure);
+
+  private:
+    void collect_definitions();
+    bool fold_correlated_branch(HIRBaseBlock& block);
+    bool thread_branch(HIRBaseBlock& block);
+    bool thread_forwarded_edges(HIRBaseBlock& forwarder, IRRegister forwarded_phi,
+                                HIRBaseBlock& branch);
+    bool retarget_edge(HIRBaseBlock& from, HIRBaseBlock& via, HIRBaseBlock& branch,
+                       HIRBaseBlock& to);
+
+    std::optional<bool> get_value_on_edge(HIRBaseBlock& from, HIRBaseBlock& to,
+                                          IRRegister register_id);
+    HIRPhiFunctionInstruction* get_branch_phi(HIRBaseBlock& block);
+    bool is_forwarding_block(HIRBaseBlock& block, IRRegister forwarded_phi);
+    int get_target_label(HIRJumpNZInstruction* jump, bool is_taken);
+
+    HIRProcedure* procedure = nullptr;
+    std::vector<HIRInstruction*> definitions;
+    std::vector<int> use_counts;
+};
+
+} // namespace bonk
@@ -0,0 +1,202 @@
+
+#include "hir_loop_finder.hpp"
+#include <algorithm>
+
+bonk::HIRLoopFinder::HIRLoopFinder(bonk::HIRDominatorFinder& dominator_finder)
+    : procedure(dominator_finder.procedure), dominator_finder(dominator_finder) {
+}
+
+std::vector<bonk::HIRLoop>& bonk::HIRLoopFinder::get_loops() {
+    if (!is_built) {
+        find_loops();
+        build_loop_nest();
+        is_built = true;
+    }
+    return loops;
+}
+
+void bonk::HIRLoopFinder::find_loops() {
+    auto& dominators = dominator_finder.get_dominators();
+    std::vector<int> loop_by_header(procedure.base_blocks.size(), -1);
+
+    for (auto& block : procedure.base_blocks) {
+        // Unreachable blocks are dominated by everything
+        if (!dominators[block->index][block->index]) {
+            continue;
+        }
+
+        for (auto successor : block->successors) {
+            if (!dominators[block->index][successor->index]) {
+                continue;
+            }
+
+            int& loop_index = loop_by_header[successor->index];
+            if (loop_index == -1) {
+                loop_index = loops.size();
+                auto& loop = loops.emplace_back();
+                loop.header = successor->index;
+                loop.blocks = DynamicBitSet(procedure.base_blocks.size());
+                loop.blocks[loop.header] = true;
+            }
+
+            auto& loop = loops[loop_index];
+            if (std::find(loop.latches.begin(), loop.latches.end(), block->index) ==
+                loop.latches.end()) {
+                loop.latches.push_back(block->index);
+            }
+            collect_loop_blocks(loop, block->index);
+        }
+    }
+}
+
+void bonk::HIRLoopFinder::collect_loop_blocks(HIRLoop& loop, int latch) {
+    std::vector<int> stack;
+
+    if (!loop.blocks[latch]) {
+        loop.blocks[latch] = true;
+        stack.push_back(latch);
+    }
+
+    while (!stack.empty()) {
+        auto& block = *procedure.base_blocks[stack.back()];
+        stack.pop_back();
+
+        for (auto predecessor : block.predecessors) {
+            if (!loop.blocks[predecessor->index]) {
+                loop.blocks[predecessor->index] = true;
+                stack.push_back(predecessor->index);
+            }
+        }
+    }
+}
+
+void bonk::HIRLoopFinder::build_loop_nest() {
+    // Inner loops have less blocks than the loops containing them
+    std::sort(loops.begin(), loops.end(), [](const HIRLoop& a, const HIRLoop& b) {
+        return a.blocks.count() < b.blocks.count();
+    });
+
+    for (int i = 0; i < loops.size(); i++) {
+        for (int j = i + 1; j < loops.size(); j++) {
+            if (loops[j].contains(loops[i].header)) {
+                loops[i].parent = j;
+                break;
+            }
+        }
+    }
+
+    for (int i = (int)loops.size() - 1; i >= 0; i--) {
+        if (loops[i].parent != -1) {
+            loops[i].depth = loops[loops[i].parent].depth + 1;
+        }
+    }
+}
+
+bonk::HIRBaseBlock* bonk::HIRLoopFinder::ensure_preheader(HIRLoop& loop) {
+    auto& header = *procedure.base_blocks[loop.header];
+
+    std::vector<int> outside_edges;
+    for (int i = 0; i < header.predecessors.size(); i++) {
+        if (!loop.contains(header.predecessors[i]->index)) {
+            outside_edges.push_back(i);
+        }
+    }
+
+    if (outside_edges.empty()) {
+        return nullptr;
+    }
+
+    if (outside_edges.size() == 1) {
+        auto predecessor = header.predecessors[outside_edges[0]];
+        if (predecessor->successors.size() == 1 &&
+            predecessor->index != procedure.start_block_index) {
+            loop.preheader = predecessor->index;
+            return predecessor;
+        }
+    }
+
+    procedure.create_base_block();
+    auto& preheader = *procedure.base_blocks.back();
+    loop.preheader = preheader.index;
+
+    // The preheader belongs to all the loops containing this one
+    for (auto& other_loop : loops) {
+        other_loop.blocks.resize(procedure.base_blocks.size());
+    }
+    for (int parent = loop.parent; parent != -1; parent = loops[parent].parent) {
+        loops[parent].blocks[preheader.index] = true;
+    }
+
+    // Phi functions of the header get a single source from the preheader.
+    // If there are several outer predecessors, the preheader merges them.
+    for (auto instruction : header.instructions) {
+        if (instruction->type != HIRInstructionType::phi_function) {
+            break;
+        }
+
+        auto phi = (HIRPhiFunctionInstruction*)instruction;
+        IRRegister outside_value = phi->sources[outside_edges[0]];
+
+        if (outside_edges.size() > 1) {
+            auto preheader_phi = preheader.instruction<HIRPhiFunctionInstruction>();
+            preheader_phi->type = phi->type;
+            preheader_phi->target = procedure.get_unused_register();
+            for (int edge : outside_edges) {
+                preheader_phi->sources.push_back(phi->sources[edge]);
+            }
+            preheader.instructions.push_back(preheader_phi);
+            outside_value = preheader_phi->target;
+        }
+
+        std::vector<IRRegister> sources;
+        for (int i = 0; i < phi->sources.size(); i++) {
+            if (loop.contains(header.predecessors[i]->index)) {
+                sources.push_back(phi->sources[i]);
+            }
+        }
+        sources.push_back(outside_value);
+        phi->sources = std::move(sources);
+    }
+
+    std::vector<HIRBaseBlock*> predecessors;
+    for (auto predecessor : header.predecessors) {
+        if (loop.contains(predecessor->index)) {
+            predecessors.push_back(predecessor);
+        } else {
+            preheader.predecessors.push_back(predecessor);
+        }
+    }
+    predecessors.push_back(&preheader);
+    header.predecessors = std::move(predecessors);
+
+    preheader.successors.push_back(&header);
+    preheader.instructions.push_back(preheader.instruction<HIRJumpInstruction>(header.index));
+
+    // Redirect the outer predecessors to the preheader. A predecessor may
+    // jump to the header from both branches of a jnz, so there may be duplicates.
+    for (auto predecessor : preheader.predecessors) {
+        for (auto& successor : predecessor->successors) {
+            if (successor == &header) {
+                successor = &preheader;
+            }
+        }
+
+        auto terminator = predecessor->instructions.back();
+        if (terminator->type == HIRInstructionType::jump) {
+            auto jump = (HIRJumpInstruction*)terminator;
+            if (jump->label_id == header.index) {
+                jump->label_id = preheader.index;
+            }
+        } else if (terminator->type == HIRInstructionType::jump_nz) {
+            auto jump = (HIRJumpNZInstruction*)terminator;
+            if (jump->nz_label == header.index) {
+                jump->nz_label = preheader.index;
+            }
+            if (jump->z_label == header.index) {
+                jump->z_label = preheader.index;
+            }
+        }
+    }
+
+    return &preheader;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include "bonk/middleend/ir/hir.hpp"
+#include "hir_dominator_finder.hpp"
+#include "utils/dynamic_bitset.hpp"
+
+namespace bonk {
+
+struct HIRLoop {
+    int header = -1;
+    int preheader = -1;
+
+    // Index of the innermost enclosing loop in HIRLoopFinder::get_loops, or -1
+    int parent = -1;
+    int depth = 1;
+
+    DynamicBitSet blocks{0};
+    std::vector<int> latches;
+
+    bool contains(int block_index) const {
+        return block_index >= 0 && block_index < blocks.size() && blocks[block_index];
+    }
+};
+
+// Finds natural loops of a procedure. Every back edge (an edge to a block that
+// dominates its source) defines a loop consisting of the header and all the
+// blocks that reach the back edge without passing through the header. Loops
+// sharing a header are merged. Loops are sorted so that inner loops go before
+// the loops containing them.
+class HIRLoopFinder {
+  public:
+    HIRProcedure& procedure;
+    HIRDominatorFinder& dominator_finder;
+
+    explicit HIRLoopFinder(HIRDominatorFinder& dominator_finder);
+
+    std::vector<HIRLoop>& get_loops();
+
+    // Makes sure the loop header has a single predecessor outside of the loop,
+    // which only jumps to the header. Creates a new block if needed, so the
+    // dominator information is only valid for the old blocks afterwards.
+    HIRBaseBlock* ensure_preheader(HIRLoop& loop);
+
+  private:
+    void find_loops();
+    void collect_loop_blocks(HIRLoop& loop, int latch);
+    void build_loop_nest();
+
+    std::vector<HIRLoop> loops;
+    bool is_built = false;
+};
+
+} // namespace bonk
@@ -0,0 +1,177 @@
+
+#include "hir_loop_invariant_code_motion.hpp"
+
+bool bonk::HIRLoopInvariantCodeMotion::hoist_invariants(HIRProgram& program) {
+    for (auto& procedure : program.procedures) {
+        if (!hoist_invariants(*procedure)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool bonk::HIRLoopInvariantCodeMotion::hoist_invariants(HIRProcedure& procedure) {
+    if (procedure.is_external) {
+        return true;
+    }
+
+    HIRDominatorFinder dominator_finder(procedure);
+    HIRLoopFinder loop_finder(dominator_finder);
+
+    auto& loops = loop_finder.get_loops();
+    if (loops.empty()) {
+        return true;
+    }
+
+    this->procedure = &procedure;
+    this->dominator_finder = &dominator_finder;
+
+    dominance_blocks.clear();
+    for (int i = 0; i < procedure.base_blocks.size(); i++) {
+        dominance_blocks.push_back(i);
+    }
+
+    // Parameters and registers without definitions stay at -1,
+    // which is outside of every loop
+    definition_blocks.assign(procedure.used_registers, -1);
+    for (auto& block : procedure.base_blocks) {
+        for (auto instruction : block->instructions) {
+            for (int i = 0; i < instruction->get_write_register_count(); i++) {
+                definition_blocks[instruction->get_write_register(i)] = block->index;
+            }
+        }
+    }
+
+    for (auto& loop : loops) {
+        auto preheader = loop_finder.ensure_preheader(loop);
+        if (!preheader) {
+            continue;
+        }
+
+        if (preheader->index >= dominance_blocks.size()) {
+            dominance_blocks.resize(preheader->index + 1, -1);
+            dominance_blocks[preheader->index] = loop.header;
+        }
+
+        hoist_loop_invariants(loop, *preheader);
+    }
+
+    this->procedure = nullptr;
+    this->dominator_finder = nullptr;
+    return true;
+}
+
+void bonk::HIRLoopInvariantCodeMotion::hoist_loop_invariants(HIRLoop& loop,
+                                                            HIRBaseBlock& preheader) {
+    bool writes_memory = false;
+
+    for (auto& block : procedure->base_blocks) {
+        if (!loop.contains(block->index)) {
+            continue;
+        }
+        for (auto instruction : block->instructions) {
+            switch (instruction->type) {
+            case HIRInstructionType::memory_store:
+            case HIRInstructionType::call:
+            case HIRInstructionType::dec_ref_counter:
+                writes_memory = true;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    // Hoisted instructions go right before the jump to the header
+    auto insert_position = std::prev(preheader.instructions.end());
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        for (auto& block : procedure->base_blocks) {
+            if (!loop.contains(block->index)) {
+                continue;
+            }
+
+            for (auto it = block->instructions.begin(); it != block->instructions.end();) {
+                auto instruction = *it;
+
+                if (!is_hoistable(instruction, *block, loop, writes_memory)) {
+                    it++;
+                    continue;
+                }
+
+                preheader.instructions.insert(insert_position, instruction);
+                definition_blocks[instruction->get_write_register(0)] = preheader.index;
+                it = block->instructions.erase(it);
+                changed = true;
+            }
+        }
+    }
+}
+
+bool bonk::HIRLoopInvariantCodeMotion::is_invariant(HIRInstruction* instruction, HIRLoop& loop) {
+    for (int i = 0; i < instruction->get_read_register_count(); i++) {
+        auto reg = instruction->get_read_register(i);
+        // Phi functions created for the preheaders are not listed, but they are outside anyway
+        if (reg < definition_blocks.size() && loop.contains(definition_blocks[reg])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool bonk::HIRLoopInvariantCodeMotion::is_hoistable(HIRInstruction* instruction,
+                                                    HIRBaseBlock& block, HIRLoop& loop,
+                                                    bool writes_memory) {
+    switch (instruction->type) {
+    case HIRInstructionType::constant_load:
+    case HIRInstructionType::symbol_load:
+        return true;
+    case HIRInstructionType::operation:
+        if (((HIROperationInstruction*)instruction)->operation_type == HIROperationType::divide) {
+            return false;
+        }
+        return is_invariant(instruction, loop);
+    case HIRInstructionType::memory_load:
+        if (writes_memory || !dominates_exits(block.index, loop)) {
+            return false;
+        }
+        return is_invariant(instruction, loop);
+    default:
+        return false;
+    }
+}
+
+bool bonk::HIRLoopInvariantCodeMotion::dominates_exits(int block_index, HIRLoop& loop) {
+    for (auto& block : procedure->base_blocks) {
+        if (!loop.contains(block->index)) {
+            continue;
+        }
+
+        bool is_exit = false;
+        for (auto successor : block->successors) {
+            if (!loop.contains(successor->index)) {
+                is_exit = true;
+            }
+        }
+
+        if (is_exit && !dominates(block_index, block->index)) {
+            return false;
+        }
+    }
+
+    for (auto latch : loop.latches) {
+        if (!dominates(block_index, latch)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool bonk::HIRLoopInvariantCodeMotion::dominates(int dominator, int block_index) {
+    auto& dominators = dominator_finder->get_dominators();
+    return (bool)dominators[dominance_blocks[block_index]][dominance_blocks[dominator]];
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include "bonk/middleend/ir/hir.hpp"
+#include "hir_loop_finder.hpp"
+
+namespace bonk {
+
+// Moves computations that produce the same value on every iteration of a loop
+// to its preheader. Constant loads, symbol loads and operations are hoisted
+// once all their operands are defined outside the loop. Divisions are left in
+// place, since they may trap. Memory loads are only hoisted from loops that
+// never write memory, and only if they are executed on every iteration.
+// Inner loops are processed first, so invariants can move through several
+// levels of nesting. Expects the procedure to be in SSA form.
+class HIRLoopInvariantCodeMotion {
+  public:
+    HIRLoopInvariantCodeMotion() = default;
+
+    bool hoist_invariants(HIRProgram& program);
+    bool hoist_invariants(HIRProcedure& procedure);
+
+  private:
+    void hoist_loop_invariants(HIRLoop& loop, HIRBaseBlock& preheader);
+    bool is_invariant(HIRInstruction* instruction, HIRLoop& loop);
+    bool is_hoistable(HIRInstruction* instruction, HIRBaseBlock& block, HIRLoop& loop,
+                      bool writes_memory);
+    bool dominates_exits(int block_index, HIRLoop& loop);
+    bool dominates(int dominator, int block_index);
+
+    HIRProcedure* procedure = nullptr;
+    HIRDominatorFinder* dominator_finder = nullptr;
+    std::vector<int> definition_blocks;
+
+    // Blocks created for preheaders are not known to the dominator finder.
+    // A preheader dominates the same blocks of the loop as its header does.
+    std::vector<int> dominance_blocks;
+};
+
+} // namespace bonk
@@ -0,0 +1,274 @@
+
+#include "hir_null_check_eliminator.hpp"
+#include "bonk/frontend/frontend.hpp"
+
+bool bonk::HIRNullCheckEliminator::eliminate_null_checks(HIRProgram& program) {
+    for (auto& procedure : program.procedures) {
+        if (!eliminate_null_checks(*procedure)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool bonk::HIRNullCheckEliminator::eliminate_null_checks(HIRProcedure& procedure) {
+    if (procedure.is_external) {
+        return true;
+    }
+
+    this->procedure = &procedure;
+
+    collect_definitions();
+    find_non_null_registers();
+
+    for (auto& block : procedure.base_blocks) {
+        fold_checks(*block);
+    }
+
+    block_exit_states.clear();
+    definitions.clear();
+    this->procedure = nullptr;
+    return true;
+}
+
+void bonk::HIRNullCheckEliminator::collect_definitions() {
+    definitions.assign(procedure->used_registers, nullptr);
+
+    for (auto& block : procedure->base_blocks) {
+        for (auto instruction : block->instructions) {
+            for (int i = 0; i < instruction->get_write_register_count(); i++) {
+                definitions[instruction->get_write_register(i, nullptr)] = instruction;
+            }
+        }
+    }
+}
+
+void bonk::HIRNullCheckEliminator::find_non_null_registers() {
+    // Start with every register being non-null and remove the facts that do
+    // not hold, so that loops keep the facts that are true on every iteration
+    block_exit_states.assign(procedure->base_blocks.size(),
+                             DynamicBitSet(procedure->used_registers, true));
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        for (auto& block : procedure->base_blocks) {
+            DynamicBitSet state = get_entry_state(*block);
+            for (auto instruction : block->instructions) {
+                transfer(instruction, state);
+            }
+
+            if (state != block_exit_states[block->index]) {
+                block_exit_states[block->index] = std::move(state);
+                changed = true;
+            }
+        }
+    }
+}
+
+bonk::DynamicBitSet bonk::HIRNullCheckEliminator::get_entry_state(HIRBaseBlock& block) {
+    if (block.index == procedure->start_block_index || block.predecessors.empty()) {
+        return DynamicBitSet(procedure->used_registers);
+    }
+
+    DynamicBitSet state(procedure->used_registers, true);
+    std::vector<DynamicBitSet> edge_states;
+
+    for (auto predecessor : block.predecessors) {
+        edge_states.push_back(get_edge_state(*predecessor, block));
+        state &= edge_states.back();
+    }
+
+    // Phi sources are checked on the edges they come from
+    for (auto instruction : block.instructions) {
+        if (instruction->type != HIRInstructionType::phi_function) {
+            break;
+        }
+
+        auto phi = (HIRPhiFunctionInstruction*)instruction;
+        bool non_null = true;
+        for (int i = 0; i < phi->sources.size(); i++) {
+            if (!edge_states[i][phi->sources[i]]) {
+                non_null = false;
+            }
+        }
+        state[phi->target] = non_null;
+    }
+
+    return state;
+}
+
+bonk::DynamicBitSet bonk::HIRNullCheckEliminator::get_edge_state(HIRBaseBlock& from,
+                                                                  HIRBaseBlock& to) {
+    DynamicBitSet state = block_exit_states[from.index];
+
+    if (from.instructions.empty() ||
+        from.instructions.back()->type != HIRInstructionType::jump_nz) {
+        return state;
+    }
+
+    auto jump = (HIRJumpNZInstruction*)from.instructions.back();
+    if (jump->nz_label == jump->z_label) {
+        return state;
+    }
+
+    if (to.index == jump->nz_label) {
+        state[jump->condition] = true;
+        state[resolve_copies(jump->condition)] = true;
+        if (auto compared = get_null_comparison(jump->condition, HIROperationType::not_equal)) {
+            state[*compared] = true;
+        }
+    } else if (auto compared = get_null_comparison(jump->condition, HIROperationType::equal)) {
+        state[*compared] = true;
+    }
+
+    return state;
+}
+
+void bonk::HIRNullCheckEliminator::transfer(HIRInstruction* instruction, DynamicBitSet& state) {
+    // Phi functions are evaluated on the block entry
+    if (instruction->type == HIRInstructionType::phi_function) {
+        return;
+    }
+
+    for (int i = 0; i < instruction->get_write_register_count(); i++) {
+        state[instruction->get_write_register(i, nullptr)] = false;
+    }
+
+    switch (instruction->type) {
+    case HIRInstructionType::call: {
+        auto call = (HIRCallInstruction*)instruction;
+        if (call->return_value && is_constructor_call(call)) {
+            state[*call->return_value] = true;
+        }
+        break;
+    }
+    case HIRInstructionType::stack_alloc:
+        state[((HIRStackAllocInstruction*)instruction)->target] = true;
+        break;
+    case HIRInstructionType::operation: {
+        auto operation = (HIROperationInstruction*)instruction;
+        if (operation->operation_type == HIROperationType::assign &&
+            state[operation->left]) {
+            state[operation->target] = true;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+bool bonk::HIRNullCheckEliminator::is_constructor_call(HIRCallInstruction* call) {
+    auto& id_table = procedure->program.id_table;
+    auto callee = id_table.get_node(call->procedure_label_id);
+
+    // Constructors abort the program when they fail to allocate the hive
+    return id_table.front_end.get_constructed_hive(callee) != nullptr;
+}
+
+bonk::IRRegister bonk::HIRNullCheckEliminator::resolve_copies(IRRegister register_id) {
+    while (auto definition = definitions[register_id]) {
+        if (definition->type != HIRInstructionType::operation) {
+            break;
+        }
+        auto operation = (HIROperationInstruction*)definition;
+        if (operation->operation_type != HIROperationType::assign) {
+            break;
+        }
+        register_id = operation->left;
+    }
+    return register_id;
+}
+
+std::optional<bonk::IRRegister>
+bonk::HIRNullCheckEliminator::get_null_comparison(IRRegister condition,
+                                                  HIROperationType operation_type) {
+    auto definition = definitions[resolve_copies(condition)];
+    if (!definition || definition->type != HIRInstructionType::operation) {
+        return std::nullopt;
+    }
+
+    auto operation = (HIROperationInstruction*)definition;
+    if (operation->operation_type != operation_type || !operation->right.has_value()) {
+        return std::nullopt;
+    }
+
+    if (is_null_constant(*operation->right)) {
+        return operation->left;
+    }
+    if (is_null_constant(operation->left)) {
+        return *operation->right;
+    }
+    return std::nullopt;
+}
+
+bool bonk::HIRNullCheckEliminator::is_null_constant(IRRegister register_id) {
+    auto definition = definitions[resolve_copies(register_id)];
+    if (!definition || definition->type != HIRInstructionType::constant_load) {
+        return false;
+    }
+
+    auto constant = (HIRConstantLoadInstruction*)definition;
+    return constant->type == HIRDataType::dword && constant->constant == 0;
+}
+
+bool bonk::HIRNullCheckEliminator::fold_checks(HIRBaseBlock& block) {
+    DynamicBitSet state = get_entry_state(block);
+
+    for (auto instruction : block.instructions) {
+        if (instruction->type == HIRInstructionType::inc_ref_counter) {
+            auto increment = (HIRIncRefCounterInstruction*)instruction;
+            if (state[increment->address]) {
+                increment->never_null = true;
+            }
+        } else if (instruction->type == HIRInstructionType::dec_ref_counter) {
+            auto decrement = (HIRDecRefCounterInstruction*)instruction;
+            if (state[decrement->address]) {
+                decrement->never_null = true;
+            }
+        }
+        transfer(instruction, state);
+    }
+
+    if (block.instructions.empty() ||
+        block.instructions.back()->type != HIRInstructionType::jump_nz) {
+        return false;
+    }
+
+    auto jump = (HIRJumpNZInstruction*)block.instructions.back();
+    if (jump->nz_label == jump->z_label) {
+        return false;
+    }
+
+    auto is_taken = evaluate_condition(jump->condition, state);
+    if (!is_taken.has_value()) {
+        return false;
+    }
+
+    int target = *is_taken ? jump->nz_label : jump->z_label;
+    int skipped = *is_taken ? jump->z_label : jump->nz_label;
+
+    block.instructions.back() = block.instruction<HIRJumpInstruction>(target);
+    procedure->remove_control_flow_edge(&block, procedure->base_blocks[skipped].get());
+    return true;
+}
+
+std::optional<bool> bonk::HIRNullCheckEliminator::evaluate_condition(IRRegister condition,
+                                                                     const DynamicBitSet& state) {
+    if (state[condition]) {
+        return true;
+    }
+    if (auto compared = get_null_comparison(condition, HIROperationType::not_equal)) {
+        if (state[*compared]) {
+            return true;
+        }
+    }
+    if (auto compared = get_null_comparison(condition, HIROperationType::equal)) {
+        if (state[*compared]) {
+            return false;
+        }
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+#include "bonk/middleend/ir/hir.hpp"
+#include "utils/dynamic_bitset.hpp"
+
+namespace bonk {
+
+// Forward dataflow analysis that finds registers which can never hold null.
+// Results of hive constructors and stack allocations are never null, and so
+// are copies of non-null registers and phi functions over them. A register is
+// also known to be non-null on the branch where it was compared with null,
+// or on the non-zero branch when it was tested with jnz directly.
+//
+// Reference counter operations on such registers are marked to skip their
+// null test, and jnz instructions testing them are folded into jumps.
+// Expects the procedures to be in SSA form.
+class HIRNullCheckEliminator {
+  public:
+    HIRNullCheckEliminator() = default;
+
+    bool eliminate_null_checks(HIRProgram& program);
+    bool eliminate_null_checks(HIRProcedure& procedure);
+
+  private:
+    void collect_definitions();
+    void find_non_null_registers();
+    DynamicBitSet get_entry_state(HIRBaseBlock& block);
+    DynamicBitSet get_edge_state(HIRBaseBlock& from, HIRBaseBlock& to);
+    void transfer(HIRInstruction* instruction, DynamicBitSet& state);
+    bool is_constructor_call(HIRCallInstruction* call);
+    IRRegister resolve_copies(IRRegister register_id);
+    std::optional<IRRegister> get_null_comparison(IRRegister condition,
+                                                  HIROperationType operation_type);
+    bool is_null_constant(IRRegister register_id);
+
+    bool fold_checks(HIRBaseBlock& block);
+    std::optional<bool> evaluate_condition(IRRegister condition, const DynamicBitSet& state);
+
+    HIRProcedure* procedure = nullptr;
+    std::vector<HIRInstruction*> definitions;
+    std::vector<DynamicBitSet> block_exit_states;
+};
+
+} // namespace bonk
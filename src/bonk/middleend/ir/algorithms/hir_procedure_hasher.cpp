@@ -0,0 +1,210 @@
+
+#include "hir_procedure_hasher.hpp"
+#include "bonk/frontend/frontend.hpp"
+
+uint64_t bonk::HIRProcedureHasher::hash(bonk::HIRProcedure& procedure) {
+    return FNVHasher::hash(get_key(procedure));
+}
+
+std::string bonk::HIRProcedureHasher::get_key(bonk::HIRProcedure& procedure) {
+    key.clear();
+    current_program = &procedure.program;
+
+    hash_symbol(procedure.program, procedure.procedure_id);
+    write_value(procedure.return_type);
+    write_value(procedure.is_external);
+    write_value(procedure.start_block_index);
+    write_value(procedure.end_block_index);
+
+    write_value(procedure.parameters.size());
+    for (auto& parameter : procedure.parameters) {
+        write_value(parameter.type);
+        write_value(parameter.register_id);
+    }
+
+    write_value(procedure.base_blocks.size());
+    for (auto& block : procedure.base_blocks) {
+        hash_block(*block);
+    }
+
+    return std::move(key);
+}
+
+void bonk::HIRProcedureHasher::write(std::string_view data) {
+    key.append(data);
+}
+
+void bonk::HIRProcedureHasher::hash_block(bonk::HIRBaseBlock& block) {
+    write_value(block.index);
+
+    // Phi sources are matched with predecessors by their order
+    write_value(block.predecessors.size());
+    for (auto predecessor : block.predecessors) {
+        write_value(predecessor->index);
+    }
+
+    for (auto instruction : block.instructions) {
+        if (!hash_locations && (instruction->type == HIRInstructionType::location ||
+                                instruction->type == HIRInstructionType::file)) {
+            continue;
+        }
+        hash_instruction(*instruction);
+    }
+
+    // Terminates the instruction list
+    write_value(HIRInstructionType::unset);
+}
+
+void bonk::HIRProcedureHasher::hash_instruction(bonk::HIRInstruction& instruction) {
+    write_value(instruction.type);
+
+    switch (instruction.type) {
+    case HIRInstructionType::label:
+        write_value(static_cast<HIRLabelInstruction&>(instruction).label_id);
+        break;
+    case HIRInstructionType::constant_load: {
+        auto& constant_load = static_cast<HIRConstantLoadInstruction&>(instruction);
+        write_value(constant_load.target);
+        write_value(constant_load.type);
+        write_value(constant_load.constant);
+        break;
+    }
+    case HIRInstructionType::symbol_load: {
+        auto& symbol_load = static_cast<HIRSymbolLoadInstruction&>(instruction);
+        write_value(symbol_load.target);
+        write_value(symbol_load.type);
+        hash_symbol(*current_program, symbol_load.symbol_id);
+        break;
+    }
+    case HIRInstructionType::operation: {
+        auto& operation = static_cast<HIROperationInstruction&>(instruction);
+        write_value(operation.target);
+        write_value(operation.left);
+        write_value(operation.right.has_value());
+        write_value(operation.right.value_or(0));
+        write_value(operation.operation_type);
+        write_value(operation.operand_type);
+        write_value(operation.result_type);
+        break;
+    }
+    case HIRInstructionType::jump:
+        write_value(static_cast<HIRJumpInstruction&>(instruction).label_id);
+        break;
+    case HIRInstructionType::jump_nz: {
+        auto& jump_nz = static_cast<HIRJumpNZInstruction&>(instruction);
+        write_value(jump_nz.condition);
+        write_value(jump_nz.nz_label);
+        write_value(jump_nz.z_label);
+        break;
+    }
+    case HIRInstructionType::call: {
+        auto& call = static_cast<HIRCallInstruction&>(instruction);
+        write_value(call.return_type);
+        write_value(call.return_value.has_value());
+        write_value(call.return_value.value_or(0));
+        write_value(call.is_tail_call);
+        hash_symbol(*current_program, call.procedure_label_id);
+        write_value(call.inlined_procedure_id != -1);
+        if (call.inlined_procedure_id != -1) {
+            hash_symbol(*current_program, call.inlined_procedure_id);
+        }
+        break;
+    }
+    case HIRInstructionType::return_op: {
+        auto& return_op = static_cast<HIRReturnInstruction&>(instruction);
+        write_value(return_op.return_type);
+        write_value(return_op.return_value.has_value());
+        write_value(return_op.return_value.value_or(0));
+        break;
+    }
+    case HIRInstructionType::parameter: {
+        auto& parameter = static_cast<HIRParameterInstruction&>(instruction);
+        write_value(parameter.type);
+        write_value(parameter.parameter);
+        break;
+    }
+    case HIRInstructionType::memory_load: {
+        auto& memory_load = static_cast<HIRMemoryLoadInstruction&>(instruction);
+        write_value(memory_load.target);
+        write_value(memory_load.address);
+        write_value(memory_load.type);
+        break;
+    }
+    case HIRInstructionType::memory_store: {
+        auto& memory_store = static_cast<HIRMemoryStoreInstruction&>(instruction);
+        write_value(memory_store.address);
+        write_value(memory_store.value);
+        write_value(memory_store.type);
+        break;
+    }
+    case HIRInstructionType::stack_alloc: {
+        auto& stack_alloc = static_cast<HIRStackAllocInstruction&>(instruction);
+        write_value(stack_alloc.target);
+        write_value(stack_alloc.size);
+        break;
+    }
+    case HIRInstructionType::select: {
+        auto& select = static_cast<HIRSelectInstruction&>(instruction);
+        write_value(select.target);
+        write_value(select.condition);
+        write_value(select.nz_value);
+        write_value(select.z_value);
+        write_value(select.type);
+        break;
+    }
+    case HIRInstructionType::inc_ref_counter: {
+        auto& inc_ref_counter = static_cast<HIRIncRefCounterInstruction&>(instruction);
+        write_value(inc_ref_counter.address);
+        write_value(inc_ref_counter.never_null);
+        break;
+    }
+    case HIRInstructionType::dec_ref_counter: {
+        auto& dec_ref_counter = static_cast<HIRDecRefCounterInstruction&>(instruction);
+        write_value(dec_ref_counter.address);
+        write_value(dec_ref_counter.never_null);
+        std::string_view hive_name;
+        if (dec_ref_counter.hive_definition) {
+            hive_name = dec_ref_counter.hive_definition->hive_name->identifier_text;
+        }
+        write_value(dec_ref_counter.hive_definition != nullptr);
+        write_value(hive_name.size());
+        write(hive_name);
+        break;
+    }
+    case HIRInstructionType::file: {
+        auto& file = static_cast<HIRFileInstruction&>(instruction);
+        write_value(file.file.size());
+        write(file.file);
+        break;
+    }
+    case HIRInstructionType::location: {
+        auto& location = static_cast<HIRLocationInstruction&>(instruction);
+        write_value(location.line);
+        write_value(location.column);
+        break;
+    }
+    case HIRInstructionType::phi_function: {
+        auto& phi_function = static_cast<HIRPhiFunctionInstruction&>(instruction);
+        write_value(phi_function.target);
+        write_value(phi_function.type);
+        write_value(phi_function.sources.size());
+        for (auto source : phi_function.sources) {
+            write_value(source);
+        }
+        break;
+    }
+    default:
+        assert(!"Unknown instruction type");
+    }
+}
+
+void bonk::HIRProcedureHasher::hash_symbol(bonk::HIRProgram& program, int symbol_id) {
+    TreeNode* definition = program.id_table.get_node(symbol_id);
+    auto it = program.symbol_table.symbol_names.find(definition);
+    std::string_view name;
+    if (it != program.symbol_table.symbol_names.end()) {
+        name = it->second;
+    }
+    write_value(name.size());
+    write(name);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include "bonk/middleend/ir/hir.hpp"
+#include "utils/hash.hpp"
+
+namespace bonk {
+
+// Computes a structural hash of a procedure. Symbols are hashed by their
+// names rather than by id table indices, so the hash stays the same across
+// compilations as long as the procedure and the symbols it refers to do.
+class HIRProcedureHasher {
+  public:
+    uint64_t hash(HIRProcedure& procedure);
+
+    // The bytes the hash is computed from. Two procedures with equal keys
+    // compile to the same code, so caches compare keys rather than hashes.
+    std::string get_key(HIRProcedure& procedure);
+
+    // Source locations only matter when they are emitted as debug info
+    bool hash_locations = true;
+
+  private:
+    void write(std::string_view data);
+
+    template <typename T> void write_value(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write(std::string_view((const char*)&value, sizeof(T)));
+    }
+
+    void hash_block(HIRBaseBlock& block);
+    void hash_instruction(HIRInstruction& instruction);
+    void hash_symbol(HIRProgram& program, int symbol_id);
+
+    std::string key;
+    HIRProgram* current_program = nullptr;
+};
+
+} // namespace bonk
@@ -0,0 +1,773 @@
+
+#include "hir_ref_count_elider.hpp"
+#include <algorithm>
+#include <unordered_set>
+
+static bool has_pointer_arguments(bonk::HIRBaseBlock& block,
+                                  std::list<bonk::HIRInstruction*>::iterator call) {
+    // Arguments are passed with parameter instructions right before the call
+    for (auto it = call; it != block.instructions.begin();) {
+        --it;
+        auto instruction = *it;
+        if (instruction->type == bonk::HIRInstructionType::location ||
+            instruction->type == bonk::HIRInstructionType::file) {
+            continue;
+        }
+        if (instruction->type != bonk::HIRInstructionType::parameter) {
+            break;
+        }
+        if (((bonk::HIRParameterInstruction*)instruction)->type == bonk::HIRDataType::dword) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool bonk::HIRRefCountElider::elide(HIRProgram& program) {
+    // Eliding reference counters in a procedure may make it harmless for its
+    // callers, so repeat until the summaries settle
+    while (true) {
+        collect_summaries(program);
+
+        bool changed = false;
+        for (auto& procedure : program.procedures) {
+            if (!procedure->is_external && elide_procedure(*procedure)) {
+                changed = true;
+            }
+        }
+
+        if (!changed) {
+            break;
+        }
+    }
+    return true;
+}
+
+bool bonk::HIRRefCountElider::elide(HIRProcedure& procedure) {
+    if (procedure.is_external) {
+        return true;
+    }
+
+    collect_summaries(procedure.program);
+    elide_procedure(procedure);
+    return true;
+}
+
+const bonk::HIRRefCountSummary& bonk::HIRRefCountElider::get_summary(int procedure_id) {
+    static const HIRRefCountSummary unknown_summary{};
+
+    auto it = summaries.find(procedure_id);
+    if (it == summaries.end()) {
+        return unknown_summary;
+    }
+    return it->second;
+}
+
+void bonk::HIRRefCountElider::collect_summaries(HIRProgram& program) {
+    summaries.clear();
+
+    for (auto& procedure : program.procedures) {
+        if (!procedure->is_external) {
+            summaries[procedure->procedure_id] = {false, false};
+        }
+    }
+
+    std::vector<std::pair<int, int>> calls;
+
+    for (auto& procedure : program.procedures) {
+        if (procedure->is_external) {
+            continue;
+        }
+
+        auto& summary = summaries[procedure->procedure_id];
+
+        for (auto& block : procedure->base_blocks) {
+            for (auto it = block->instructions.begin(); it != block->instructions.end(); ++it) {
+                switch ((*it)->type) {
+                case HIRInstructionType::memory_store:
+                    summary.may_store = true;
+                    break;
+                case HIRInstructionType::dec_ref_counter:
+                    summary.may_release = true;
+                    break;
+                case HIRInstructionType::call:
+                    if (has_pointer_arguments(*block, it)) {
+                        auto call = (HIRCallInstruction*)*it;
+                        calls.emplace_back(procedure->procedure_id, call->procedure_label_id);
+                    }
+                    break;
+                default:
+                    break;
+                }
+            }
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto [caller_id, callee_id] : calls) {
+            auto& caller = summaries[caller_id];
+            auto& callee = get_summary(callee_id);
+
+            if (callee.may_release && !caller.may_release) {
+                caller.may_release = true;
+                changed = true;
+            }
+            if (callee.may_store && !caller.may_store) {
+                caller.may_store = true;
+                changed = true;
+            }
+        }
+    }
+}
+
+bool bonk::HIRRefCountElider::elide_procedure(HIRProcedure& procedure) {
+    this->procedure = &procedure;
+    collect_definitions();
+
+    bool changed = remove_unneeded_registers();
+    changed |= cancel_held_pairs();
+
+    while (true) {
+        bool round_changed = false;
+        for (auto& block : procedure.base_blocks) {
+            round_changed |= cancel_pairs(*block);
+        }
+        for (auto& block : procedure.base_blocks) {
+            round_changed |= sink_increments(*block);
+        }
+        if (!round_changed) {
+            break;
+        }
+        changed = true;
+    }
+
+    this->procedure = nullptr;
+    return changed;
+}
+
+void bonk::HIRRefCountElider::collect_definitions() {
+    definitions.assign(procedure->used_registers, nullptr);
+    for (auto& block : procedure->base_blocks) {
+        for (auto instruction : block->instructions) {
+            for (int i = 0; i < instruction->get_write_register_count(); i++) {
+                definitions[instruction->get_write_register(i)] = instruction;
+            }
+        }
+    }
+}
+
+bool bonk::HIRRefCountElider::remove_unneeded_registers() {
+    std::vector<bool> unneeded(procedure->used_registers, false);
+    std::vector<bool> borrowed(procedure->used_registers, false);
+
+    for (auto definition : definitions) {
+        if (definition && definition->type == HIRInstructionType::constant_load &&
+            ((HIRConstantLoadInstruction*)definition)->constant == 0) {
+            unneeded[((HIRConstantLoadInstruction*)definition)->target] = true;
+        }
+    }
+
+    find_borrowed_parameters(unneeded);
+
+    if (!writes_memory()) {
+        find_borrowed_loads(borrowed);
+    }
+
+    // Only registers that are reference counted somewhere are known to be hives
+    std::vector<bool> counted(procedure->used_registers, false);
+    for (auto& block : procedure->base_blocks) {
+        for (auto instruction : block->instructions) {
+            if (instruction->type == HIRInstructionType::inc_ref_counter ||
+                instruction->type == HIRInstructionType::dec_ref_counter) {
+                counted[instruction->get_read_register(0)] = true;
+            }
+        }
+    }
+
+    bool changed = false;
+
+    // The caller still gets its own reference to a returned borrowed hive
+    std::unordered_set<HIRInstruction*> kept;
+    for (auto& block : procedure->base_blocks) {
+        if (block->instructions.empty()) {
+            continue;
+        }
+
+        auto last = std::prev(block->instructions.end());
+        if ((*last)->type != HIRInstructionType::return_op) {
+            continue;
+        }
+
+        auto return_instruction = (HIRReturnInstruction*)*last;
+        if (!return_instruction->return_value) {
+            continue;
+        }
+
+        IRRegister return_value = *return_instruction->return_value;
+        if (!borrowed[return_value] || unneeded[return_value] || !counted[return_value]) {
+            continue;
+        }
+
+        if (last != block->instructions.begin()) {
+            auto previous = *std::prev(last);
+            if (previous->type == HIRInstructionType::inc_ref_counter &&
+                previous->get_read_register(0) == return_value) {
+                kept.insert(previous);
+                continue;
+            }
+        }
+
+        auto increment = procedure->instruction<HIRIncRefCounterInstruction>();
+        increment->address = return_value;
+        block->instructions.insert(last, increment);
+        kept.insert(increment);
+        changed = true;
+    }
+
+    for (auto& block : procedure->base_blocks) {
+        for (auto it = block->instructions.begin(); it != block->instructions.end();) {
+            auto instruction = *it;
+            if (instruction->type != HIRInstructionType::inc_ref_counter &&
+                instruction->type != HIRInstructionType::dec_ref_counter) {
+                ++it;
+                continue;
+            }
+
+            IRRegister register_id = instruction->get_read_register(0);
+            if ((!unneeded[register_id] && !borrowed[register_id]) || kept.count(instruction)) {
+                ++it;
+                continue;
+            }
+
+            it = block->instructions.erase(it);
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+void bonk::HIRRefCountElider::find_borrowed_parameters(std::vector<bool>& unneeded) {
+    // A parameter which is stored, returned or copied may give its reference
+    // away, so its increments and decrements are not necessarily balanced
+    std::vector<bool> passed_on(procedure->used_registers, false);
+
+    for (auto& block : procedure->base_blocks) {
+        for (auto instruction : block->instructions) {
+            switch (instruction->type) {
+            case HIRInstructionType::memory_store:
+                passed_on[((HIRMemoryStoreInstruction*)instruction)->value] = true;
+                break;
+            case HIRInstructionType::return_op: {
+                auto return_instruction = (HIRReturnInstruction*)instruction;
+                if (return_instruction->return_value) {
+                    passed_on[*return_instruction->return_value] = true;
+                }
+                break;
+            }
+            case HIRInstructionType::phi_function:
+                for (auto source : ((HIRPhiFunctionInstruction*)instruction)->sources) {
+                    passed_on[source] = true;
+                }
+                break;
+            case HIRInstructionType::operation: {
+                auto operation = (HIROperationInstruction*)instruction;
+                if (operation->operation_type == HIROperationType::assign) {
+                    passed_on[operation->left] = true;
+                }
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+
+    for (auto& parameter : procedure->parameters) {
+        if (parameter.type == HIRDataType::dword && !passed_on[parameter.register_id]) {
+            unneeded[parameter.register_id] = true;
+        }
+    }
+}
+
+void bonk::HIRRefCountElider::find_borrowed_loads(std::vector<bool>& borrowed) {
+    // Start with every candidate and drop the ones that turn out to hold
+    // references of their own, until nothing changes
+    for (auto& parameter : procedure->parameters) {
+        if (parameter.type == HIRDataType::dword) {
+            borrowed[parameter.register_id] = true;
+        }
+    }
+
+    for (auto definition : definitions) {
+        if (!definition) {
+            continue;
+        }
+        switch (definition->type) {
+        case HIRInstructionType::memory_load:
+        case HIRInstructionType::phi_function:
+            borrowed[definition->get_write_register(0)] = true;
+            break;
+        case HIRInstructionType::operation:
+            if (((HIROperationInstruction*)definition)->operation_type ==
+                HIROperationType::assign) {
+                borrowed[definition->get_write_register(0)] = true;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    auto is_borrowed_address = [&](IRRegister address) {
+        if (borrowed[address]) {
+            return true;
+        }
+
+        // Field addresses are computed as 'hive + offset'
+        auto definition = definitions[address];
+        if (!definition || definition->type != HIRInstructionType::operation) {
+            return false;
+        }
+
+        auto operation = (HIROperationInstruction*)definition;
+        if (operation->operation_type != HIROperationType::plus || !operation->right) {
+            return false;
+        }
+
+        auto offset = definitions[*operation->right];
+        return borrowed[operation->left] && offset &&
+               offset->type == HIRInstructionType::constant_load;
+    };
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        auto drop = [&](IRRegister register_id) {
+            if (borrowed[register_id]) {
+                borrowed[register_id] = false;
+                changed = true;
+            }
+        };
+
+        for (auto& block : procedure->base_blocks) {
+            for (auto instruction : block->instructions) {
+                switch (instruction->type) {
+                case HIRInstructionType::memory_load: {
+                    auto load = (HIRMemoryLoadInstruction*)instruction;
+                    if (borrowed[load->target] && !is_borrowed_address(load->address)) {
+                        drop(load->target);
+                    }
+                    break;
+                }
+                case HIRInstructionType::phi_function: {
+                    auto phi = (HIRPhiFunctionInstruction*)instruction;
+                    for (auto source : phi->sources) {
+                        if (!borrowed[source]) {
+                            drop(phi->target);
+                        }
+                    }
+                    if (!borrowed[phi->target]) {
+                        for (auto source : phi->sources) {
+                            drop(source);
+                        }
+                    }
+                    break;
+                }
+                case HIRInstructionType::operation: {
+                    auto operation = (HIROperationInstruction*)instruction;
+                    if (operation->operation_type != HIROperationType::assign) {
+                        break;
+                    }
+                    if (!borrowed[operation->left]) {
+                        drop(operation->target);
+                    }
+                    if (!borrowed[operation->target]) {
+                        drop(operation->left);
+                    }
+                    break;
+                }
+                default:
+                    break;
+                }
+            }
+        }
+    }
+}
+
+bool bonk::HIRRefCountElider::cancel_pairs(HIRBaseBlock& block) {
+    struct PendingOperation {
+        InstructionIterator instruction;
+        int epoch;
+    };
+
+    // Every instruction that may destroy a hive starts a new epoch.
+    // Operations of the same epoch can be cancelled out.
+    std::unordered_map<IRRegister, std::vector<PendingOperation>> increments;
+    std::unordered_map<IRRegister, std::vector<PendingOperation>> decrements;
+    int epoch = 0;
+    bool changed = false;
+
+    for (auto it = block.instructions.begin(); it != block.instructions.end();) {
+        auto instruction = *it;
+
+        if (instruction->type == HIRInstructionType::inc_ref_counter) {
+            auto& pending = decrements[instruction->get_read_register(0)];
+            if (!pending.empty() && pending.back().epoch == epoch) {
+                block.instructions.erase(pending.back().instruction);
+                pending.pop_back();
+                it = block.instructions.erase(it);
+                changed = true;
+                continue;
+            }
+            increments[instruction->get_read_register(0)].push_back({it, epoch});
+        } else if (instruction->type == HIRInstructionType::dec_ref_counter) {
+            auto& pending = increments[instruction->get_read_register(0)];
+            if (!pending.empty() && pending.back().epoch == epoch) {
+                block.instructions.erase(pending.back().instruction);
+                pending.pop_back();
+                it = block.instructions.erase(it);
+                changed = true;
+                continue;
+            }
+            // The hive was alive before the decrement, so a following increment
+            // of the same epoch proves that this decrement did not destroy it
+            epoch++;
+            decrements[instruction->get_read_register(0)].push_back({it, epoch});
+        } else if (is_release(block, it)) {
+            epoch++;
+        }
+
+        ++it;
+    }
+
+    return changed;
+}
+
+bool bonk::HIRRefCountElider::cancel_held_pairs() {
+    // Only registers that are reference counted somewhere are tracked
+    held_indices.assign(procedure->used_registers, -1);
+    int tracked = 0;
+
+    for (auto& block : procedure->base_blocks) {
+        for (auto instruction : block->instructions) {
+            if (instruction->type == HIRInstructionType::inc_ref_counter ||
+                instruction->type == HIRInstructionType::dec_ref_counter) {
+                int& index = held_indices[instruction->get_read_register(0)];
+                if (index == -1) {
+                    index = tracked++;
+                }
+            }
+        }
+    }
+
+    if (tracked == 0) {
+        return false;
+    }
+
+    std::vector<std::vector<int>> held_on_entry;
+    find_held_references(held_on_entry);
+
+    bool changed = false;
+
+    for (auto& block : procedure->base_blocks) {
+        auto held = held_on_entry[block->index];
+
+        for (auto it = block->instructions.begin(); it != block->instructions.end();) {
+            auto instruction = *it;
+
+            if (instruction->type == HIRInstructionType::inc_ref_counter &&
+                held[held_indices[instruction->get_read_register(0)]] > 0) {
+                auto decrement = find_held_decrement(*block, it);
+                if (decrement != block->instructions.end()) {
+                    block->instructions.erase(decrement);
+                    it = block->instructions.erase(it);
+                    changed = true;
+                    continue;
+                }
+            }
+
+            update_held_references(instruction, held);
+            ++it;
+        }
+    }
+
+    return changed;
+}
+
+void bonk::HIRRefCountElider::find_held_references(
+    std::vector<std::vector<int>>& held_on_entry) {
+    // A lower bound of the references that the procedure holds to each
+    // tracked register, on entry to each block. Parameters are held by the
+    // caller for the whole call.
+    int tracked = 0;
+    for (int index : held_indices) {
+        tracked = std::max(tracked, index + 1);
+    }
+
+    int block_count = procedure->base_blocks.size();
+    std::vector<std::vector<int>> held_on_exit(block_count,
+                                               std::vector<int>(tracked, max_held_references));
+    held_on_entry.assign(block_count, std::vector<int>(tracked, 0));
+
+    std::vector<int> start_held(tracked, 0);
+    for (auto& parameter : procedure->parameters) {
+        if (held_indices[parameter.register_id] != -1) {
+            start_held[held_indices[parameter.register_id]] = 1;
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        for (auto& block : procedure->base_blocks) {
+            auto& held = held_on_entry[block->index];
+
+            if (block->index == procedure->start_block_index) {
+                held = start_held;
+            } else {
+                held.assign(tracked, max_held_references);
+                for (auto predecessor : block->predecessors) {
+                    auto& predecessor_held = held_on_exit[predecessor->index];
+                    for (int i = 0; i < tracked; i++) {
+                        held[i] = std::min(held[i], predecessor_held[i]);
+                    }
+                }
+            }
+
+            auto exit_held = held;
+            for (auto instruction : block->instructions) {
+                update_held_references(instruction, exit_held);
+            }
+
+            // Values merged by phi functions are handed over to their targets
+            for (auto successor : block->successors) {
+                int predecessor_index = std::find(successor->predecessors.begin(),
+                                                  successor->predecessors.end(),
+                                                  block.get()) -
+                                        successor->predecessors.begin();
+                for (auto instruction : successor->instructions) {
+                    if (instruction->type != HIRInstructionType::phi_function) {
+                        continue;
+                    }
+                    auto phi = (HIRPhiFunctionInstruction*)instruction;
+                    if (predecessor_index < phi->sources.size()) {
+                        int index = held_indices[phi->sources[predecessor_index]];
+                        if (index != -1) {
+                            exit_held[index] = std::max(exit_held[index] - 1, 0);
+                        }
+                    }
+                }
+            }
+
+            if (exit_held != held_on_exit[block->index]) {
+                held_on_exit[block->index] = std::move(exit_held);
+                changed = true;
+            }
+        }
+    }
+}
+
+void bonk::HIRRefCountElider::update_held_references(HIRInstruction* instruction,
+                                                     std::vector<int>& held) {
+    auto adjust = [&](IRRegister register_id, int delta) {
+        int index = held_indices[register_id];
+        if (index != -1) {
+            held[index] = std::clamp(held[index] + delta, 0, max_held_references);
+        }
+    };
+
+    switch (instruction->type) {
+    case HIRInstructionType::inc_ref_counter:
+        adjust(instruction->get_read_register(0), 1);
+        break;
+    case HIRInstructionType::dec_ref_counter:
+        adjust(instruction->get_read_register(0), -1);
+        break;
+    case HIRInstructionType::call: {
+        // Returned hives come with a reference
+        auto call = (HIRCallInstruction*)instruction;
+        if (call->return_value && held_indices[*call->return_value] != -1) {
+            held[held_indices[*call->return_value]] = 1;
+        }
+        break;
+    }
+    case HIRInstructionType::phi_function: {
+        auto phi = (HIRPhiFunctionInstruction*)instruction;
+        if (held_indices[phi->target] != -1) {
+            held[held_indices[phi->target]] = 0;
+        }
+        break;
+    }
+    case HIRInstructionType::memory_store:
+        // The memory takes the reference over
+        adjust(((HIRMemoryStoreInstruction*)instruction)->value, -1);
+        break;
+    case HIRInstructionType::return_op: {
+        auto return_instruction = (HIRReturnInstruction*)instruction;
+        if (return_instruction->return_value) {
+            adjust(*return_instruction->return_value, -1);
+        }
+        break;
+    }
+    case HIRInstructionType::operation: {
+        auto operation = (HIROperationInstruction*)instruction;
+        if (operation->operation_type == HIROperationType::assign) {
+            adjust(operation->left, -1);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+bonk::HIRRefCountElider::InstructionIterator
+bonk::HIRRefCountElider::find_held_decrement(HIRBaseBlock& block, InstructionIterator increment) {
+    // The increment is redundant if the reference it adds is dropped before
+    // the procedure gives any of its own references away
+    IRRegister register_id = (*increment)->get_read_register(0);
+
+    for (auto it = std::next(increment); it != block.instructions.end(); ++it) {
+        auto instruction = *it;
+        switch (instruction->type) {
+        case HIRInstructionType::dec_ref_counter:
+            if (instruction->get_read_register(0) == register_id) {
+                return it;
+            }
+            break;
+        case HIRInstructionType::memory_store:
+            if (((HIRMemoryStoreInstruction*)instruction)->value == register_id) {
+                return block.instructions.end();
+            }
+            break;
+        case HIRInstructionType::return_op:
+            return block.instructions.end();
+        case HIRInstructionType::operation: {
+            auto operation = (HIROperationInstruction*)instruction;
+            if (operation->operation_type == HIROperationType::assign &&
+                operation->left == register_id) {
+                return block.instructions.end();
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    return block.instructions.end();
+}
+
+bool bonk::HIRRefCountElider::sink_increments(HIRBaseBlock& block) {
+    if (block.successors.empty() || block.instructions.empty()) {
+        return false;
+    }
+
+    // Only sink into blocks that are reached from this block alone,
+    // otherwise other predecessors would get an extra increment
+    for (auto successor : block.successors) {
+        if (successor->index == procedure->end_block_index ||
+            successor->predecessors.size() != 1) {
+            return false;
+        }
+    }
+
+    auto terminator = block.instructions.back()->type;
+    if (terminator != HIRInstructionType::jump && terminator != HIRInstructionType::jump_nz) {
+        return false;
+    }
+
+    std::vector<InstructionIterator> trailing_increments;
+    for (auto it = block.instructions.begin(); it != block.instructions.end(); ++it) {
+        if ((*it)->type == HIRInstructionType::inc_ref_counter) {
+            trailing_increments.push_back(it);
+        } else if (is_release(block, it)) {
+            trailing_increments.clear();
+        }
+    }
+
+    bool changed = false;
+
+    for (auto it : trailing_increments) {
+        IRRegister register_id = (*it)->get_read_register(0);
+
+        bool cancels = false;
+        for (auto successor : block.successors) {
+            cancels |= has_cancelling_decrement(*successor, register_id);
+        }
+        if (!cancels) {
+            continue;
+        }
+
+        block.instructions.erase(it);
+
+        for (auto successor : block.successors) {
+            auto position = successor->instructions.begin();
+            while (position != successor->instructions.end() &&
+                   ((*position)->type == HIRInstructionType::phi_function ||
+                    (*position)->type == HIRInstructionType::label)) {
+                ++position;
+            }
+
+            auto increment = procedure->instruction<HIRIncRefCounterInstruction>();
+            increment->address = register_id;
+            successor->instructions.insert(position, increment);
+        }
+
+        changed = true;
+    }
+
+    return changed;
+}
+
+bool bonk::HIRRefCountElider::has_cancelling_decrement(HIRBaseBlock& block,
+                                                       IRRegister register_id) {
+    for (auto it = block.instructions.begin(); it != block.instructions.end(); ++it) {
+        if ((*it)->type == HIRInstructionType::dec_ref_counter &&
+            (*it)->get_read_register(0) == register_id) {
+            return true;
+        }
+        if (is_release(block, it)) {
+            return false;
+        }
+    }
+    return false;
+}
+
+bonk::HIRRefCountSummary bonk::HIRRefCountElider::get_call_summary(HIRBaseBlock& block,
+                                                                   InstructionIterator call) {
+    if (!has_pointer_arguments(block, call)) {
+        return {false, false};
+    }
+    return get_summary(((HIRCallInstruction*)*call)->procedure_label_id);
+}
+
+bool bonk::HIRRefCountElider::is_release(HIRBaseBlock& block, InstructionIterator instruction) {
+    switch ((*instruction)->type) {
+    case HIRInstructionType::dec_ref_counter:
+        return true;
+    case HIRInstructionType::call:
+        return get_call_summary(block, instruction).may_release;
+    default:
+        return false;
+    }
+}
+
+bool bonk::HIRRefCountElider::writes_memory() {
+    for (auto& block : procedure->base_blocks) {
+        for (auto it = block->instructions.begin(); it != block->instructions.end(); ++it) {
+            if ((*it)->type == HIRInstructionType::memory_store) {
+                return true;
+            }
+            if ((*it)->type == HIRInstructionType::call && get_call_summary(*block, it).may_store) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
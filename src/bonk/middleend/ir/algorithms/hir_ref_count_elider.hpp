@@ -0,0 +1,79 @@
+#pragma once
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include "bonk/middleend/ir/hir.hpp"
+
+namespace bonk {
+
+// What a call to a procedure may do to hives that already existed before
+// the call. Both flags are transitive over the callees of the procedure.
+struct HIRRefCountSummary {
+    // The procedure decrements reference counters, so it may destroy hives
+    bool may_release = true;
+    // The procedure writes memory, so it may unlink hives from other hives
+    bool may_store = true;
+};
+
+// Removes reference counter operations across base blocks. An increment and
+// a decrement of the same register cancel out when nothing in between may
+// destroy a hive: no other decrement and no call that may release. Increments
+// that could not be cancelled in their block are moved to the successors, so
+// they can meet the decrements there.
+//
+// Some registers do not need reference counting at all:
+// - Null constants.
+// - Parameters, since the caller holds a reference for the whole call. They
+//   are only skipped if the procedure never passes their reference on.
+// - In procedures that never write memory, hives loaded from parameters (and
+//   the hives loaded from them), since they stay reachable from the caller.
+//
+// An increment and a decrement of a hive that the procedure already holds a
+// reference to cancel out even across calls that may release, since a call can
+// only release the references it owns. This removes the counting around calls
+// whose arguments are held by the caller anyway, e.g. in local variables.
+//
+// Calls are classified with the summaries of their callees. Callees of other
+// modules are unknown, unless they were inlined. A callee without
+// pointer-sized arguments can only reach the hives it created itself, so
+// calling it is harmless. Expects the procedures to be in SSA form.
+class HIRRefCountElider {
+  public:
+    HIRRefCountElider() = default;
+
+    bool elide(HIRProgram& program);
+    bool elide(HIRProcedure& procedure);
+
+    const HIRRefCountSummary& get_summary(int procedure_id);
+
+  private:
+    using InstructionIterator = std::list<HIRInstruction*>::iterator;
+
+    // Held reference counts are only tracked up to this value
+    static constexpr int max_held_references = 4;
+
+    void collect_summaries(HIRProgram& program);
+    bool elide_procedure(HIRProcedure& procedure);
+    void collect_definitions();
+    bool remove_unneeded_registers();
+    void find_borrowed_parameters(std::vector<bool>& unneeded);
+    void find_borrowed_loads(std::vector<bool>& unneeded);
+    bool cancel_pairs(HIRBaseBlock& block);
+    bool cancel_held_pairs();
+    void find_held_references(std::vector<std::vector<int>>& held_on_entry);
+    void update_held_references(HIRInstruction* instruction, std::vector<int>& held);
+    InstructionIterator find_held_decrement(HIRBaseBlock& block, InstructionIterator increment);
+    bool sink_increments(HIRBaseBlock& block);
+    bool has_cancelling_decrement(HIRBaseBlock& block, IRRegister register_id);
+    HIRRefCountSummary get_call_summary(HIRBaseBlock& block, InstructionIterator call);
+    bool is_release(HIRBaseBlock& block, InstructionIterator instruction);
+    bool writes_memory();
+
+    HIRProcedure* procedure = nullptr;
+    std::unordered_map<int, HIRRefCountSummary> summaries;
+    std::vector<HIRInstruction*> definitions;
+    std::vector<int> held_indices;
+};
+
+} // namespace bonk
@@ -35,11 +35,12 @@ void bonk::HIRRefCountReplacer::replace_ref_counters(HIRInstruction* instruction
     if (instruction->type == HIRInstructionType::inc_ref_counter) {
         remove_instruction();
         auto inc_instruction = (HIRIncRefCounterInstruction*)instruction;
-        increase_reference_count(inc_instruction->address);
+        increase_reference_count(inc_instruction->address, inc_instruction->never_null);
     } else if (instruction->type == HIRInstructionType::dec_ref_counter) {
         remove_instruction();
         auto dec_instruction = (HIRDecRefCounterInstruction*)instruction;
-        decrease_reference_count(dec_instruction->address, dec_instruction->hive_definition);
+        decrease_reference_count(dec_instruction->address, dec_instruction->hive_definition,
+                                 dec_instruction->never_null);
     } else {
         current_instruction_iterator++;
     }
@@ -61,7 +62,17 @@ bonk::IRRegister bonk::HIRRefCountReplacer::get_reference_address(IRRegister hiv
     return value_register;
 }
 
-void bonk::HIRRefCountReplacer::increase_reference_count(bonk::IRRegister register_id) {
+void bonk::HIRRefCountReplacer::increase_reference_count(bonk::IRRegister register_id,
+                                                         bool never_null) {
+
+    // Known hives are updated in place, without any control flow
+    if (never_null) {
+        IRRegister reference_address = get_reference_address(register_id);
+        IRRegister reference_counter = load_reference_count(reference_address);
+        IRRegister adjusted_reference_counter = adjust_reference_count(reference_counter, 1);
+        write_reference_count(reference_address, adjusted_reference_counter);
+        return;
+    }
 
     auto skip_block = split_block();
     auto start_block = create_block();
@@ -81,14 +92,17 @@ void bonk::HIRRefCountReplacer::increase_reference_count(bonk::IRRegister regist
 }
 
 void bonk::HIRRefCountReplacer::decrease_reference_count(bonk::IRRegister register_id,
-                                                         TreeNodeHiveDefinition* hive_definition) {
+                                                         TreeNodeHiveDefinition* hive_definition,
+                                                         bool never_null) {
     auto skip_block = split_block();
-    auto start_block = create_block();
+    auto start_block = never_null ? current_base_block : create_block();
     auto destruct_block = create_block();
     auto keep_block = create_block();
 
     // If reference is null, skip everything
-    jmpnz(register_id, start_block, skip_block);
+    if (!never_null) {
+        jmpnz(register_id, start_block, skip_block);
+    }
 
     // Fill up the start block
     switch_to_block(start_block);
@@ -7,6 +7,10 @@
 
 namespace bonk {
 
+// Lowers reference counter operations into plain HIR instructions with their
+// own base blocks. The QBE backend lowers them on its own, which keeps the
+// control flow graph small for the late passes, so this is only needed for
+// backends that cannot.
 class HIRRefCountReplacer : ASTVisitor {
 
     HIRProgram* current_program;
@@ -22,8 +26,9 @@ class HIRRefCountReplacer : ASTVisitor {
     IRRegister adjust_reference_count(IRRegister reference_address, int64_t delta);
     bonk::IRRegister load_reference_count(bonk::IRRegister reference_address);
     void write_reference_count(IRRegister reference_address, IRRegister value);
-    void increase_reference_count(IRRegister register_id);
-    void decrease_reference_count(IRRegister register_id, TreeNodeHiveDefinition* hive_definition);
+    void increase_reference_count(IRRegister register_id, bool never_null);
+    void decrease_reference_count(IRRegister register_id, TreeNodeHiveDefinition* hive_definition,
+                                  bool never_null);
     void replace_ref_counters(HIRInstruction* instruction);
     void call_destructor(TreeNodeHiveDefinition* hive_definition, IRRegister register_id);
 
@@ -1,5 +1,6 @@
 
 #include "hir_ref_counter_reducer.hpp"
+#include <unordered_map>
 
 bool bonk::HIRRefCountReducer::reduce(bonk::HIRProgram& program) {
     for (auto& procedure : program.procedures) {
@@ -1,6 +1,7 @@
 
 #include "hir_ssa_converter.hpp"
 #include <iostream>
+#include <queue>
 #include "bonk/middleend/ir/hir_printer.hpp"
 #include "hir_alive_variables_finder.hpp"
 #include "hir_dominance_frontier_finder.hpp"
@@ -126,18 +127,14 @@ void bonk::HIRSSAConverter::convert(bonk::HIRProcedure& procedure) {
 }
 
 struct VariableInfo {
-    bonk::DynamicBitSet blocks;
+    // Blocks that define the register, each one listed once
+    std::vector<int> blocks;
     bonk::HIRDataType type;
 };
 
 std::vector<VariableInfo> get_variable_info(bonk::HIRProcedure& procedure) {
-    std::vector<VariableInfo> blocks;
-    blocks.reserve(procedure.used_registers);
-
-    for (int i = 0; i < procedure.used_registers; i++) {
-        blocks.push_back(
-            {bonk::DynamicBitSet(procedure.base_blocks.size()), bonk::HIRDataType::unset});
-    }
+    std::vector<VariableInfo> variables(procedure.used_registers,
+                                        {{}, bonk::HIRDataType::unset});
 
     for (auto& block : procedure.base_blocks) {
         for (auto& instruction : block->instructions) {
@@ -147,13 +144,36 @@ std::vector<VariableInfo> get_variable_info(bonk::HIRProcedure& procedure) {
                 bonk::HIRDataType type = bonk::HIRDataType::unset;
                 auto reg = instruction->get_write_register(i, &type);
 
-                blocks[reg].type = type;
-                blocks[reg].blocks[block->index] = true;
+                auto& variable = variables[reg];
+                variable.type = type;
+                if (variable.blocks.empty() || variable.blocks.back() != block->index) {
+                    variable.blocks.push_back(block->index);
+                }
             }
         }
     }
 
-    return blocks;
+    return variables;
+}
+
+std::vector<int> get_dominance_tree_levels(bonk::HIRProcedure& procedure,
+                                           bonk::HIRDominanceTreeBuilder& dominance_tree) {
+    // Unreachable blocks are left at -1
+    std::vector<int> levels(procedure.base_blocks.size(), -1);
+    std::vector<int> stack{procedure.start_block_index};
+    levels[procedure.start_block_index] = 0;
+
+    while (!stack.empty()) {
+        int block = stack.back();
+        stack.pop_back();
+
+        for (int child : dominance_tree.get_children(block)) {
+            levels[child] = levels[block] + 1;
+            stack.push_back(child);
+        }
+    }
+
+    return levels;
 }
 
 void bonk::HIRSSAConverter::insert_phi_functions(bonk::HIRProcedure& procedure,
@@ -161,58 +181,93 @@ void bonk::HIRSSAConverter::insert_phi_functions(bonk::HIRProcedure& procedure,
     HIRAliveVariablesFinder av_finder;
     av_finder.walk(procedure);
 
-    auto frontiers = df_finder.get_frontiers();
-
+    auto& dominance_tree = df_finder.dominance_tree_builder;
+    auto levels = get_dominance_tree_levels(procedure, dominance_tree);
     auto variable_info = get_variable_info(procedure);
 
-    DynamicBitSet work_list(procedure.base_blocks.size());
-    DynamicBitSet visited_list(procedure.base_blocks.size());
-    DynamicBitSet phi_functions(procedure.base_blocks.size());
+    // Registers that are not alive at the start of any block never need a phi function
+    DynamicBitSet live_anywhere(procedure.used_registers);
+    for (auto& block : procedure.base_blocks) {
+        live_anywhere |= av_finder.get_in(*block);
+    }
 
+    // Blocks are marked with the register that is being processed,
+    // so the marks never have to be cleared
+    int block_count = procedure.base_blocks.size();
+    std::vector<int> defining(block_count, -1);
+    std::vector<int> visited(block_count, -1);
+    std::vector<int> reached(block_count, -1);
+
+    std::priority_queue<std::pair<int, int>> queue;
+    std::vector<int> subtree;
+    std::vector<int> phi_blocks;
+
+    // Iterated dominance frontiers are found with the DJ-graph: the deepest
+    // block of the queue is taken, and its dominator subtree is walked to find
+    // the join edges that leave it. Their targets that are not deeper than the
+    // root belong to the frontier. Targets where the register is dead get no
+    // phi function, like in the pruned SSA form.
     for (int reg_index = 0; reg_index < variable_info.size(); reg_index++) {
-        auto& block_map = variable_info[reg_index];
+        auto& variable = variable_info[reg_index];
+        if (variable.blocks.empty() || !live_anywhere[reg_index]) {
+            continue;
+        }
 
-        work_list = block_map.blocks;
-        visited_list.reset();
-        phi_functions.reset();
+        phi_blocks.clear();
 
-        bool changed = true;
+        for (int block : variable.blocks) {
+            if (levels[block] == -1) {
+                continue;
+            }
+            defining[block] = reg_index;
+            queue.emplace(levels[block], block);
+        }
 
-        while (changed) {
-            changed = false;
-            for (int i = 0; i < work_list.size(); i++) {
-                if (!work_list[i]) {
-                    continue;
-                }
-                visited_list[i] = true;
-                work_list[i] = false;
+        while (!queue.empty()) {
+            auto [root_level, root] = queue.top();
+            queue.pop();
 
-                auto frontier = frontiers[i];
-                if (frontier == -1) {
-                    continue;
-                }
+            subtree.assign(1, root);
+            visited[root] = reg_index;
 
-                if(!av_finder.get_in(*procedure.base_blocks[frontier])[reg_index]) {
-                    continue;
-                }
+            while (!subtree.empty()) {
+                int block = subtree.back();
+                subtree.pop_back();
 
-                phi_functions[frontier] = true;
+                for (auto successor : procedure.base_blocks[block]->successors) {
+                    int target = successor->index;
 
-                if (visited_list[frontier]) {
-                    continue;
+                    if (dominance_tree.get_parent(target) == block) {
+                        continue;
+                    }
+                    if (levels[target] > root_level || reached[target] == reg_index) {
+                        continue;
+                    }
+                    reached[target] = reg_index;
+
+                    if (!av_finder.get_in(*successor)[reg_index]) {
+                        continue;
+                    }
+
+                    phi_blocks.push_back(target);
+                    if (defining[target] != reg_index) {
+                        queue.emplace(levels[target], target);
+                    }
+                }
+
+                for (int child : dominance_tree.get_children(block)) {
+                    if (visited[child] != reg_index) {
+                        visited[child] = reg_index;
+                        subtree.push_back(child);
+                    }
                 }
-                work_list[frontier] = true;
-                changed = true;
             }
         }
 
-        for (int i = 0; i < phi_functions.size(); i++) {
-            if (!phi_functions[i]) {
-                continue;
-            }
-            auto& block = procedure.base_blocks[i];
+        for (int block_index : phi_blocks) {
+            auto& block = procedure.base_blocks[block_index];
             auto phi = block->instruction<HIRPhiFunctionInstruction>();
-            phi->type = variable_info[reg_index].type;
+            phi->type = variable.type;
             phi->target = reg_index;
 
             for (int j = 0; j < block->predecessors.size(); j++) {
@@ -221,4 +276,4 @@ void bonk::HIRSSAConverter::insert_phi_functions(bonk::HIRProcedure& procedure,
             block->instructions.insert(block->instructions.begin(), phi);
         }
     }
-}
\ No newline at end of file
+}
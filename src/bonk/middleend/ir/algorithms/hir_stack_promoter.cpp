@@ -0,0 +1,362 @@
+
+#include "hir_stack_promoter.hpp"
+#include <algorithm>
+#include "bonk/frontend/frontend.hpp"
+
+static bonk::Type* resolve_type(bonk::Type* type) {
+    if (type && type->kind == bonk::TypeKind::external) {
+        return ((bonk::ExternalType*)type)->get_resolved();
+    }
+    return type;
+}
+
+bool bonk::HIRStackPromoter::promote(HIRProgram& program) {
+    for (auto& procedure : program.procedures) {
+        if (!promote(*procedure)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool bonk::HIRStackPromoter::promote(HIRProcedure& procedure) {
+    if (procedure.is_external) {
+        return true;
+    }
+
+    this->procedure = &procedure;
+    collect_uses();
+
+    std::vector<Allocation> allocations;
+
+    for (auto& block : procedure.base_blocks) {
+        for (auto it = block->instructions.begin(); it != block->instructions.end(); ++it) {
+            if ((*it)->type != HIRInstructionType::call) {
+                continue;
+            }
+
+            auto call = (HIRCallInstruction*)*it;
+            if (!call->return_value) {
+                continue;
+            }
+
+            Allocation allocation;
+            allocation.block = block.get();
+            allocation.call = it;
+            allocation.hive_definition = get_constructed_hive(call);
+
+            if (!allocation.hive_definition || !collect_parameters(allocation) ||
+                escapes(*call->return_value) || !find_releases(allocation)) {
+                continue;
+            }
+
+            allocations.push_back(std::move(allocation));
+        }
+    }
+
+    // Allocations never use each other: passing a hive to a constructor is an escape
+    for (auto& allocation : allocations) {
+        place_on_stack(allocation);
+    }
+
+    this->procedure = nullptr;
+    return true;
+}
+
+void bonk::HIRStackPromoter::collect_uses() {
+    uses.assign(procedure->used_registers, {});
+    definitions.assign(procedure->used_registers, nullptr);
+
+    for (auto& block : procedure->base_blocks) {
+        for (auto instruction : block->instructions) {
+            for (int i = 0; i < instruction->get_read_register_count(); i++) {
+                uses[instruction->get_read_register(i)].push_back(instruction);
+            }
+            for (int i = 0; i < instruction->get_write_register_count(); i++) {
+                definitions[instruction->get_write_register(i, nullptr)] = instruction;
+            }
+        }
+    }
+}
+
+bonk::TreeNodeHiveDefinition*
+bonk::HIRStackPromoter::get_constructed_hive(HIRCallInstruction* call) {
+    auto& front_end = procedure->program.id_table.front_end;
+    return front_end.get_constructed_hive(
+        procedure->program.id_table.get_node(call->procedure_label_id));
+}
+
+bool bonk::HIRStackPromoter::collect_parameters(Allocation& allocation) {
+    int field_count = 0;
+    for (auto& field : allocation.hive_definition->body) {
+        if (field->type == TreeNodeType::n_variable_definition) {
+            field_count++;
+        }
+    }
+
+    // Arguments are passed with parameter instructions right before the call,
+    // in the order of the hive fields
+    auto& instructions = allocation.block->instructions;
+    for (auto it = allocation.call; allocation.parameters.size() < field_count;) {
+        if (it == instructions.begin()) {
+            break;
+        }
+        --it;
+        if ((*it)->type == HIRInstructionType::location ||
+            (*it)->type == HIRInstructionType::file) {
+            continue;
+        }
+        if ((*it)->type != HIRInstructionType::parameter) {
+            break;
+        }
+        allocation.parameters.push_back(it);
+    }
+
+    std::reverse(allocation.parameters.begin(), allocation.parameters.end());
+    return allocation.parameters.size() == field_count;
+}
+
+bool bonk::HIRStackPromoter::escapes(IRRegister object) {
+    // Field addresses are derived from the hive, they may only be used to access memory
+    std::vector<IRRegister> pointers{object};
+
+    while (!pointers.empty()) {
+        IRRegister pointer = pointers.back();
+        pointers.pop_back();
+
+        for (auto use : uses[pointer]) {
+            switch (use->type) {
+            case HIRInstructionType::inc_ref_counter:
+            case HIRInstructionType::dec_ref_counter:
+                if (pointer != object) {
+                    return true;
+                }
+                break;
+            case HIRInstructionType::memory_load:
+            case HIRInstructionType::jump_nz:
+                break;
+            case HIRInstructionType::memory_store:
+                if (((HIRMemoryStoreInstruction*)use)->value == pointer) {
+                    return true;
+                }
+                break;
+            case HIRInstructionType::operation: {
+                auto operation = (HIROperationInstruction*)use;
+                if (operation->operation_type == HIROperationType::equal ||
+                    operation->operation_type == HIROperationType::not_equal) {
+                    break;
+                }
+                if (operation->operation_type != HIROperationType::plus ||
+                    !operation->right.has_value()) {
+                    return true;
+                }
+                IRRegister offset =
+                    operation->left == pointer ? *operation->right : operation->left;
+                auto offset_definition = definitions[offset];
+                if (!offset_definition ||
+                    offset_definition->type != HIRInstructionType::constant_load) {
+                    return true;
+                }
+                pointers.push_back(operation->target);
+                break;
+            }
+            default:
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool bonk::HIRStackPromoter::find_releases(Allocation& allocation) {
+    auto call = *allocation.call;
+    IRRegister object = *((HIRCallInstruction*)call)->return_value;
+
+    // Nobody else can reach the hive, so its reference counter only depends on
+    // the path taken through the procedure. Paths that meet must agree on it.
+    std::vector<int> counters(procedure->base_blocks.size(), -1);
+    std::vector<HIRBaseBlock*> worklist{procedure->base_blocks[procedure->start_block_index].get()};
+    counters[procedure->start_block_index] = 0;
+
+    while (!worklist.empty()) {
+        auto block = worklist.back();
+        worklist.pop_back();
+
+        int counter = counters[block->index];
+
+        for (auto instruction : block->instructions) {
+            if (instruction == call) {
+                // The previous hive must be destroyed before its slot is reused
+                if (counter != 0) {
+                    return false;
+                }
+                counter = 1;
+            } else if (instruction->type == HIRInstructionType::inc_ref_counter) {
+                if (((HIRIncRefCounterInstruction*)instruction)->address != object) {
+                    continue;
+                }
+                if (counter <= 0) {
+                    return false;
+                }
+                counter++;
+            } else if (instruction->type == HIRInstructionType::dec_ref_counter) {
+                if (((HIRDecRefCounterInstruction*)instruction)->address != object) {
+                    continue;
+                }
+                if (counter <= 0) {
+                    return false;
+                }
+                if (--counter == 0) {
+                    allocation.releases.insert(instruction);
+                }
+            } else if (instruction->type == HIRInstructionType::return_op) {
+                // The hive would outlive the stack frame
+                if (counter != 0) {
+                    return false;
+                }
+            }
+        }
+
+        for (auto successor : block->successors) {
+            if (counters[successor->index] == -1) {
+                counters[successor->index] = counter;
+                worklist.push_back(successor);
+            } else if (counters[successor->index] != counter) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void bonk::HIRStackPromoter::place_on_stack(Allocation& allocation) {
+    auto call = (HIRCallInstruction*)*allocation.call;
+    IRRegister object = *call->return_value;
+    auto& block = *allocation.block;
+
+    auto& front_end = procedure->program.id_table.front_end;
+    auto fields = get_fields(allocation.hive_definition);
+
+    // Allocations in the start block get a fixed slot in the stack frame.
+    // Empty hives still need a distinct address.
+    int size = std::max(front_end.get_hive_field_offset(allocation.hive_definition, -1), 8);
+
+    auto& start_block = *procedure->base_blocks[procedure->start_block_index];
+    auto start_position = start_block.instructions.end();
+    if (!start_block.instructions.empty()) {
+        auto last = start_block.instructions.back()->type;
+        if (last == HIRInstructionType::jump || last == HIRInstructionType::jump_nz) {
+            start_position = std::prev(start_position);
+        }
+    }
+    start_block.instructions.insert(start_position,
+                                    procedure->instruction<HIRStackAllocInstruction>(object, size));
+
+    // Initialize the fields like the constructor would. The hive holds a
+    // reference to every hive that is stored in it.
+    for (int i = 0; i < fields.size(); i++) {
+        auto parameter = (HIRParameterInstruction*)*allocation.parameters[i];
+
+        if (fields[i].hive_definition) {
+            auto increment = procedure->instruction<HIRIncRefCounterInstruction>();
+            increment->address = parameter->parameter;
+            block.instructions.insert(allocation.call, increment);
+        }
+
+        auto store = procedure->instruction<HIRMemoryStoreInstruction>();
+        store->address = get_field_address(block, allocation.call, object, fields[i].offset);
+        store->value = parameter->parameter;
+        store->type = parameter->type;
+        block.instructions.insert(allocation.call, store);
+    }
+
+    for (auto& parameter : allocation.parameters) {
+        block.instructions.erase(parameter);
+    }
+    block.instructions.erase(allocation.call);
+
+    // The decrement that would have destroyed the hive releases its fields
+    // instead, the memory itself is freed with the stack frame
+    for (auto& release_block : procedure->base_blocks) {
+        auto& instructions = release_block->instructions;
+        for (auto it = instructions.begin(); it != instructions.end();) {
+            auto instruction = *it;
+            bool is_increment = instruction->type == HIRInstructionType::inc_ref_counter &&
+                                ((HIRIncRefCounterInstruction*)instruction)->address == object;
+            bool is_decrement = instruction->type == HIRInstructionType::dec_ref_counter &&
+                                ((HIRDecRefCounterInstruction*)instruction)->address == object;
+
+            if (!is_increment && !is_decrement) {
+                ++it;
+                continue;
+            }
+
+            if (allocation.releases.count(instruction)) {
+                for (auto& field : fields) {
+                    if (!field.hive_definition) {
+                        continue;
+                    }
+
+                    IRRegister value = procedure->get_unused_register();
+                    IRRegister address =
+                        get_field_address(*release_block, it, object, field.offset);
+                    instructions.insert(it, procedure->instruction<HIRMemoryLoadInstruction>(
+                                                value, address, HIRDataType::dword));
+
+                    auto decrement = procedure->instruction<HIRDecRefCounterInstruction>();
+                    decrement->address = value;
+                    decrement->hive_definition = field.hive_definition;
+                    instructions.insert(it, decrement);
+                }
+            }
+
+            it = instructions.erase(it);
+        }
+    }
+}
+
+std::vector<bonk::HIRStackPromoter::HiveField>
+bonk::HIRStackPromoter::get_fields(TreeNodeHiveDefinition* hive_definition) {
+    auto& front_end = procedure->program.id_table.front_end;
+    std::vector<HiveField> fields;
+
+    for (auto& child : hive_definition->body) {
+        if (child->type != TreeNodeType::n_variable_definition) {
+            continue;
+        }
+
+        HiveField field;
+        field.offset = front_end.get_hive_field_offset(hive_definition, fields.size());
+
+        auto type = resolve_type(front_end.type_table.get_type(child.get()));
+        if (type && type->kind == TypeKind::hive) {
+            field.hive_definition = ((HiveType*)type)->hive_definition;
+        }
+
+        fields.push_back(field);
+    }
+
+    return fields;
+}
+
+bonk::IRRegister bonk::HIRStackPromoter::get_field_address(HIRBaseBlock& block,
+                                                           InstructionIterator position,
+                                                           IRRegister object, int offset) {
+    IRRegister offset_register = procedure->get_unused_register();
+    block.instructions.insert(position, procedure->instruction<HIRConstantLoadInstruction>(
+                                            offset_register, (int64_t)offset));
+
+    IRRegister address = procedure->get_unused_register();
+    auto operation = procedure->instruction<HIROperationInstruction>();
+    operation->target = address;
+    operation->left = object;
+    operation->right = offset_register;
+    operation->operation_type = HIROperationType::plus;
+    operation->operand_type = HIRDataType::dword;
+    operation->result_type = HIRDataType::dword;
+    block.instructions.insert(position, operation);
+
+    return address;
+}
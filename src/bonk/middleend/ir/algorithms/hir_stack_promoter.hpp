@@ -0,0 +1,61 @@
+#pragma once
+
+#include <list>
+#include <unordered_set>
+#include <vector>
+#include "bonk/middleend/ir/hir.hpp"
+
+namespace bonk {
+
+// Places hives that never escape the procedure that constructed them on the
+// stack. A hive escapes when it is stored into memory, passed to a call,
+// returned or merged with other values. Otherwise, its fields are only
+// accessed by this procedure, so its reference counter is known at every
+// point. The constructor call is replaced with a stack slot and inline field
+// stores, the reference counter operations of the hive are removed, and the
+// decrement that would have destroyed it releases its fields instead.
+//
+// The slot is reserved in the start block, so constructing a hive in a loop
+// reuses the same memory. This is only done when the previous hive is
+// destroyed before the next one is constructed. Should run after the reference
+// counter optimizations. Expects the procedures to be in SSA form.
+class HIRStackPromoter {
+  public:
+    HIRStackPromoter() = default;
+
+    bool promote(HIRProgram& program);
+    bool promote(HIRProcedure& procedure);
+
+  private:
+    using InstructionIterator = std::list<HIRInstruction*>::iterator;
+
+    struct HiveField {
+        int offset = 0;
+        // Set for fields that hold hives
+        TreeNodeHiveDefinition* hive_definition = nullptr;
+    };
+
+    struct Allocation {
+        HIRBaseBlock* block = nullptr;
+        InstructionIterator call{};
+        std::vector<InstructionIterator> parameters;
+        TreeNodeHiveDefinition* hive_definition = nullptr;
+        std::unordered_set<HIRInstruction*> releases;
+    };
+
+    void collect_uses();
+    TreeNodeHiveDefinition* get_constructed_hive(HIRCallInstruction* call);
+    bool collect_parameters(Allocation& allocation);
+    bool escapes(IRRegister object);
+    bool find_releases(Allocation& allocation);
+    void place_on_stack(Allocation& allocation);
+    std::vector<HiveField> get_fields(TreeNodeHiveDefinition* hive_definition);
+    IRRegister get_field_address(HIRBaseBlock& block, InstructionIterator position,
+                                 IRRegister object, int offset);
+
+    HIRProcedure* procedure = nullptr;
+    std::vector<std::vector<HIRInstruction*>> uses;
+    std::vector<HIRInstruction*> definitions;
+};
+
+} // namespace bonk
@@ -0,0 +1,184 @@
+
+#include "hir_tail_call_eliminator.hpp"
+#include <algorithm>
+#include <unordered_map>
+
+bool bonk::HIRTailCallEliminator::eliminate_tail_calls(HIRProgram& program) {
+    for (auto& procedure : program.procedures) {
+        if (!eliminate_tail_calls(*procedure)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool bonk::HIRTailCallEliminator::eliminate_tail_calls(HIRProcedure& procedure) {
+    if (procedure.is_external) {
+        return true;
+    }
+
+    this->procedure = &procedure;
+
+    std::vector<TailCall> self_calls;
+
+    for (auto& block : procedure.base_blocks) {
+        TailCall tail_call;
+        if (!find_tail_call(*block, tail_call)) {
+            continue;
+        }
+
+        auto call = (HIRCallInstruction*)*tail_call.call;
+        if (call->procedure_label_id == procedure.procedure_id && collect_parameters(tail_call)) {
+            self_calls.push_back(std::move(tail_call));
+        } else {
+            call->is_tail_call = true;
+        }
+    }
+
+    if (!self_calls.empty()) {
+        auto header = create_loop_header();
+
+        for (auto& tail_call : self_calls) {
+            if (header) {
+                replace_with_jump(tail_call, *header);
+            } else {
+                ((HIRCallInstruction*)*tail_call.call)->is_tail_call = true;
+            }
+        }
+    }
+
+    this->procedure = nullptr;
+    return true;
+}
+
+bool bonk::HIRTailCallEliminator::find_tail_call(HIRBaseBlock& block, TailCall& tail_call) {
+    auto& instructions = block.instructions;
+    if (instructions.empty() || instructions.back()->type != HIRInstructionType::return_op) {
+        return false;
+    }
+
+    tail_call.block = &block;
+    tail_call.return_op = std::prev(instructions.end());
+
+    // Only debug information may stand between the call and the return
+    auto it = tail_call.return_op;
+    do {
+        if (it == instructions.begin()) {
+            return false;
+        }
+        --it;
+    } while ((*it)->type == HIRInstructionType::location ||
+             (*it)->type == HIRInstructionType::file);
+
+    if ((*it)->type != HIRInstructionType::call) {
+        return false;
+    }
+
+    auto call = (HIRCallInstruction*)*it;
+    auto return_op = (HIRReturnInstruction*)*tail_call.return_op;
+
+    if (return_op->return_value.has_value() && return_op->return_value != call->return_value) {
+        return false;
+    }
+
+    tail_call.call = it;
+    return true;
+}
+
+bool bonk::HIRTailCallEliminator::collect_parameters(TailCall& tail_call) {
+    auto& instructions = tail_call.block->instructions;
+    int parameter_count = procedure->parameters.size();
+
+    for (auto it = tail_call.call; it != instructions.begin();) {
+        --it;
+        if ((*it)->type == HIRInstructionType::location ||
+            (*it)->type == HIRInstructionType::file) {
+            continue;
+        }
+        if ((*it)->type != HIRInstructionType::parameter) {
+            break;
+        }
+        tail_call.parameters.push_back(it);
+    }
+
+    std::reverse(tail_call.parameters.begin(), tail_call.parameters.end());
+    return tail_call.parameters.size() == parameter_count;
+}
+
+bonk::HIRBaseBlock* bonk::HIRTailCallEliminator::create_loop_header() {
+    auto& start_block = *procedure->base_blocks[procedure->start_block_index];
+
+    // The start block only jumps to the body and reserves the stack slots,
+    // which are reused by every iteration
+    if (start_block.instructions.empty() ||
+        start_block.instructions.back()->type != HIRInstructionType::jump ||
+        start_block.successors.size() != 1) {
+        return nullptr;
+    }
+
+    auto body = start_block.successors[0];
+
+    procedure->create_base_block();
+    auto header = procedure->base_blocks.back().get();
+
+    std::unordered_map<IRRegister, IRRegister> parameter_values;
+
+    for (auto& parameter : procedure->parameters) {
+        auto phi = header->instruction<HIRPhiFunctionInstruction>();
+        phi->type = parameter.type;
+        phi->target = procedure->get_unused_register();
+        phi->sources.push_back(parameter.register_id);
+        header->instructions.push_back(phi);
+
+        parameter_values[parameter.register_id] = phi->target;
+    }
+
+    header->instructions.push_back(header->instruction<HIRJumpInstruction>(body->index));
+
+    // The parameters only hold their values on the first iteration
+    for (auto& block : procedure->base_blocks) {
+        if (block.get() == &start_block || block.get() == header) {
+            continue;
+        }
+        for (auto instruction : block->instructions) {
+            for (int i = 0; i < instruction->get_read_register_count(); i++) {
+                auto& read_register = instruction->get_read_register(i);
+                auto it = parameter_values.find(read_register);
+                if (it != parameter_values.end()) {
+                    read_register = it->second;
+                }
+            }
+        }
+    }
+
+    ((HIRJumpInstruction*)start_block.instructions.back())->label_id = header->index;
+    start_block.successors[0] = header;
+    header->predecessors.push_back(&start_block);
+
+    header->successors.push_back(body);
+    std::replace(body->predecessors.begin(), body->predecessors.end(), &start_block, header);
+
+    return header;
+}
+
+void bonk::HIRTailCallEliminator::replace_with_jump(TailCall& tail_call, HIRBaseBlock& header) {
+    auto& block = *tail_call.block;
+
+    // Phi sources follow the order of the predecessors
+    auto phi_it = header.instructions.begin();
+    for (auto& parameter : tail_call.parameters) {
+        auto phi = (HIRPhiFunctionInstruction*)*phi_it++;
+        phi->sources.push_back(((HIRParameterInstruction*)*parameter)->parameter);
+        block.instructions.erase(parameter);
+    }
+
+    block.instructions.erase(tail_call.call);
+    block.instructions.erase(tail_call.return_op);
+
+    while (!block.successors.empty()) {
+        procedure->remove_control_flow_edge(&block, block.successors.back());
+    }
+
+    procedure->add_control_flow_edge(&block, &header);
+    block.instructions.push_back(block.instruction<HIRJumpInstruction>(header.index));
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <list>
+#include <vector>
+#include "bonk/middleend/ir/hir.hpp"
+
+namespace bonk {
+
+// Finds calls whose result is returned right away. Only self tail calls are
+// eliminated: such a call is replaced with a jump to a loop header right after
+// the start block, where phi functions select either the incoming parameters
+// or the arguments of the tail call. Calls to other procedures stay calls and
+// keep using stack space. They are only marked with the advisory
+// HIRCallInstruction::is_tail_call flag.
+//
+// Reference counter cleanup is never reordered: a call followed by a decrement
+// is not in tail position. Should run after the reference counter optimizations,
+// since they remove most of these decrements. Expects the procedures to be in
+// SSA form.
+class HIRTailCallEliminator {
+  public:
+    HIRTailCallEliminator() = default;
+
+    bool eliminate_tail_calls(HIRProgram& program);
+    bool eliminate_tail_calls(HIRProcedure& procedure);
+
+  private:
+    using InstructionIterator = std::list<HIRInstruction*>::iterator;
+
+    struct TailCall {
+        HIRBaseBlock* block = nullptr;
+        InstructionIterator call{};
+        InstructionIterator return_op{};
+        std::vector<InstructionIterator> parameters;
+    };
+
+    bool find_tail_call(HIRBaseBlock& block, TailCall& tail_call);
+    bool collect_parameters(TailCall& tail_call);
+    HIRBaseBlock* create_loop_header();
+    void replace_with_jump(TailCall& tail_call, HIRBaseBlock& header);
+
+    HIRProcedure* procedure = nullptr;
+};
+
+} // namespace bonk
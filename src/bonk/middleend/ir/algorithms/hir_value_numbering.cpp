@@ -0,0 +1,211 @@
+
+#include "hir_value_numbering.hpp"
+#include "utils/hash.hpp"
+
+bool bonk::HIRValueNumbering::ValueKey::operator==(const ValueKey& other) const {
+    return kind == other.kind && operation == other.operation && type == other.type &&
+           operand_type == other.operand_type && left == other.left && right == other.right &&
+           epoch == other.epoch;
+}
+
+size_t bonk::HIRValueNumbering::ValueKeyHash::operator()(const ValueKey& key) const {
+    FNVHasher hasher;
+    hasher.update_value(key.kind);
+    hasher.update_value(key.operation);
+    hasher.update_value(key.type);
+    hasher.update_value(key.operand_type);
+    hasher.update_value(key.left);
+    hasher.update_value(key.right);
+    hasher.update_value(key.epoch);
+    return hasher.digest();
+}
+
+bool bonk::HIRValueNumbering::eliminate_redundancy(HIRProgram& program) {
+    for (auto& procedure : program.procedures) {
+        if (!eliminate_redundancy(*procedure)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool bonk::HIRValueNumbering::eliminate_redundancy(HIRProcedure& procedure) {
+    if (procedure.is_external) {
+        return true;
+    }
+
+    HIRDominatorFinder dominator_finder(procedure);
+    HIRDominanceTreeBuilder dominance_tree_builder(dominator_finder);
+    dominance_tree = &dominance_tree_builder;
+
+    available_values.clear();
+    scope_history.clear();
+    replacements.resize(procedure.used_registers);
+    for (int i = 0; i < procedure.used_registers; i++) {
+        replacements[i] = i;
+    }
+
+    number_block(*procedure.base_blocks[procedure.start_block_index], epoch_counter++);
+    replace_registers(procedure);
+
+    dominance_tree = nullptr;
+    return true;
+}
+
+void bonk::HIRValueNumbering::number_block(HIRBaseBlock& block, long long epoch) {
+    size_t scope_start = scope_history.size();
+
+    for (auto it = block.instructions.begin(); it != block.instructions.end();) {
+        auto instruction = *it;
+
+        if (is_memory_barrier(instruction)) {
+            epoch = epoch_counter++;
+        }
+
+        // Operands are renamed right away, so that the keys of the dependent
+        // instructions match. Phi sources may come from blocks that are not
+        // visited yet, they are renamed in replace_registers.
+        if (instruction->type != HIRInstructionType::phi_function) {
+            for (int i = 0; i < instruction->get_read_register_count(); i++) {
+                auto& reg = instruction->get_read_register(i);
+                reg = get_value(reg);
+            }
+        }
+
+        ValueKey key;
+        if (!get_key(instruction, epoch, key)) {
+            it++;
+            continue;
+        }
+
+        auto target = instruction->get_write_register(0);
+
+        if (instruction->type == HIRInstructionType::operation &&
+            ((HIROperationInstruction*)instruction)->operation_type == HIROperationType::assign) {
+            // Copies are numbered as their source
+            replacements[target] = key.left;
+            it = block.instructions.erase(it);
+            continue;
+        }
+
+        auto existing = available_values.find(key);
+        if (existing != available_values.end()) {
+            replacements[target] = existing->second;
+            it = block.instructions.erase(it);
+            continue;
+        }
+
+        available_values.emplace(key, target);
+        scope_history.push_back(key);
+        it++;
+    }
+
+    for (auto child : dominance_tree->get_children(block.index)) {
+        auto& child_block = *block.procedure.base_blocks[child];
+
+        // Memory is only known to be unchanged if the child is entered
+        // straight from this block. Otherwise, a store on another path may
+        // have happened in between.
+        long long child_epoch = epoch;
+        if (child_block.predecessors.size() != 1 || child_block.predecessors[0] != &block) {
+            child_epoch = epoch_counter++;
+        }
+
+        number_block(child_block, child_epoch);
+    }
+
+    while (scope_history.size() > scope_start) {
+        available_values.erase(scope_history.back());
+        scope_history.pop_back();
+    }
+}
+
+bool bonk::HIRValueNumbering::get_key(HIRInstruction* instruction, long long epoch,
+                                      ValueKey& key) {
+    key.kind = instruction->type;
+
+    switch (instruction->type) {
+    case HIRInstructionType::constant_load: {
+        auto constant = (HIRConstantLoadInstruction*)instruction;
+        key.type = constant->type;
+        key.left = constant->constant;
+        return true;
+    }
+    case HIRInstructionType::symbol_load: {
+        auto symbol = (HIRSymbolLoadInstruction*)instruction;
+        key.type = symbol->type;
+        key.left = symbol->symbol_id;
+        return true;
+    }
+    case HIRInstructionType::operation: {
+        auto operation = (HIROperationInstruction*)instruction;
+
+        if (operation->operation_type == HIROperationType::assign &&
+            operation->operand_type != operation->result_type) {
+            return false;
+        }
+
+        key.operation = (int)operation->operation_type;
+        key.type = operation->result_type;
+        key.operand_type = operation->operand_type;
+        key.left = operation->left;
+        key.right = operation->right.has_value() ? operation->right.value() : -1;
+
+        switch (operation->operation_type) {
+        case HIROperationType::plus:
+        case HIROperationType::multiply:
+        case HIROperationType::and_op:
+        case HIROperationType::or_op:
+        case HIROperationType::xor_op:
+        case HIROperationType::equal:
+        case HIROperationType::not_equal:
+            if (key.left > key.right) {
+                std::swap(key.left, key.right);
+            }
+            break;
+        default:
+            break;
+        }
+        return true;
+    }
+    case HIRInstructionType::memory_load: {
+        auto load = (HIRMemoryLoadInstruction*)instruction;
+        key.type = load->type;
+        key.left = load->address;
+        key.epoch = epoch;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+bool bonk::HIRValueNumbering::is_memory_barrier(HIRInstruction* instruction) {
+    switch (instruction->type) {
+    case HIRInstructionType::memory_store:
+    case HIRInstructionType::call:
+    case HIRInstructionType::dec_ref_counter:
+        return true;
+    default:
+        // Incrementing a reference counter does not change any hive fields
+        return false;
+    }
+}
+
+bonk::IRRegister bonk::HIRValueNumbering::get_value(IRRegister reg) {
+    while (replacements[reg] != reg) {
+        reg = replacements[reg];
+    }
+    return reg;
+}
+
+void bonk::HIRValueNumbering::replace_registers(HIRProcedure& procedure) {
+    for (auto& block : procedure.base_blocks) {
+        for (auto instruction : block->instructions) {
+            for (int i = 0; i < instruction->get_read_register_count(); i++) {
+                auto& reg = instruction->get_read_register(i);
+                reg = get_value(reg);
+            }
+        }
+    }
+}
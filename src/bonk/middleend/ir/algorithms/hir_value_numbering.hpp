@@ -0,0 +1,56 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include "bonk/middleend/ir/hir.hpp"
+#include "hir_dominance_tree_builder.hpp"
+
+namespace bonk {
+
+// Dominator-based global value numbering. Walks the dominance tree and keeps a
+// scoped table of the values computed so far, so an instruction that recomputes
+// a value already available in a dominating block is removed and its uses are
+// redirected to the earlier register.
+//
+// Constant loads, symbol loads and operations are pure. Memory loads are only
+// reused within the same memory epoch: every store, call or reference counter
+// decrement (which may destroy an object) starts a new one. Expects the
+// procedure to be in SSA form.
+class HIRValueNumbering {
+  public:
+    HIRValueNumbering() = default;
+
+    bool eliminate_redundancy(HIRProgram& program);
+    bool eliminate_redundancy(HIRProcedure& procedure);
+
+  private:
+    struct ValueKey {
+        HIRInstructionType kind = HIRInstructionType::unset;
+        int operation = 0;
+        HIRDataType type = HIRDataType::unset;
+        HIRDataType operand_type = HIRDataType::unset;
+        long long left = 0;
+        long long right = 0;
+        long long epoch = 0;
+
+        bool operator==(const ValueKey& other) const;
+    };
+
+    struct ValueKeyHash {
+        size_t operator()(const ValueKey& key) const;
+    };
+
+    void number_block(HIRBaseBlock& block, long long epoch);
+    bool get_key(HIRInstruction* instruction, long long epoch, ValueKey& key);
+    bool is_memory_barrier(HIRInstruction* instruction);
+    IRRegister get_value(IRRegister reg);
+    void replace_registers(HIRProcedure& procedure);
+
+    HIRDominanceTreeBuilder* dominance_tree = nullptr;
+    std::unordered_map<ValueKey, IRRegister, ValueKeyHash> available_values;
+    std::vector<ValueKey> scope_history;
+    std::vector<IRRegister> replacements;
+    long long epoch_counter = 0;
+};
+
+} // namespace bonk
@@ -0,0 +1,637 @@
+
+#include "hir_value_range_finder.hpp"
+#include <algorithm>
+#include <climits>
+
+// Widening makes every loop stable after a few rounds, this only guards
+// against irreducible control flow
+static constexpr int max_widening_rounds = 32;
+
+static constexpr int narrowing_rounds = 2;
+
+static bool is_integer(bonk::HIRDataType type) {
+    switch (type) {
+    case bonk::HIRDataType::byte:
+    case bonk::HIRDataType::hword:
+    case bonk::HIRDataType::word:
+    case bonk::HIRDataType::dword:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool is_comparison(bonk::HIROperationType operation) {
+    switch (operation) {
+    case bonk::HIROperationType::equal:
+    case bonk::HIROperationType::not_equal:
+    case bonk::HIROperationType::less:
+    case bonk::HIROperationType::less_equal:
+    case bonk::HIROperationType::greater:
+    case bonk::HIROperationType::greater_equal:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bonk::HIROperationType mirror_comparison(bonk::HIROperationType operation) {
+    switch (operation) {
+    case bonk::HIROperationType::less:
+        return bonk::HIROperationType::greater;
+    case bonk::HIROperationType::less_equal:
+        return bonk::HIROperationType::greater_equal;
+    case bonk::HIROperationType::greater:
+        return bonk::HIROperationType::less;
+    case bonk::HIROperationType::greater_equal:
+        return bonk::HIROperationType::less_equal;
+    default:
+        return operation;
+    }
+}
+
+static bonk::HIROperationType invert_comparison(bonk::HIROperationType operation) {
+    switch (operation) {
+    case bonk::HIROperationType::equal:
+        return bonk::HIROperationType::not_equal;
+    case bonk::HIROperationType::not_equal:
+        return bonk::HIROperationType::equal;
+    case bonk::HIROperationType::less:
+        return bonk::HIROperationType::greater_equal;
+    case bonk::HIROperationType::less_equal:
+        return bonk::HIROperationType::greater;
+    case bonk::HIROperationType::greater:
+        return bonk::HIROperationType::less_equal;
+    case bonk::HIROperationType::greater_equal:
+        return bonk::HIROperationType::less;
+    default:
+        return operation;
+    }
+}
+
+// Builds a range from bounds computed without overflow, or returns the whole
+// range of the type if they do not fit into it
+static bonk::HIRValueRange make_range(__int128 min, __int128 max, bonk::HIRDataType type) {
+    auto type_range = bonk::HIRValueRangeFinder::get_type_range(type);
+    if (min < type_range.min || max > type_range.max) {
+        return type_range;
+    }
+    return {(long long)min, (long long)max};
+}
+
+bonk::HIRValueRange bonk::HIRValueRange::empty() {
+    return {};
+}
+
+bonk::HIRValueRange bonk::HIRValueRange::constant(long long value) {
+    return {value, value};
+}
+
+bonk::HIRValueRange bonk::HIRValueRange::unite(const HIRValueRange& other) const {
+    if (is_empty()) {
+        return other;
+    }
+    if (other.is_empty()) {
+        return *this;
+    }
+    return {std::min(min, other.min), std::max(max, other.max)};
+}
+
+bonk::HIRValueRange bonk::HIRValueRange::intersect(const HIRValueRange& other) const {
+    HIRValueRange result = {std::max(min, other.min), std::min(max, other.max)};
+    if (result.is_empty()) {
+        return empty();
+    }
+    return result;
+}
+
+bool bonk::HIRValueRange::operator==(const HIRValueRange& other) const {
+    if (is_empty() || other.is_empty()) {
+        return is_empty() == other.is_empty();
+    }
+    return min == other.min && max == other.max;
+}
+
+bonk::HIRValueRangeFinder::HIRValueRangeFinder(HIRDominatorFinder& dominator_finder)
+    : procedure(dominator_finder.procedure), dominator_finder(dominator_finder) {
+}
+
+const bonk::HIRValueRange& bonk::HIRValueRangeFinder::get_range(IRRegister register_id) {
+    // The ranges are looked up while they are built, so the flag is set first
+    if (!is_built) {
+        is_built = true;
+        build();
+    }
+    return ranges[register_id];
+}
+
+bonk::HIRValueRange bonk::HIRValueRangeFinder::get_range_in_block(IRRegister register_id,
+                                                                  HIRBaseBlock& block) {
+    HIRValueRange range = get_range(register_id);
+    if (!is_integer(types[register_id])) {
+        return range;
+    }
+
+    for (auto guarded_block : guarded_blocks[block.index]) {
+        auto jump = (HIRJumpNZInstruction*)guarded_block->predecessors[0]->instructions.back();
+        range = refine(range, register_id, jump, jump->nz_label == guarded_block->index);
+    }
+
+    return range;
+}
+
+bonk::HIRValueRange bonk::HIRValueRangeFinder::get_range_on_edge(IRRegister register_id,
+                                                                 HIRBaseBlock& from,
+                                                                 HIRBaseBlock& to) {
+    HIRValueRange range = get_range_in_block(register_id, from);
+    if (!is_integer(types[register_id]) || !is_branch(from)) {
+        return range;
+    }
+
+    auto jump = (HIRJumpNZInstruction*)from.instructions.back();
+    return refine(range, register_id, jump, jump->nz_label == to.index);
+}
+
+std::optional<bool> bonk::HIRValueRangeFinder::compare(HIROperationType operation,
+                                                       const HIRValueRange& left,
+                                                       const HIRValueRange& right) {
+    if (left.is_empty() || right.is_empty()) {
+        return std::nullopt;
+    }
+
+    switch (operation) {
+    case HIROperationType::equal:
+        if (left.is_constant() && right.is_constant() && left.min == right.min) {
+            return true;
+        }
+        if (left.intersect(right).is_empty()) {
+            return false;
+        }
+        return std::nullopt;
+    case HIROperationType::not_equal: {
+        auto result = compare(HIROperationType::equal, left, right);
+        if (result.has_value()) {
+            return !*result;
+        }
+        return std::nullopt;
+    }
+    case HIROperationType::less:
+        if (left.max < right.min) {
+            return true;
+        }
+        if (left.min >= right.max) {
+            return false;
+        }
+        return std::nullopt;
+    case HIROperationType::less_equal:
+        if (left.max <= right.min) {
+            return true;
+        }
+        if (left.min > right.max) {
+            return false;
+        }
+        return std::nullopt;
+    case HIROperationType::greater:
+        return compare(HIROperationType::less, right, left);
+    case HIROperationType::greater_equal:
+        return compare(HIROperationType::less_equal, right, left);
+    default:
+        return std::nullopt;
+    }
+}
+
+bonk::HIRValueRange bonk::HIRValueRangeFinder::get_type_range(HIRDataType type) {
+    if (type == HIRDataType::dword) {
+        return {LLONG_MIN, LLONG_MAX};
+    }
+    if (is_integer(type)) {
+        return {INT32_MIN, INT32_MAX};
+    }
+    // Floats are not tracked, their range only has to be non-empty
+    return {LLONG_MIN, LLONG_MAX};
+}
+
+void bonk::HIRValueRangeFinder::build() {
+    collect_registers();
+    find_block_order();
+
+    int round = 0;
+    while (round < max_widening_rounds && update_ranges(true)) {
+        round++;
+    }
+
+    if (round == max_widening_rounds) {
+        // The ranges did not stabilize, so none of them can be trusted
+        for (int i = 0; i < ranges.size(); i++) {
+            ranges[i] = get_type_range(types[i]);
+        }
+        return;
+    }
+
+    for (int i = 0; i < narrowing_rounds; i++) {
+        update_ranges(false);
+    }
+}
+
+void bonk::HIRValueRangeFinder::collect_registers() {
+    definitions.assign(procedure.used_registers, nullptr);
+    types.assign(procedure.used_registers, HIRDataType::unset);
+
+    for (auto& block : procedure.base_blocks) {
+        for (auto instruction : block->instructions) {
+            for (int i = 0; i < instruction->get_write_register_count(); i++) {
+                HIRDataType type = HIRDataType::unset;
+                IRRegister register_id = instruction->get_write_register(i, &type);
+                definitions[register_id] = instruction;
+                types[register_id] = type;
+            }
+        }
+    }
+
+    for (auto& parameter : procedure.parameters) {
+        types[parameter.register_id] = parameter.type;
+    }
+
+    // Parameters and registers without a definition may hold any value
+    ranges.resize(procedure.used_registers);
+    for (int i = 0; i < procedure.used_registers; i++) {
+        if (definitions[i] && is_integer(types[i])) {
+            ranges[i] = HIRValueRange::empty();
+        } else {
+            ranges[i] = get_type_range(types[i]);
+        }
+    }
+}
+
+void bonk::HIRValueRangeFinder::find_block_order() {
+    // Reverse post-order, so that most definitions are visited before their uses
+    DynamicBitSet visited(procedure.base_blocks.size());
+    std::vector<std::pair<HIRBaseBlock*, int>> stack;
+
+    block_order.clear();
+    auto start_block = procedure.base_blocks[procedure.start_block_index].get();
+    visited[start_block->index] = true;
+    stack.emplace_back(start_block, 0);
+
+    while (!stack.empty()) {
+        auto& [block, successor_index] = stack.back();
+        if (successor_index < block->successors.size()) {
+            auto successor = block->successors[successor_index++];
+            if (!visited[successor->index]) {
+                visited[successor->index] = true;
+                stack.emplace_back(successor, 0);
+            }
+            continue;
+        }
+        block_order.push_back(block);
+        stack.pop_back();
+    }
+
+    std::reverse(block_order.begin(), block_order.end());
+
+    // A loop header dominates the source of its back edge
+    auto& dominators = dominator_finder.get_dominators();
+    loop_headers = DynamicBitSet(procedure.base_blocks.size());
+
+    for (auto block : block_order) {
+        for (auto predecessor : block->predecessors) {
+            if (dominators[predecessor->index][block->index]) {
+                loop_headers[block->index] = true;
+            }
+        }
+    }
+
+    // A block is only entered through a branch edge if it is dominated by the
+    // single-predecessor block that edge leads to
+    guarded_blocks.assign(procedure.base_blocks.size(), {});
+
+    for (auto block : block_order) {
+        for (auto dominator : block_order) {
+            if (dominators[block->index][dominator->index] &&
+                dominator->predecessors.size() == 1 && is_branch(*dominator->predecessors[0])) {
+                guarded_blocks[block->index].push_back(dominator);
+            }
+        }
+    }
+}
+
+bool bonk::HIRValueRangeFinder::is_branch(HIRBaseBlock& block) {
+    if (block.instructions.empty() ||
+        block.instructions.back()->type != HIRInstructionType::jump_nz) {
+        return false;
+    }
+    auto jump = (HIRJumpNZInstruction*)block.instructions.back();
+    return jump->nz_label != jump->z_label;
+}
+
+bool bonk::HIRValueRangeFinder::update_ranges(bool is_widening) {
+    bool changed = false;
+
+    for (auto block : block_order) {
+        for (auto instruction : block->instructions) {
+            if (instruction->get_write_register_count() == 0) {
+                continue;
+            }
+
+            IRRegister target = instruction->get_write_register(0, nullptr);
+            if (!is_integer(types[target]) || !definitions[target]) {
+                continue;
+            }
+
+            auto range = evaluate(instruction, *block, is_widening);
+
+            // Narrowing may only make the ranges smaller
+            if (!is_widening) {
+                range = range.intersect(ranges[target]);
+            }
+
+            if (range != ranges[target]) {
+                ranges[target] = range;
+                changed = true;
+            }
+        }
+    }
+
+    return changed;
+}
+
+bonk::HIRValueRange bonk::HIRValueRangeFinder::evaluate(HIRInstruction* instruction,
+                                                        HIRBaseBlock& block, bool is_widening) {
+    switch (instruction->type) {
+    case HIRInstructionType::constant_load:
+        return HIRValueRange::constant(((HIRConstantLoadInstruction*)instruction)->constant);
+    case HIRInstructionType::operation:
+        return evaluate_operation((HIROperationInstruction*)instruction, block);
+    case HIRInstructionType::phi_function:
+        return evaluate_phi((HIRPhiFunctionInstruction*)instruction, block, is_widening);
+    case HIRInstructionType::select: {
+        auto select = (HIRSelectInstruction*)instruction;
+        auto condition = get_range_in_block(select->condition, block);
+        auto nz_range = get_range_in_block(select->nz_value, block);
+        auto z_range = get_range_in_block(select->z_value, block);
+
+        if (condition.is_empty()) {
+            return HIRValueRange::empty();
+        }
+        if (!condition.contains(0)) {
+            return nz_range;
+        }
+        if (condition.is_constant()) {
+            return z_range;
+        }
+        return nz_range.unite(z_range);
+    }
+    default:
+        return get_type_range(types[instruction->get_write_register(0, nullptr)]);
+    }
+}
+
+bonk::HIRValueRange bonk::HIRValueRangeFinder::evaluate_phi(HIRPhiFunctionInstruction* phi,
+                                                            HIRBaseBlock& block,
+                                                            bool is_widening) {
+    HIRValueRange range = HIRValueRange::empty();
+
+    for (int i = 0; i < phi->sources.size(); i++) {
+        range = range.unite(get_range_on_edge(phi->sources[i], *block.predecessors[i], block));
+    }
+
+    if (!is_widening || !loop_headers[block.index]) {
+        return range;
+    }
+
+    // A bound that is still moving is pushed to the end of the type, so the
+    // loop needs a bounded number of rounds to stabilize
+    auto& old_range = ranges[phi->target];
+    if (old_range.is_empty() || range.is_empty()) {
+        return range.unite(old_range);
+    }
+
+    auto type_range = get_type_range(phi->type);
+    range = range.unite(old_range);
+    if (range.min < old_range.min) {
+        range.min = type_range.min;
+    }
+    if (range.max > old_range.max) {
+        range.max = type_range.max;
+    }
+    return range;
+}
+
+bonk::HIRValueRange
+bonk::HIRValueRangeFinder::evaluate_operation(HIROperationInstruction* operation,
+                                              HIRBaseBlock& block) {
+    auto type_range = get_type_range(operation->result_type);
+    auto left = get_range_in_block(operation->left, block);
+    auto right = operation->right.has_value() ? get_range_in_block(*operation->right, block)
+                                              : HIRValueRange::constant(0);
+
+    if (left.is_empty() || right.is_empty()) {
+        return HIRValueRange::empty();
+    }
+
+    if (is_comparison(operation->operation_type)) {
+        if (!is_integer(operation->operand_type)) {
+            return {0, 1};
+        }
+        auto result = compare(operation->operation_type, left, right);
+        if (result.has_value()) {
+            return HIRValueRange::constant(*result);
+        }
+        return {0, 1};
+    }
+
+    // Results narrower than a word are not truncated consistently by the
+    // backend, so only their comparisons are tracked
+    if (!is_integer(operation->operand_type) || operation->result_type == HIRDataType::byte ||
+        operation->result_type == HIRDataType::hword) {
+        return type_range;
+    }
+
+    if (operation->operation_type == HIROperationType::assign) {
+        return left.intersect(type_range) == left ? left : type_range;
+    }
+
+    return evaluate_arithmetic(operation, left, right);
+}
+
+bonk::HIRValueRange bonk::HIRValueRangeFinder::evaluate_arithmetic(
+    HIROperationInstruction* operation, const HIRValueRange& left, const HIRValueRange& right) {
+    auto type = operation->result_type;
+    auto type_range = get_type_range(type);
+    int bits = type == HIRDataType::dword ? 64 : 32;
+
+    switch (operation->operation_type) {
+    case HIROperationType::plus:
+        return make_range((__int128)left.min + right.min, (__int128)left.max + right.max, type);
+    case HIROperationType::minus:
+        return make_range((__int128)left.min - right.max, (__int128)left.max - right.min, type);
+    case HIROperationType::multiply:
+    case HIROperationType::multiply_high: {
+        __int128 corners[] = {
+            (__int128)left.min * right.min,
+            (__int128)left.min * right.max,
+            (__int128)left.max * right.min,
+            (__int128)left.max * right.max,
+        };
+        __int128 min = *std::min_element(std::begin(corners), std::end(corners));
+        __int128 max = *std::max_element(std::begin(corners), std::end(corners));
+
+        if (operation->operation_type == HIROperationType::multiply_high) {
+            // The high part of a word product is monotonic in the product
+            if (bits != 32) {
+                return type_range;
+            }
+            return make_range(min >> 32, max >> 32, type);
+        }
+        return make_range(min, max, type);
+    }
+    case HIROperationType::divide: {
+        // Division by zero traps, and the quotient is monotonic in both
+        // operands while the divisor keeps its sign
+        if (right.contains(0)) {
+            return type_range;
+        }
+        __int128 corners[] = {
+            (__int128)left.min / right.min,
+            (__int128)left.min / right.max,
+            (__int128)left.max / right.min,
+            (__int128)left.max / right.max,
+        };
+        return make_range(*std::min_element(std::begin(corners), std::end(corners)),
+                          *std::max_element(std::begin(corners), std::end(corners)), type);
+    }
+    case HIROperationType::and_op:
+        // Masking a non-negative value can only clear its bits
+        if (left.min >= 0 && right.min >= 0) {
+            return {0, std::min(left.max, right.max)};
+        }
+        if (left.min >= 0) {
+            return {0, left.max};
+        }
+        if (right.min >= 0) {
+            return {0, right.max};
+        }
+        return type_range;
+    case HIROperationType::or_op:
+    case HIROperationType::xor_op: {
+        if (left.min < 0 || right.min < 0) {
+            return type_range;
+        }
+        // The result has no bits above the highest bit of the operands
+        unsigned long long mask = std::max(left.max, right.max);
+        for (int shift = 1; shift < 64; shift *= 2) {
+            mask |= mask >> shift;
+        }
+        return {0, (long long)mask};
+    }
+    case HIROperationType::shift_left:
+        if (!right.is_constant() || right.min < 0 || right.min >= bits) {
+            return type_range;
+        }
+        return make_range((__int128)left.min * ((__int128)1 << right.min),
+                          (__int128)left.max * ((__int128)1 << right.min), type);
+    case HIROperationType::shift_right:
+        if (!right.is_constant() || right.min < 0 || right.min >= bits) {
+            return left.min >= 0 ? HIRValueRange{0, left.max} : type_range;
+        }
+        return {left.min >> right.min, left.max >> right.min};
+    default:
+        return type_range;
+    }
+}
+
+bonk::HIRValueRange bonk::HIRValueRangeFinder::refine(const HIRValueRange& range,
+                                                      IRRegister register_id,
+                                                      HIRJumpNZInstruction* jump, bool is_taken) {
+    if (jump->condition == register_id) {
+        if (!is_taken) {
+            return range.intersect(HIRValueRange::constant(0));
+        }
+        HIRValueRange result = range;
+        if (result.min == 0) {
+            result.min = 1;
+        }
+        if (result.max == 0) {
+            result.max = -1;
+        }
+        return result.is_empty() ? HIRValueRange::empty() : result;
+    }
+
+    auto definition = definitions[jump->condition];
+    if (!definition || definition->type != HIRInstructionType::operation) {
+        return range;
+    }
+
+    auto comparison = (HIROperationInstruction*)definition;
+    if (!is_comparison(comparison->operation_type) || !is_integer(comparison->operand_type) ||
+        !comparison->right.has_value() || comparison->left == *comparison->right) {
+        return range;
+    }
+
+    auto operation = comparison->operation_type;
+    if (!is_taken) {
+        operation = invert_comparison(operation);
+    }
+
+    // The bounds come from the plain ranges of the other operand, so that
+    // refining one register never depends on refining another
+    if (comparison->left == register_id) {
+        return apply_constraint(range, operation, ranges[*comparison->right],
+                                comparison->operand_type);
+    }
+    if (*comparison->right == register_id) {
+        return apply_constraint(range, mirror_comparison(operation), ranges[comparison->left],
+                                comparison->operand_type);
+    }
+    return range;
+}
+
+bonk::HIRValueRange bonk::HIRValueRangeFinder::apply_constraint(const HIRValueRange& range,
+                                                                HIROperationType operation,
+                                                                const HIRValueRange& bound,
+                                                                HIRDataType type) {
+    if (bound.is_empty()) {
+        return range;
+    }
+
+    // Bounds are computed in 128 bits, so that 'x < INT64_MIN' gives an
+    // empty range instead of wrapping around
+    __int128 min = range.min;
+    __int128 max = range.max;
+
+    switch (operation) {
+    case HIROperationType::less:
+        max = std::min(max, (__int128)bound.max - 1);
+        break;
+    case HIROperationType::less_equal:
+        max = std::min(max, (__int128)bound.max);
+        break;
+    case HIROperationType::greater:
+        min = std::max(min, (__int128)bound.min + 1);
+        break;
+    case HIROperationType::greater_equal:
+        min = std::max(min, (__int128)bound.min);
+        break;
+    case HIROperationType::equal:
+        min = std::max(min, (__int128)bound.min);
+        max = std::min(max, (__int128)bound.max);
+        break;
+    case HIROperationType::not_equal:
+        if (bound.is_constant()) {
+            if (min == bound.min) {
+                min++;
+            }
+            if (max == bound.min) {
+                max--;
+            }
+        }
+        break;
+    default:
+        break;
+    }
+
+    if (min > max) {
+        return HIRValueRange::empty();
+    }
+    return {(long long)min, (long long)max};
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <optional>
+#include <vector>
+#include "bonk/middleend/ir/hir.hpp"
+#include "hir_dominator_finder.hpp"
+#include "utils/dynamic_bitset.hpp"
+
+namespace bonk {
+
+// An inclusive range of the values a register may hold. Registers defined in
+// unreachable code have an empty range.
+struct HIRValueRange {
+    long long min = 1;
+    long long max = 0;
+
+    static HIRValueRange empty();
+    static HIRValueRange constant(long long value);
+
+    bool is_empty() const {
+        return min > max;
+    }
+    bool is_constant() const {
+        return min == max;
+    }
+    bool contains(long long value) const {
+        return min <= value && value <= max;
+    }
+
+    HIRValueRange unite(const HIRValueRange& other) const;
+    HIRValueRange intersect(const HIRValueRange& other) const;
+
+    bool operator==(const HIRValueRange& other) const;
+    bool operator!=(const HIRValueRange& other) const {
+        return !(*this == other);
+    }
+};
+
+// Finds the ranges of the integer registers of a procedure. Ranges flow
+// through operations and phi functions, and are narrowed on the edges of the
+// branches that compare them: in the blocks entered when 'i < n' holds, 'i'
+// is known to be less than the largest 'n'. Phi functions of loop headers are
+// widened to the bounds of their type when they keep growing, and then the
+// ranges are narrowed again.
+//
+// Smaller integers are computed in word registers, so bytes and half-words
+// get word ranges. Floats and untracked registers get the whole range of
+// their type. Expects the procedure to be in SSA form.
+class HIRValueRangeFinder {
+  public:
+    HIRProcedure& procedure;
+    HIRDominatorFinder& dominator_finder;
+
+    explicit HIRValueRangeFinder(HIRDominatorFinder& dominator_finder);
+
+    // Range of the register wherever it is available
+    const HIRValueRange& get_range(IRRegister register_id);
+
+    // Range of the register inside the block, narrowed by the branches that
+    // every path to the block goes through
+    HIRValueRange get_range_in_block(IRRegister register_id, HIRBaseBlock& block);
+
+    // Range of the register when the control passes from one block to another
+    HIRValueRange get_range_on_edge(IRRegister register_id, HIRBaseBlock& from,
+                                    HIRBaseBlock& to);
+
+    // Result of comparing values from the given ranges, if it is always the same
+    static std::optional<bool> compare(HIROperationType operation, const HIRValueRange& left,
+                                       const HIRValueRange& right);
+
+    static HIRValueRange get_type_range(HIRDataType type);
+
+  private:
+    void build();
+    void collect_registers();
+    void find_block_order();
+    bool is_branch(HIRBaseBlock& block);
+    bool update_ranges(bool is_widening);
+
+    HIRValueRange evaluate(HIRInstruction* instruction, HIRBaseBlock& block, bool is_widening);
+    HIRValueRange evaluate_phi(HIRPhiFunctionInstruction* phi, HIRBaseBlock& block,
+                               bool is_widening);
+    HIRValueRange evaluate_operation(HIROperationInstruction* operation, HIRBaseBlock& block);
+    HIRValueRange evaluate_arithmetic(HIROperationInstruction* operation,
+                                      const HIRValueRange& left, const HIRValueRange& right);
+
+    HIRValueRange refine(const HIRValueRange& range, IRRegister register_id,
+                         HIRJumpNZInstruction* jump, bool is_taken);
+    HIRValueRange apply_constraint(const HIRValueRange& range, HIROperationType operation,
+                                   const HIRValueRange& bound, HIRDataType type);
+
+    std::vector<HIRValueRange> ranges;
+    std::vector<HIRDataType> types;
+    std::vector<HIRInstruction*> definitions;
+    std::vector<HIRBaseBlock*> block_order;
+    // Blocks entered by a branch edge that dominate each block
+    std::vector<std::vector<HIRBaseBlock*>> guarded_blocks;
+    DynamicBitSet loop_headers{0};
+    bool is_built = false;
+};
+
+} // namespace bonk
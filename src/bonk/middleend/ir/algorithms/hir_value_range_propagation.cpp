@@ -0,0 +1,90 @@
+
+#include "hir_value_range_propagation.hpp"
+#include <algorithm>
+#include "hir_dominator_finder.hpp"
+#include "hir_value_range_finder.hpp"
+
+static bool is_comparison(bonk::HIROperationType operation) {
+    switch (operation) {
+    case bonk::HIROperationType::equal:
+    case bonk::HIROperationType::not_equal:
+    case bonk::HIROperationType::less:
+    case bonk::HIROperationType::less_equal:
+    case bonk::HIROperationType::greater:
+    case bonk::HIROperationType::greater_equal:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool bonk::HIRValueRangePropagation::propagate_ranges(HIRProgram& program) {
+    for (auto& procedure : program.procedures) {
+        if (!propagate_ranges(*procedure)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool bonk::HIRValueRangePropagation::propagate_ranges(HIRProcedure& procedure) {
+    if (procedure.is_external) {
+        return true;
+    }
+
+    HIRDominatorFinder dominator_finder(procedure);
+    HIRValueRangeFinder range_finder(dominator_finder);
+
+    // The ranges are only valid for the original control flow, so every
+    // decision is made before the procedure is changed
+    for (auto& block : procedure.base_blocks) {
+        for (auto instruction : block->instructions) {
+            if (instruction->type == HIRInstructionType::operation) {
+                auto operation = (HIROperationInstruction*)instruction;
+                auto& range = range_finder.get_range(operation->target);
+                if (is_comparison(operation->operation_type) && range.is_constant()) {
+                    folded_comparisons.push_back({block.get(), operation, range.min != 0});
+                }
+            }
+        }
+
+        if (block->instructions.empty() ||
+            block->instructions.back()->type != HIRInstructionType::jump_nz) {
+            continue;
+        }
+
+        auto jump = (HIRJumpNZInstruction*)block->instructions.back();
+        if (jump->nz_label == jump->z_label) {
+            continue;
+        }
+
+        auto range = range_finder.get_range_in_block(jump->condition, *block);
+        if (range.is_empty()) {
+            continue;
+        }
+        if (!range.contains(0)) {
+            folded_jumps.push_back({block.get(), true});
+        } else if (range.is_constant()) {
+            folded_jumps.push_back({block.get(), false});
+        }
+    }
+
+    for (auto& [block, instruction, value] : folded_comparisons) {
+        auto it = std::find(block->instructions.begin(), block->instructions.end(), instruction);
+        *it = block->instruction<HIRConstantLoadInstruction>(instruction->target, (long long)value,
+                                                             instruction->result_type);
+    }
+
+    for (auto& [block, is_taken] : folded_jumps) {
+        auto jump = (HIRJumpNZInstruction*)block->instructions.back();
+        int label = is_taken ? jump->nz_label : jump->z_label;
+        int skipped_label = is_taken ? jump->z_label : jump->nz_label;
+
+        block->instructions.back() = block->instruction<HIRJumpInstruction>(label);
+        procedure.remove_control_flow_edge(block, procedure.base_blocks[skipped_label].get());
+    }
+
+    folded_comparisons.clear();
+    folded_jumps.clear();
+    return true;
+}
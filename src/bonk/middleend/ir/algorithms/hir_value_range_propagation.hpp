@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+#include "bonk/middleend/ir/hir.hpp"
+
+namespace bonk {
+
+// Folds the integer comparisons whose outcome follows from the ranges found
+// by HIRValueRangeFinder, like 'i >= 0' for a counter that starts at zero and
+// only grows. A jnz whose condition is known inside its block is replaced by
+// a jump, and the edge it never takes is removed. Expects the procedures to
+// be in SSA form. Blocks left without predecessors are not deleted.
+class HIRValueRangePropagation {
+  public:
+    HIRValueRangePropagation() = default;
+
+    bool propagate_ranges(HIRProgram& program);
+    bool propagate_ranges(HIRProcedure& procedure);
+
+  private:
+    struct FoldedComparison {
+        HIRBaseBlock* block;
+        HIROperationInstruction* instruction;
+        bool value;
+    };
+
+    struct FoldedJump {
+        HIRBaseBlock* block;
+        bool is_taken;
+    };
+
+    std::vector<FoldedComparison> folded_comparisons;
+    std::vector<FoldedJump> folded_jumps;
+};
+
+} // namespace bonk
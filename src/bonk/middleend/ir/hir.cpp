@@ -1,5 +1,6 @@
 
 #include "hir.hpp"
+#include <algorithm>
 #include <ostream>
 
 bonk::HIRInstruction::HIRInstruction(bonk::HIRInstructionType type) : type(type) {
@@ -132,13 +133,29 @@ void bonk::HIRBaseBlock::remove_killed_edges() {
     }
     successors.resize(new_index);
 
+    // Phi sources line up with the predecessors, so they are erased together
+    std::vector<HIRPhiFunctionInstruction*> phis;
+    for (auto instruction : instructions) {
+        if (instruction->type != HIRInstructionType::phi_function) {
+            break;
+        }
+        phis.push_back((HIRPhiFunctionInstruction*)instruction);
+    }
+
     new_index = 0;
-    for (auto& predecessor : predecessors) {
-        if (predecessor->index != -1) {
-            predecessors[new_index++] = predecessor;
+    for (int i = 0; i < predecessors.size(); i++) {
+        if (predecessors[i]->index == -1) {
+            continue;
         }
+        for (auto phi : phis) {
+            phi->sources[new_index] = phi->sources[i];
+        }
+        predecessors[new_index++] = predecessors[i];
     }
     predecessors.resize(new_index);
+    for (auto phi : phis) {
+        phi->sources.resize(new_index);
+    }
 }
 
 bonk::HIRLabelInstruction::HIRLabelInstruction(int label_id)
@@ -256,6 +273,24 @@ bonk::HIRMemoryStoreInstruction::HIRMemoryStoreInstruction()
     : HIRInstruction(HIRInstructionType::memory_store) {
 }
 
+bonk::HIRStackAllocInstruction::HIRStackAllocInstruction()
+    : HIRInstruction(HIRInstructionType::stack_alloc) {
+}
+
+bonk::HIRStackAllocInstruction::HIRStackAllocInstruction(IRRegister target, int size)
+    : HIRInstruction(HIRInstructionType::stack_alloc), target(target), size(size) {
+}
+
+bonk::HIRSelectInstruction::HIRSelectInstruction() : HIRInstruction(HIRInstructionType::select) {
+}
+
+bonk::HIRSelectInstruction::HIRSelectInstruction(IRRegister target, IRRegister condition,
+                                                 IRRegister nz_value, IRRegister z_value,
+                                                 HIRDataType type)
+    : HIRInstruction(HIRInstructionType::select), target(target), condition(condition),
+      nz_value(nz_value), z_value(z_value), type(type) {
+}
+
 bonk::HIRIncRefCounterInstruction::HIRIncRefCounterInstruction()
     : HIRInstruction(HIRInstructionType::inc_ref_counter) {
 }
@@ -28,7 +28,9 @@ enum class HIRInstructionType {
     dec_ref_counter,
     file,
     location,
-    phi_function
+    phi_function,
+    stack_alloc,
+    select
 };
 
 enum class HIROperationType {
@@ -46,7 +48,12 @@ enum class HIROperationType {
     less,
     less_equal,
     greater,
-    greater_equal
+    greater_equal,
+    shift_left,
+    // Arithmetic shift
+    shift_right,
+    // Upper half of the signed product
+    multiply_high
 };
 
 enum class HIRDataType {
@@ -61,6 +68,7 @@ enum class HIRDataType {
 
 } // namespace bonk
 
+#include <cassert>
 #include <optional>
 #include <string>
 #include <vector>
@@ -97,6 +105,9 @@ struct HIRProcedure {
     std::vector<HIRProcedureParameter> parameters;
     HIRDataType return_type = HIRDataType::unset;
     bool is_external = false;
+    // Body of a blok defined in another module. It is only compiled to be inlined,
+    // and is never emitted by the backend.
+    bool is_imported = false;
 
     HIRProcedure(HIRProgram& program) : program(program) {
     }
@@ -286,6 +297,15 @@ struct HIRCallInstruction : HIRInstruction {
 
     int procedure_label_id = -1;
 
+    // Advisory: set for calls whose result is returned right away. Nothing
+    // guarantees that the call is compiled as a tail call. No backend reads
+    // the flag, and QBE has no tail call form, so these are regular calls.
+    bool is_tail_call = false;
+
+    // Set for calls copied by the inliner, to the procedure they were
+    // copied from. Profilers use it to attribute the call.
+    int inlined_procedure_id = -1;
+
     HIRCallInstruction();
 
     int get_write_register_count() const override {
@@ -371,8 +391,59 @@ struct HIRMemoryStoreInstruction : HIRInstruction {
     }
 };
 
+// Reserves 'size' bytes in the stack frame of the procedure. The memory is not
+// initialized and lives until the procedure returns.
+struct HIRStackAllocInstruction : HIRInstruction {
+    IRRegister target = 0;
+    int size = 0;
+
+    HIRStackAllocInstruction();
+    HIRStackAllocInstruction(IRRegister target, int size);
+
+    int get_write_register_count() const override {
+        return 1;
+    }
+    IRRegister& get_write_register(int index, HIRDataType* type) override {
+        if (type)
+            *type = HIRDataType::dword;
+        return target;
+    }
+};
+
+// Evaluates to 'nz_value' when the condition is not zero, and to 'z_value'
+// otherwise, without branching. Created by HIRIfConverter from diamonds whose
+// arms have no side effects.
+struct HIRSelectInstruction : HIRInstruction {
+    IRRegister target = 0;
+    IRRegister condition = 0;
+    IRRegister nz_value = 0;
+    IRRegister z_value = 0;
+    HIRDataType type = HIRDataType::unset;
+
+    HIRSelectInstruction();
+    HIRSelectInstruction(IRRegister target, IRRegister condition, IRRegister nz_value,
+                         IRRegister z_value, HIRDataType type);
+
+    int get_write_register_count() const override {
+        return 1;
+    }
+    IRRegister& get_write_register(int index, HIRDataType* type) override {
+        if (type)
+            *type = this->type;
+        return target;
+    }
+    int get_read_register_count() const override {
+        return 3;
+    }
+    IRRegister& get_read_register(int index) override {
+        return index == 0 ? condition : index == 1 ? nz_value : z_value;
+    }
+};
+
 struct HIRIncRefCounterInstruction : HIRInstruction {
     IRRegister address = 0;
+    // Set by HIRNullCheckEliminator when the address is known to be a hive
+    bool never_null = false;
 
     HIRIncRefCounterInstruction();
 
@@ -387,6 +458,8 @@ struct HIRIncRefCounterInstruction : HIRInstruction {
 struct HIRDecRefCounterInstruction : HIRInstruction {
     IRRegister address = 0;
     TreeNodeHiveDefinition* hive_definition = nullptr;
+    // Set by HIRNullCheckEliminator when the address is known to be a hive
+    bool never_null = false;
 
     HIRDecRefCounterInstruction();
 
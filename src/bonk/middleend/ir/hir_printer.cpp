@@ -81,6 +81,21 @@ void bonk::HIRPrinter::print(const bonk::HIRBaseBlock& block,
     stream.get_stream() << '\n';
 }
 
+void bonk::HIRPrinter::print(const bonk::HIRBaseBlock& block,
+                             const bonk::HIRStackAllocInstruction& instruction) const {
+    padding();
+    stream.get_stream() << "%" << instruction.target << " <- alloca " << instruction.size << '\n';
+}
+
+void bonk::HIRPrinter::print(const bonk::HIRBaseBlock& block,
+                             const bonk::HIRSelectInstruction& instruction) const {
+    padding();
+    stream.get_stream() << "%" << instruction.target << " <- select ";
+    print(instruction.type);
+    stream.get_stream() << " %" << instruction.condition << " ? %" << instruction.nz_value
+                        << " : %" << instruction.z_value << '\n';
+}
+
 void bonk::HIRPrinter::print(const bonk::HIRBaseBlock& block,
                              const bonk::HIRCallInstruction& instruction) const {
     padding();
@@ -89,6 +104,10 @@ void bonk::HIRPrinter::print(const bonk::HIRBaseBlock& block,
         stream.get_stream() << "%" << instruction.return_value.value() << " <- ";
     }
 
+    if (instruction.is_tail_call) {
+        stream.get_stream() << "tail ";
+    }
+
     stream.get_stream() << "call ";
 
     print_label(block, instruction.procedure_label_id);
@@ -183,6 +202,15 @@ void bonk::HIRPrinter::print(bonk::HIROperationType type) const {
     case HIROperationType::greater_equal:
         stream.get_stream() << ">=";
         break;
+    case HIROperationType::shift_left:
+        stream.get_stream() << "<<";
+        break;
+    case HIROperationType::shift_right:
+        stream.get_stream() << ">>";
+        break;
+    case HIROperationType::multiply_high:
+        stream.get_stream() << "*h";
+        break;
     }
 }
 
@@ -215,14 +243,22 @@ void bonk::HIRPrinter::print(bonk::HIRDataType type) const {
 void bonk::HIRPrinter::print(const bonk::HIRBaseBlock& block,
                              const bonk::HIRIncRefCounterInstruction& instruction) const {
     padding();
-    stream.get_stream() << "inc_ref %" << instruction.address << "\n";
+    stream.get_stream() << "inc_ref %" << instruction.address;
+    if (instruction.never_null) {
+        stream.get_stream() << " (non-null)";
+    }
+    stream.get_stream() << "\n";
 }
 
 void bonk::HIRPrinter::print(const bonk::HIRBaseBlock& block,
                              const bonk::HIRDecRefCounterInstruction& instruction) const {
     padding();
     stream.get_stream() << "dec_ref %" << instruction.address << " (hive "
-                        << instruction.hive_definition->hive_name->identifier_text << ")\n";
+                        << instruction.hive_definition->hive_name->identifier_text;
+    if (instruction.never_null) {
+        stream.get_stream() << ", non-null";
+    }
+    stream.get_stream() << ")\n";
 }
 
 void bonk::HIRPrinter::print(const bonk::HIRBaseBlock& block,
@@ -275,6 +311,12 @@ void bonk::HIRPrinter::print(const bonk::HIRBaseBlock& block,
     case HIRInstructionType::memory_store:
         print(block, static_cast<const HIRMemoryStoreInstruction&>(instruction));
         break;
+    case HIRInstructionType::stack_alloc:
+        print(block, static_cast<const HIRStackAllocInstruction&>(instruction));
+        break;
+    case HIRInstructionType::select:
+        print(block, static_cast<const HIRSelectInstruction&>(instruction));
+        break;
     case HIRInstructionType::inc_ref_counter:
         print(block, static_cast<const HIRIncRefCounterInstruction&>(instruction));
         break;
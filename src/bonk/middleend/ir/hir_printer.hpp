@@ -27,6 +27,8 @@ class HIRPrinter {
     void print(const bonk::HIRBaseBlock& block, const bonk::HIRParameterInstruction& instruction) const;
     void print(const bonk::HIRBaseBlock& block, const bonk::HIRMemoryLoadInstruction& instruction) const;
     void print(const bonk::HIRBaseBlock& block, const bonk::HIRMemoryStoreInstruction& instruction) const;
+    void print(const bonk::HIRBaseBlock& block, const bonk::HIRStackAllocInstruction& instruction) const;
+    void print(const bonk::HIRBaseBlock& block, const bonk::HIRSelectInstruction& instruction) const;
     void print(const bonk::HIRBaseBlock& block, const bonk::HIRIncRefCounterInstruction& instruction) const;
     void print(const bonk::HIRBaseBlock& block, const bonk::HIRDecRefCounterInstruction& instruction) const;
     void print(const bonk::HIRBaseBlock& block, const bonk::HIRFileInstruction& instruction) const;
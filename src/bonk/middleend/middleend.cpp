@@ -2,15 +2,26 @@
 #include "middleend.hpp"
 #include "bonk/middleend/ir/algorithms/hir_base_block_separator.hpp"
 #include "bonk/middleend/ir/algorithms/hir_block_sorter.hpp"
+#include "bonk/middleend/ir/algorithms/hir_constant_propagation.hpp"
 #include "bonk/middleend/ir/algorithms/hir_copy_propagation.hpp"
+#include "bonk/middleend/ir/algorithms/hir_if_converter.hpp"
+#include "bonk/middleend/ir/algorithms/hir_inliner.hpp"
+#include "bonk/middleend/ir/algorithms/hir_instruction_combiner.hpp"
 #include "bonk/middleend/ir/algorithms/hir_jmp_reducer.hpp"
 #include "bonk/middleend/ir/algorithms/hir_jnz_optimizer.hpp"
+#include "bonk/middleend/ir/algorithms/hir_jump_threader.hpp"
 #include "bonk/middleend/ir/algorithms/hir_loc_collapser.hpp"
-#include "bonk/middleend/ir/algorithms/hir_ref_count_replacer.hpp"
+#include "bonk/middleend/ir/algorithms/hir_loop_invariant_code_motion.hpp"
+#include "bonk/middleend/ir/algorithms/hir_null_check_eliminator.hpp"
+#include "bonk/middleend/ir/algorithms/hir_ref_count_elider.hpp"
 #include "bonk/middleend/ir/algorithms/hir_ref_counter_reducer.hpp"
 #include "bonk/middleend/ir/algorithms/hir_ssa_converter.hpp"
+#include "bonk/middleend/ir/algorithms/hir_stack_promoter.hpp"
+#include "bonk/middleend/ir/algorithms/hir_tail_call_eliminator.hpp"
 #include "bonk/middleend/ir/algorithms/hir_unreachable_code_deleter.hpp"
 #include "bonk/middleend/ir/algorithms/hir_unused_def_deleter.hpp"
+#include "bonk/middleend/ir/algorithms/hir_value_numbering.hpp"
+#include "bonk/middleend/ir/algorithms/hir_value_range_propagation.hpp"
 #include "bonk/middleend/ir/algorithms/hir_variable_index_compressor.hpp"
 
 bool bonk::MiddleEnd::do_passes(HIRProgram& program) {
@@ -19,16 +30,28 @@ bool bonk::MiddleEnd::do_passes(HIRProgram& program) {
     bonk::HIRBaseBlockSeparator().separate_blocks(program);
     bonk::HIRLocCollapser().collapse(program);
     bonk::HIRSSAConverter().convert(program);
+    bonk::HIRInliner().inline_calls(program);
 
     bonk::HIRCopyPropagation().propagate_copies(program);
+    bonk::HIRConstantPropagation().propagate_constants(program);
+    bonk::HIRInstructionCombiner().combine(program);
+    bonk::HIRValueNumbering().eliminate_redundancy(program);
+    bonk::HIRLoopInvariantCodeMotion().hoist_invariants(program);
     bonk::HIRUnusedDefDeleter().delete_unused_defs(program);
     bonk::HIRRefCountReducer().reduce(program);
+    bonk::HIRRefCountElider().elide(program);
+    bonk::HIRStackPromoter().promote(program);
+    bonk::HIRTailCallEliminator().eliminate_tail_calls(program);
+    bonk::HIRNullCheckEliminator().eliminate_null_checks(program);
+    bonk::HIRJumpThreader().thread_jumps(program);
+    bonk::HIRValueRangePropagation().propagate_ranges(program);
 
-    bonk::HIRRefCountReplacer().replace_ref_counters(program);
-
+    // Reference counter operations are kept as single instructions, the
+    // backend lowers them
     bonk::HIRJnzOptimizer().optimize(program);
     bonk::HIRUnreachableCodeDeleter().delete_unreachable_code(program);
     bonk::HIRJmpReducer().reduce(program);
+    bonk::HIRIfConverter().convert(program);
     bonk::HIRUnusedDefDeleter().delete_unused_defs(program);
     bonk::HIRVariableIndexCompressor().compress(program);
     bonk::HIRLocCollapser().collapse(program);
@@ -0,0 +1,230 @@
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "argparse/argparse.hpp"
+
+// Reads the heap profiles written by bonk_heap_profiler.c in the runtime
+
+struct HeapProfileSite {
+    uint32_t line = 0;
+    uint32_t column = 0;
+    std::string hive_name;
+    std::string file;
+};
+
+struct HeapProfileSample {
+    uint32_t site_index = 0;
+    uint32_t size = 0;
+    uint64_t allocated_at = 0;
+    uint64_t freed_at = 0;
+
+    bool is_alive() const {
+        return freed_at == UINT64_MAX;
+    }
+};
+
+struct HeapProfile {
+    uint64_t sample_interval = 0;
+    uint64_t allocation_count = 0;
+    uint64_t allocated_bytes = 0;
+    std::vector<HeapProfileSite> sites;
+    std::vector<HeapProfileSample> samples;
+};
+
+struct ProfileReader {
+    std::ifstream& stream;
+
+    template <typename T> T read() {
+        T value{};
+        stream.read((char*)&value, sizeof(value));
+        return value;
+    }
+
+    std::string read_string() {
+        auto length = read<uint32_t>();
+        std::string result(length, '\0');
+        stream.read(result.data(), length);
+        return result;
+    }
+};
+
+bool read_heap_profile(const std::string& path, HeapProfile& profile) {
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream.is_open()) {
+        std::cerr << "failed to open " << path << std::endl;
+        return false;
+    }
+
+    ProfileReader reader{stream};
+
+    char magic[8] = {};
+    stream.read(magic, sizeof(magic));
+    if (!stream || memcmp(magic, "BONKHEAP", sizeof(magic)) != 0) {
+        std::cerr << path << " is not a bonk heap profile" << std::endl;
+        return false;
+    }
+
+    auto version = reader.read<uint32_t>();
+    if (version != 1) {
+        std::cerr << "unsupported heap profile version " << version << std::endl;
+        return false;
+    }
+
+    auto site_count = reader.read<uint32_t>();
+    auto sample_count = reader.read<uint64_t>();
+    profile.sample_interval = reader.read<uint64_t>();
+    profile.allocation_count = reader.read<uint64_t>();
+    profile.allocated_bytes = reader.read<uint64_t>();
+
+    for (uint32_t i = 0; i < site_count && stream; i++) {
+        HeapProfileSite site;
+        site.line = reader.read<uint32_t>();
+        site.column = reader.read<uint32_t>();
+        site.hive_name = reader.read_string();
+        site.file = reader.read_string();
+        profile.sites.push_back(std::move(site));
+    }
+
+    for (uint64_t i = 0; i < sample_count && stream; i++) {
+        HeapProfileSample sample;
+        sample.site_index = reader.read<uint32_t>();
+        sample.size = reader.read<uint32_t>();
+        sample.allocated_at = reader.read<uint64_t>();
+        sample.freed_at = reader.read<uint64_t>();
+        profile.samples.push_back(sample);
+    }
+
+    if (!stream) {
+        std::cerr << path << " is truncated" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// Every sample stands for the bytes allocated since the previous one
+struct AllocationStatistics {
+    uint64_t samples = 0;
+    double estimated_bytes = 0;
+    double estimated_count = 0;
+    uint64_t alive_at_exit = 0;
+    uint64_t freed = 0;
+    uint64_t total_lifetime = 0;
+
+    void add(const HeapProfileSample& sample, uint64_t sample_interval) {
+        double allocation_size = sample.size + sizeof(uint64_t);
+        double weight = std::max((double)sample_interval, allocation_size);
+
+        samples++;
+        estimated_bytes += weight;
+        estimated_count += weight / allocation_size;
+
+        if (sample.is_alive()) {
+            alive_at_exit++;
+        } else {
+            freed++;
+            total_lifetime += sample.freed_at - sample.allocated_at;
+        }
+    }
+};
+
+void print_table(const std::string& key_title,
+                 const std::vector<std::pair<std::string, AllocationStatistics>>& rows) {
+    size_t key_width = key_title.size();
+    for (auto& row : rows) {
+        key_width = std::max(key_width, row.first.size());
+    }
+
+    std::cout << std::left << std::setw(key_width) << key_title << std::right << std::setw(10)
+              << "samples" << std::setw(14) << "est. bytes" << std::setw(14) << "est. count"
+              << std::setw(10) << "alive" << std::setw(16) << "avg lifetime" << "\n";
+
+    for (auto& [key, statistics] : rows) {
+        std::cout << std::left << std::setw(key_width) << key << std::right << std::setw(10)
+                  << statistics.samples << std::setw(14) << (uint64_t)statistics.estimated_bytes
+                  << std::setw(14) << (uint64_t)statistics.estimated_count << std::setw(10)
+                  << statistics.alive_at_exit << std::setw(16);
+        if (statistics.freed > 0) {
+            std::cout << statistics.total_lifetime / statistics.freed;
+        } else {
+            std::cout << "-";
+        }
+        std::cout << "\n";
+    }
+}
+
+std::vector<std::pair<std::string, AllocationStatistics>>
+sort_by_bytes(const std::map<std::string, AllocationStatistics>& statistics) {
+    std::vector<std::pair<std::string, AllocationStatistics>> rows(statistics.begin(),
+                                                                   statistics.end());
+    std::stable_sort(rows.begin(), rows.end(), [](auto& a, auto& b) {
+        return a.second.estimated_bytes > b.second.estimated_bytes;
+    });
+    return rows;
+}
+
+int main(int argc, const char* argv[]) {
+
+    argparse::ArgumentParser program("bonk-heap-viewer");
+    program.add_argument("input").help("path to the heap profile written by a bonk program");
+    program.add_argument("-h", "--help")
+        .default_value(false)
+        .implicit_value(true)
+        .help("show this help message and exit");
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error& err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        return EXIT_FAILURE;
+    }
+
+    auto input_path = program.get<std::string>("input");
+
+    if (program.get<bool>("--help") || input_path.empty()) {
+        std::cout << program;
+        return EXIT_SUCCESS;
+    }
+
+    HeapProfile profile;
+    if (!read_heap_profile(input_path, profile)) {
+        return EXIT_FAILURE;
+    }
+
+    std::map<std::string, AllocationStatistics> hives;
+    std::map<std::string, AllocationStatistics> sites;
+
+    for (auto& sample : profile.samples) {
+        std::string hive_name = "<unknown>";
+        std::string site_name = "<unknown>";
+
+        if (sample.site_index > 0 && sample.site_index <= profile.sites.size()) {
+            auto& site = profile.sites[sample.site_index - 1];
+            hive_name = site.hive_name;
+            site_name = site.file + ":" + std::to_string(site.line) + ":" +
+                        std::to_string(site.column) + " " + site.hive_name;
+        }
+
+        hives[hive_name].add(sample, profile.sample_interval);
+        sites[site_name].add(sample, profile.sample_interval);
+    }
+
+    std::cout << profile.allocation_count << " allocations, " << profile.allocated_bytes
+              << " bytes, " << profile.samples.size() << " samples taken every "
+              << profile.sample_interval << " bytes\n";
+    std::cout << "Lifetimes are measured in bytes allocated while the hive was alive\n\n";
+
+    print_table("hive", sort_by_bytes(hives));
+    std::cout << "\n";
+    print_table("site", sort_by_bytes(sites));
+
+    return EXIT_SUCCESS;
+}
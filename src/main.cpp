@@ -1,13 +1,18 @@
 
 #include <fstream>
+#include <thread>
 #include "argparse/argparse.hpp"
 #include "bonk/backend/qbe/qbe_backend.hpp"
 //#include "bonk/backend/x86/x86_backend.hpp"
+#include "bonk/compiler/build_report.hpp"
+#include "bonk/compiler/compilation_cache.hpp"
 #include "bonk/compiler/compiler.hpp"
+#include "bonk/driver/build_driver.hpp"
 #include "bonk/frontend/ast/ast_printer.hpp"
 #include "bonk/frontend/ast/json_ast_serializer.hpp"
 #include "bonk/frontend/frontend.hpp"
 #include "bonk/frontend/help_resolver/help_resolver.hpp"
+#include "bonk/frontend/metadata/metadata_archive.hpp"
 #include "utils/json_serializer.hpp"
 
 struct InitErrorReporter {
@@ -44,12 +49,127 @@ bool dump_ast(bonk::TreeNode* ast, std::string_view mode, bonk::OutputStream& ou
     return true;
 }
 
+std::optional<std::string> read_file(const std::filesystem::path& path) {
+    std::ifstream file{path, std::ios::binary};
+    if (!file.is_open()) {
+        return std::nullopt;
+    }
+    return std::string{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+int pack_main(int argc, const char* argv[]) {
+
+    InitErrorReporter error_reporter;
+
+    argparse::ArgumentParser program("bonk pack");
+    program.add_argument("sources").help("library modules to pack").remaining();
+    program.add_argument("-o", "--output").required().help("path to the output archive");
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error& err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        return EXIT_FAILURE;
+    }
+
+    auto archive_path = std::filesystem::absolute(program.get<std::string>("--output"));
+    // Module paths are stored relative to the archive directory, which is
+    // also where bonk looks for them when the archive is passed with -L
+    auto root = archive_path.parent_path();
+
+    std::vector<std::string> sources;
+    try {
+        sources = program.get<std::vector<std::string>>("sources");
+    } catch (const std::logic_error&) {
+        error_reporter.fatal_error() << "no modules to pack";
+        return EXIT_FAILURE;
+    }
+
+    std::unique_ptr<bonk::OutputStream> error_file =
+        std::make_unique<bonk::StdOutputStream>(std::cerr);
+
+    bonk::CompilerConfig config = {
+        .error_file = *error_file
+    };
+
+    bonk::Compiler compiler(config);
+    bonk::qbe_backend::QBEBackend backend(compiler);
+    compiler.backend = &backend;
+
+    bonk::MetadataArchiveWriter writer{root};
+
+    for (auto& source : sources) {
+        auto source_path = std::filesystem::absolute(source).lexically_normal();
+
+        if (!bonk::HelpResolver{compiler}.compile_file(source_path)) {
+            return EXIT_FAILURE;
+        }
+
+        auto meta_contents = read_file(bonk::SourceMetadata::get_meta_path(source_path));
+        if (!meta_contents) {
+            error_reporter.fatal_error() << "failed to read metafile for " << source.c_str();
+            return EXIT_FAILURE;
+        }
+
+        if (!writer.add(source_path, std::move(*meta_contents))) {
+            error_reporter.fatal_error()
+                << source.c_str() << " is outside of the archive root " << root.c_str();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!writer.write(archive_path)) {
+        error_reporter.fatal_error() << "failed to write " << archive_path.c_str();
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+std::filesystem::path get_default_stdlib_path() {
+    std::error_code error;
+    auto executable_path = std::filesystem::canonical("/proc/self/exe", error);
+    if (error) {
+        return {};
+    }
+    return executable_path.parent_path() / "bonk_stdlib" / "libbonk-stdlib.a";
+}
+
 int main(int argc, const char* argv[]) {
 
+    if (argc > 1 && std::string_view(argv[1]) == "pack") {
+        return pack_main(argc - 1, argv + 1);
+    }
+
+    // bonk build accepts the same options as bonk, and then
+    // goes on to produce an executable from the compiled modules
+    bool build_mode = argc > 1 && std::string_view(argv[1]) == "build";
+    if (build_mode) {
+        argc--;
+        argv++;
+    }
+
     InitErrorReporter error_reporter;
 
-    argparse::ArgumentParser program("bonk");
+    argparse::ArgumentParser program(build_mode ? "bonk build" : "bonk");
     program.add_argument("input").help("path to the input file");
+    if (build_mode) {
+        program.add_argument("-l", "--link")
+            .default_value(std::vector<std::string>{})
+            .append()
+            .help("additional C source, object or library to link");
+        program.add_argument("-o", "--output").nargs(1).help("path to the executable");
+        program.add_argument("-j", "--jobs")
+            .default_value((int)std::max(1u, std::thread::hardware_concurrency()))
+            .scan<'i', int>()
+            .help("maximum number of tools running at once");
+        program.add_argument("--qbe").default_value(std::string("qbe")).help("qbe executable");
+        program.add_argument("--cc")
+            .default_value(std::string("cc"))
+            .help("C compiler used to assemble and link");
+        program.add_argument("--stdlib").nargs(1).help("path to libbonk-stdlib.a");
+    }
     program.add_argument("-h", "--help")
         .default_value(false)
         .implicit_value(true)
@@ -62,6 +182,29 @@ int main(int argc, const char* argv[]) {
             .default_value(false)
             .implicit_value(true)
             .help("generate debug symbols");
+    program.add_argument("--iterative-teardown")
+        .default_value(false)
+        .implicit_value(true)
+        .help("destroy chains of hives without recursion");
+    program.add_argument("--heap-profile")
+        .default_value(false)
+        .implicit_value(true)
+        .help("sample allocations and write a heap profile at exit (see bonk-heap-viewer)");
+    program.add_argument("--instrument-refcounts")
+        .default_value(false)
+        .implicit_value(true)
+        .help("count reference counter updates per source location and print them at exit");
+    program.add_argument("-L", "--library")
+        .default_value(std::vector<std::string>{})
+        .append()
+        .help("metadata archive of a prebuilt library (see bonk pack)");
+    program.add_argument("--explain")
+        .default_value(false)
+        .implicit_value(true)
+        .help("explain why each module was rebuilt and where the time went");
+    program.add_argument("--explain-json")
+        .nargs(1)
+        .help("write a machine-readable build report to the given file");
 
     try {
         program.parse_args(argc, argv);
@@ -97,6 +240,15 @@ int main(int argc, const char* argv[]) {
         if(program.get<bool>("--debug")) {
             qbe_backend->generate_debug_symbols = true;
         }
+        if(program.get<bool>("--iterative-teardown")) {
+            qbe_backend->iterative_teardown = true;
+        }
+        if(program.get<bool>("--heap-profile")) {
+            qbe_backend->heap_profiling = true;
+        }
+        if(program.get<bool>("--instrument-refcounts")) {
+            qbe_backend->instrument_refcounts = true;
+        }
         backend = std::move(qbe_backend);
     } else {
         error_reporter.fatal_error() << "unknown compile target: '" << target_flag.c_str() << "'";
@@ -105,9 +257,47 @@ int main(int argc, const char* argv[]) {
 
     compiler.backend = backend.get();
 
+    bool debug_flag = program.get<bool>("--debug");
+    std::string cache_options = target_flag + backend->get_output_options();
+    // Heap profiles and reference counter sites name their source file
+    bool heap_profile_flag = program.get<bool>("--heap-profile");
+    bool instrument_refcounts_flag = program.get<bool>("--instrument-refcounts");
+    compiler.compilation_cache = bonk::CompilationCache::from_environment(cache_options);
+    if (compiler.compilation_cache) {
+        compiler.compilation_cache->path_dependent_outputs =
+            debug_flag || heap_profile_flag || instrument_refcounts_flag;
+    }
+
+    for (auto& library_path : program.get<std::vector<std::string>>("--library")) {
+        auto archive_path = std::filesystem::absolute(library_path);
+        auto archive = bonk::MetadataArchive::open(archive_path, archive_path.parent_path());
+        if (!archive) {
+            error_reporter.fatal_error() << "invalid metadata archive: '" << library_path.c_str() << "'";
+            return 1;
+        }
+        compiler.metadata_archives.push_back(std::move(archive));
+    }
+
+    bool explain_flag = program.get<bool>("--explain");
+    auto explain_json_path = program.present("--explain-json");
+
+    if (explain_flag || explain_json_path) {
+        compiler.build_report = std::make_unique<bonk::BuildReport>();
+    }
+
     bonk::HelpResolver help_resolver{compiler};
 
-    if(!help_resolver.compile_file(input_file_path)) {
+    bool compiled = help_resolver.compile_file(input_file_path);
+
+    if (explain_flag) {
+        compiler.build_report->print_explanation(bonk::StdOutputStream{std::cout});
+    }
+
+    if (explain_json_path) {
+        compiler.build_report->write_json(bonk::FileOutputStream{*explain_json_path});
+    }
+
+    if (!compiled) {
         return 1;
     }
 
@@ -122,5 +312,38 @@ int main(int argc, const char* argv[]) {
         project_meta_file.get_stream() << file << "\n";
     }
 
+    if (!build_mode) {
+        return EXIT_SUCCESS;
+    }
+
+    bonk::BuildDriverConfig build_config;
+    build_config.stamp_directory = bs_cache_path;
+    build_config.qbe = program.get<std::string>("--qbe");
+    build_config.cc = program.get<std::string>("--cc");
+    build_config.jobs = (size_t)std::max(1, program.get<int>("--jobs"));
+    build_config.debug = debug_flag;
+    build_config.link_inputs = program.get<std::vector<std::string>>("--link");
+    build_config.output_path = input_file_path.parent_path() / "build" / input_file_path.stem();
+
+    if (auto output_path = program.present("--output")) {
+        build_config.output_path = *output_path;
+    }
+
+    std::filesystem::path stdlib_path = get_default_stdlib_path();
+    if (auto stdlib_flag = program.present("--stdlib")) {
+        stdlib_path = *stdlib_flag;
+    }
+
+    if (!std::filesystem::exists(stdlib_path)) {
+        error_reporter.fatal_error() << "cannot find bonk stdlib, specify it with --stdlib";
+        return 1;
+    }
+
+    build_config.link_inputs.push_back(stdlib_path.string());
+
+    if (!bonk::BuildDriver(compiler, std::move(build_config)).build()) {
+        return 1;
+    }
+
     return EXIT_SUCCESS;
 }
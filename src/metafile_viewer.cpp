@@ -5,9 +5,9 @@
 // #include "bonk/backend/x86/x86_backend.hpp"
 #include "bonk/compiler/compiler.hpp"
 #include "bonk/frontend/frontend.hpp"
-#include "bonk/help-resolver/help_resolver.hpp"
-#include "bonk/tree/ast_printer.hpp"
-#include "bonk/tree/json_ast_serializer.hpp"
+#include "bonk/frontend/ast/ast_printer.hpp"
+#include "bonk/frontend/ast/json_ast_serializer.hpp"
+#include "bonk/frontend/help_resolver/help_resolver.hpp"
 
 struct InitErrorReporter {
 
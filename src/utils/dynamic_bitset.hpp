@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <cassert>
 #include <cstdint>
 #include <iostream>
 #include <stdexcept>
@@ -204,6 +205,27 @@ class DynamicBitSet {
         return (bit_size + bits_per_chunk - 1) / bits_per_chunk;
     }
 
+    [[nodiscard]] size_t count() const {
+        size_t result = 0;
+        for (size_t i = 0; i < num_chunks(); i++) {
+            uint64_t chunk = data()[i];
+            // Bits past the end may be set by negate() or set()
+            if (i == num_chunks() - 1 && bit_size % bits_per_chunk != 0) {
+                chunk &= (1ULL << (bit_size % bits_per_chunk)) - 1;
+            }
+            result += __builtin_popcountll(chunk);
+        }
+        return result;
+    }
+
+    void resize(size_t size) {
+        DynamicBitSet result(size);
+        for (size_t i = 0; i < size && i < bit_size; i++) {
+            result[i] = (bool)(*this)[i];
+        }
+        *this = std::move(result);
+    }
+
     bool any() {
         for (auto i = (ssize_t)num_chunks() - 1; i >= 0; --i) {
             if (data()[i] != 0) {
@@ -0,0 +1,129 @@
+
+#include "hash.hpp"
+
+bonk::FNVHasher& bonk::FNVHasher::update(std::string_view data) {
+    for (unsigned char c : data) {
+        state ^= c;
+        state *= prime;
+    }
+    return *this;
+}
+
+std::string bonk::FNVHasher::to_hex(uint64_t value) {
+    static const char digits[] = "0123456789abcdef";
+    std::string result(16, '0');
+    for (int i = 15; i >= 0; i--) {
+        result[i] = digits[value & 0xf];
+        value >>= 4;
+    }
+    return result;
+}
+
+static const uint32_t sha256_round_constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4,
+    0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe,
+    0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f,
+    0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
+    0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116,
+    0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7,
+    0xc67178f2,
+};
+
+static uint32_t rotate_right(uint32_t value, int bits) {
+    return (value >> bits) | (value << (32 - bits));
+}
+
+void bonk::SHA256Hasher::process_block(const uint8_t* block) {
+    uint32_t schedule[64];
+    for (int i = 0; i < 16; i++) {
+        schedule[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 |
+                      (uint32_t)block[i * 4 + 2] << 8 | (uint32_t)block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotate_right(schedule[i - 15], 7) ^ rotate_right(schedule[i - 15], 18) ^
+                      (schedule[i - 15] >> 3);
+        uint32_t s1 = rotate_right(schedule[i - 2], 17) ^ rotate_right(schedule[i - 2], 19) ^
+                      (schedule[i - 2] >> 10);
+        schedule[i] = schedule[i - 16] + s0 + schedule[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int i = 0; i < 64; i++) {
+        uint32_t s1 = rotate_right(e, 6) ^ rotate_right(e, 11) ^ rotate_right(e, 25);
+        uint32_t choice = (e & f) ^ (~e & g);
+        uint32_t temp1 = h + s1 + choice + sha256_round_constants[i] + schedule[i];
+        uint32_t s0 = rotate_right(a, 2) ^ rotate_right(a, 13) ^ rotate_right(a, 22);
+        uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t temp2 = s0 + majority;
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + temp1;
+        d = c;
+        c = b;
+        b = a;
+        a = temp1 + temp2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+bonk::SHA256Hasher& bonk::SHA256Hasher::update(std::string_view data) {
+    for (unsigned char c : data) {
+        buffer[length % 64] = c;
+        length++;
+        if (length % 64 == 0) {
+            process_block(buffer);
+        }
+    }
+    return *this;
+}
+
+bonk::SHA256Hasher::Digest bonk::SHA256Hasher::digest() const {
+    SHA256Hasher final_hasher = *this;
+
+    // Padding: a single one bit, zeroes, then the message length in bits
+    uint64_t bit_length = length * 8;
+    final_hasher.update(std::string_view("\x80", 1));
+    while (final_hasher.length % 64 != 56) {
+        final_hasher.update(std::string_view("\0", 1));
+    }
+
+    char length_bytes[8];
+    for (int i = 0; i < 8; i++) {
+        length_bytes[i] = (char)(bit_length >> (56 - i * 8));
+    }
+    final_hasher.update(std::string_view(length_bytes, 8));
+
+    Digest result{};
+    for (int i = 0; i < 8; i++) {
+        result[i * 4] = final_hasher.state[i] >> 24;
+        result[i * 4 + 1] = final_hasher.state[i] >> 16;
+        result[i * 4 + 2] = final_hasher.state[i] >> 8;
+        result[i * 4 + 3] = final_hasher.state[i];
+    }
+    return result;
+}
+
+std::string bonk::SHA256Hasher::to_hex(const Digest& digest) {
+    static const char digits[] = "0123456789abcdef";
+    std::string result;
+    for (uint8_t byte : digest) {
+        result += digits[byte >> 4];
+        result += digits[byte & 0xf];
+    }
+    return result;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace bonk {
+
+// 64-bit FNV-1a. Not cryptographic, but stable across runs and platforms,
+// which is all that is needed for on-disk indices and cache keys.
+class FNVHasher {
+  public:
+    static constexpr uint64_t offset_basis = 0xcbf29ce484222325ull;
+    static constexpr uint64_t prime = 0x100000001b3ull;
+
+    FNVHasher& update(std::string_view data);
+
+    template <typename T> FNVHasher& update_value(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        return update(std::string_view((const char*)&value, sizeof(T)));
+    }
+
+    uint64_t digest() const {
+        return state;
+    }
+
+    static uint64_t hash(std::string_view data) {
+        return FNVHasher().update(data).digest();
+    }
+
+    static std::string to_hex(uint64_t value);
+
+  private:
+    uint64_t state = offset_basis;
+};
+
+// SHA-256, for keys of caches shared between builds and checkouts, where a
+// collision would silently reuse the output of another module
+class SHA256Hasher {
+  public:
+    using Digest = std::array<uint8_t, 32>;
+
+    SHA256Hasher& update(std::string_view data);
+
+    template <typename T> SHA256Hasher& update_value(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        return update(std::string_view((const char*)&value, sizeof(T)));
+    }
+
+    // Does not change the state, so more data can still be added
+    Digest digest() const;
+
+    static std::string to_hex(const Digest& digest);
+
+  private:
+    void process_block(const uint8_t* block);
+
+    uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                         0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    uint8_t buffer[64]{};
+    uint64_t length = 0;
+};
+
+} // namespace bonk
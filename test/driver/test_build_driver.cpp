@@ -0,0 +1,182 @@
+
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <sys/stat.h>
+#include "../qbe_backend/utils.hpp"
+#include "bonk/driver/build_driver.hpp"
+
+// The driver only needs tools that accept the qbe and cc command lines, so
+// the tests use shell scripts that log their invocations and copy the files
+
+static void write_file(const std::filesystem::path& path, const std::string& contents) {
+    std::ofstream file{path, std::ios::trunc};
+    file << contents;
+}
+
+static std::string read_file(const std::filesystem::path& path) {
+    std::ifstream file{path};
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+static std::vector<std::string> read_lines(const std::filesystem::path& path) {
+    std::ifstream file{path};
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(file, line)) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+static std::filesystem::path write_script(const std::filesystem::path& path,
+                                          const std::string& contents) {
+    write_file(path, "#!/bin/sh" + contents);
+    chmod(path.c_str(), 0755);
+    return std::filesystem::absolute(path);
+}
+
+struct FakeToolchain {
+    std::filesystem::path directory;
+    std::filesystem::path log;
+    bonk::BuildDriverConfig config;
+
+    FakeToolchain() {
+        directory = "toolchain";
+        ensure_path(directory);
+        std::filesystem::remove_all(directory);
+        std::filesystem::create_directories(directory);
+        directory = std::filesystem::absolute(directory);
+        log = directory / "log";
+
+        // Modules that contain 'fail' do not compile
+        auto qbe = write_script(directory / "qbe", R"(
+echo "qbe $3" >> "$(dirname "$0")/log"
+grep -q fail "$3" && exit 1
+cp "$3" "$2"
+)");
+
+        // Linking concatenates the objects, so the program shows their order
+        auto cc = write_script(directory / "cc", R"(
+if [ "$1" = -c ]; then
+    echo "cc $4" >> "$(dirname "$0")/log"
+    cp "$4" "$3"
+    exit 0
+fi
+echo link >> "$(dirname "$0")/log"
+: > "$0.out"
+while [ $# -gt 0 ]; do
+    if [ "$1" = -o ]; then
+        output="$2"
+        shift
+    else
+        cat "$1" >> "$0.out"
+    fi
+    shift
+done
+mv "$0.out" "$output"
+)");
+
+        config.qbe = qbe.string();
+        config.cc = cc.string();
+        config.output_path = directory / "program";
+        config.stamp_directory = directory / "stamps";
+    }
+
+    std::filesystem::path add_module(bonk::Compiler& compiler, const std::string& name,
+                                     const std::string& contents) {
+        auto path = directory / (name + ".qbe");
+        write_file(path, contents);
+        compiler.output_files.insert(path.string());
+        return path;
+    }
+
+    // Index of the first log line that starts with the step, or -1
+    static int find_step(const std::vector<std::string>& lines, const std::string& step) {
+        for (size_t i = 0; i < lines.size(); i++) {
+            if (lines[i].compare(0, step.size(), step) == 0) {
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+};
+
+TEST(BuildDriver, ParallelBuildTest) {
+    auto error_stream = bonk::StdOutputStream(std::cerr);
+
+    bonk::CompilerConfig compiler_config{.error_file = error_stream};
+    bonk::Compiler compiler(compiler_config);
+
+    FakeToolchain toolchain;
+    toolchain.config.jobs = 3;
+
+    std::vector<std::string> modules{"a", "b", "c", "d", "e"};
+    for (auto& module : modules) {
+        toolchain.add_module(compiler, module, module + "\n");
+    }
+
+    ASSERT_TRUE(bonk::BuildDriver(compiler, toolchain.config).build());
+
+    // Every module goes through qbe before the assembler, and the link waits for all of them
+    auto lines = read_lines(toolchain.log);
+    ASSERT_EQ(lines.size(), modules.size() * 2 + 1);
+    EXPECT_EQ(lines.back(), "link");
+
+    for (auto& module : modules) {
+        auto path = (toolchain.directory / module).string();
+        auto qbe_step = toolchain.find_step(lines, "qbe " + path);
+        auto cc_step = toolchain.find_step(lines, "cc " + path);
+        EXPECT_NE(qbe_step, -1) << module;
+        EXPECT_LT(qbe_step, cc_step) << module;
+    }
+
+    // The objects are linked in a stable order, whichever module finished first
+    EXPECT_EQ(read_file(toolchain.config.output_path), "a\nb\nc\nd\ne\n");
+
+    // Nothing changed, so nothing is rebuilt
+    ASSERT_TRUE(bonk::BuildDriver(compiler, toolchain.config).build());
+    EXPECT_EQ(read_lines(toolchain.log).size(), lines.size());
+
+    // Only the changed module is rebuilt, and the program is linked again
+    toolchain.add_module(compiler, "c", "changed\n");
+    ASSERT_TRUE(bonk::BuildDriver(compiler, toolchain.config).build());
+
+    auto rebuild_lines = read_lines(toolchain.log);
+    rebuild_lines.erase(rebuild_lines.begin(), rebuild_lines.begin() + lines.size());
+    ASSERT_EQ(rebuild_lines.size(), 3);
+    EXPECT_EQ(rebuild_lines[0], "qbe " + (toolchain.directory / "c.qbe").string());
+    EXPECT_EQ(rebuild_lines[2], "link");
+    EXPECT_EQ(read_file(toolchain.config.output_path), "a\nb\nchanged\nd\ne\n");
+}
+
+TEST(BuildDriver, FailurePropagationTest) {
+    auto error_stream = bonk::StdOutputStream(std::cerr);
+
+    bonk::CompilerConfig compiler_config{.error_file = error_stream};
+    bonk::Compiler compiler(compiler_config);
+
+    FakeToolchain toolchain;
+    toolchain.config.jobs = 2;
+
+    toolchain.add_module(compiler, "a", "a\n");
+    auto failing = toolchain.add_module(compiler, "b", "fail\n");
+    toolchain.add_module(compiler, "c", "c\n");
+
+    EXPECT_FALSE(bonk::BuildDriver(compiler, toolchain.config).build());
+
+    // The failed module is not assembled or stamped, and nothing is linked
+    auto lines = read_lines(toolchain.log);
+    EXPECT_NE(toolchain.find_step(lines, "qbe " + failing.string()), -1);
+    EXPECT_EQ(toolchain.find_step(lines, "cc " + (toolchain.directory / "b").string()), -1);
+    EXPECT_EQ(toolchain.find_step(lines, "link"), -1);
+    EXPECT_FALSE(std::filesystem::exists(toolchain.config.output_path));
+    EXPECT_FALSE(std::filesystem::exists(toolchain.directory / "b.o.hash"));
+
+    // Once the module is fixed, the build goes through
+    toolchain.add_module(compiler, "b", "b\n");
+    ASSERT_TRUE(bonk::BuildDriver(compiler, toolchain.config).build());
+    EXPECT_EQ(read_file(toolchain.config.output_path), "a\nb\nc\n");
+}
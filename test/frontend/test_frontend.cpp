@@ -1,15 +1,24 @@
 
+#include <cstring>
+#include <fstream>
 #include <sstream>
 #include <gtest/gtest.h>
+#include "bonk/backend/procedure_output_cache.hpp"
+#include "bonk/backend/qbe/qbe_backend.hpp"
+#include "bonk/compiler/build_report.hpp"
+#include "bonk/compiler/compilation_cache.hpp"
 #include "bonk/frontend/ast/ast_printer.hpp"
 #include "bonk/frontend/converters/hir_early_generator_visitor.hpp"
 #include "bonk/frontend/converters/stdlib_header_generator.hpp"
 #include "bonk/frontend/frontend.hpp"
+#include "bonk/frontend/help_resolver/help_resolver.hpp"
+#include "bonk/frontend/metadata/metadata_archive.hpp"
 #include "bonk/frontend/parsing/parser.hpp"
 #include "bonk/middleend/ir/algorithms/hir_base_block_separator.hpp"
 #include "bonk/middleend/ir/algorithms/hir_ref_count_replacer.hpp"
 #include "bonk/middleend/ir/algorithms/hir_variable_index_compressor.hpp"
 #include "bonk/middleend/ir/hir.hpp"
+#include "utils/hash.hpp"
 
 TEST(FrontEnd, TypecheckerTest1) {
     std::stringstream error_stringstream;
@@ -355,6 +364,11 @@ TEST(FrontEnd, StdLibHeaderGenerator) {
 
     EXPECT_NE(ast_string.find("blok $$bonk_create_object[bowl size: nubr]"), std::string::npos);
     EXPECT_NE(ast_string.find("blok $$bonk_object_free[bowl object: long]"), std::string::npos);
+    EXPECT_NE(ast_string.find("blok $$bonk_create_small_object[bowl size: nubr]"),
+              std::string::npos);
+    EXPECT_NE(
+        ast_string.find("blok $$bonk_small_object_free[bowl object: long, bowl size: nubr]"),
+        std::string::npos);
 }
 
 TEST(FrontEnd, ConstructorDestructorGeneratorTest) {
@@ -448,7 +462,7 @@ TEST(FrontEnd, ConstructorDestructorGeneratorTest) {
         auto call = (bonk::TreeNodeCall*)(cast->operand.get());
         EXPECT_EQ(call->callee->type, bonk::TreeNodeType::n_identifier);
         EXPECT_EQ(((bonk::TreeNodeIdentifier*)call->callee.get())->identifier_text,
-                  "$$bonk_create_object");
+                  "$$bonk_create_small_object");
         EXPECT_EQ(call->arguments->parameters.size(), 1);
 
         auto parameter = call->arguments->parameters.front().get();
@@ -470,6 +484,24 @@ TEST(FrontEnd, ConstructorDestructorGeneratorTest) {
                   "TestHive");
     }
 
+    {
+        // The destructor tells the runtime the size of the freed hive
+        auto& body = destructor->body->body;
+        ASSERT_FALSE(body.empty());
+        ASSERT_EQ(body.back()->type, bonk::TreeNodeType::n_call);
+
+        auto call = (bonk::TreeNodeCall*)body.back().get();
+        EXPECT_EQ(((bonk::TreeNodeIdentifier*)call->callee.get())->identifier_text,
+                  "$$bonk_small_object_free");
+        EXPECT_EQ(call->arguments->parameters.size(), 2);
+
+        auto parameter = call->arguments->parameters.back().get();
+        EXPECT_EQ(parameter->parameter_name->identifier_text, "size");
+        EXPECT_EQ(((bonk::TreeNodeNumberConstant*)parameter->parameter_value.get())
+                      ->contents.integer_value,
+                  24);
+    }
+
     // Count the number of calls to the constructor
     struct IdentifierVisitor : bonk::ASTVisitor {
         int constructor_reference_count = 0;
@@ -655,4 +687,322 @@ TEST(FrontEnd, TestMetadataExporter) {
     )";
 
     // TODO
-}
\ No newline at end of file
+}
+
+static std::string read_text_file(const std::filesystem::path& path) {
+    std::ifstream file{path, std::ios::binary};
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+TEST(FrontEnd, MetadataArchiveTest) {
+    auto root = std::filesystem::temp_directory_path() / "bonk-metadata-archive-test";
+    std::filesystem::create_directories(root);
+    auto archive_path = root / "library.bspack";
+
+    bonk::MetadataArchiveWriter writer{root};
+    for (int i = 0; i < 20; i++) {
+        auto path = root / ("module" + std::to_string(i) + ".bs");
+        EXPECT_TRUE(writer.add(path, "metadata of module " + std::to_string(i)));
+    }
+    EXPECT_TRUE(writer.add(root / "nested" / "module.bs", "nested metadata"));
+    EXPECT_FALSE(writer.add(root.parent_path() / "outside.bs", "outside metadata"));
+    ASSERT_TRUE(writer.write(archive_path));
+
+    auto archive = bonk::MetadataArchive::open(archive_path, root);
+    ASSERT_NE(archive, nullptr);
+
+    for (int i = 0; i < 20; i++) {
+        auto path = root / ("module" + std::to_string(i) + ".bs");
+        auto contents = archive->find(path);
+        ASSERT_TRUE(contents.has_value());
+        EXPECT_EQ(*contents, "metadata of module " + std::to_string(i));
+        EXPECT_EQ((uintptr_t)contents->data() % bonk::MetadataArchive::alignment, 0);
+    }
+
+    EXPECT_EQ(archive->find(root / "other" / ".." / "nested" / "module.bs"), "nested metadata");
+    EXPECT_FALSE(archive->find(root / "missing.bs").has_value());
+    EXPECT_FALSE(archive->find(root.parent_path() / "outside.bs").has_value());
+
+    std::filesystem::remove_all(root);
+}
+
+TEST(FrontEnd, CorruptMetadataArchiveTest) {
+    auto root = std::filesystem::temp_directory_path() / "bonk-corrupt-metadata-archive-test";
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root);
+    auto archive_path = root / "library.bspack";
+    auto corrupt_path = root / "corrupt.bspack";
+
+    bonk::MetadataArchiveWriter writer{root};
+    EXPECT_TRUE(writer.add(root / "module.bs", "metadata of the module"));
+    ASSERT_TRUE(writer.write(archive_path));
+
+    std::string contents = read_text_file(archive_path);
+    bonk::MetadataArchiveHeader header{};
+    memcpy(&header, contents.data(), sizeof(header));
+    bonk::MetadataArchiveEntry entry{};
+    memcpy(&entry, contents.data() + header.entries_offset, sizeof(entry));
+
+    auto open_corrupted = [&](size_t length, auto corrupt) {
+        auto corrupted_header = header;
+        auto corrupted_entry = entry;
+        corrupt(corrupted_header, corrupted_entry);
+
+        std::string corrupted = contents.substr(0, length);
+        memcpy(corrupted.data(), &corrupted_header, sizeof(corrupted_header));
+        if (header.entries_offset + sizeof(entry) <= length) {
+            memcpy(corrupted.data() + header.entries_offset, &corrupted_entry, sizeof(entry));
+        }
+
+        bonk::FileOutputStream{corrupt_path.string()}.get_stream() << corrupted;
+        return bonk::MetadataArchive::open(corrupt_path, root);
+    };
+
+    auto keep = [](bonk::MetadataArchiveHeader&, bonk::MetadataArchiveEntry&) {};
+    ASSERT_NE(open_corrupted(contents.size(), keep), nullptr);
+
+    // Truncated archives
+    EXPECT_EQ(open_corrupted(sizeof(header), keep), nullptr);
+    EXPECT_EQ(open_corrupted(header.entries_offset + sizeof(entry) / 2, keep), nullptr);
+    EXPECT_EQ(open_corrupted(entry.meta_offset + entry.meta_size - 1, keep), nullptr);
+
+    // Ranges whose end overflows would pass a plain 'offset + length <= size' check
+    EXPECT_EQ(open_corrupted(contents.size(),
+                             [](auto& header, auto&) { header.entries_offset = -16; }),
+              nullptr);
+    EXPECT_EQ(open_corrupted(contents.size(),
+                             [](auto&, auto& entry) {
+                                 entry.path_offset = -16;
+                                 entry.path_length = 32;
+                             }),
+              nullptr);
+    EXPECT_EQ(open_corrupted(contents.size(),
+                             [](auto&, auto& entry) {
+                                 entry.meta_offset = 16;
+                                 entry.meta_size = -8;
+                             }),
+              nullptr);
+
+    // Misaligned tables
+    EXPECT_EQ(open_corrupted(contents.size(),
+                             [](auto& header, auto&) { header.buckets_offset += 1; }),
+              nullptr);
+    EXPECT_EQ(open_corrupted(contents.size(),
+                             [](auto& header, auto&) { header.entries_offset += 4; }),
+              nullptr);
+
+    std::filesystem::remove_all(root);
+}
+
+TEST(FrontEnd, CompilationCacheTest) {
+    auto root = std::filesystem::temp_directory_path() / "bonk-compilation-cache-test";
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root);
+
+    auto output_path = root / "module.out";
+    auto restored_path = root / "restored.out";
+
+    bonk::CompilationCache::ModuleKey old_key{"old", {}};
+    bonk::CompilationCache::ModuleKey new_key{"new", {}};
+
+    {
+        // Each entry is 1000 bytes, so only one of them fits into the cache
+        bonk::CompilationCache cache{root / "cache", "qbe", 1500};
+
+        bonk::FileOutputStream{output_path.string()}.get_stream() << std::string(1000, 'a');
+        cache.store_output(old_key, root / "a.bs", output_path);
+
+        // Outputs are shared between different source locations
+        EXPECT_TRUE(cache.restore_output(old_key, root / "b.bs", restored_path));
+        EXPECT_EQ(std::filesystem::file_size(restored_path), 1000);
+        EXPECT_FALSE(cache.restore_output(new_key, root / "a.bs", restored_path));
+
+        auto past = std::filesystem::file_time_type::clock::now() - std::chrono::hours(1);
+        std::filesystem::last_write_time(root / "cache" / "old", past);
+
+        cache.store_output(new_key, root / "a.bs", output_path);
+    }
+
+    // The least recently used entry is evicted once the cache is closed
+    bonk::CompilationCache cache{root / "cache", "qbe", 1500};
+    EXPECT_FALSE(cache.restore_output(old_key, root / "a.bs", restored_path));
+    EXPECT_TRUE(cache.restore_output(new_key, root / "a.bs", restored_path));
+
+    std::filesystem::remove_all(root);
+}
+
+TEST(FrontEnd, ProcedureOutputCacheTest) {
+    auto root = std::filesystem::temp_directory_path() / "bonk-procedure-cache-test";
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root);
+
+    auto path = root / "module.procs";
+
+    // Keys that only differ in their last byte must not share an entry
+    std::string first_key = std::string(64, 'k') + '\x01';
+    std::string second_key = std::string(64, 'k') + '\x02';
+
+    {
+        bonk::ProcedureOutputCache cache{path};
+        cache.store(first_key, "first");
+        cache.store(second_key, "second");
+        EXPECT_TRUE(cache.write());
+    }
+
+    {
+        bonk::ProcedureOutputCache cache{path};
+        EXPECT_EQ(cache.find(first_key), "first");
+        EXPECT_EQ(cache.find(std::string(64, 'k')), std::nullopt);
+        EXPECT_EQ(cache.get_hit_count(), 1);
+        EXPECT_EQ(cache.get_miss_count(), 1);
+        EXPECT_TRUE(cache.write());
+    }
+
+    {
+        // Entries that were not used by the last compilation are dropped
+        bonk::ProcedureOutputCache cache{path};
+        EXPECT_EQ(cache.find(second_key), std::nullopt);
+        EXPECT_EQ(cache.find(first_key), "first");
+    }
+
+    // A truncated cache is ignored as a whole
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+    bonk::ProcedureOutputCache cache{path};
+    EXPECT_EQ(cache.find(first_key), std::nullopt);
+
+    std::filesystem::remove_all(root);
+}
+
+TEST(FrontEnd, BuildReportTest) {
+    bonk::BuildReport build_report;
+
+    auto report = build_report.begin_module("/project/main.bs");
+    ASSERT_NE(report, nullptr);
+    EXPECT_EQ(build_report.begin_module("/project/./main.bs"), nullptr);
+    EXPECT_EQ(build_report.find_module("/project/lib/../main.bs"), report);
+
+    report->set_reason(bonk::RebuildReason::dependency_changed, "/project/lib.bs");
+    report->set_reason(bonk::RebuildReason::metadata_outdated);
+    report->verdict = bonk::ModuleVerdict::rebuilt;
+
+    EXPECT_EQ(report->reason, bonk::RebuildReason::dependency_changed);
+    EXPECT_EQ(report->trigger, "/project/lib.bs");
+
+    std::stringstream explanation;
+    build_report.print_explanation(bonk::StdOutputStream(explanation));
+    EXPECT_NE(explanation.str().find("rebuilt (interface of "), std::string::npos);
+    EXPECT_NE(explanation.str().find("modules: 1, 0 not rebuilt"), std::string::npos);
+}
+
+// Compiles the project like bonk does, with the backend configured by the callback
+template <typename Configure>
+static std::unique_ptr<bonk::BuildReport> compile_project(const std::filesystem::path& path,
+                                                          Configure configure) {
+    auto error_stream = bonk::StdOutputStream(std::cerr);
+
+    bonk::CompilerConfig config{.error_file = error_stream};
+    bonk::Compiler compiler(config);
+    bonk::qbe_backend::QBEBackend backend(compiler);
+    configure(backend);
+    compiler.backend = &backend;
+    compiler.build_report = std::make_unique<bonk::BuildReport>();
+
+    if (!bonk::HelpResolver(compiler).compile_file(path)) {
+        return nullptr;
+    }
+    return std::move(compiler.build_report);
+}
+
+// Outputs compiled with and without the option must never be linked
+// together, so switching it rebuilds the modules that are otherwise up to date
+template <typename Enable>
+static void expect_rebuild_on_option_change(const std::string& name, Enable enable,
+                                            std::string_view marker) {
+    auto root = std::filesystem::temp_directory_path() / ("bonk-" + name + "-test");
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root);
+
+    auto library_path = root / "list.bs";
+    auto main_path = root / "main.bs";
+
+    bonk::FileOutputStream{library_path.string()}.get_stream() << R"(
+        hive Node {
+            bowl next: Node = null;
+        }
+
+        blok use[bowl node: Node]: nothing;
+
+        blok release {
+            bowl node = @Node[next = @Node[next = @Node]];
+            @use[node = node];
+        }
+    )";
+
+    bonk::FileOutputStream{main_path.string()}.get_stream() << R"(
+        help "list.bs"
+
+        blok main {
+            @release;
+        }
+    )";
+
+    auto disable = [](bonk::qbe_backend::QBEBackend&) {};
+    auto library_output = bonk::HelpResolver::get_output_path(library_path);
+
+    using bonk::ModuleVerdict;
+    using bonk::RebuildReason;
+
+    struct Step {
+        bool enabled;
+        ModuleVerdict verdict;
+        RebuildReason reason;
+    };
+
+    Step steps[] = {
+        {false, ModuleVerdict::rebuilt, RebuildReason::output_missing},
+        {false, ModuleVerdict::up_to_date, RebuildReason::none},
+        {true, ModuleVerdict::rebuilt, RebuildReason::options_changed},
+        {true, ModuleVerdict::up_to_date, RebuildReason::none},
+        {false, ModuleVerdict::rebuilt, RebuildReason::options_changed},
+    };
+
+    for (auto& step : steps) {
+        auto build_report = step.enabled ? compile_project(main_path, enable)
+                                         : compile_project(main_path, disable);
+        ASSERT_NE(build_report, nullptr);
+
+        for (auto& path : {library_path, main_path}) {
+            auto report = build_report->find_module(path);
+            ASSERT_NE(report, nullptr) << path;
+            EXPECT_EQ(report->verdict, step.verdict) << path;
+            EXPECT_EQ(report->reason, step.reason) << path;
+        }
+
+        auto output = read_text_file(library_output);
+        EXPECT_EQ(output.find(marker) != std::string::npos, step.enabled);
+    }
+
+    std::filesystem::remove_all(root);
+}
+
+TEST(FrontEnd, IterativeTeardownRebuildTest) {
+    expect_rebuild_on_option_change(
+        "iterative-teardown",
+        [](bonk::qbe_backend::QBEBackend& backend) { backend.iterative_teardown = true; },
+        "$$bonk_destroy_object");
+}
+
+TEST(FrontEnd, HeapProfileRebuildTest) {
+    expect_rebuild_on_option_change(
+        "heap-profile",
+        [](bonk::qbe_backend::QBEBackend& backend) { backend.heap_profiling = true; }, "$$site");
+}
+
+TEST(FrontEnd, RefCountInstrumentationRebuildTest) {
+    expect_rebuild_on_option_change(
+        "instrument-refcounts",
+        [](bonk::qbe_backend::QBEBackend& backend) { backend.instrument_refcounts = true; },
+        "$$refcount");
+}
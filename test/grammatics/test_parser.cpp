@@ -442,4 +442,49 @@ TEST(Parser, TestAssociativeSide) {
     ASSERT_EQ(binary_op->operator_type, bonk::OperatorType::o_assign);
     ASSERT_EQ(binary_op->left->type, bonk::TreeNodeType::n_identifier);
     ASSERT_EQ(binary_op->right->type, bonk::TreeNodeType::n_identifier);
-}
\ No newline at end of file
+}
+TEST(Parser, TestFlatIdentifier) {
+    auto error_stream = bonk::StdOutputStream(std::cout);
+
+    bonk::CompilerConfig config{.error_file = error_stream};
+    bonk::Compiler compiler(config);
+
+    // 'flat' only marks a blok definition, elsewhere it is an ordinary name
+    const char* source = R"(
+        flat blok flat[bowl flat: nubr]: nubr {
+            bonk flat + 1;
+        }
+        blok main {
+            bowl flat = 2;
+        }
+    )";
+
+    auto lexemes = bonk::Lexer(compiler).parse_file("test", source);
+    ASSERT_FALSE(lexemes.empty());
+
+    auto ast = bonk::Parser(compiler).parse_file(&lexemes);
+    ASSERT_NE(ast, nullptr);
+
+    auto program = (bonk::TreeNodeProgram*)ast.get();
+    ASSERT_EQ(program->body.size(), 2);
+    ASSERT_EQ(program->body.front()->type, bonk::TreeNodeType::n_block_definition);
+    ASSERT_EQ(program->body.back()->type, bonk::TreeNodeType::n_block_definition);
+
+    auto flat_blok = (bonk::TreeNodeBlockDefinition*)program->body.front().get();
+    ASSERT_TRUE(flat_blok->is_flat);
+    ASSERT_EQ(flat_blok->block_name->identifier_text, "flat");
+    ASSERT_EQ(flat_blok->block_parameters->parameters.size(), 1);
+    ASSERT_EQ(flat_blok->block_parameters->parameters.front()->variable_name->identifier_text,
+              "flat");
+    ASSERT_EQ(flat_blok->body->body.size(), 1);
+    ASSERT_EQ(flat_blok->body->body.front()->type, bonk::TreeNodeType::n_bonk_statement);
+
+    auto main_blok = (bonk::TreeNodeBlockDefinition*)program->body.back().get();
+    ASSERT_FALSE(main_blok->is_flat);
+    ASSERT_EQ(main_blok->body->body.size(), 1);
+    ASSERT_EQ(main_blok->body->body.front()->type, bonk::TreeNodeType::n_variable_definition);
+
+    auto variable_definition =
+        (bonk::TreeNodeVariableDefinition*)main_blok->body->body.front().get();
+    ASSERT_EQ(variable_definition->variable_name->identifier_text, "flat");
+}
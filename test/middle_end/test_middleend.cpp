@@ -2,14 +2,32 @@
 #include <gtest/gtest.h>
 #include "bonk/frontend/ast/ast_printer.hpp"
 #include "bonk/frontend/frontend.hpp"
+#include "bonk/frontend/parsing/parser.hpp"
 #include "bonk/middleend/ir/algorithms/hir_alive_variables_finder.hpp"
 #include "bonk/middleend/ir/algorithms/hir_base_block_separator.hpp"
+#include "bonk/middleend/ir/algorithms/hir_constant_folder.hpp"
+#include "bonk/middleend/ir/algorithms/hir_constant_propagation.hpp"
 #include "bonk/middleend/ir/algorithms/hir_copy_propagation.hpp"
 #include "bonk/middleend/ir/algorithms/hir_dominance_frontier_finder.hpp"
 #include "bonk/middleend/ir/algorithms/hir_dominator_finder.hpp"
+#include "bonk/middleend/ir/algorithms/hir_if_converter.hpp"
+#include "bonk/middleend/ir/algorithms/hir_inliner.hpp"
+#include "bonk/middleend/ir/algorithms/hir_instruction_combiner.hpp"
+#include "bonk/middleend/ir/algorithms/hir_jump_threader.hpp"
+#include "bonk/middleend/ir/algorithms/hir_loop_finder.hpp"
+#include "bonk/middleend/ir/algorithms/hir_loop_invariant_code_motion.hpp"
+#include "bonk/middleend/ir/algorithms/hir_null_check_eliminator.hpp"
+#include "bonk/middleend/ir/algorithms/hir_procedure_hasher.hpp"
+#include "bonk/middleend/ir/algorithms/hir_ref_count_elider.hpp"
+#include "bonk/middleend/ir/algorithms/hir_ref_counter_reducer.hpp"
 #include "bonk/middleend/ir/algorithms/hir_ssa_converter.hpp"
+#include "bonk/middleend/ir/algorithms/hir_stack_promoter.hpp"
+#include "bonk/middleend/ir/algorithms/hir_tail_call_eliminator.hpp"
 #include "bonk/middleend/ir/algorithms/hir_unreachable_code_deleter.hpp"
 #include "bonk/middleend/ir/algorithms/hir_unused_def_deleter.hpp"
+#include "bonk/middleend/ir/algorithms/hir_value_numbering.hpp"
+#include "bonk/middleend/ir/algorithms/hir_value_range_finder.hpp"
+#include "bonk/middleend/ir/algorithms/hir_value_range_propagation.hpp"
 #include "bonk/middleend/ir/algorithms/hir_variable_index_compressor.hpp"
 #include "bonk/middleend/ir/hir_graphviz_dumper.hpp"
 #include "bonk/middleend/middleend.hpp"
@@ -176,7 +194,7 @@ TEST(MiddleEnd, DominanceFrontierTest) {
 
     auto dominance_frontiers = df_finder.get_frontiers();
 
-    ASSERT_EQ(dominance_frontiers, std::vector<int>({-1, 1, 1, -1, 1, -1, -1}));
+    ASSERT_EQ(dominance_frontiers, std::vector<std::vector<int>>({{}, {1}, {1}, {}, {1}, {}, {}}));
 }
 
 TEST(MiddleEnd, AliveVariablesTest) {
@@ -451,6 +469,278 @@ TEST(MiddleEnd, SSAConverterTest2) {
     EXPECT_EQ(ir_procedure->used_registers, used_variables.size());
 }
 
+static int count_phi_functions(bonk::HIRBaseBlock& block) {
+    int phi_functions = 0;
+    for (auto instruction : block.instructions) {
+        if (instruction->type == bonk::HIRInstructionType::phi_function) {
+            phi_functions++;
+        }
+    }
+    return phi_functions;
+}
+
+static bonk::HIRInstruction* find_definition(bonk::HIRProcedure& procedure,
+                                             bonk::IRRegister register_id) {
+    for (auto& block : procedure.base_blocks) {
+        for (auto instruction : block->instructions) {
+            for (int i = 0; i < instruction->get_write_register_count(); i++) {
+                if (instruction->get_write_register(i) == register_id) {
+                    return instruction;
+                }
+            }
+        }
+    }
+    return nullptr;
+}
+
+static void expect_single_assignment(bonk::HIRProcedure& procedure) {
+    std::unordered_set<bonk::IRRegister> used_variables;
+    for (auto& block : procedure.base_blocks) {
+        for (auto instruction : block->instructions) {
+            for (int i = 0; i < instruction->get_write_register_count(); i++) {
+                auto variable = instruction->get_write_register(i);
+                EXPECT_TRUE(used_variables.insert(variable).second);
+            }
+        }
+    }
+}
+
+TEST(MiddleEnd, SSAConverterNestedLoopTest) {
+    auto error_stream = bonk::StdOutputStream(std::cerr);
+
+    bonk::CompilerConfig config{.error_file = error_stream};
+    bonk::Compiler compiler(config);
+
+    bonk::FrontEnd front_end(compiler);
+    bonk::IDTable id_table(front_end);
+    bonk::SymbolTable symbol_table;
+    auto ir_program = std::make_unique<bonk::HIRProgram>(id_table, symbol_table);
+
+    ir_program->create_procedure();
+    auto& ir_procedure = ir_program->procedures[0];
+    ir_procedure->create_base_block();
+    auto& block = ir_procedure->base_blocks[0];
+
+    auto plus = [&](bonk::IRRegister target, bonk::IRRegister left, bonk::IRRegister right) {
+        auto instruction = block->instruction<bonk::HIROperationInstruction>();
+        instruction->target = target;
+        instruction->left = left;
+        instruction->right = right;
+        instruction->operation_type = bonk::HIROperationType::plus;
+        instruction->operand_type = bonk::HIRDataType::dword;
+        instruction->result_type = bonk::HIRDataType::dword;
+        return instruction;
+    };
+
+    // %0 counts the outer loop, %2 the inner one, %1 sums in the inner loop
+    block->instructions = {
+        block->instruction<bonk::HIRLabelInstruction>(0),
+        block->instruction<bonk::HIRConstantLoadInstruction>(0, (int64_t)0),
+        block->instruction<bonk::HIRConstantLoadInstruction>(1, (int64_t)0),
+        block->instruction<bonk::HIRConstantLoadInstruction>(3, (int64_t)1),
+        block->instruction<bonk::HIRJumpInstruction>(1),
+
+        block->instruction<bonk::HIRLabelInstruction>(1),
+        block->instruction<bonk::HIRMemoryLoadInstruction>(4, 0, bonk::HIRDataType::dword),
+        block->instruction<bonk::HIRJumpNZInstruction>(4, 2, 5),
+
+        block->instruction<bonk::HIRLabelInstruction>(2),
+        block->instruction<bonk::HIRConstantLoadInstruction>(2, (int64_t)0),
+        block->instruction<bonk::HIRJumpInstruction>(3),
+
+        block->instruction<bonk::HIRLabelInstruction>(3),
+        block->instruction<bonk::HIRMemoryLoadInstruction>(5, 2, bonk::HIRDataType::dword),
+        block->instruction<bonk::HIRJumpNZInstruction>(5, 4, 6),
+
+        block->instruction<bonk::HIRLabelInstruction>(4),
+        plus(1, 1, 2),
+        plus(2, 2, 3),
+        block->instruction<bonk::HIRJumpInstruction>(3),
+
+        block->instruction<bonk::HIRLabelInstruction>(6),
+        plus(0, 0, 3),
+        block->instruction<bonk::HIRJumpInstruction>(1),
+
+        block->instruction<bonk::HIRLabelInstruction>(5),
+        block->instruction<bonk::HIRMemoryLoadInstruction>(6, 1, bonk::HIRDataType::dword),
+        block->instruction<bonk::HIRReturnInstruction>(),
+    };
+
+    bonk::HIRVariableIndexCompressor().compress(*ir_procedure);
+    bonk::HIRBaseBlockSeparator().separate_blocks(*ir_program);
+    bonk::HIRSSAConverter().convert(*ir_procedure);
+
+    expect_single_assignment(*ir_procedure);
+
+    // Blocks are numbered in the order they appear, after the entry block.
+    // The outer header joins %0 and %1. %2 is assigned before every use in
+    // the outer loop, so it only gets a phi function in the inner header.
+    auto& outer_header = ir_procedure->base_blocks[2];
+    auto& inner_header = ir_procedure->base_blocks[4];
+
+    int phi_functions = 0;
+    for (auto& base_block : ir_procedure->base_blocks) {
+        phi_functions += count_phi_functions(*base_block);
+    }
+
+    EXPECT_EQ(count_phi_functions(*outer_header), 2);
+    EXPECT_EQ(count_phi_functions(*inner_header), 2);
+    EXPECT_EQ(phi_functions, 4);
+
+    // The inner counter starts from the constant assigned before the loop
+    for (auto instruction : inner_header->instructions) {
+        if (instruction->type != bonk::HIRInstructionType::phi_function) {
+            break;
+        }
+        auto phi = (bonk::HIRPhiFunctionInstruction*)instruction;
+        ASSERT_EQ(phi->sources.size(), 2);
+        EXPECT_NE(phi->sources[0], phi->sources[1]);
+    }
+}
+
+TEST(MiddleEnd, SSAConverterDiamondInLoopTest) {
+    auto error_stream = bonk::StdOutputStream(std::cerr);
+
+    bonk::CompilerConfig config{.error_file = error_stream};
+    bonk::Compiler compiler(config);
+
+    bonk::FrontEnd front_end(compiler);
+    bonk::IDTable id_table(front_end);
+    bonk::SymbolTable symbol_table;
+    auto ir_program = std::make_unique<bonk::HIRProgram>(id_table, symbol_table);
+
+    ir_program->create_procedure();
+    auto& ir_procedure = ir_program->procedures[0];
+    ir_procedure->create_base_block();
+    auto& block = ir_procedure->base_blocks[0];
+
+    auto sum = block->instruction<bonk::HIROperationInstruction>();
+    sum->target = 0;
+    sum->left = 0;
+    sum->right = 4;
+    sum->operation_type = bonk::HIROperationType::plus;
+    sum->operand_type = bonk::HIRDataType::dword;
+    sum->result_type = bonk::HIRDataType::dword;
+
+    // %4 is picked by a diamond inside the loop and added to %0
+    block->instructions = {
+        block->instruction<bonk::HIRLabelInstruction>(0),
+        block->instruction<bonk::HIRConstantLoadInstruction>(0, (int64_t)0),
+        block->instruction<bonk::HIRJumpInstruction>(1),
+
+        block->instruction<bonk::HIRLabelInstruction>(1),
+        block->instruction<bonk::HIRMemoryLoadInstruction>(2, 0, bonk::HIRDataType::dword),
+        block->instruction<bonk::HIRJumpNZInstruction>(2, 2, 6),
+
+        block->instruction<bonk::HIRLabelInstruction>(2),
+        block->instruction<bonk::HIRMemoryLoadInstruction>(3, 0, bonk::HIRDataType::dword),
+        block->instruction<bonk::HIRJumpNZInstruction>(3, 3, 4),
+
+        block->instruction<bonk::HIRLabelInstruction>(3),
+        block->instruction<bonk::HIRConstantLoadInstruction>(4, (int64_t)1),
+        block->instruction<bonk::HIRJumpInstruction>(5),
+
+        block->instruction<bonk::HIRLabelInstruction>(4),
+        block->instruction<bonk::HIRConstantLoadInstruction>(4, (int64_t)2),
+        block->instruction<bonk::HIRJumpInstruction>(5),
+
+        block->instruction<bonk::HIRLabelInstruction>(5),
+        sum,
+        block->instruction<bonk::HIRJumpInstruction>(1),
+
+        block->instruction<bonk::HIRLabelInstruction>(6),
+        block->instruction<bonk::HIRReturnInstruction>(),
+    };
+
+    bonk::HIRVariableIndexCompressor().compress(*ir_procedure);
+    bonk::HIRBaseBlockSeparator().separate_blocks(*ir_program);
+    bonk::HIRSSAConverter().convert(*ir_procedure);
+
+    expect_single_assignment(*ir_procedure);
+
+    auto& header = ir_procedure->base_blocks[2];
+    auto& join = ir_procedure->base_blocks[6];
+
+    // The join of the diamond is in the frontier of the arms, and the loop
+    // header is in the frontier of the join. %4 is dead at the header, so
+    // only %0 gets a phi function there.
+    ASSERT_EQ(count_phi_functions(*join), 1);
+    ASSERT_EQ(count_phi_functions(*header), 1);
+
+    auto join_phi = (bonk::HIRPhiFunctionInstruction*)join->instructions.front();
+    ASSERT_EQ(join_phi->sources.size(), 2);
+    for (auto source : join_phi->sources) {
+        auto definition = find_definition(*ir_procedure, source);
+        ASSERT_NE(definition, nullptr);
+        EXPECT_EQ(definition->type, bonk::HIRInstructionType::constant_load);
+    }
+    EXPECT_EQ(sum->right, join_phi->target);
+
+    auto header_phi = (bonk::HIRPhiFunctionInstruction*)header->instructions.front();
+    ASSERT_EQ(header_phi->sources.size(), 2);
+    EXPECT_EQ(sum->left, header_phi->target);
+    EXPECT_TRUE(std::find(header_phi->sources.begin(), header_phi->sources.end(),
+                          sum->target) != header_phi->sources.end());
+}
+
+TEST(MiddleEnd, SSAConverterPruningTest) {
+    auto error_stream = bonk::StdOutputStream(std::cerr);
+
+    bonk::CompilerConfig config{.error_file = error_stream};
+    bonk::Compiler compiler(config);
+
+    bonk::FrontEnd front_end(compiler);
+    bonk::IDTable id_table(front_end);
+    bonk::SymbolTable symbol_table;
+    auto ir_program = std::make_unique<bonk::HIRProgram>(id_table, symbol_table);
+
+    ir_program->create_procedure();
+    auto& ir_procedure = ir_program->procedures[0];
+    ir_procedure->create_base_block();
+    auto& block = ir_procedure->base_blocks[0];
+
+    // Both arms assign %0 and only use it themselves, so it is dead at the
+    // join. %3 is assigned in both arms too, and is used after the join.
+    block->instructions = {
+        block->instruction<bonk::HIRLabelInstruction>(0),
+        block->instruction<bonk::HIRConstantLoadInstruction>(1, (int64_t)0),
+        block->instruction<bonk::HIRMemoryLoadInstruction>(2, 1, bonk::HIRDataType::dword),
+        block->instruction<bonk::HIRJumpNZInstruction>(2, 1, 2),
+
+        block->instruction<bonk::HIRLabelInstruction>(1),
+        block->instruction<bonk::HIRConstantLoadInstruction>(0, (int64_t)1),
+        block->instruction<bonk::HIRMemoryLoadInstruction>(3, 0, bonk::HIRDataType::dword),
+        block->instruction<bonk::HIRJumpInstruction>(3),
+
+        block->instruction<bonk::HIRLabelInstruction>(2),
+        block->instruction<bonk::HIRConstantLoadInstruction>(0, (int64_t)2),
+        block->instruction<bonk::HIRMemoryLoadInstruction>(3, 0, bonk::HIRDataType::dword),
+        block->instruction<bonk::HIRJumpInstruction>(3),
+
+        block->instruction<bonk::HIRLabelInstruction>(3),
+        block->instruction<bonk::HIRMemoryLoadInstruction>(4, 3, bonk::HIRDataType::dword),
+        block->instruction<bonk::HIRReturnInstruction>(),
+    };
+
+    bonk::HIRVariableIndexCompressor().compress(*ir_procedure);
+    bonk::HIRBaseBlockSeparator().separate_blocks(*ir_program);
+    bonk::HIRSSAConverter().convert(*ir_procedure);
+
+    expect_single_assignment(*ir_procedure);
+
+    auto& join = ir_procedure->base_blocks[4];
+    ASSERT_EQ(count_phi_functions(*join), 1);
+
+    // The only phi function joins the loaded values
+    auto phi = (bonk::HIRPhiFunctionInstruction*)join->instructions.front();
+    ASSERT_EQ(phi->sources.size(), 2);
+    for (auto source : phi->sources) {
+        auto definition = find_definition(*ir_procedure, source);
+        ASSERT_NE(definition, nullptr);
+        EXPECT_EQ(definition->type, bonk::HIRInstructionType::memory_load);
+    }
+}
+
 TEST(MiddleEnd, UnreachableCodeDeleterTest) {
     auto error_stream = bonk::StdOutputStream(std::cerr);
     auto output_stream = bonk::StdOutputStream(std::cout);
@@ -651,4 +941,1530 @@ TEST(MiddleEnd, UnusedDefinitionDeletionTest) {
             }
         }
     }
-}
\ No newline at end of file
+}
+
+TEST(MiddleEnd, ConstantPropagationTest) {
+    auto error_stream = bonk::StdOutputStream(std::cerr);
+    auto output_stream = bonk::StdOutputStream(std::cout);
+
+    bonk::CompilerConfig config{.error_file = error_stream};
+    bonk::Compiler compiler(config);
+
+    bonk::FrontEnd front_end(compiler);
+    bonk::IDTable id_table(front_end);
+    bonk::SymbolTable symbol_table;
+    auto ir_program = std::make_unique<bonk::HIRProgram>(id_table, symbol_table);
+
+    ir_program->create_procedure();
+    auto& ir_procedure = ir_program->procedures[0];
+    ir_procedure->create_base_block();
+    auto& block = ir_procedure->base_blocks[0];
+
+    auto operation = [&](bonk::IRRegister target, bonk::IRRegister left, bonk::IRRegister right,
+                         bonk::HIROperationType type, bonk::HIRDataType operand_type,
+                         bonk::HIRDataType result_type) {
+        auto instruction = block->instruction<bonk::HIROperationInstruction>();
+        instruction->target = target;
+        instruction->left = left;
+        instruction->right = right;
+        instruction->operation_type = type;
+        instruction->operand_type = operand_type;
+        instruction->result_type = result_type;
+        return instruction;
+    };
+
+    block->instructions = {
+        block->instruction<bonk::HIRLabelInstruction>(0),
+        block->instruction<bonk::HIRConstantLoadInstruction>(0, (int32_t)0),
+        block->instruction<bonk::HIRConstantLoadInstruction>(1, (int32_t)10),
+        operation(2, 1, 0, bonk::HIROperationType::greater, bonk::HIRDataType::word,
+                  bonk::HIRDataType::word),
+        block->instruction<bonk::HIRJumpNZInstruction>(2, 1, 2),
+
+        block->instruction<bonk::HIRLabelInstruction>(1),
+        block->instruction<bonk::HIRConstantLoadInstruction>(3, 1.5f),
+        operation(4, 3, 3, bonk::HIROperationType::multiply, bonk::HIRDataType::float32,
+                  bonk::HIRDataType::float32),
+        block->instruction<bonk::HIRJumpInstruction>(3),
+
+        // Never taken, since 10 > 0
+        block->instruction<bonk::HIRLabelInstruction>(2),
+        block->instruction<bonk::HIRConstantLoadInstruction>(4, 7.0f),
+        block->instruction<bonk::HIRJumpInstruction>(3),
+
+        block->instruction<bonk::HIRLabelInstruction>(3),
+        block->instruction<bonk::HIRReturnInstruction>(4),
+    };
+
+    bonk::HIRVariableIndexCompressor().compress(*ir_procedure);
+    bonk::HIRBaseBlockSeparator().separate_blocks(*ir_program);
+    bonk::HIRSSAConverter().convert(*ir_procedure);
+
+    int blocks = ir_procedure->base_blocks.size();
+
+    bonk::HIRConstantPropagation().propagate_constants(*ir_procedure);
+
+    bonk::HIRPrinter printer(output_stream);
+    printer.print(*ir_program);
+
+    EXPECT_EQ(ir_procedure->base_blocks.size(), blocks - 1);
+
+    std::unordered_map<bonk::IRRegister, bonk::HIRConstantLoadInstruction*> constants;
+    bonk::HIRReturnInstruction* return_instruction = nullptr;
+
+    for (auto& block : ir_procedure->base_blocks) {
+        for (auto& instruction : block->instructions) {
+            EXPECT_NE(instruction->type, bonk::HIRInstructionType::jump_nz);
+            EXPECT_NE(instruction->type, bonk::HIRInstructionType::phi_function);
+
+            if (instruction->type == bonk::HIRInstructionType::constant_load) {
+                auto constant = (bonk::HIRConstantLoadInstruction*)instruction;
+                constants[constant->target] = constant;
+            }
+            if (instruction->type == bonk::HIRInstructionType::return_op) {
+                return_instruction = (bonk::HIRReturnInstruction*)instruction;
+            }
+        }
+    }
+
+    ASSERT_NE(return_instruction, nullptr);
+
+    auto result = constants.find(return_instruction->return_value.value());
+    ASSERT_NE(result, constants.end());
+    EXPECT_EQ(result->second->type, bonk::HIRDataType::float32);
+    EXPECT_EQ(bonk::HIRConstantFolder::to_float(result->second->constant), 2.25f);
+}
+
+TEST(MiddleEnd, ValueNumberingTest) {
+    auto error_stream = bonk::StdOutputStream(std::cerr);
+    auto output_stream = bonk::StdOutputStream(std::cout);
+
+    bonk::CompilerConfig config{.error_file = error_stream};
+    bonk::Compiler compiler(config);
+
+    bonk::FrontEnd front_end(compiler);
+    bonk::IDTable id_table(front_end);
+    bonk::SymbolTable symbol_table;
+    auto ir_program = std::make_unique<bonk::HIRProgram>(id_table, symbol_table);
+
+    ir_program->create_procedure();
+    auto& ir_procedure = ir_program->procedures[0];
+    ir_procedure->create_base_block();
+    auto& block = ir_procedure->base_blocks[0];
+
+    auto add = [&](bonk::IRRegister target, bonk::IRRegister left, bonk::IRRegister right) {
+        auto instruction = block->instruction<bonk::HIROperationInstruction>();
+        instruction->target = target;
+        instruction->left = left;
+        instruction->right = right;
+        instruction->operation_type = bonk::HIROperationType::plus;
+        instruction->operand_type = bonk::HIRDataType::dword;
+        instruction->result_type = bonk::HIRDataType::dword;
+        return instruction;
+    };
+
+    auto store = block->instruction<bonk::HIRMemoryStoreInstruction>();
+    store->address = 2;
+    store->value = 1;
+    store->type = bonk::HIRDataType::dword;
+
+    ir_procedure->parameters = {{bonk::HIRDataType::dword, 0}};
+
+    block->instructions = {
+        block->instruction<bonk::HIRLabelInstruction>(0),
+        block->instruction<bonk::HIRConstantLoadInstruction>(1, (int64_t)8),
+        add(2, 0, 1),
+        block->instruction<bonk::HIRMemoryLoadInstruction>(3, 2, bonk::HIRDataType::dword),
+        block->instruction<bonk::HIRJumpInstruction>(1),
+
+        // Same field, computed again in a dominated block
+        block->instruction<bonk::HIRLabelInstruction>(1),
+        block->instruction<bonk::HIRConstantLoadInstruction>(4, (int64_t)8),
+        add(5, 4, 0),
+        block->instruction<bonk::HIRMemoryLoadInstruction>(6, 5, bonk::HIRDataType::dword),
+        store,
+        block->instruction<bonk::HIRMemoryLoadInstruction>(7, 5, bonk::HIRDataType::dword),
+        add(8, 3, 6),
+        add(9, 8, 7),
+        block->instruction<bonk::HIRReturnInstruction>(9),
+    };
+
+    bonk::HIRVariableIndexCompressor().compress(*ir_procedure);
+    bonk::HIRBaseBlockSeparator().separate_blocks(*ir_program);
+    bonk::HIRSSAConverter().convert(*ir_procedure);
+    bonk::HIRValueNumbering().eliminate_redundancy(*ir_procedure);
+
+    bonk::HIRPrinter printer(output_stream);
+    printer.print(*ir_program);
+
+    int constants = 0;
+    int additions = 0;
+    std::vector<bonk::HIRMemoryLoadInstruction*> loads;
+
+    for (auto& block : ir_procedure->base_blocks) {
+        for (auto& instruction : block->instructions) {
+            switch (instruction->type) {
+            case bonk::HIRInstructionType::constant_load:
+                constants++;
+                break;
+            case bonk::HIRInstructionType::operation:
+                additions++;
+                break;
+            case bonk::HIRInstructionType::memory_load:
+                loads.push_back((bonk::HIRMemoryLoadInstruction*)instruction);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    EXPECT_EQ(constants, 1);
+    // The address is computed once, and both sums are kept
+    EXPECT_EQ(additions, 3);
+    // The second load is redundant, the one after the store is not
+    ASSERT_EQ(loads.size(), 2);
+    EXPECT_EQ(loads[0]->address, loads[1]->address);
+}
+
+TEST(MiddleEnd, LoopFinderTest) {
+    auto error_stream = bonk::StdOutputStream(std::cerr);
+
+    bonk::CompilerConfig config{.error_file = error_stream};
+    bonk::Compiler compiler(config);
+
+    bonk::FrontEnd front_end(compiler);
+    bonk::IDTable id_table(front_end);
+    bonk::SymbolTable symbol_table;
+    auto ir_program = std::make_unique<bonk::HIRProgram>(id_table, symbol_table);
+
+    ir_program->create_procedure();
+    auto& ir_procedure = ir_program->procedures[0];
+    ir_procedure->create_base_block();
+    auto& block = ir_procedure->base_blocks[0];
+
+    block->instructions = {
+        block->instruction<bonk::HIRLabelInstruction>(0),
+        block->instruction<bonk::HIRConstantLoadInstruction>(0, (int64_t)1),
+        block->instruction<bonk::HIRJumpInstruction>(1),
+
+        // Outer loop header
+        block->instruction<bonk::HIRLabelInstruction>(1),
+        block->instruction<bonk::HIRJumpNZInstruction>(0, 2, 4),
+
+        // Inner loop, consisting of a single block
+        block->instruction<bonk::HIRLabelInstruction>(2),
+        block->instruction<bonk::HIRJumpNZInstruction>(0, 2, 3),
+
+        block->instruction<bonk::HIRLabelInstruction>(3),
+        block->instruction<bonk::HIRJumpInstruction>(1),
+
+        block->instruction<bonk::HIRLabelInstruction>(4),
+        block->instruction<bonk::HIRReturnInstruction>(),
+    };
+
+    bonk::HIRVariableIndexCompressor().compress(*ir_procedure);
+    bonk::HIRBaseBlockSeparator().separate_blocks(*ir_program);
+
+    auto block_of_label = [&](int label) {
+        // The separator inserts an empty start block
+        return label + 1;
+    };
+
+    bonk::HIRDominatorFinder dominator_finder(*ir_procedure);
+    bonk::HIRLoopFinder loop_finder(dominator_finder);
+    auto& loops = loop_finder.get_loops();
+
+    ASSERT_EQ(loops.size(), 2);
+
+    auto& inner = loops[0];
+    auto& outer = loops[1];
+
+    EXPECT_EQ(inner.header, block_of_label(2));
+    EXPECT_EQ(inner.blocks.count(), 1);
+    EXPECT_EQ(inner.parent, 1);
+    EXPECT_EQ(inner.depth, 2);
+
+    EXPECT_EQ(outer.header, block_of_label(1));
+    EXPECT_EQ(outer.blocks.count(), 3);
+    EXPECT_TRUE(outer.contains(block_of_label(3)));
+    EXPECT_FALSE(outer.contains(block_of_label(4)));
+    EXPECT_EQ(outer.parent, -1);
+
+    // The inner header is entered from the outer header and from itself,
+    // so a new preheader is created, which belongs to the outer loop
+    auto preheader = loop_finder.ensure_preheader(inner);
+    ASSERT_NE(preheader, nullptr);
+    EXPECT_EQ(preheader->successors.size(), 1);
+    EXPECT_EQ(preheader->successors[0]->index, inner.header);
+    EXPECT_TRUE(outer.contains(preheader->index));
+    EXPECT_FALSE(inner.contains(preheader->index));
+
+    auto& inner_header = ir_procedure->base_blocks[inner.header];
+    for (auto predecessor : inner_header->predecessors) {
+        EXPECT_TRUE(predecessor == preheader || inner.contains(predecessor->index));
+    }
+}
+
+TEST(MiddleEnd, LoopInvariantCodeMotionTest) {
+    auto error_stream = bonk::StdOutputStream(std::cerr);
+    auto output_stream = bonk::StdOutputStream(std::cout);
+
+    bonk::CompilerConfig config{.error_file = error_stream};
+    bonk::Compiler compiler(config);
+
+    bonk::FrontEnd front_end(compiler);
+    bonk::IDTable id_table(front_end);
+    bonk::SymbolTable symbol_table;
+    auto ir_program = std::make_unique<bonk::HIRProgram>(id_table, symbol_table);
+
+    ir_program->create_procedure();
+    auto& ir_procedure = ir_program->procedures[0];
+    ir_procedure->create_base_block();
+    auto& block = ir_procedure->base_blocks[0];
+
+    auto operation = [&](bonk::IRRegister target, bonk::IRRegister left, bonk::IRRegister right,
+                         bonk::HIROperationType type) {
+        auto instruction = block->instruction<bonk::HIROperationInstruction>();
+        instruction->target = target;
+        instruction->left = left;
+        instruction->right = right;
+        instruction->operation_type = type;
+        instruction->operand_type = bonk::HIRDataType::dword;
+        instruction->result_type = bonk::HIRDataType::dword;
+        return instruction;
+    };
+
+    ir_procedure->parameters = {{bonk::HIRDataType::dword, 5}};
+
+    block->instructions = {
+        block->instruction<bonk::HIRLabelInstruction>(0),
+        block->instruction<bonk::HIRConstantLoadInstruction>(0, (int64_t)0),
+        block->instruction<bonk::HIRJumpInstruction>(1),
+
+        block->instruction<bonk::HIRLabelInstruction>(1),
+        block->instruction<bonk::HIRConstantLoadInstruction>(1, (int64_t)10),
+        operation(2, 0, 1, bonk::HIROperationType::less),
+        block->instruction<bonk::HIRJumpNZInstruction>(2, 2, 3),
+
+        block->instruction<bonk::HIRLabelInstruction>(2),
+        block->instruction<bonk::HIRConstantLoadInstruction>(3, (int64_t)4),
+        operation(4, 3, 5, bonk::HIROperationType::multiply),
+        operation(6, 4, 5, bonk::HIROperationType::divide),
+        operation(0, 0, 6, bonk::HIROperationType::plus),
+        block->instruction<bonk::HIRJumpInstruction>(1),
+
+        block->instruction<bonk::HIRLabelInstruction>(3),
+        block->instruction<bonk::HIRReturnInstruction>(0),
+    };
+
+    bonk::HIRVariableIndexCompressor().compress(*ir_procedure);
+    bonk::HIRBaseBlockSeparator().separate_blocks(*ir_program);
+    bonk::HIRSSAConverter().convert(*ir_procedure);
+    bonk::HIRLoopInvariantCodeMotion().hoist_invariants(*ir_procedure);
+
+    bonk::HIRPrinter printer(output_stream);
+    printer.print(*ir_program);
+
+    bonk::HIRDominatorFinder dominator_finder(*ir_procedure);
+    bonk::HIRLoopFinder loop_finder(dominator_finder);
+    auto& loops = loop_finder.get_loops();
+    ASSERT_EQ(loops.size(), 1);
+
+    int constants = 0;
+    int operations = 0;
+
+    for (auto& block : ir_procedure->base_blocks) {
+        if (!loops[0].contains(block->index)) {
+            continue;
+        }
+        for (auto& instruction : block->instructions) {
+            if (instruction->type == bonk::HIRInstructionType::constant_load) {
+                constants++;
+            }
+            if (instruction->type == bonk::HIRInstructionType::operation) {
+                operations++;
+            }
+        }
+    }
+
+    // Only the comparison, the division and the increment are left in the loop
+    EXPECT_EQ(constants, 0);
+    EXPECT_EQ(operations, 3);
+}
+
+TEST(MiddleEnd, InlinerTest) {
+    auto error_stream = bonk::StdOutputStream(std::cerr);
+    auto output_stream = bonk::StdOutputStream(std::cout);
+
+    bonk::CompilerConfig config{.error_file = error_stream};
+    bonk::Compiler compiler(config);
+
+    bonk::FrontEnd front_end(compiler);
+    bonk::IDTable id_table(front_end);
+    bonk::SymbolTable symbol_table;
+    auto ir_program = std::make_unique<bonk::HIRProgram>(id_table, symbol_table);
+
+    auto operation = [&](bonk::HIRBaseBlock* block, bonk::IRRegister target,
+                         bonk::IRRegister left, bonk::IRRegister right,
+                         bonk::HIROperationType type) {
+        auto instruction = block->instruction<bonk::HIROperationInstruction>();
+        instruction->target = target;
+        instruction->left = left;
+        instruction->right = right;
+        instruction->operation_type = type;
+        instruction->operand_type = bonk::HIRDataType::dword;
+        instruction->result_type = bonk::HIRDataType::dword;
+        return instruction;
+    };
+
+    // Caller: bonk @callee[a = 7]
+    ir_program->create_procedure();
+    auto caller = ir_program->procedures.back().get();
+    caller->create_base_block();
+    auto caller_block = caller->base_blocks[0].get();
+
+    auto parameter = caller_block->instruction<bonk::HIRParameterInstruction>();
+    parameter->parameter = 0;
+    parameter->type = bonk::HIRDataType::dword;
+
+    auto call = caller_block->instruction<bonk::HIRCallInstruction>();
+    call->procedure_label_id = 10;
+    call->return_value = 1;
+    call->return_type = bonk::HIRDataType::dword;
+
+    caller_block->instructions = {
+        caller_block->instruction<bonk::HIRLabelInstruction>(0),
+        caller_block->instruction<bonk::HIRConstantLoadInstruction>(0, (int64_t)7),
+        parameter,
+        call,
+        caller_block->instruction<bonk::HIRReturnInstruction>(1),
+    };
+
+    // Imported callee: a < 10 and { bonk a * 2; }; bonk 5;
+    ir_program->create_procedure();
+    auto callee = ir_program->procedures.back().get();
+    callee->procedure_id = 10;
+    callee->is_imported = true;
+    callee->parameters = {{bonk::HIRDataType::dword, 0}};
+    callee->create_base_block();
+    auto callee_block = callee->base_blocks[0].get();
+
+    callee_block->instructions = {
+        callee_block->instruction<bonk::HIRLabelInstruction>(0),
+        callee_block->instruction<bonk::HIRConstantLoadInstruction>(1, (int64_t)10),
+        operation(callee_block, 2, 0, 1, bonk::HIROperationType::less),
+        callee_block->instruction<bonk::HIRJumpNZInstruction>(2, 1, 2),
+
+        callee_block->instruction<bonk::HIRLabelInstruction>(1),
+        callee_block->instruction<bonk::HIRConstantLoadInstruction>(3, (int64_t)2),
+        operation(callee_block, 4, 0, 3, bonk::HIROperationType::multiply),
+        callee_block->instruction<bonk::HIRReturnInstruction>(4),
+
+        callee_block->instruction<bonk::HIRLabelInstruction>(2),
+        callee_block->instruction<bonk::HIRConstantLoadInstruction>(5, (int64_t)5),
+        callee_block->instruction<bonk::HIRReturnInstruction>(5),
+    };
+
+    bonk::HIRVariableIndexCompressor().compress(*ir_program);
+    bonk::HIRBaseBlockSeparator().separate_blocks(*ir_program);
+    bonk::HIRSSAConverter().convert(*ir_program);
+    bonk::HIRInliner().inline_calls(*ir_program);
+
+    bonk::HIRPrinter printer(output_stream);
+    printer.print(*ir_program);
+
+    // The imported procedure is not a part of this module
+    ASSERT_EQ(ir_program->procedures.size(), 1);
+
+    int calls = 0;
+    int phis = 0;
+
+    for (auto& block : caller->base_blocks) {
+        for (auto& instruction : block->instructions) {
+            if (instruction->type == bonk::HIRInstructionType::call) {
+                calls++;
+            }
+            if (instruction->type == bonk::HIRInstructionType::phi_function) {
+                phis++;
+                EXPECT_EQ(((bonk::HIRPhiFunctionInstruction*)instruction)->sources.size(), 2);
+            }
+        }
+    }
+
+    // Both returns of the callee meet in the continuation block
+    EXPECT_EQ(calls, 0);
+    EXPECT_EQ(phis, 1);
+
+    // The argument is known, so the whole call folds to a constant
+    bonk::HIRConstantPropagation().propagate_constants(*caller);
+
+    std::unordered_map<bonk::IRRegister, long long> constants;
+    std::optional<bonk::IRRegister> return_value;
+
+    for (auto& block : caller->base_blocks) {
+        for (auto& instruction : block->instructions) {
+            if (instruction->type == bonk::HIRInstructionType::constant_load) {
+                auto constant_load = (bonk::HIRConstantLoadInstruction*)instruction;
+                constants[constant_load->target] = constant_load->constant;
+            }
+            if (instruction->type == bonk::HIRInstructionType::return_op) {
+                return_value = ((bonk::HIRReturnInstruction*)instruction)->return_value;
+            }
+        }
+    }
+
+    ASSERT_TRUE(return_value.has_value());
+    ASSERT_TRUE(constants.count(*return_value));
+    EXPECT_EQ(constants[*return_value], 14);
+}
+
+TEST(MiddleEnd, RefCountElisionTest) {
+    auto error_stream = bonk::StdOutputStream(std::cerr);
+
+    bonk::CompilerConfig config{.error_file = error_stream};
+    bonk::Compiler compiler(config);
+
+    bonk::FrontEnd front_end(compiler);
+    bonk::IDTable id_table(front_end);
+    bonk::SymbolTable symbol_table;
+    auto ir_program = std::make_unique<bonk::HIRProgram>(id_table, symbol_table);
+
+    ir_program->create_procedure();
+    auto procedure = ir_program->procedures.back().get();
+    procedure->procedure_id = 10;
+    procedure->parameters = {{bonk::HIRDataType::dword, 0}};
+    procedure->create_base_block();
+    auto block = procedure->base_blocks[0].get();
+
+    auto inc = [&](bonk::IRRegister register_id) {
+        auto instruction = block->instruction<bonk::HIRIncRefCounterInstruction>();
+        instruction->address = register_id;
+        return instruction;
+    };
+
+    auto dec = [&](bonk::IRRegister register_id) {
+        auto instruction = block->instruction<bonk::HIRDecRefCounterInstruction>();
+        instruction->address = register_id;
+        return instruction;
+    };
+
+    auto load = block->instruction<bonk::HIRMemoryLoadInstruction>(1, 0, bonk::HIRDataType::dword);
+
+    auto parameter = block->instruction<bonk::HIRParameterInstruction>();
+    parameter->parameter = 1;
+    parameter->type = bonk::HIRDataType::dword;
+
+    // Unknown procedure, which may destroy any hive passed to it
+    auto call = block->instruction<bonk::HIRCallInstruction>();
+    call->procedure_label_id = 20;
+
+    block->instructions = {
+        block->instruction<bonk::HIRLabelInstruction>(0),
+        inc(0),
+        block->instruction<bonk::HIRConstantLoadInstruction>(2, (int64_t)0),
+        inc(2),
+        load,
+        inc(1),
+        dec(2),
+        block->instruction<bonk::HIRConstantLoadInstruction>(3, (int64_t)1),
+        block->instruction<bonk::HIRJumpNZInstruction>(3, 1, 2),
+
+        block->instruction<bonk::HIRLabelInstruction>(1),
+        dec(1),
+        dec(0),
+        block->instruction<bonk::HIRReturnInstruction>(),
+
+        block->instruction<bonk::HIRLabelInstruction>(2),
+        parameter,
+        call,
+        dec(1),
+        dec(0),
+        block->instruction<bonk::HIRReturnInstruction>(),
+    };
+
+    // Procedure that never writes memory and never releases anything
+    ir_program->create_procedure();
+    auto reader = ir_program->procedures.back().get();
+    reader->procedure_id = 30;
+    reader->parameters = {{bonk::HIRDataType::dword, 0}};
+    reader->create_base_block();
+    auto reader_block = reader->base_blocks[0].get();
+
+    auto reader_inc = reader_block->instruction<bonk::HIRIncRefCounterInstruction>();
+    reader_inc->address = 1;
+    auto reader_dec = reader_block->instruction<bonk::HIRDecRefCounterInstruction>();
+    reader_dec->address = 1;
+
+    reader_block->instructions = {
+        reader_block->instruction<bonk::HIRLabelInstruction>(0),
+        reader_block->instruction<bonk::HIRMemoryLoadInstruction>(1, 0, bonk::HIRDataType::dword),
+        reader_inc,
+        reader_dec,
+        reader_block->instruction<bonk::HIRReturnInstruction>(),
+    };
+
+    bonk::HIRVariableIndexCompressor().compress(*ir_program);
+    bonk::HIRBaseBlockSeparator().separate_blocks(*ir_program);
+    bonk::HIRSSAConverter().convert(*ir_program);
+
+    bonk::HIRRefCountElider elider;
+    elider.elide(*ir_program);
+
+    EXPECT_FALSE(elider.get_summary(30).may_release);
+    EXPECT_FALSE(elider.get_summary(30).may_store);
+    EXPECT_TRUE(elider.get_summary(10).may_release);
+
+    // The parameter and the null constant are not counted at all. The loaded
+    // hive is only counted on the branch which calls the unknown procedure.
+    for (auto& procedure_block : procedure->base_blocks) {
+        int ref_count_operations = 0;
+        bool has_call = false;
+
+        for (auto instruction : procedure_block->instructions) {
+            if (instruction->type == bonk::HIRInstructionType::inc_ref_counter ||
+                instruction->type == bonk::HIRInstructionType::dec_ref_counter) {
+                EXPECT_EQ(instruction->get_read_register(0), load->target);
+                ref_count_operations++;
+            }
+            if (instruction->type == bonk::HIRInstructionType::call) {
+                has_call = true;
+            }
+        }
+
+        EXPECT_EQ(ref_count_operations, has_call ? 2 : 0);
+    }
+
+    for (auto& reader_block : reader->base_blocks) {
+        for (auto instruction : reader_block->instructions) {
+            EXPECT_NE(instruction->type, bonk::HIRInstructionType::inc_ref_counter);
+            EXPECT_NE(instruction->type, bonk::HIRInstructionType::dec_ref_counter);
+        }
+    }
+}
+
+TEST(MiddleEnd, HeldRefCountElisionTest) {
+    auto error_stream = bonk::StdOutputStream(std::cerr);
+
+    bonk::CompilerConfig config{.error_file = error_stream};
+    bonk::Compiler compiler(config);
+
+    bonk::FrontEnd front_end(compiler);
+    bonk::IDTable id_table(front_end);
+    bonk::SymbolTable symbol_table;
+    auto ir_program = std::make_unique<bonk::HIRProgram>(id_table, symbol_table);
+
+    ir_program->create_procedure();
+    auto procedure = ir_program->procedures.back().get();
+    procedure->procedure_id = 10;
+    procedure->create_base_block();
+    auto block = procedure->base_blocks[0].get();
+
+    auto inc = [&](bonk::IRRegister register_id) {
+        auto instruction = block->instruction<bonk::HIRIncRefCounterInstruction>();
+        instruction->address = register_id;
+        return instruction;
+    };
+
+    auto dec = [&](bonk::IRRegister register_id) {
+        auto instruction = block->instruction<bonk::HIRDecRefCounterInstruction>();
+        instruction->address = register_id;
+        return instruction;
+    };
+
+    // Passes the register to an unknown procedure, which may destroy any hive
+    auto pass = [&](bonk::IRRegister register_id) {
+        auto parameter = block->instruction<bonk::HIRParameterInstruction>();
+        parameter->parameter = register_id;
+        parameter->type = bonk::HIRDataType::dword;
+        auto call = block->instruction<bonk::HIRCallInstruction>();
+        call->procedure_label_id = 30;
+        return std::vector<bonk::HIRInstruction*>{parameter, call};
+    };
+
+    auto create = block->instruction<bonk::HIRCallInstruction>();
+    create->procedure_label_id = 20;
+    create->return_value = 0;
+    create->return_type = bonk::HIRDataType::dword;
+
+    auto owned_pass = pass(0);
+    auto borrowed_pass = pass(1);
+
+    block->instructions = {
+        block->instruction<bonk::HIRLabelInstruction>(0),
+        create,
+        inc(0),
+        owned_pass[0],
+        owned_pass[1],
+        dec(0),
+        block->instruction<bonk::HIRMemoryLoadInstruction>(1, 0, bonk::HIRDataType::dword),
+        inc(1),
+        borrowed_pass[0],
+        borrowed_pass[1],
+        dec(1),
+        dec(0),
+        block->instruction<bonk::HIRReturnInstruction>(),
+    };
+
+    bonk::HIRVariableIndexCompressor().compress(*ir_program);
+    bonk::HIRBaseBlockSeparator().separate_blocks(*ir_program);
+    bonk::HIRSSAConverter().convert(*ir_program);
+    bonk::HIRRefCountElider().elide(*ir_program);
+
+    // The procedure owns the created hive, so passing it needs no reference of
+    // its own. The loaded hive may be destroyed by the call, so it is counted.
+    int increments = 0;
+    int decrements = 0;
+    for (auto& procedure_block : procedure->base_blocks) {
+        for (auto instruction : procedure_block->instructions) {
+            if (instruction->type == bonk::HIRInstructionType::inc_ref_counter) {
+                EXPECT_EQ(instruction->get_read_register(0), 1);
+                increments++;
+            }
+            if (instruction->type == bonk::HIRInstructionType::dec_ref_counter) {
+                decrements++;
+            }
+        }
+    }
+
+    EXPECT_EQ(increments, 1);
+    EXPECT_EQ(decrements, 2);
+}
+
+TEST(MiddleEnd, NullCheckEliminationTest) {
+    auto error_stream = bonk::StdOutputStream(std::cerr);
+
+    bonk::CompilerConfig config{.error_file = error_stream};
+    bonk::Compiler compiler(config);
+
+    bonk::FrontEnd front_end(compiler);
+    bonk::IDTable id_table(front_end);
+    bonk::SymbolTable symbol_table;
+    auto ir_program = std::make_unique<bonk::HIRProgram>(id_table, symbol_table);
+
+    ir_program->create_procedure();
+    auto& ir_procedure = ir_program->procedures[0];
+    ir_procedure->create_base_block();
+    auto& block = ir_procedure->base_blocks[0];
+
+    auto operation = [&](bonk::IRRegister target, bonk::IRRegister left, bonk::IRRegister right,
+                         bonk::HIROperationType type) {
+        auto instruction = block->instruction<bonk::HIROperationInstruction>();
+        instruction->target = target;
+        instruction->left = left;
+        instruction->right = right;
+        instruction->operation_type = type;
+        instruction->operand_type = bonk::HIRDataType::dword;
+        instruction->result_type = bonk::HIRDataType::word;
+        return instruction;
+    };
+
+    auto inc = [&](bonk::IRRegister register_id) {
+        auto instruction = block->instruction<bonk::HIRIncRefCounterInstruction>();
+        instruction->address = register_id;
+        return instruction;
+    };
+
+    auto dec = [&](bonk::IRRegister register_id) {
+        auto instruction = block->instruction<bonk::HIRDecRefCounterInstruction>();
+        instruction->address = register_id;
+        return instruction;
+    };
+
+    block->instructions = {
+        block->instruction<bonk::HIRLabelInstruction>(0),
+        block->instruction<bonk::HIRConstantLoadInstruction>(1, (int64_t)0),
+        block->instruction<bonk::HIRMemoryLoadInstruction>(0, 1, bonk::HIRDataType::dword),
+        operation(2, 0, 1, bonk::HIROperationType::not_equal),
+        block->instruction<bonk::HIRJumpNZInstruction>(2, 1, 2),
+
+        // %0 was just compared with null, so the second comparison is redundant
+        block->instruction<bonk::HIRLabelInstruction>(1),
+        inc(0),
+        operation(3, 0, 1, bonk::HIROperationType::equal),
+        block->instruction<bonk::HIRJumpNZInstruction>(3, 2, 3),
+
+        block->instruction<bonk::HIRLabelInstruction>(2),
+        inc(0),
+        block->instruction<bonk::HIRReturnInstruction>(),
+
+        block->instruction<bonk::HIRLabelInstruction>(3),
+        dec(0),
+        block->instruction<bonk::HIRReturnInstruction>(),
+    };
+
+    bonk::HIRVariableIndexCompressor().compress(*ir_procedure);
+    bonk::HIRBaseBlockSeparator().separate_blocks(*ir_program);
+    bonk::HIRSSAConverter().convert(*ir_procedure);
+    bonk::HIRNullCheckEliminator().eliminate_null_checks(*ir_procedure);
+
+    int jumps_nz = 0;
+    int checked = 0;
+    int unchecked = 0;
+
+    for (auto& procedure_block : ir_procedure->base_blocks) {
+        for (auto instruction : procedure_block->instructions) {
+            bool never_null = false;
+            if (instruction->type == bonk::HIRInstructionType::jump_nz) {
+                jumps_nz++;
+                continue;
+            } else if (instruction->type == bonk::HIRInstructionType::inc_ref_counter) {
+                never_null = ((bonk::HIRIncRefCounterInstruction*)instruction)->never_null;
+            } else if (instruction->type == bonk::HIRInstructionType::dec_ref_counter) {
+                never_null = ((bonk::HIRDecRefCounterInstruction*)instruction)->never_null;
+            } else {
+                continue;
+            }
+
+            if (never_null) {
+                unchecked++;
+            } else {
+                checked++;
+            }
+        }
+    }
+
+    // The block with the second increment is also reached when %0 is null
+    EXPECT_EQ(jumps_nz, 1);
+    EXPECT_EQ(checked, 1);
+    EXPECT_EQ(unchecked, 2);
+}
+
+// Passes that work with hives need their definitions from the front end, so
+// their tests start from the source. The program is brought to SSA form, and
+// its reference counter operations are optimized like the middle end does.
+static std::unique_ptr<bonk::HIRProgram> compile_to_ssa(bonk::Compiler& compiler,
+                                                        bonk::FrontEnd& front_end,
+                                                        bonk::AST& ast, const char* source) {
+    auto lexemes = bonk::Lexer(compiler).parse_file("test", source);
+    if (lexemes.empty()) {
+        return nullptr;
+    }
+
+    ast.root = bonk::Parser(compiler).parse_file(&lexemes);
+    if (!ast.root || !front_end.transform_ast(ast)) {
+        return nullptr;
+    }
+
+    auto ir_program = front_end.generate_hir(ast.root.get());
+    if (!ir_program) {
+        return nullptr;
+    }
+
+    bonk::HIRVariableIndexCompressor().compress(*ir_program);
+    bonk::HIRBaseBlockSeparator().separate_blocks(*ir_program);
+    bonk::HIRSSAConverter().convert(*ir_program);
+    bonk::HIRCopyPropagation().propagate_copies(*ir_program);
+    bonk::HIRUnusedDefDeleter().delete_unused_defs(*ir_program);
+    bonk::HIRRefCountReducer().reduce(*ir_program);
+    bonk::HIRRefCountElider().elide(*ir_program);
+    return ir_program;
+}
+
+static bonk::HIRProcedure* find_procedure(bonk::HIRProgram& program, std::string_view name) {
+    for (auto& procedure : program.procedures) {
+        auto definition = program.id_table.get_node(procedure->procedure_id);
+        if (definition && definition->type == bonk::TreeNodeType::n_block_definition &&
+            ((bonk::TreeNodeBlockDefinition*)definition)->block_name->identifier_text == name) {
+            return procedure.get();
+        }
+    }
+    return nullptr;
+}
+
+static int count_instructions(bonk::HIRProcedure& procedure, bonk::HIRInstructionType type) {
+    int count = 0;
+    for (auto& block : procedure.base_blocks) {
+        for (auto instruction : block->instructions) {
+            if (instruction->type == type) {
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+static bonk::HIRCallInstruction* find_constructor_call(bonk::HIRProcedure& procedure) {
+    auto& front_end = procedure.program.id_table.front_end;
+    for (auto& block : procedure.base_blocks) {
+        for (auto instruction : block->instructions) {
+            if (instruction->type != bonk::HIRInstructionType::call) {
+                continue;
+            }
+            auto call = (bonk::HIRCallInstruction*)instruction;
+            auto callee = procedure.program.id_table.get_node(call->procedure_label_id);
+            if (front_end.get_constructed_hive(callee)) {
+                return call;
+            }
+        }
+    }
+    return nullptr;
+}
+
+TEST(MiddleEnd, StackPromotionTest) {
+    auto error_stream = bonk::StdOutputStream(std::cerr);
+
+    bonk::CompilerConfig config{.error_file = error_stream};
+    bonk::Compiler compiler(config);
+    bonk::FrontEnd front_end(compiler);
+    bonk::AST ast;
+
+    const char* source = R"(
+        hive Point {
+            bowl x = 0;
+            bowl y = 0;
+        }
+
+        hive Holder {
+            bowl point: Point = null;
+        }
+
+        blok use[bowl point: Point]: nubr;
+
+        blok local: nubr {
+            bowl point = @Point[x = 1, y = 2];
+            bonk x of point + y of point;
+        }
+
+        blok holder: nubr {
+            bowl point = @Point[x = 1, y = 2];
+            bowl holder = @Holder[point = point];
+            bonk x of point of holder;
+        }
+
+        blok stored[bowl holder: Holder] {
+            point of holder = @Point[x = 1, y = 2];
+        }
+
+        blok returned: Point {
+            bonk @Point[x = 1, y = 2];
+        }
+
+        blok passed: nubr {
+            bowl point = @Point[x = 1, y = 2];
+            bonk @use[point = point];
+        }
+    )";
+
+    auto ir_program = compile_to_ssa(compiler, front_end, ast, source);
+    ASSERT_NE(ir_program, nullptr);
+
+    bonk::HIRStackPromoter().promote(*ir_program);
+
+    // The hive is only read by its constructing blok. Its constructor is
+    // replaced with a stack slot and field stores, and it is not counted.
+    auto local = find_procedure(*ir_program, "local");
+    ASSERT_NE(local, nullptr);
+    EXPECT_EQ(find_constructor_call(*local), nullptr);
+    EXPECT_EQ(count_instructions(*local, bonk::HIRInstructionType::stack_alloc), 1);
+    EXPECT_EQ(count_instructions(*local, bonk::HIRInstructionType::inc_ref_counter), 0);
+    EXPECT_EQ(count_instructions(*local, bonk::HIRInstructionType::dec_ref_counter), 0);
+
+    // The point is passed to the constructor of the holder, so only the
+    // holder is promoted, and it releases the point when it is released
+    auto holder = find_procedure(*ir_program, "holder");
+    ASSERT_NE(holder, nullptr);
+    EXPECT_EQ(count_instructions(*holder, bonk::HIRInstructionType::stack_alloc), 1);
+    EXPECT_NE(find_constructor_call(*holder), nullptr);
+    EXPECT_GE(count_instructions(*holder, bonk::HIRInstructionType::dec_ref_counter), 1);
+
+    // Hives that are stored, returned or passed to a call outlive the blok
+    for (auto name : {"stored", "returned", "passed"}) {
+        auto procedure = find_procedure(*ir_program, name);
+        ASSERT_NE(procedure, nullptr) << name;
+        EXPECT_NE(find_constructor_call(*procedure), nullptr) << name;
+        EXPECT_EQ(count_instructions(*procedure, bonk::HIRInstructionType::stack_alloc), 0)
+            << name;
+    }
+}
+
+TEST(MiddleEnd, StackPromotionCounterMismatchTest) {
+    auto error_stream = bonk::StdOutputStream(std::cerr);
+
+    bonk::CompilerConfig config{.error_file = error_stream};
+    bonk::Compiler compiler(config);
+    bonk::FrontEnd front_end(compiler);
+    bonk::AST ast;
+
+    const char* source = R"(
+        hive Point {
+            bowl x = 0;
+            bowl y = 0;
+        }
+
+        blok agreeing[bowl f: nubr]: nubr {
+            bowl point = @Point[x = 1, y = 2];
+            bowl result = 0;
+            f > 0 and { result = x of point; };
+            bonk result + y of point;
+        }
+
+        blok disagreeing[bowl f: nubr]: nubr {
+            bowl point = @Point[x = 1, y = 2];
+            bowl result = 0;
+            f > 0 and { result = x of point; };
+            bonk result + y of point;
+        }
+    )";
+
+    auto ir_program = compile_to_ssa(compiler, front_end, ast, source);
+    ASSERT_NE(ir_program, nullptr);
+
+    auto agreeing = find_procedure(*ir_program, "agreeing");
+    auto disagreeing = find_procedure(*ir_program, "disagreeing");
+    ASSERT_NE(agreeing, nullptr);
+    ASSERT_NE(disagreeing, nullptr);
+
+    // Take one more reference to the point in the taken arm only. The
+    // counter then depends on the path at the join, so the decrement that
+    // releases the hive is not known.
+    auto call = find_constructor_call(*disagreeing);
+    ASSERT_NE(call, nullptr);
+
+    bonk::HIRBaseBlock* arm = nullptr;
+    for (auto& block : disagreeing->base_blocks) {
+        if (!block->instructions.empty() &&
+            block->instructions.back()->type == bonk::HIRInstructionType::jump_nz) {
+            arm = block->successors[0];
+        }
+    }
+    ASSERT_NE(arm, nullptr);
+
+    auto increment = disagreeing->instruction<bonk::HIRIncRefCounterInstruction>();
+    increment->address = *call->return_value;
+    arm->instructions.insert(std::prev(arm->instructions.end()), increment);
+
+    bonk::HIRStackPromoter().promote(*ir_program);
+
+    EXPECT_EQ(find_constructor_call(*agreeing), nullptr);
+    EXPECT_EQ(count_instructions(*agreeing, bonk::HIRInstructionType::stack_alloc), 1);
+
+    EXPECT_EQ(find_constructor_call(*disagreeing), call);
+    EXPECT_EQ(count_instructions(*disagreeing, bonk::HIRInstructionType::stack_alloc), 0);
+}
+
+static std::vector<bonk::HIRCallInstruction*> find_calls(bonk::HIRProcedure& procedure) {
+    std::vector<bonk::HIRCallInstruction*> calls;
+    for (auto& block : procedure.base_blocks) {
+        for (auto instruction : block->instructions) {
+            if (instruction->type == bonk::HIRInstructionType::call) {
+                calls.push_back((bonk::HIRCallInstruction*)instruction);
+            }
+        }
+    }
+    return calls;
+}
+
+TEST(MiddleEnd, TailCallEliminationTest) {
+    auto error_stream = bonk::StdOutputStream(std::cerr);
+
+    bonk::CompilerConfig config{.error_file = error_stream};
+    bonk::Compiler compiler(config);
+    bonk::FrontEnd front_end(compiler);
+    bonk::AST ast;
+
+    const char* source = R"(
+        hive Counter {
+            bowl steps = 0;
+        }
+
+        blok use[bowl counter: Counter]: nubr;
+
+        blok count[bowl n: nubr, bowl total: nubr]: nubr {
+            n == 0 and { bonk total; };
+            bonk @count[n = n - 1, total = total + 2];
+        }
+
+        blok forward[bowl n: nubr]: nubr {
+            bonk @count[n = n, total = 0];
+        }
+
+        blok released: nubr {
+            bowl counter = @Counter;
+            bonk @use[counter = counter];
+        }
+    )";
+
+    auto ir_program = compile_to_ssa(compiler, front_end, ast, source);
+    ASSERT_NE(ir_program, nullptr);
+
+    auto released = find_procedure(*ir_program, "released");
+    ASSERT_NE(released, nullptr);
+
+    // The counter is released after the call, otherwise the test is moot
+    ASSERT_GE(count_instructions(*released, bonk::HIRInstructionType::dec_ref_counter), 1);
+
+    bonk::HIRTailCallEliminator().eliminate_tail_calls(*ir_program);
+
+    // The self tail call becomes a back edge to a loop header, where the
+    // parameters are selected by phi functions
+    auto count = find_procedure(*ir_program, "count");
+    ASSERT_NE(count, nullptr);
+    EXPECT_TRUE(find_calls(*count).empty());
+
+    auto& start_block = *count->base_blocks[count->start_block_index];
+    ASSERT_EQ(start_block.successors.size(), 1);
+    auto header = start_block.successors[0];
+
+    ASSERT_EQ(header->predecessors.size(), 2);
+    EXPECT_EQ(header->predecessors[0], &start_block);
+    auto back_edge = header->predecessors[1];
+    ASSERT_EQ(back_edge->successors.size(), 1);
+    EXPECT_EQ(back_edge->successors[0], header);
+    ASSERT_EQ(back_edge->instructions.back()->type, bonk::HIRInstructionType::jump);
+    EXPECT_EQ(((bonk::HIRJumpInstruction*)back_edge->instructions.back())->label_id,
+              header->index);
+
+    ASSERT_EQ(count_phi_functions(*header), count->parameters.size());
+    auto phi_it = header->instructions.begin();
+    for (auto& parameter : count->parameters) {
+        auto phi = (bonk::HIRPhiFunctionInstruction*)*phi_it++;
+        ASSERT_EQ(phi->sources.size(), 2);
+        EXPECT_EQ(phi->sources[0], parameter.register_id);
+        EXPECT_NE(phi->sources[1], parameter.register_id);
+
+        // The body reads the phi functions instead of the parameters
+        for (auto& block : count->base_blocks) {
+            if (block.get() == &start_block || block.get() == header) {
+                continue;
+            }
+            for (auto instruction : block->instructions) {
+                for (int i = 0; i < instruction->get_read_register_count(); i++) {
+                    EXPECT_NE(instruction->get_read_register(i), parameter.register_id);
+                }
+            }
+        }
+    }
+    expect_single_assignment(*count);
+
+    // A tail call to another blok is left for the backend
+    auto forward = find_procedure(*ir_program, "forward");
+    ASSERT_NE(forward, nullptr);
+    auto forward_calls = find_calls(*forward);
+    ASSERT_EQ(forward_calls.size(), 1);
+    EXPECT_TRUE(forward_calls[0]->is_tail_call);
+
+    // The release of the counter follows the call, so the call is not in tail position
+    for (auto call : find_calls(*released)) {
+        EXPECT_FALSE(call->is_tail_call);
+    }
+}
+
+TEST(MiddleEnd, JumpThreadingTest) {
+    auto error_stream = bonk::StdOutputStream(std::cerr);
+
+    bonk::CompilerConfig config{.error_file = error_stream};
+    bonk::Compiler compiler(config);
+
+    bonk::FrontEnd front_end(compiler);
+    bonk::IDTable id_table(front_end);
+    bonk::SymbolTable symbol_table;
+    auto ir_program = std::make_unique<bonk::HIRProgram>(id_table, symbol_table);
+
+    ir_program->create_procedure();
+    auto& ir_procedure = ir_program->procedures[0];
+    ir_procedure->create_base_block();
+    auto& block = ir_procedure->base_blocks[0];
+
+    // %3 = %0 and %2, followed by a test of %3, like the lazy logic compiles it
+    block->instructions = {
+        block->instruction<bonk::HIRLabelInstruction>(0),
+        block->instruction<bonk::HIRConstantLoadInstruction>(1, (int64_t)0),
+        block->instruction<bonk::HIRMemoryLoadInstruction>(0, 1, bonk::HIRDataType::word),
+        block->instruction<bonk::HIRJumpNZInstruction>(0, 1, 2),
+
+        block->instruction<bonk::HIRLabelInstruction>(1),
+        block->instruction<bonk::HIRMemoryLoadInstruction>(2, 1, bonk::HIRDataType::word),
+        &block->instruction<bonk::HIROperationInstruction>()->set_assign(3, 2,
+                                                                         bonk::HIRDataType::word),
+        block->instruction<bonk::HIRJumpInstruction>(3),
+
+        // %0 is known to be zero here, so the test of %3 can be skipped
+        block->instruction<bonk::HIRLabelInstruction>(2),
+        &block->instruction<bonk::HIROperationInstruction>()->set_assign(3, 0,
+                                                                         bonk::HIRDataType::word),
+        block->instruction<bonk::HIRJumpInstruction>(3),
+
+        block->instruction<bonk::HIRLabelInstruction>(3),
+        block->instruction<bonk::HIRJumpNZInstruction>(3, 4, 5),
+
+        block->instruction<bonk::HIRLabelInstruction>(4),
+        block->instruction<bonk::HIRReturnInstruction>(),
+
+        block->instruction<bonk::HIRLabelInstruction>(5),
+        block->instruction<bonk::HIRReturnInstruction>(),
+    };
+
+    bonk::HIRVariableIndexCompressor().compress(*ir_procedure);
+    bonk::HIRBaseBlockSeparator().separate_blocks(*ir_program);
+    bonk::HIRSSAConverter().convert(*ir_procedure);
+    bonk::HIRCopyPropagation().propagate_copies(*ir_procedure);
+    bonk::HIRJumpThreader().thread_jumps(*ir_procedure);
+
+    // The block separator adds an entry block in front of the others
+    auto& zero_block = ir_procedure->base_blocks[3];
+    auto& join_block = ir_procedure->base_blocks[4];
+    auto& false_block = ir_procedure->base_blocks[6];
+
+    ASSERT_EQ(zero_block->instructions.back()->type, bonk::HIRInstructionType::jump);
+    EXPECT_EQ(((bonk::HIRJumpInstruction*)zero_block->instructions.back())->label_id, 6);
+
+    ASSERT_EQ(zero_block->successors.size(), 1);
+    EXPECT_EQ(zero_block->successors[0], false_block.get());
+
+    ASSERT_EQ(join_block->predecessors.size(), 1);
+    EXPECT_EQ(join_block->predecessors[0], ir_procedure->base_blocks[2].get());
+
+    ASSERT_EQ(join_block->instructions.front()->type, bonk::HIRInstructionType::phi_function);
+    EXPECT_EQ(((bonk::HIRPhiFunctionInstruction*)join_block->instructions.front())->sources.size(),
+              1);
+}
+
+TEST(MiddleEnd, IfConversionTest) {
+    auto error_stream = bonk::StdOutputStream(std::cerr);
+
+    bonk::CompilerConfig config{.error_file = error_stream};
+    bonk::Compiler compiler(config);
+
+    bonk::FrontEnd front_end(compiler);
+    bonk::IDTable id_table(front_end);
+    bonk::SymbolTable symbol_table;
+    auto ir_program = std::make_unique<bonk::HIRProgram>(id_table, symbol_table);
+
+    ir_program->create_procedure();
+    auto& ir_procedure = ir_program->procedures[0];
+    ir_procedure->create_base_block();
+    auto& block = ir_procedure->base_blocks[0];
+
+    auto sum = block->instruction<bonk::HIROperationInstruction>();
+    sum->target = 3;
+    sum->left = 2;
+    sum->right = 2;
+    sum->operand_type = bonk::HIRDataType::word;
+    sum->result_type = bonk::HIRDataType::word;
+
+    auto return_instruction = block->instruction<bonk::HIRReturnInstruction>(3);
+    return_instruction->return_type = bonk::HIRDataType::word;
+
+    // %3 = %0 ? %2 + %2 : %2, with both arms free of side effects
+    block->instructions = {
+        block->instruction<bonk::HIRLabelInstruction>(0),
+        block->instruction<bonk::HIRConstantLoadInstruction>(1, (int64_t)0),
+        block->instruction<bonk::HIRMemoryLoadInstruction>(0, 1, bonk::HIRDataType::word),
+        block->instruction<bonk::HIRMemoryLoadInstruction>(2, 1, bonk::HIRDataType::word),
+        block->instruction<bonk::HIRJumpNZInstruction>(0, 1, 2),
+
+        block->instruction<bonk::HIRLabelInstruction>(1),
+        sum,
+        block->instruction<bonk::HIRJumpInstruction>(3),
+
+        block->instruction<bonk::HIRLabelInstruction>(2),
+        &block->instruction<bonk::HIROperationInstruction>()->set_assign(3, 2,
+                                                                         bonk::HIRDataType::word),
+        block->instruction<bonk::HIRJumpInstruction>(3),
+
+        block->instruction<bonk::HIRLabelInstruction>(3),
+        return_instruction,
+    };
+
+    bonk::HIRVariableIndexCompressor().compress(*ir_procedure);
+    bonk::HIRBaseBlockSeparator().separate_blocks(*ir_program);
+    bonk::HIRSSAConverter().convert(*ir_procedure);
+    bonk::HIRIfConverter().convert(*ir_procedure);
+
+    int jumps_nz = 0;
+    bonk::HIRSelectInstruction* select = nullptr;
+
+    for (auto& base_block : ir_procedure->base_blocks) {
+        for (auto instruction : base_block->instructions) {
+            if (instruction->type == bonk::HIRInstructionType::jump_nz) {
+                jumps_nz++;
+            } else if (instruction->type == bonk::HIRInstructionType::select) {
+                select = (bonk::HIRSelectInstruction*)instruction;
+            } else {
+                EXPECT_NE(instruction->type, bonk::HIRInstructionType::phi_function);
+            }
+        }
+    }
+
+    EXPECT_EQ(jumps_nz, 0);
+    ASSERT_NE(select, nullptr);
+    EXPECT_EQ(select->type, bonk::HIRDataType::word);
+
+    // Only the entry block, the block that held the jnz and the join are left.
+    // The join returns, so it stays the end block.
+    EXPECT_EQ(ir_procedure->base_blocks.size(), 3);
+}
+
+TEST(MiddleEnd, InstructionCombiningTest) {
+    auto error_stream = bonk::StdOutputStream(std::cerr);
+
+    bonk::CompilerConfig config{.error_file = error_stream};
+    bonk::Compiler compiler(config);
+
+    bonk::FrontEnd front_end(compiler);
+    bonk::IDTable id_table(front_end);
+    bonk::SymbolTable symbol_table;
+    auto ir_program = std::make_unique<bonk::HIRProgram>(id_table, symbol_table);
+
+    ir_program->create_procedure();
+    auto& ir_procedure = ir_program->procedures[0];
+    ir_procedure->create_base_block();
+    auto& block = ir_procedure->base_blocks[0];
+
+    auto operation = [&](bonk::IRRegister target, bonk::IRRegister left, bonk::IRRegister right,
+                         bonk::HIROperationType type) {
+        auto instruction = block->instruction<bonk::HIROperationInstruction>();
+        instruction->target = target;
+        instruction->left = left;
+        instruction->right = right;
+        instruction->operation_type = type;
+        instruction->operand_type = bonk::HIRDataType::word;
+        instruction->result_type = bonk::HIRDataType::word;
+        return instruction;
+    };
+
+    block->instructions = {
+        block->instruction<bonk::HIRLabelInstruction>(0),
+        block->instruction<bonk::HIRConstantLoadInstruction>(1, 0, bonk::HIRDataType::word),
+        block->instruction<bonk::HIRMemoryLoadInstruction>(0, 1, bonk::HIRDataType::word),
+
+        // %3 = %0 * 8
+        block->instruction<bonk::HIRConstantLoadInstruction>(2, 8, bonk::HIRDataType::word),
+        operation(3, 0, 2, bonk::HIROperationType::multiply),
+
+        // %5 = %0 / 7
+        block->instruction<bonk::HIRConstantLoadInstruction>(4, 7, bonk::HIRDataType::word),
+        operation(5, 0, 4, bonk::HIROperationType::divide),
+
+        // %9 = (%0 - 3) + 5
+        block->instruction<bonk::HIRConstantLoadInstruction>(6, 3, bonk::HIRDataType::word),
+        operation(7, 0, 6, bonk::HIROperationType::minus),
+        block->instruction<bonk::HIRConstantLoadInstruction>(8, 5, bonk::HIRDataType::word),
+        operation(9, 7, 8, bonk::HIROperationType::plus),
+
+        // %10 = %0 - %0
+        operation(10, 0, 0, bonk::HIROperationType::minus),
+
+        // %11 = %9 * 1, used by %12
+        block->instruction<bonk::HIRConstantLoadInstruction>(13, 1, bonk::HIRDataType::word),
+        operation(11, 9, 13, bonk::HIROperationType::multiply),
+        operation(12, 11, 10, bonk::HIROperationType::plus),
+
+        block->instruction<bonk::HIRReturnInstruction>(),
+    };
+
+    bonk::HIRVariableIndexCompressor().compress(*ir_procedure);
+    bonk::HIRBaseBlockSeparator().separate_blocks(*ir_program);
+    bonk::HIRSSAConverter().convert(*ir_procedure);
+
+    // Registers are renamed above, so the operations are looked up by their
+    // position in the block instead
+    auto& combined_block = ir_procedure->base_blocks[1];
+    std::vector<bonk::HIRInstruction*> definitions;
+    for (auto instruction : combined_block->instructions) {
+        if (instruction->type == bonk::HIRInstructionType::operation) {
+            definitions.push_back(instruction);
+        }
+    }
+    ASSERT_EQ(definitions.size(), 7);
+
+    auto product = (bonk::HIROperationInstruction*)definitions[0];
+    auto quotient = (bonk::HIROperationInstruction*)definitions[1];
+    auto sum = (bonk::HIROperationInstruction*)definitions[3];
+    auto difference = (bonk::HIROperationInstruction*)definitions[4];
+    auto result = (bonk::HIROperationInstruction*)definitions[6];
+    bonk::IRRegister x = product->left;
+    bonk::IRRegister sum_register = sum->target;
+    bonk::IRRegister difference_register = difference->target;
+
+    bonk::HIRInstructionCombiner().combine(*ir_procedure);
+
+    int divisions = 0;
+    bonk::HIRInstruction* difference_definition = nullptr;
+    for (auto instruction : combined_block->instructions) {
+        if (instruction->type == bonk::HIRInstructionType::operation &&
+            ((bonk::HIROperationInstruction*)instruction)->operation_type ==
+                bonk::HIROperationType::divide) {
+            divisions++;
+        }
+        if (instruction->get_write_register_count() > 0 &&
+            instruction->get_write_register(0) == difference_register) {
+            difference_definition = instruction;
+        }
+    }
+
+    EXPECT_EQ(divisions, 0);
+    EXPECT_EQ(product->operation_type, bonk::HIROperationType::shift_left);
+    EXPECT_EQ(quotient->operation_type, bonk::HIROperationType::minus);
+
+    // The constants are re-associated into %0 + 2
+    EXPECT_EQ(sum->operation_type, bonk::HIROperationType::plus);
+    EXPECT_EQ(sum->left, x);
+
+    ASSERT_NE(difference_definition, nullptr);
+    ASSERT_EQ(difference_definition->type, bonk::HIRInstructionType::constant_load);
+    EXPECT_EQ(((bonk::HIRConstantLoadInstruction*)difference_definition)->constant, 0);
+
+    // The multiplication by one is skipped, and adding zero is folded too
+    EXPECT_EQ(result->operation_type, bonk::HIROperationType::assign);
+    EXPECT_EQ(result->left, sum_register);
+}
+
+TEST(MiddleEnd, ValueRangeTest) {
+    auto error_stream = bonk::StdOutputStream(std::cerr);
+
+    bonk::CompilerConfig config{.error_file = error_stream};
+    bonk::Compiler compiler(config);
+
+    bonk::FrontEnd front_end(compiler);
+    bonk::IDTable id_table(front_end);
+    bonk::SymbolTable symbol_table;
+    auto ir_program = std::make_unique<bonk::HIRProgram>(id_table, symbol_table);
+
+    ir_program->create_procedure();
+    auto& ir_procedure = ir_program->procedures[0];
+    ir_procedure->create_base_block();
+    auto& block = ir_procedure->base_blocks[0];
+
+    auto operation = [&](bonk::IRRegister target, bonk::IRRegister left, bonk::IRRegister right,
+                         bonk::HIROperationType type, bonk::HIRDataType result_type) {
+        auto instruction = block->instruction<bonk::HIROperationInstruction>();
+        instruction->target = target;
+        instruction->left = left;
+        instruction->right = right;
+        instruction->operation_type = type;
+        instruction->operand_type = bonk::HIRDataType::word;
+        instruction->result_type = result_type;
+        return instruction;
+    };
+
+    // for (%2 = 0; %2 < 10; %2 += 1) { if (%2 < 100) continue; return; }
+    block->instructions = {
+        block->instruction<bonk::HIRLabelInstruction>(0),
+        block->instruction<bonk::HIRConstantLoadInstruction>(0, 0, bonk::HIRDataType::word),
+        block->instruction<bonk::HIRConstantLoadInstruction>(1, 10, bonk::HIRDataType::word),
+        block->instruction<bonk::HIRConstantLoadInstruction>(5, 1, bonk::HIRDataType::word),
+        block->instruction<bonk::HIRConstantLoadInstruction>(6, 100, bonk::HIRDataType::word),
+        &block->instruction<bonk::HIROperationInstruction>()->set_assign(2, 0,
+                                                                         bonk::HIRDataType::word),
+        block->instruction<bonk::HIRJumpInstruction>(1),
+
+        block->instruction<bonk::HIRLabelInstruction>(1),
+        operation(3, 2, 1, bonk::HIROperationType::less, bonk::HIRDataType::byte),
+        block->instruction<bonk::HIRJumpNZInstruction>(3, 2, 3),
+
+        // %2 never reaches 100 here, so this test always passes
+        block->instruction<bonk::HIRLabelInstruction>(2),
+        operation(4, 2, 6, bonk::HIROperationType::less, bonk::HIRDataType::byte),
+        block->instruction<bonk::HIRJumpNZInstruction>(4, 4, 3),
+
+        block->instruction<bonk::HIRLabelInstruction>(4),
+        operation(2, 2, 5, bonk::HIROperationType::plus, bonk::HIRDataType::word),
+        block->instruction<bonk::HIRJumpInstruction>(1),
+
+        block->instruction<bonk::HIRLabelInstruction>(3),
+        block->instruction<bonk::HIRReturnInstruction>(),
+    };
+
+    bonk::HIRVariableIndexCompressor().compress(*ir_procedure);
+    bonk::HIRBaseBlockSeparator().separate_blocks(*ir_program);
+    bonk::HIRSSAConverter().convert(*ir_procedure);
+
+    // The block separator adds an entry block in front of the others
+    auto& header_block = ir_procedure->base_blocks[2];
+    auto& inner_block = ir_procedure->base_blocks[3];
+
+    ASSERT_EQ(header_block->instructions.front()->type, bonk::HIRInstructionType::phi_function);
+    auto counter = (bonk::HIRPhiFunctionInstruction*)header_block->instructions.front();
+
+    {
+        bonk::HIRDominatorFinder dominator_finder(*ir_procedure);
+        bonk::HIRValueRangeFinder range_finder(dominator_finder);
+
+        // The counter is widened at the loop header, and narrowed back by the
+        // exit condition
+        auto& range = range_finder.get_range(counter->target);
+        EXPECT_EQ(range.min, 0);
+        EXPECT_EQ(range.max, 10);
+
+        auto inner_range = range_finder.get_range_in_block(counter->target, *inner_block);
+        EXPECT_EQ(inner_range.min, 0);
+        EXPECT_EQ(inner_range.max, 9);
+    }
+
+    bonk::HIRValueRangePropagation().propagate_ranges(*ir_procedure);
+
+    // Blocks are numbered in the order they appear, so the increment is block 4
+    ASSERT_EQ(inner_block->instructions.back()->type, bonk::HIRInstructionType::jump);
+    EXPECT_EQ(((bonk::HIRJumpInstruction*)inner_block->instructions.back())->label_id, 4);
+    ASSERT_EQ(inner_block->successors.size(), 1);
+    EXPECT_EQ(inner_block->successors[0], ir_procedure->base_blocks[4].get());
+
+    // The header test depends on the counter, so it is kept
+    EXPECT_EQ(header_block->instructions.back()->type, bonk::HIRInstructionType::jump_nz);
+}
+
+TEST(MiddleEnd, ProcedureHasherTest) {
+    auto error_stream = bonk::StdOutputStream(std::cerr);
+
+    bonk::CompilerConfig config{.error_file = error_stream};
+    bonk::Compiler compiler(config);
+
+    bonk::FrontEnd front_end(compiler);
+    bonk::IDTable id_table(front_end);
+    bonk::SymbolTable symbol_table;
+    auto ir_program = std::make_unique<bonk::HIRProgram>(id_table, symbol_table);
+
+    bonk::TreeNodeIdentifier first_callee, second_callee;
+    symbol_table.symbol_names[&first_callee] = "first";
+    symbol_table.symbol_names[&second_callee] = "second";
+    int first_callee_id = id_table.get_id(&first_callee);
+    int second_callee_id = id_table.get_id(&second_callee);
+
+    auto create_procedure = [&](long long constant, int callee_id, unsigned int line) {
+        ir_program->create_procedure();
+        auto& procedure = ir_program->procedures.back();
+        procedure->create_base_block();
+        auto& block = procedure->base_blocks[0];
+
+        auto call = block->instruction<bonk::HIRCallInstruction>();
+        call->procedure_label_id = callee_id;
+
+        auto location = block->instruction<bonk::HIRLocationInstruction>();
+        location->line = line;
+
+        block->instructions = {
+            block->instruction<bonk::HIRLabelInstruction>(0),
+            location,
+            block->instruction<bonk::HIRConstantLoadInstruction>(0, (int64_t)constant),
+            call,
+            block->instruction<bonk::HIRReturnInstruction>(0),
+        };
+
+        bonk::HIRBaseBlockSeparator().separate_blocks(*procedure);
+        return procedure.get();
+    };
+
+    auto base = create_procedure(1, first_callee_id, 1);
+    auto same = create_procedure(1, first_callee_id, 1);
+    auto other_constant = create_procedure(2, first_callee_id, 1);
+    auto other_callee = create_procedure(1, second_callee_id, 1);
+    auto other_line = create_procedure(1, first_callee_id, 2);
+
+    bonk::HIRProcedureHasher hasher;
+    auto base_hash = hasher.hash(*base);
+
+    EXPECT_EQ(base_hash, hasher.hash(*same));
+    EXPECT_NE(base_hash, hasher.hash(*other_constant));
+    EXPECT_NE(base_hash, hasher.hash(*other_callee));
+    EXPECT_NE(base_hash, hasher.hash(*other_line));
+
+    // Caches compare the keys the hashes are computed from
+    EXPECT_EQ(hasher.get_key(*base), hasher.get_key(*same));
+    EXPECT_NE(hasher.get_key(*base), hasher.get_key(*other_constant));
+    EXPECT_EQ(base_hash, bonk::FNVHasher::hash(hasher.get_key(*base)));
+
+    hasher.hash_locations = false;
+    EXPECT_EQ(hasher.hash(*base), hasher.hash(*other_line));
+}
@@ -1,5 +1,6 @@
 
 #include <array>
+#include <fstream>
 #include <gtest/gtest.h>
 #include "utils.hpp"
 
@@ -90,6 +91,36 @@ TEST(TestQBEFullCycle, TestLoop) {
     EXPECT_EQ(get_executable_return_code("test"), 10);
 }
 
+TEST(TestQBEFullCycle, TestNestedLoop) {
+    const char* bonk_source = R"(
+        hive Size {
+            bowl width: nubr;
+            bowl height: nubr;
+        }
+
+        blok area[bowl size: Size] {
+            bowl sum = 0;
+            loop[bowl y = 0] {
+                y < height of size or { brek; };
+                loop[bowl x = 0] {
+                    x < width of size or { brek; };
+                    sum = sum + 1;
+                    x = x + 1;
+                }
+                y = y + 1;
+            }
+            bonk sum;
+        }
+
+        blok main {
+            bonk @area[size = @Size[width = 6, height = 7]];
+        }
+    )";
+
+    ASSERT_TRUE(run_bonk(bonk_source, "test"));
+    EXPECT_EQ(get_executable_return_code("test"), 42);
+}
+
 TEST(TestQBEFullCycle, TestHiveComplex) {
     const char* bonk_source = R"(
         hive TestHive2 {
@@ -378,6 +409,300 @@ TEST(TestQBEFullCycle, TestReferenceCounter8) {
     EXPECT_EQ(get_executable_return_code("test"), 43);
 }
 
+TEST(TestQBEFullCycle, TestStackAllocatedHives) {
+
+    // 'segment' and 'point' never escape, so they are placed on the stack.
+    // Releasing 'segment' must still release the references it holds.
+
+    const char* bonk_source = R"(
+        blok print_ref_count[bowl item: Point]: nothing;
+
+        hive Point {
+            bowl x = 0;
+            bowl y = 0;
+        }
+
+        hive Segment {
+            bowl start: Point = null;
+            bowl end: Point = null;
+        }
+
+        blok main {
+            bowl origin = @Point[x = 1, y = 2];
+            bowl total = 0;
+            loop[bowl i = 0] {
+                i == 3 and { brek; };
+                bowl segment = @Segment[start = origin, end = origin];
+                bowl point = @Point[x = x of start of segment, y = i];
+                @print_ref_count[item = origin];
+                total = total + x of point + y of point;
+                i = i + 1;
+            }
+            @print_ref_count[item = origin];
+            bonk total;
+        }
+    )";
+
+    const char* c_source = R"(
+        #include <stdio.h>
+
+        void print_ref_count(unsigned long long* ptr) { printf("%llu ", ptr[-1]); }
+    )";
+
+    ASSERT_TRUE(run_bonk_with_counterpart(bonk_source, c_source, "test"));
+    EXPECT_EQ(get_executable_output("test"), "3 3 3 1 ");
+    EXPECT_EQ(get_executable_return_code("test"), 6);
+}
+
+TEST(TestQBEFullCycle, TestTailCalls) {
+
+    // The recursion is too deep for the stack, so 'count' must become a loop
+
+    const char* bonk_source = R"(
+        blok print_num[bowl num: nubr]: nothing;
+
+        hive Counter {
+            bowl steps = 0;
+        }
+
+        blok count[bowl n: nubr, bowl total: nubr, bowl counter: Counter] {
+            n == 0 and { bonk total; };
+            steps of counter = steps of counter + 1;
+            bonk @count[n = n - 1, total = total + 2, counter = counter];
+        }
+
+        blok main {
+            bowl counter = @Counter;
+            @print_num[num = @count[n = 10000000, total = 0, counter = counter]];
+            @print_num[num = steps of counter];
+        }
+    )";
+
+    const char* c_source = R"(
+        #include <stdio.h>
+
+        void print_num(int num) { printf("%d ", num); }
+    )";
+
+    ASSERT_TRUE(run_bonk_with_counterpart(bonk_source, c_source, "test"));
+    EXPECT_EQ(get_executable_output("test"), "20000000 10000000 ");
+}
+
+TEST(TestQBEFullCycle, TestIterativeTeardown) {
+
+    // Destroying the chain recursively would need a stack frame for each item
+
+    const char* bonk_source = R"(
+        blok print_num[bowl num: nubr]: nothing;
+
+        hive Item {
+            bowl value: nubr;
+            bowl next: Item = null;
+        }
+
+        blok build_chain[bowl length: nubr] {
+            bowl head: Item = null;
+            loop[bowl i = 0] {
+                i < length or { brek; };
+                head = @Item[value = i, next = head];
+                i = i + 1;
+            }
+            bonk value of head;
+        }
+
+        blok main {
+            @print_num[num = @build_chain[length = 1000000]];
+            @print_num[num = @build_chain[length = 1000000]];
+        }
+    )";
+
+    const char* c_source = R"(
+        #include <stdio.h>
+
+        void print_num(int num) { printf("%d ", num); }
+    )";
+
+    RunParameters parameters;
+    parameters.iterative_teardown = true;
+
+    ASSERT_TRUE(run_bonk_with_counterpart(bonk_source, c_source, "test", parameters));
+    EXPECT_EQ(get_executable_output("test"), "999999 999999 ");
+    EXPECT_EQ(get_executable_return_code("test"), 0);
+}
+
+TEST(TestQBEFullCycle, TestHeapProfile) {
+
+    // With a sampling interval of one byte, every allocation is sampled
+
+    const char* bonk_source = R"(
+        blok print_num[bowl num: nubr]: nothing;
+
+        hive Point {
+            bowl x: nubr;
+            bowl y: nubr;
+        }
+
+        blok make_point[bowl x: nubr] {
+            bonk @Point[x = x, y = x * 2];
+        }
+
+        blok main {
+            bowl sum = 0;
+            loop[bowl i = 0] {
+                i < 10 or { brek; };
+                bowl point = @make_point[x = i];
+                sum = sum + y of point;
+                i = i + 1;
+            }
+            @print_num[num = sum];
+        }
+    )";
+
+    const char* c_source = R"(
+        #include <stdio.h>
+
+        void print_num(int num) { printf("%d ", num); }
+    )";
+
+    RunParameters parameters;
+    parameters.heap_profiling = true;
+
+    std::filesystem::path profile_path = "heap.profile";
+    ensure_path(profile_path);
+    std::filesystem::remove(profile_path);
+
+    setenv("BONK_HEAP_PROFILE", profile_path.c_str(), 1);
+    setenv("BONK_HEAP_PROFILE_INTERVAL", "1", 1);
+
+    ASSERT_TRUE(run_bonk_with_counterpart(bonk_source, c_source, "test", parameters));
+    EXPECT_EQ(get_executable_output("test"), "90 ");
+
+    unsetenv("BONK_HEAP_PROFILE");
+    unsetenv("BONK_HEAP_PROFILE_INTERVAL");
+
+    std::ifstream profile(profile_path, std::ios::binary);
+    ASSERT_TRUE(profile.is_open());
+
+    char magic[8] = {};
+    uint32_t version = 0, site_count = 0;
+    uint64_t sample_count = 0, interval = 0, allocation_count = 0;
+
+    profile.read(magic, sizeof(magic));
+    profile.read((char*)&version, sizeof(version));
+    profile.read((char*)&site_count, sizeof(site_count));
+    profile.read((char*)&sample_count, sizeof(sample_count));
+    profile.read((char*)&interval, sizeof(interval));
+    profile.read((char*)&allocation_count, sizeof(allocation_count));
+
+    EXPECT_EQ(std::string(magic, sizeof(magic)), "BONKHEAP");
+    EXPECT_EQ(version, 1);
+    EXPECT_EQ(site_count, 1);
+    EXPECT_EQ(sample_count, 10);
+    EXPECT_EQ(interval, 1);
+    EXPECT_EQ(allocation_count, 10);
+
+    // The allocation is attributed to the constructor call in make_point,
+    // even if make_point gets inlined into main
+
+    uint64_t allocated_bytes = 0;
+    uint32_t line = 0, column = 0, name_length = 0;
+    profile.read((char*)&allocated_bytes, sizeof(allocated_bytes));
+    profile.read((char*)&line, sizeof(line));
+    profile.read((char*)&column, sizeof(column));
+    profile.read((char*)&name_length, sizeof(name_length));
+
+    std::string hive_name(name_length, '\0');
+    profile.read(hive_name.data(), name_length);
+
+    ASSERT_TRUE(profile.good());
+    EXPECT_EQ(hive_name, "Point");
+    EXPECT_EQ(line, 10);
+}
+
+TEST(TestQBEFullCycle, TestRefCountInstrumentation) {
+
+    // Every box is released once: nine of them when they are replaced, and
+    // the last one together with the holder
+
+    const char* bonk_source = R"(
+        blok print_num[bowl num: nubr]: nothing;
+
+        hive Box {
+            bowl value: nubr;
+        }
+
+        hive Holder {
+            bowl box: Box = null;
+        }
+
+        blok main {
+            bowl holder = @Holder;
+            bowl sum = 0;
+            loop[bowl i = 0] {
+                i < 10 or { brek; };
+                box of holder = @Box[value = i];
+                sum = sum + value of box of holder;
+                i = i + 1;
+            }
+            @print_num[num = sum];
+        }
+    )";
+
+    const char* c_source = R"(
+        #include <stdio.h>
+
+        void print_num(int num) { printf("%d ", num); }
+    )";
+
+    RunParameters parameters;
+    parameters.instrument_refcounts = true;
+
+    std::filesystem::path profile_path = "refcounts.txt";
+    ensure_path(profile_path);
+    std::filesystem::remove(profile_path);
+
+    setenv("BONK_REFCOUNT_PROFILE", profile_path.c_str(), 1);
+
+    ASSERT_TRUE(run_bonk_with_counterpart(bonk_source, c_source, "test", parameters));
+    EXPECT_EQ(get_executable_output("test"), "45 ");
+
+    unsetenv("BONK_REFCOUNT_PROFILE");
+
+    std::ifstream profile(profile_path);
+    ASSERT_TRUE(profile.is_open());
+
+    std::string line;
+    std::getline(profile, line);
+    EXPECT_EQ(line.rfind("bonk: ", 0), 0);
+    std::getline(profile, line);
+
+    int decrement_sites = 0;
+    int located_sites = 0;
+    uint64_t total_releases = 0;
+
+    while (std::getline(profile, line)) {
+        std::istringstream row(line);
+        std::string updates, releases, kind, site;
+        row >> updates >> releases >> kind >> site;
+
+        EXPECT_GT(std::stoull(updates), 0);
+        if (kind == "dec") {
+            decrement_sites++;
+            total_releases += std::stoull(releases);
+        } else {
+            EXPECT_EQ(kind, "inc");
+            EXPECT_EQ(releases, "-");
+        }
+        if (site.find("test:") != std::string::npos) {
+            located_sites++;
+        }
+    }
+
+    EXPECT_GT(decrement_sites, 0);
+    EXPECT_GT(located_sites, 0);
+    EXPECT_EQ(total_releases, 10);
+}
+
 TEST(TestQBEFullCycle, TestHive1) {
 
     // This test used to cause a segfault in the hive_ctor_dtor_late_generator
@@ -589,4 +914,111 @@ TEST(TestQBEFullCycle, TestLogic) {
 
     ASSERT_TRUE(run_bonk(bonk_source, "test"));
     EXPECT_EQ(get_executable_return_code("test"), 23);
-}
\ No newline at end of file
+}
+TEST(TestQBEFullCycle, TestLogicValues) {
+
+    // The lazy operations and the assignment have no side effects, so they
+    // are compiled into selects
+
+    const char* bonk_source = R"(
+        blok print_num[bowl num: nubr]: nothing;
+        blok identity[bowl num: nubr]: nubr;
+
+        blok pick[bowl left: nubr, bowl right: nubr] {
+            bowl add_left = left != 0 and (right == 0 or left <= right);
+            bowl result = 0;
+            add_left and { result = result + left; } or { result = result + right; };
+            bonk result;
+        }
+
+        blok main {
+            @print_num[num = @pick[left = @identity[num = 3], right = @identity[num = 5]]];
+            @print_num[num = @pick[left = @identity[num = 5], right = @identity[num = 3]]];
+            @print_num[num = @pick[left = @identity[num = 0], right = @identity[num = 4]]];
+            @print_num[num = @pick[left = @identity[num = 4], right = @identity[num = 0]]];
+            @print_num[num = @pick[left = @identity[num = 0], right = @identity[num = 0]]];
+        }
+    )";
+
+    const char* c_source = R"(
+        #include <stdio.h>
+
+        void print_num(int num) { printf("%d ", num); }
+        int identity(int num) { return num; }
+    )";
+
+    ASSERT_TRUE(run_bonk_with_counterpart(bonk_source, c_source, "test"));
+    EXPECT_EQ(get_executable_output("test"), "3 3 4 4 0 ");
+}
+
+TEST(TestQBEFullCycle, TestDivisionByConstants) {
+
+    // Divisions by constants are replaced with shifts and high multiplications,
+    // which have to round towards zero like the division does
+
+    const char* bonk_source = R"(
+        blok print_num[bowl num: nubr]: nothing;
+
+        blok main {
+            bowl sum = 0;
+            loop[bowl x = 0 - 1000] {
+                x < 1000 or { brek; };
+                bowl value = x * 2147461;
+                sum = sum * 31 + value / 7;
+                sum = sum * 31 + value / (0 - 3);
+                sum = sum * 31 + value / 4;
+                sum = sum * 31 + value / (0 - 8);
+                sum = sum * 31 + value / 10;
+                sum = sum * 31 + value / 641;
+                x = x + 1;
+            }
+            @print_num[num = sum];
+        }
+    )";
+
+    const char* c_source = R"(
+        #include <stdio.h>
+
+        void print_num(int num) { printf("%d ", num); }
+    )";
+
+    ASSERT_TRUE(run_bonk_with_counterpart(bonk_source, c_source, "test"));
+    EXPECT_EQ(get_executable_output("test"), "-2023519163 ");
+}
+
+TEST(TestQBEFullCycle, TestValueRanges) {
+
+    // 'i >= 0' always holds for a counter that starts at zero and only grows,
+    // and 'j < 0' never holds for one that counts down to zero. The remaining
+    // tests depend on the counters and have to stay.
+
+    const char* bonk_source = R"(
+        blok print_num[bowl num: nubr]: nothing;
+
+        blok main {
+            bowl sum = 0;
+            loop[bowl i = 0] {
+                i < 100 or { brek; };
+                i >= 0 and { sum = sum + i; };
+                i < 50 and { sum = sum + 1000; } or { sum = sum - 1; };
+                i = i + 1;
+            }
+            loop[bowl j = 10] {
+                j > 0 or { brek; };
+                j < 0 and { sum = 0; };
+                sum = sum * 3 + j;
+                j = j - 1;
+            }
+            @print_num[num = sum];
+        }
+    )";
+
+    const char* c_source = R"(
+        #include <stdio.h>
+
+        void print_num(int num) { printf("%d ", num); }
+    )";
+
+    ASSERT_TRUE(run_bonk_with_counterpart(bonk_source, c_source, "test"));
+    EXPECT_EQ(get_executable_output("test"), "-1052896713 ");
+}
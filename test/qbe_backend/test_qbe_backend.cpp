@@ -1,4 +1,6 @@
 
+#include <map>
+#include <set>
 #include <sstream>
 #include <gtest/gtest.h>
 #include "bonk/backend/qbe/qbe_backend.hpp"
@@ -58,7 +60,195 @@ TEST(QBEBackend, CodegenTest) {
     // add_one function call
     ASSERT_NE(result.find(" =s call $\"_add_one\"(s "), std::string::npos);
 
-    // make sure there are s_1 and s_5 constants
+    // make sure there is s_1 constant, and 1.0 + 5.0 is folded into s_6
     ASSERT_NE(result.find("s_1"), std::string::npos);
-    ASSERT_NE(result.find("s_5"), std::string::npos);
-}
\ No newline at end of file
+    ASSERT_NE(result.find("s_6"), std::string::npos);
+}
+
+static bool compile_to_qbe(const char* source, std::string& result,
+                           bool instrument_refcounts = false) {
+    std::stringstream result_stream;
+
+    auto error_stream = bonk::StdOutputStream(std::cout);
+    auto output_stream = bonk::StdOutputStream(result_stream);
+
+    bonk::CompilerConfig config{.error_file = error_stream};
+    bonk::Compiler compiler(config);
+
+    auto lexemes = bonk::Lexer(compiler).parse_file("test", source);
+    if (lexemes.empty()) {
+        return false;
+    }
+
+    auto ast = bonk::AST();
+    ast.root = bonk::Parser(compiler).parse_file(&lexemes);
+    if (ast.root == nullptr) {
+        return false;
+    }
+
+    bonk::FrontEnd front_end(compiler);
+    if (!front_end.transform_ast(ast)) {
+        return false;
+    }
+
+    auto ir_program = front_end.generate_hir(ast.root.get());
+    if (ir_program == nullptr || !bonk::MiddleEnd(compiler).do_passes(*ir_program)) {
+        return false;
+    }
+
+    bonk::qbe_backend::QBEBackend backend{compiler};
+    backend.instrument_refcounts = instrument_refcounts;
+    backend.compile_program(*ir_program, output_stream);
+    result = result_stream.str();
+    return true;
+}
+
+// Reference counter operations are lowered into sub-blocks labeled @L<block>_<n>.
+// Every label a phi function names has to be a predecessor of its block, and
+// has to be the last sub-block of the HIR block it stands for. Returns the
+// phi functions that break this.
+static std::vector<std::string> find_misplaced_phi_labels(const std::string& qbe,
+                                                          int& sub_label_count) {
+    std::vector<std::string> errors;
+    std::map<std::string, std::set<std::string>> predecessors;
+    std::map<std::string, std::string> last_labels;
+    std::vector<std::pair<std::string, std::string>> phis;
+    std::string current_label;
+    bool is_terminated = true;
+
+    auto get_block_label = [](const std::string& label) {
+        return label.substr(0, label.find('_'));
+    };
+
+    auto check_function = [&]() {
+        for (auto& [label, phi] : phis) {
+            std::stringstream sources(phi.substr(phi.find(" phi ") + 5));
+            std::string source_label, source_register;
+            while (sources >> source_label >> source_register) {
+                if (source_label.find('_') != std::string::npos) {
+                    sub_label_count++;
+                }
+                if (!predecessors[label].count(source_label) ||
+                    last_labels[get_block_label(source_label)] != source_label) {
+                    errors.push_back(label + ": " + phi);
+                }
+            }
+        }
+        predecessors.clear();
+        last_labels.clear();
+        phis.clear();
+    };
+
+    std::stringstream stream(qbe);
+    std::string line;
+    while (std::getline(stream, line)) {
+        line.erase(0, line.find_first_not_of(' '));
+
+        if (line == "}") {
+            check_function();
+            is_terminated = true;
+        } else if (line.rfind('@', 0) == 0) {
+            if (!is_terminated) {
+                predecessors[line].insert(current_label);
+            }
+            current_label = line;
+            last_labels[get_block_label(line)] = line;
+            is_terminated = false;
+        } else if (line.rfind("jmp ", 0) == 0) {
+            predecessors[line.substr(4)].insert(current_label);
+            is_terminated = true;
+        } else if (line.rfind("jnz ", 0) == 0) {
+            auto nz_label_start = line.find('@');
+            auto z_label_start = line.find('@', nz_label_start + 1);
+            predecessors[line.substr(nz_label_start, line.find(',', nz_label_start) -
+                                                         nz_label_start)]
+                .insert(current_label);
+            predecessors[line.substr(z_label_start)].insert(current_label);
+            is_terminated = true;
+        } else if (line.rfind("ret", 0) == 0 || line.rfind("hlt", 0) == 0) {
+            is_terminated = true;
+        } else if (line.find(" phi ") != std::string::npos) {
+            phis.emplace_back(current_label, line);
+        }
+    }
+
+    return errors;
+}
+
+TEST(QBEBackend, LoweredRefCountPhiLabelsTest) {
+
+    // Both predecessors of each join end in a reference counter operation:
+    // a new hive that is never null and a parameter that may be, for both
+    // increments and decrements. The phi functions of the joins have to name
+    // the last sub-block the operations are lowered into.
+
+    const char* source = R"(
+        hive Box {
+            bowl value: nubr;
+            bowl next: Box = null;
+        }
+
+        blok keep[bowl a: Box]: nubr {
+            bonk value of a;
+        }
+
+        blok pick[bowl a: Box, bowl f: nubr]: Box {
+            bowl n = @Box[value = 2];
+            bowl r = a;
+            f > 0 and { r = n; };
+            bonk r;
+        }
+
+        blok drop[bowl a: Box, bowl f: nubr]: nubr {
+            bowl r = 0;
+            f > 0 and { bowl t = @Box[value = 3]; r = @keep[a = t]; };
+            f > 1 and { bowl s = next of a; next of a = null; r = r + @keep[a = s]; };
+            bonk r;
+        }
+
+        blok main {
+            @pick[a = @Box[value = 1], f = 1];
+            @drop[a = @Box[value = 1], f = 1];
+        }
+    )";
+
+    std::string result;
+    ASSERT_TRUE(compile_to_qbe(source, result));
+
+    int sub_label_count = 0;
+    auto errors = find_misplaced_phi_labels(result, sub_label_count);
+    EXPECT_EQ(errors, std::vector<std::string>());
+    EXPECT_GE(sub_label_count, 3);
+}
+
+TEST(QBEBackend, InstrumentedRefCountPhiLabelsTest) {
+
+    // With --instrument-refcounts every operation registers its site in two
+    // more sub-blocks. The increment of the new hive is the last operation of
+    // its block and is never null, so the registration ends the block.
+
+    const char* source = R"(
+        hive Box {
+            bowl value: nubr;
+        }
+
+        blok pick[bowl a: Box, bowl f: nubr]: Box {
+            bowl n = @Box[value = 2];
+            bowl r = a;
+            f > 0 and { r = n; };
+            bonk r;
+        }
+
+        blok main {
+            @pick[a = @Box[value = 1], f = 1];
+        }
+    )";
+
+    std::string result;
+    ASSERT_TRUE(compile_to_qbe(source, result, true));
+
+    int sub_label_count = 0;
+    auto errors = find_misplaced_phi_labels(result, sub_label_count);
+    EXPECT_EQ(errors, std::vector<std::string>());
+    EXPECT_GE(sub_label_count, 2);
+}
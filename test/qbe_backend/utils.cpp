@@ -2,15 +2,26 @@
 #include "utils.hpp"
 #include "bonk/middleend/ir/algorithms/hir_base_block_separator.hpp"
 #include "bonk/middleend/ir/algorithms/hir_block_sorter.hpp"
+#include "bonk/middleend/ir/algorithms/hir_constant_propagation.hpp"
 #include "bonk/middleend/ir/algorithms/hir_copy_propagation.hpp"
+#include "bonk/middleend/ir/algorithms/hir_if_converter.hpp"
+#include "bonk/middleend/ir/algorithms/hir_inliner.hpp"
+#include "bonk/middleend/ir/algorithms/hir_instruction_combiner.hpp"
 #include "bonk/middleend/ir/algorithms/hir_jmp_reducer.hpp"
 #include "bonk/middleend/ir/algorithms/hir_jnz_optimizer.hpp"
+#include "bonk/middleend/ir/algorithms/hir_jump_threader.hpp"
 #include "bonk/middleend/ir/algorithms/hir_loc_collapser.hpp"
-#include "bonk/middleend/ir/algorithms/hir_ref_count_replacer.hpp"
+#include "bonk/middleend/ir/algorithms/hir_loop_invariant_code_motion.hpp"
+#include "bonk/middleend/ir/algorithms/hir_null_check_eliminator.hpp"
+#include "bonk/middleend/ir/algorithms/hir_ref_count_elider.hpp"
 #include "bonk/middleend/ir/algorithms/hir_ref_counter_reducer.hpp"
 #include "bonk/middleend/ir/algorithms/hir_ssa_converter.hpp"
+#include "bonk/middleend/ir/algorithms/hir_stack_promoter.hpp"
+#include "bonk/middleend/ir/algorithms/hir_tail_call_eliminator.hpp"
 #include "bonk/middleend/ir/algorithms/hir_unreachable_code_deleter.hpp"
 #include "bonk/middleend/ir/algorithms/hir_unused_def_deleter.hpp"
+#include "bonk/middleend/ir/algorithms/hir_value_numbering.hpp"
+#include "bonk/middleend/ir/algorithms/hir_value_range_propagation.hpp"
 #include "bonk/middleend/ir/algorithms/hir_variable_index_compressor.hpp"
 #include "bonk/middleend/ir/hir_printer.hpp"
 #include "bonk/middleend/middleend.hpp"
@@ -100,21 +111,29 @@ bool compile_bonk_source(const char* source, std::filesystem::path output_file,
 
     // <optimizations>
     bonk::HIRSSAConverter().convert(*ir_program);
+    bonk::HIRInliner().inline_calls(*ir_program);
     bonk::HIRCopyPropagation().propagate_copies(*ir_program);
+    bonk::HIRConstantPropagation().propagate_constants(*ir_program);
+    bonk::HIRInstructionCombiner().combine(*ir_program);
+    bonk::HIRValueNumbering().eliminate_redundancy(*ir_program);
+    bonk::HIRLoopInvariantCodeMotion().hoist_invariants(*ir_program);
     bonk::HIRUnusedDefDeleter().delete_unused_defs(*ir_program);
 
     if(parameters.optimize_reference_counter) {
         bonk::HIRRefCountReducer().reduce(*ir_program);
+        bonk::HIRRefCountElider().elide(*ir_program);
+        bonk::HIRStackPromoter().promote(*ir_program);
     }
-    // </optimizations>
-
-    bonk::HIRRefCountReplacer().replace_ref_counters(*ir_program);
+    bonk::HIRTailCallEliminator().eliminate_tail_calls(*ir_program);
+    bonk::HIRNullCheckEliminator().eliminate_null_checks(*ir_program);
+    bonk::HIRJumpThreader().thread_jumps(*ir_program);
+    bonk::HIRValueRangePropagation().propagate_ranges(*ir_program);
 
-    // <optimizations>
     bonk::HIRJnzOptimizer().optimize(*ir_program);
 
     bonk::HIRUnreachableCodeDeleter().delete_unreachable_code(*ir_program);
     bonk::HIRJmpReducer().reduce(*ir_program);
+    bonk::HIRIfConverter().convert(*ir_program);
 
     bonk::HIRUnusedDefDeleter().delete_unused_defs(*ir_program);
     bonk::HIRVariableIndexCompressor().compress(*ir_program);
@@ -122,7 +141,11 @@ bool compile_bonk_source(const char* source, std::filesystem::path output_file,
     bonk::HIRBlockSorter().sort(*ir_program);
     // </optimizations>
 
-    bonk::qbe_backend::QBEBackend(compiler).compile_program(*ir_program, output_stream);
+    bonk::qbe_backend::QBEBackend backend(compiler);
+    backend.iterative_teardown = parameters.iterative_teardown;
+    backend.heap_profiling = parameters.heap_profiling;
+    backend.instrument_refcounts = parameters.instrument_refcounts;
+    backend.compile_program(*ir_program, output_stream);
 
     return true;
 }
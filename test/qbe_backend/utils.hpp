@@ -9,6 +9,9 @@
 
 struct RunParameters {
     bool optimize_reference_counter = true;
+    bool iterative_teardown = false;
+    bool heap_profiling = false;
+    bool instrument_refcounts = false;
 };
 
 void ensure_path(std::filesystem::path& path);
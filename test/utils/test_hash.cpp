@@ -0,0 +1,22 @@
+#include <gtest/gtest.h>
+#include "utils/hash.hpp"
+
+static std::string sha256(std::string_view data) {
+    return bonk::SHA256Hasher::to_hex(bonk::SHA256Hasher().update(data).digest());
+}
+
+TEST(Hash, SHA256Test) {
+    // Test vectors from FIPS 180-2
+    EXPECT_EQ(sha256(""), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    EXPECT_EQ(sha256("abc"), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    EXPECT_EQ(sha256("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"),
+              "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    EXPECT_EQ(sha256(std::string(1000000, 'a')),
+              "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+
+    // Feeding the data in pieces gives the same digest
+    bonk::SHA256Hasher hasher;
+    hasher.update("abcdbcdecdefdefgefghfghighij").update("hijkijkljklmklmnlmnomnopnopq");
+    EXPECT_EQ(bonk::SHA256Hasher::to_hex(hasher.digest()),
+              "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+}